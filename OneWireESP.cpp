@@ -140,8 +140,13 @@ sample code bearing this copyright.
 */
 
 #include "OneWireESP.h"
+#include "OneWireESP_pm.h"
+
+#if ONEWIRE_GPIO
 #include "utils/OneWireESP_direct_gpio.h"
 #include "driver/gpio.h"                 //used for GPIO control on ESP
+#include "esp_attr.h"
+#include <string.h>
 
 
 
@@ -153,6 +158,7 @@ void OneWire::begin(gpio_num_t pin)
 #if ONEWIRE_SEARCH
 	reset_search1();
   reset_search2();
+	clear_search_stats();
 #endif
 }
 
@@ -163,7 +169,7 @@ void OneWire::begin(gpio_num_t pin)
 //
 // Returns 1 if a device asserted a presence pulse, 0 otherwise.
 //
-uint8_t OneWire::reset1(void)
+uint8_t IRAM_ATTR OneWire::reset1(void)
 {
 	//IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
 	//volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
@@ -192,7 +198,7 @@ uint8_t OneWire::reset1(void)
 	ets_delay_us(410);
 	return r;
 }
-uint8_t OneWire::reset2(void)
+uint8_t IRAM_ATTR OneWire::reset2(void)
 {
 	//IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
 	//volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
@@ -226,7 +232,7 @@ uint8_t OneWire::reset2(void)
 // Write a bit. Port and bit is used to cut lookup time and provide
 // more certain timing.
 //
-void OneWire::write_bit1(uint8_t v)
+void IRAM_ATTR OneWire::write_bit1(uint8_t v)
 {
 	//IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
 	//volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
@@ -249,7 +255,7 @@ void OneWire::write_bit1(uint8_t v)
     ets_delay_us(5);
 	}
 }
-void OneWire::write_bit2(uint8_t v)
+void IRAM_ATTR OneWire::write_bit2(uint8_t v)
 {
 	//IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
 	//volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
@@ -277,7 +283,7 @@ void OneWire::write_bit2(uint8_t v)
 // Read a bit. Port and bit is used to cut lookup time and provide
 // more certain timing.
 //
-uint8_t OneWire::read_bit1(void)
+uint8_t IRAM_ATTR OneWire::read_bit1(void)
 {
 	//IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
 	//volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
@@ -294,7 +300,7 @@ uint8_t OneWire::read_bit1(void)
   ets_delay_us(53);
 	return r;
 }
-uint8_t OneWire::read_bit2(void)
+uint8_t IRAM_ATTR OneWire::read_bit2(void)
 {
 	//IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
 	//volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
@@ -319,7 +325,7 @@ uint8_t OneWire::read_bit2(void)
 // go tri-state at the end of the write to avoid heating in a short or
 // other mishap.
 //
-void OneWire::write1(uint8_t v, uint8_t power /* = 0 */)
+void IRAM_ATTR OneWire::write1(uint8_t v, uint8_t power /* = 0 */)
 {
     uint8_t bitMask;
 
@@ -333,7 +339,7 @@ void OneWire::write1(uint8_t v, uint8_t power /* = 0 */)
 	interrupts();
     }
 }
-void OneWire::write2(uint8_t v, uint8_t power /* = 0 */)
+void IRAM_ATTR OneWire::write2(uint8_t v, uint8_t power /* = 0 */)
 {
     uint8_t bitMask;
 
@@ -348,7 +354,7 @@ void OneWire::write2(uint8_t v, uint8_t power /* = 0 */)
     }
 }
 
-void OneWire::write_bytes1(const uint8_t *buf, uint16_t count, bool power /* = 0 */) {
+void IRAM_ATTR OneWire::write_bytes1(const uint8_t *buf, uint16_t count, bool power /* = 0 */) {
   for (uint16_t i = 0 ; i < count ; i++)
     write1(buf[i]);
   if (!power) {
@@ -358,13 +364,13 @@ void OneWire::write_bytes1(const uint8_t *buf, uint16_t count, bool power /* = 0
     interrupts();
   }
 }
-void OneWire::write_bytes2(const uint8_t *buf, uint16_t count, bool power /* = 0 */) {
+void IRAM_ATTR OneWire::write_bytes2(const uint8_t *buf, uint16_t count, bool power /* = 0 */) {
   for (uint16_t i = 0 ; i < count ; i++)
     write2(buf[i]);
   if (!power) {
     noInterrupts();
-    DIRECT_MODE_INPUT1;
-    DIRECT_WRITE_LOW1;
+    DIRECT_MODE_INPUT2;
+    DIRECT_WRITE_LOW2;
     interrupts();
   }
 }
@@ -372,7 +378,7 @@ void OneWire::write_bytes2(const uint8_t *buf, uint16_t count, bool power /* = 0
 //
 // Read a byte
 //
-uint8_t OneWire::read1() {
+uint8_t IRAM_ATTR OneWire::read1() {
     uint8_t bitMask;
     uint8_t r = 0;
 
@@ -381,7 +387,7 @@ uint8_t OneWire::read1() {
     }
     return r;
 }
-uint8_t OneWire::read2() {
+uint8_t IRAM_ATTR OneWire::read2() {
     uint8_t bitMask;
     uint8_t r = 0;
 
@@ -391,11 +397,11 @@ uint8_t OneWire::read2() {
     return r;
 }
 
-void OneWire::read_bytes1(uint8_t *buf, uint16_t count) {
+void IRAM_ATTR OneWire::read_bytes1(uint8_t *buf, uint16_t count) {
   for (uint16_t i = 0 ; i < count ; i++)
     buf[i] = read1();
 }
-void OneWire::read_bytes2(uint8_t *buf, uint16_t count) {
+void IRAM_ATTR OneWire::read_bytes2(uint8_t *buf, uint16_t count) {
   for (uint16_t i = 0 ; i < count ; i++)
     buf[i] = read2();
 }
@@ -404,7 +410,7 @@ void OneWire::read_bytes2(uint8_t *buf, uint16_t count) {
 //
 // Do a ROM select
 //
-void OneWire::select1(const uint8_t rom[8])
+void IRAM_ATTR OneWire::select1(const uint8_t rom[8])
 {
     uint8_t i;
 
@@ -412,7 +418,7 @@ void OneWire::select1(const uint8_t rom[8])
 
     for (i = 0; i < 8; i++) write1(rom[i]);
 }
-void OneWire::select2(const uint8_t rom[8])
+void IRAM_ATTR OneWire::select2(const uint8_t rom[8])
 {
     uint8_t i;
 
@@ -424,28 +430,82 @@ void OneWire::select2(const uint8_t rom[8])
 //
 // Do a ROM skip
 //
-void OneWire::skip1()
+void IRAM_ATTR OneWire::skip1()
 {
     write1(0xCC);           // Skip ROM
 }
-void OneWire::skip2()
+void IRAM_ATTR OneWire::skip2()
 {
     write2(0xCC);           // Skip ROM
 }
 
-void OneWire::depower1()
+void IRAM_ATTR OneWire::depower1()
 {
 	noInterrupts();
 	DIRECT_MODE_INPUT1;
 	interrupts();
 }
-void OneWire::depower2()
+void IRAM_ATTR OneWire::depower2()
 {
 	noInterrupts();
 	DIRECT_MODE_INPUT2;
 	interrupts();
 }
 
+uint8_t IRAM_ATTR OneWire::triplet1(uint8_t direction)
+{
+	uint8_t id_bit = read_bit1();
+	uint8_t cmp_id_bit = read_bit1();
+	if (id_bit & cmp_id_bit) return 3;
+	// devices disagree: take 'direction', else the only way there is
+	if (id_bit != cmp_id_bit) direction = id_bit;
+	write_bit1(direction);
+	return id_bit | cmp_id_bit << 1 | direction << 2;
+}
+uint8_t IRAM_ATTR OneWire::triplet2(uint8_t direction)
+{
+	uint8_t id_bit = read_bit2();
+	uint8_t cmp_id_bit = read_bit2();
+	if (id_bit & cmp_id_bit) return 3;
+	if (id_bit != cmp_id_bit) direction = id_bit;
+	write_bit2(direction);
+	return id_bit | cmp_id_bit << 1 | direction << 2;
+}
+
+//
+// OneWireBus tables.  The static functions just forward to the numbered
+// member functions of the object passed as the context.  The triplet ones
+// run between the slots of a search, so they stay in IRAM with it.
+//
+static uint8_t bus1_reset(void *ctx) { return ((OneWire *)ctx)->reset1(); }
+static void bus1_write_bytes(void *ctx, const uint8_t *buf, uint16_t count, bool power) { ((OneWire *)ctx)->write_bytes1(buf, count, power); }
+static void bus1_read_bytes(void *ctx, uint8_t *buf, uint16_t count) { ((OneWire *)ctx)->read_bytes1(buf, count); }
+static void bus1_write_bit(void *ctx, uint8_t v) { ((OneWire *)ctx)->write_bit1(v); }
+static uint8_t bus1_read_bit(void *ctx) { return ((OneWire *)ctx)->read_bit1(); }
+static void bus1_depower(void *ctx) { ((OneWire *)ctx)->depower1(); }
+static uint8_t IRAM_ATTR bus1_triplet(void *ctx, uint8_t direction) { return ((OneWire *)ctx)->triplet1(direction); }
+
+static uint8_t bus2_reset(void *ctx) { return ((OneWire *)ctx)->reset2(); }
+static void bus2_write_bytes(void *ctx, const uint8_t *buf, uint16_t count, bool power) { ((OneWire *)ctx)->write_bytes2(buf, count, power); }
+static void bus2_read_bytes(void *ctx, uint8_t *buf, uint16_t count) { ((OneWire *)ctx)->read_bytes2(buf, count); }
+static void bus2_write_bit(void *ctx, uint8_t v) { ((OneWire *)ctx)->write_bit2(v); }
+static uint8_t bus2_read_bit(void *ctx) { return ((OneWire *)ctx)->read_bit2(); }
+static void bus2_depower(void *ctx) { ((OneWire *)ctx)->depower2(); }
+static uint8_t IRAM_ATTR bus2_triplet(void *ctx, uint8_t direction) { return ((OneWire *)ctx)->triplet2(direction); }
+
+OneWireBus OneWire::bus1(void)
+{
+    OneWireBus bus = { this, bus1_reset, bus1_write_bytes, bus1_read_bytes,
+                       bus1_write_bit, bus1_read_bit, bus1_depower, bus1_triplet, 0 };
+    return bus;
+}
+OneWireBus OneWire::bus2(void)
+{
+    OneWireBus bus = { this, bus2_reset, bus2_write_bytes, bus2_read_bytes,
+                       bus2_write_bit, bus2_read_bit, bus2_depower, bus2_triplet, 0 };
+    return bus;
+}
+
 #if ONEWIRE_SEARCH
 
 //
@@ -454,25 +514,11 @@ void OneWire::depower2()
 //
 void OneWire::reset_search1()
 {
-  // reset the search state
-  LastDiscrepancy = 0;
-  LastDeviceFlag = false;
-  LastFamilyDiscrepancy = 0;
-  for(int i = 7; ; i--) {
-    ROM_NO[i] = 0;
-    if ( i == 0) break;
-  }
+  onewire_search_reset(searchState);
 }
 void OneWire::reset_search2()
 {
-  // reset the search state
-  LastDiscrepancy = 0;
-  LastDeviceFlag = false;
-  LastFamilyDiscrepancy = 0;
-  for(int i = 7; ; i--) {
-    ROM_NO[i] = 0;
-    if ( i == 0) break;
-  }
+  onewire_search_reset(searchState);
 }
 
 // Setup the search to find the device type 'family_code' on the next call
@@ -480,274 +526,153 @@ void OneWire::reset_search2()
 //
 void OneWire::target_search1(uint8_t family_code)
 {
-   // set the search state to find SearchFamily type devices
-   ROM_NO[0] = family_code;
-   for (uint8_t i = 1; i < 8; i++)
-      ROM_NO[i] = 0;
-   LastDiscrepancy = 64;
-   LastFamilyDiscrepancy = 0;
-   LastDeviceFlag = false;
+   onewire_search_target(searchState, family_code);
 }
 void OneWire::target_search2(uint8_t family_code)
 {
-   // set the search state to find SearchFamily type devices
-   ROM_NO[0] = family_code;
-   for (uint8_t i = 1; i < 8; i++)
-      ROM_NO[i] = 0;
-   LastDiscrepancy = 64;
-   LastFamilyDiscrepancy = 0;
-   LastDeviceFlag = false;
+   onewire_search_target(searchState, family_code);
 }
 
+// Go on from the last place in the family code where 0 was picked, so
+// the next search takes the 1 there and leaves this family.
 //
-// Perform a search. If this function returns a '1' then it has
-// enumerated the next device and you may retrieve the ROM from the
-// OneWire::address variable. If there are no devices, no further
-// devices, or something horrible happens in the middle of the
-// enumeration then a 0 is returned.  If a new device is found then
-// its address is copied to newAddr.  Use OneWire::reset_search() to
-// start over.
-//
-// --- Replaced by the one from the Dallas Semiconductor web site ---
-//--------------------------------------------------------------------------
-// Perform the 1-Wire Search Algorithm on the 1-Wire bus using the existing
-// search state.
-// Return TRUE  : device found, ROM number in ROM_NO buffer
-//        FALSE : device not found, end of search
-//
-bool OneWire::search1(uint8_t *newAddr, bool search_mode /* = true */)
+void OneWire::skip_family1()
 {
-   uint8_t id_bit_number;
-   uint8_t last_zero, rom_byte_number;
-   bool    search_result;
-   uint8_t id_bit, cmp_id_bit;
-
-   unsigned char rom_byte_mask, search_direction;
-
-   // initialize for search
-   id_bit_number = 1;
-   last_zero = 0;
-   rom_byte_number = 0;
-   rom_byte_mask = 1;
-   search_result = false;
-
-   // if the last call was not the last one
-   if (!LastDeviceFlag) {
-      // 1-Wire reset
-      if (!reset1()) {
-         // reset the search
-         LastDiscrepancy = 0;
-         LastDeviceFlag = false;
-         LastFamilyDiscrepancy = 0;
-         return false;
-      }
-
-      // issue the search command
-      if (search_mode == true) {
-        write1(0xF0);   // NORMAL SEARCH
-      } else {
-        write1(0xEC);   // CONDITIONAL SEARCH
-      }
-
-      // loop to do the search
-      do
-      {
-         // read a bit and its complement
-         id_bit = read_bit1();
-         cmp_id_bit = read_bit1();
-
-         // check for no devices on 1-wire
-         if ((id_bit == 1) && (cmp_id_bit == 1)) {
-            break;
-         } else {
-            // all devices coupled have 0 or 1
-            if (id_bit != cmp_id_bit) {
-               search_direction = id_bit;  // bit write value for search
-            } else {
-               // if this discrepancy if before the Last Discrepancy
-               // on a previous next then pick the same as last time
-               if (id_bit_number < LastDiscrepancy) {
-                  search_direction = ((ROM_NO[rom_byte_number] & rom_byte_mask) > 0);
-               } else {
-                  // if equal to last pick 1, if not then pick 0
-                  search_direction = (id_bit_number == LastDiscrepancy);
-               }
-               // if 0 was picked then record its position in LastZero
-               if (search_direction == 0) {
-                  last_zero = id_bit_number;
-
-                  // check for Last discrepancy in family
-                  if (last_zero < 9)
-                     LastFamilyDiscrepancy = last_zero;
-               }
-            }
-
-            // set or clear the bit in the ROM byte rom_byte_number
-            // with mask rom_byte_mask
-            if (search_direction == 1)
-              ROM_NO[rom_byte_number] |= rom_byte_mask;
-            else
-              ROM_NO[rom_byte_number] &= ~rom_byte_mask;
-
-            // serial number search direction write bit
-            write_bit1(search_direction);
-
-            // increment the byte counter id_bit_number
-            // and shift the mask rom_byte_mask
-            id_bit_number++;
-            rom_byte_mask <<= 1;
-
-            // if the mask is 0 then go to new SerialNum byte rom_byte_number and reset mask
-            if (rom_byte_mask == 0) {
-                rom_byte_number++;
-                rom_byte_mask = 1;
-            }
-         }
-      }
-      while(rom_byte_number < 8);  // loop until through all ROM bytes 0-7
-
-      // if the search was successful then
-      if (!(id_bit_number < 65)) {
-         // search successful so set LastDiscrepancy,LastDeviceFlag,search_result
-         LastDiscrepancy = last_zero;
+   onewire_search_skip_family(searchState);
+}
+void OneWire::skip_family2()
+{
+   onewire_search_skip_family(searchState);
+}
 
-         // check for last device
-         if (LastDiscrepancy == 0) {
-            LastDeviceFlag = true;
-         }
-         search_result = true;
-      }
+bool OneWire::search_family1(uint8_t *newAddr, uint8_t family_code)
+{
+   const OneWireSearchState &st = searchState;
+
+   // a new enumeration, unless the last search stopped inside this family
+   if (st.rom[0] != family_code || (st.last_discrepancy == 0 && !st.last_device)) {
+      target_search1(family_code);
+   } else if (st.last_discrepancy < 9) {
+      // the next branch is in the family code, so any device still to
+      // come is of another family
+      reset_search1();
+      return false;
    }
 
-   // if no device found then reset counters so next 'search' will be like a first
-   if (!search_result || !ROM_NO[0]) {
-      LastDiscrepancy = 0;
-      LastDeviceFlag = false;
-      LastFamilyDiscrepancy = 0;
-      search_result = false;
-   } else {
-      for (int i = 0; i < 8; i++) newAddr[i] = ROM_NO[i];
+   if (!search1(newAddr) || newAddr[0] != family_code) {
+      reset_search1();
+      return false;
    }
-   return search_result;
-  }
-bool OneWire::search2(uint8_t *newAddr, bool search_mode /* = true */)
+   return true;
+}
+bool OneWire::search_family2(uint8_t *newAddr, uint8_t family_code)
 {
-   uint8_t id_bit_number;
-   uint8_t last_zero, rom_byte_number;
-   bool    search_result;
-   uint8_t id_bit, cmp_id_bit;
-
-   unsigned char rom_byte_mask, search_direction;
-
-   // initialize for search
-   id_bit_number = 1;
-   last_zero = 0;
-   rom_byte_number = 0;
-   rom_byte_mask = 1;
-   search_result = false;
-
-   // if the last call was not the last one
-   if (!LastDeviceFlag) {
-      // 1-Wire reset
-      if (!reset2()) {
-         // reset the search
-         LastDiscrepancy = 0;
-         LastDeviceFlag = false;
-         LastFamilyDiscrepancy = 0;
-         return false;
-      }
+   const OneWireSearchState &st = searchState;
+
+   // a new enumeration, unless the last search stopped inside this family
+   if (st.rom[0] != family_code || (st.last_discrepancy == 0 && !st.last_device)) {
+      target_search2(family_code);
+   } else if (st.last_discrepancy < 9) {
+      // the next branch is in the family code, so any device still to
+      // come is of another family
+      reset_search2();
+      return false;
+   }
 
-      // issue the search command
-      if (search_mode == true) {
-        write2(0xF0);   // NORMAL SEARCH
-      } else {
-        write2(0xEC);   // CONDITIONAL SEARCH
-      }
+   if (!search2(newAddr) || newAddr[0] != family_code) {
+      reset_search2();
+      return false;
+   }
+   return true;
+}
 
-      // loop to do the search
-      do
-      {
-         // read a bit and its complement
-         id_bit = read_bit2();
-         cmp_id_bit = read_bit2();
-
-         // check for no devices on 1-wire
-         if ((id_bit == 1) && (cmp_id_bit == 1)) {
-            break;
-         } else {
-            // all devices coupled have 0 or 1
-            if (id_bit != cmp_id_bit) {
-               search_direction = id_bit;  // bit write value for search
-            } else {
-               // if this discrepancy if before the Last Discrepancy
-               // on a previous next then pick the same as last time
-               if (id_bit_number < LastDiscrepancy) {
-                  search_direction = ((ROM_NO[rom_byte_number] & rom_byte_mask) > 0);
-               } else {
-                  // if equal to last pick 1, if not then pick 0
-                  search_direction = (id_bit_number == LastDiscrepancy);
-               }
-               // if 0 was picked then record its position in LastZero
-               if (search_direction == 0) {
-                  last_zero = id_bit_number;
-
-                  // check for Last discrepancy in family
-                  if (last_zero < 9)
-                     LastFamilyDiscrepancy = last_zero;
-               }
-            }
-
-            // set or clear the bit in the ROM byte rom_byte_number
-            // with mask rom_byte_mask
-            if (search_direction == 1)
-              ROM_NO[rom_byte_number] |= rom_byte_mask;
-            else
-              ROM_NO[rom_byte_number] &= ~rom_byte_mask;
-
-            // serial number search direction write bit
-            write_bit2(search_direction);
-
-            // increment the byte counter id_bit_number
-            // and shift the mask rom_byte_mask
-            id_bit_number++;
-            rom_byte_mask <<= 1;
-
-            // if the mask is 0 then go to new SerialNum byte rom_byte_number and reset mask
-            if (rom_byte_mask == 0) {
-                rom_byte_number++;
-                rom_byte_mask = 1;
-            }
+uint8_t OneWire::count_families1(uint8_t *families, uint8_t *counts, uint8_t max)
+{
+   uint8_t addr[8];
+   uint8_t n = 0;
+   uint8_t family = 0;
+
+   reset_search1();
+   while (search1(addr)) {
+      // devices of one family come one after another
+      if (n == 0 || addr[0] != family) {
+         family = addr[0];
+         if (n < max) {
+            families[n] = family;
+            counts[n] = 0;
          }
+         n++;
       }
-      while(rom_byte_number < 8);  // loop until through all ROM bytes 0-7
-
-      // if the search was successful then
-      if (!(id_bit_number < 65)) {
-         // search successful so set LastDiscrepancy,LastDeviceFlag,search_result
-         LastDiscrepancy = last_zero;
-
-         // check for last device
-         if (LastDiscrepancy == 0) {
-            LastDeviceFlag = true;
+      if (n <= max) counts[n - 1]++;
+   }
+   return n;
+}
+uint8_t OneWire::count_families2(uint8_t *families, uint8_t *counts, uint8_t max)
+{
+   uint8_t addr[8];
+   uint8_t n = 0;
+   uint8_t family = 0;
+
+   reset_search2();
+   while (search2(addr)) {
+      // devices of one family come one after another
+      if (n == 0 || addr[0] != family) {
+         family = addr[0];
+         if (n < max) {
+            families[n] = family;
+            counts[n] = 0;
          }
-         search_result = true;
+         n++;
       }
+      if (n <= max) counts[n - 1]++;
    }
+   return n;
+}
 
-   // if no device found then reset counters so next 'search' will be like a first
-   if (!search_result || !ROM_NO[0]) {
-      LastDiscrepancy = 0;
-      LastDeviceFlag = false;
-      LastFamilyDiscrepancy = 0;
-      search_result = false;
-   } else {
-      for (int i = 0; i < 8; i++) newAddr[i] = ROM_NO[i];
-   }
-   return search_result;
-  }
+void OneWire::clear_search_stats()
+{
+   memset(&searchStats, 0, sizeof(searchStats));
+}
+
+//
+// Perform a search. If this function returns a '1' then it has
+// enumerated the next device and you may retrieve the ROM from the
+// OneWire::address variable. If there are no devices, no further
+// devices, or something horrible happens in the middle of the
+// enumeration then a 0 is returned.  If a new device is found then
+// its address is copied to newAddr.  Use OneWire::reset_search() to
+// start over.
+//
+// The algorithm (the one from the Dallas Semiconductor web site, on
+// 64 bit words) is onewire_search() in OneWireESP_program.cpp.  The
+// power management lock is held for it, as onewire_run() does.
+//
+// Unlike the slot code these are not IRAM_ATTR, and neither is
+// onewire_search(): the three slots of each bit run back to back in
+// triplet1()/triplet2(), which are.  A cache miss anywhere above them
+// (the power management calls, the bus table, the search itself) falls
+// between two triplets and only lengthens the recovery time before the
+// next slot, which 1-Wire does not limit.
+//
+bool OneWire::search1(uint8_t *newAddr, bool search_mode /* = true */)
+{
+   onewire_pm_bus_begin();
+   bool found = onewire_search(bus1(), searchState, newAddr, search_mode, &searchStats);
+   onewire_pm_bus_end();
+   return found;
+}
+bool OneWire::search2(uint8_t *newAddr, bool search_mode /* = true */)
+{
+   onewire_pm_bus_begin();
+   bool found = onewire_search(bus2(), searchState, newAddr, search_mode, &searchStats);
+   onewire_pm_bus_end();
+   return found;
+}
 
 #endif
 
+#endif // ONEWIRE_GPIO
+
 #if ONEWIRE_CRC
 // The 1-Wire CRC scheme is described in Maxim Application Note 27:
 // "Understanding and Using Cyclic Redundancy Checks with Maxim iButton Products"
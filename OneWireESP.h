@@ -24,6 +24,12 @@
 #define ONEWIRE_SEARCH 1
 #endif
 
+// How many times search1()/search2() retake a pass that came back with a
+// bad CRC or broke off partway, before giving up on the enumeration
+#ifndef ONEWIRE_SEARCH_RETRIES
+#define ONEWIRE_SEARCH_RETRIES 3
+#endif
+
 // You can exclude CRC checks altogether by defining this to 0
 #ifndef ONEWIRE_CRC
 #define ONEWIRE_CRC 1
@@ -44,6 +50,21 @@
 #define ONEWIRE_CRC16 1
 #endif
 
+// The bit-banged GPIO buses need ESP-IDF.  Without it (the Linux w1
+// backend, host builds of the drivers) only the CRC functions and the
+// shared types are compiled.
+#ifndef ONEWIRE_GPIO
+#if defined(ESP_PLATFORM)
+#define ONEWIRE_GPIO 1
+#else
+#define ONEWIRE_GPIO 0
+#endif
+#endif
+
+#include "OneWireESP_bus.h"
+#include "OneWireESP_program.h"
+
+#if ONEWIRE_GPIO
 // Board-specific macros for direct GPIO
 #include "utils/OneWireESP_direct_regtype.h"
 #include "driver/gpio.h"
@@ -58,23 +79,25 @@
 //== Define your OneWire GPIO pin here ==//
 #define OW1_PIN GPIO_NUM_11
 #define OW2_PIN GPIO_NUM_9
+#endif
 
 
 class OneWire
 {
+#if ONEWIRE_GPIO
   private:
     IO_REG_TYPE bitmask;
     volatile IO_REG_TYPE *baseReg;
 
 #if ONEWIRE_SEARCH
-    // global search state
-    unsigned char ROM_NO[8];
-    uint8_t LastDiscrepancy;
-    uint8_t LastFamilyDiscrepancy;
-    bool LastDeviceFlag;
+    // global search state, shared by both buses
+    OneWireSearchState searchState;
+    OneWireSearchStats searchStats;
+#endif
 #endif
 
   public:
+#if ONEWIRE_GPIO
     OneWire() { }
     OneWire(gpio_num_t pin) { begin(pin); }
     void begin(gpio_num_t pin);
@@ -129,6 +152,16 @@ class OneWire
     void depower1(void);
     void depower2(void);
 
+    // One ROM search step: two read slots, then the write slot of
+    // 'direction' if both reads are 0 (see OneWireBus::triplet)
+    uint8_t triplet1(uint8_t direction);
+    uint8_t triplet2(uint8_t direction);
+
+    // Call tables for bus 1 and bus 2 of this object, for use with
+    // onewire_run() and the device drivers.
+    OneWireBus bus1(void);
+    OneWireBus bus2(void);
+
 #if ONEWIRE_SEARCH
     // Clear the search state so that if will start from the beginning again.
     void reset_search1();
@@ -139,15 +172,46 @@ class OneWire
     void target_search1(uint8_t family_code);
     void target_search2(uint8_t family_code);
 
+    // Go on past the family of the device search() just returned: the
+    // next search() starts at the next family, without visiting the
+    // rest of this one.  For "everything except DS2408s", call it
+    // whenever search() returns a 0x29.
+    void skip_family1();
+    void skip_family2();
+
+    // Find the next device of 'family_code'.  Call it until it returns
+    // false to get all of them; the first call (or one after a plain
+    // search()) starts the enumeration with target_search().  Devices of
+    // one family come one after another in search order, so it stops
+    // without another pass once the search state shows no more of them.
+    bool search_family1(uint8_t *newAddr, uint8_t family_code);
+    bool search_family2(uint8_t *newAddr, uint8_t family_code);
+
+    // Walk the whole bus and count the devices of each family.  Fills in
+    // up to 'max' families and their counts, in search order, and
+    // returns the number of families found (which may be more than 'max').
+    uint8_t count_families1(uint8_t *families, uint8_t *counts, uint8_t max);
+    uint8_t count_families2(uint8_t *families, uint8_t *counts, uint8_t max);
+
     // Look for the next device. Returns 1 if a new address has been
     // returned. A zero might mean that the bus is shorted, there are
-    // no devices, or you have already retrieved all of them.  It
-    // might be a good idea to check the CRC to make sure you didn't
-    // get garbage.  The order is deterministic. You will always get
-    // the same devices in the same order.
+    // no devices, or you have already retrieved all of them.  The
+    // CRC is checked at the end of each pass; a pass with a bad CRC,
+    // or one that breaks off partway, is taken again from where it started
+    // up to ONEWIRE_SEARCH_RETRIES times, so only good ROM codes are
+    // returned.  The order is deterministic. You will always get the
+    // same devices in the same order.  Both are onewire_search() on
+    // bus1()/bus2(), with the power management lock held (see
+    // OneWireESP_pm.h; the other calls leave that to the caller).
     bool search1(uint8_t *newAddr, bool search_mode = true);
     bool search2(uint8_t *newAddr, bool search_mode = true);
+
+    // Search counters for this bus object.  They are only cleared by
+    // clear_search_stats(), not by reset_search().
+    const OneWireSearchStats &search_stats() const { return searchStats; }
+    void clear_search_stats();
 #endif
+#endif // ONEWIRE_GPIO
 
 #if ONEWIRE_CRC
     // Compute a Dallas Semiconductor 8 bit CRC, these are used in the
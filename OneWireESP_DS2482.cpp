@@ -0,0 +1,280 @@
+/*
+DS2482 I2C to 1-Wire bridge backend for OneWireESP.  Same license as
+OneWireESP.cpp.  Search is onewire_search(), the same as OneWire::search1(),
+with the bit/complement/direction slots done by one Triplet command.
+*/
+
+#include "OneWireESP_DS2482.h"
+#include <string.h>
+
+// Commands
+#define CMD_DEVICE_RESET    0xF0
+#define CMD_SET_POINTER     0xE1
+#define CMD_WRITE_CONFIG    0xD2
+#define CMD_CHANNEL_SELECT  0xC3
+#define CMD_1WIRE_RESET     0xB4
+#define CMD_1WIRE_BIT       0x87
+#define CMD_1WIRE_WRITE     0xA5
+#define CMD_1WIRE_READ      0x96
+#define CMD_1WIRE_TRIPLET   0x78
+
+// Read pointer codes
+#define PTR_STATUS          0xF0
+#define PTR_DATA            0xE1
+
+// Status register
+#define STATUS_1WB          0x01    // 1-Wire busy
+#define STATUS_PPD          0x02    // presence pulse detected
+#define STATUS_SD           0x04    // short detected
+#define STATUS_SBR          0x20    // single bit result
+#define STATUS_TSB          0x40    // triplet second bit
+#define STATUS_DIR          0x80    // branch direction taken
+
+// Configuration register
+#define CONFIG_APU          0x01    // active pullup
+#define CONFIG_SPU          0x04    // strong pullup
+
+#define I2C_TIMEOUT_MS      10
+#define BUSY_POLLS          200
+
+
+OneWireDS2482::OneWireDS2482(i2c_master_bus_handle_t b, uint8_t a, uint32_t scl_hz)
+{
+    i2cBus = b;
+    dev = 0;
+    address = a;
+    sclHz = scl_hz;
+    config = CONFIG_APU;
+    strong = false;
+    channel = 0;
+#if ONEWIRE_SEARCH
+    for (uint8_t i = 0; i < 8; i++) onewire_search_reset(searchState[i]);
+    clear_search_stats();
+#endif
+}
+
+//
+// Every 1-Wire command ends a strong pullup, so it is forgotten here.
+//
+bool OneWireDS2482::command(uint8_t cmd)
+{
+    strong = false;
+    return i2c_master_transmit(dev, &cmd, 1, I2C_TIMEOUT_MS) == ESP_OK;
+}
+
+bool OneWireDS2482::command(uint8_t cmd, uint8_t param)
+{
+    uint8_t buf[2] = { cmd, param };
+    strong = false;
+    return i2c_master_transmit(dev, buf, 2, I2C_TIMEOUT_MS) == ESP_OK;
+}
+
+//
+// Poll the status register until the 1-Wire transfer is finished.  The
+// read pointer is left on the status register by every 1-Wire command.
+// Returns the final status, or 0xFF (busy) if the bridge never finished.
+//
+uint8_t OneWireDS2482::wait_idle(void)
+{
+    uint8_t status = STATUS_1WB;
+
+    for (int i = 0; i < BUSY_POLLS; i++) {
+        if (i2c_master_receive(dev, &status, 1, I2C_TIMEOUT_MS) != ESP_OK)
+            return 0xFF;
+        if (!(status & STATUS_1WB)) return status;
+    }
+    return 0xFF;
+}
+
+//
+// 'cfg' is the whole register: the persistent bits in 'config' plus SPU
+// when it is wanted for the next byte.
+//
+bool OneWireDS2482::write_config(uint8_t cfg)
+{
+    // upper nibble is the complement of the lower one
+    uint8_t buf[2] = { CMD_WRITE_CONFIG, (uint8_t)(cfg | (~cfg << 4)) };
+    return i2c_master_transmit(dev, buf, 2, I2C_TIMEOUT_MS) == ESP_OK;
+}
+
+void OneWireDS2482::end_pullup(void)
+{
+    // writing SPU = 0 ends the pullup without a 1-Wire command
+    if (strong) write_config(config);
+    strong = false;
+}
+
+bool OneWireDS2482::begin(void)
+{
+    uint8_t status;
+
+    if (!dev) {
+        i2c_device_config_t cfg = {};
+        cfg.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+        cfg.device_address = address;
+        cfg.scl_speed_hz = sclHz;
+        if (i2c_master_bus_add_device(i2cBus, &cfg, &dev) != ESP_OK) {
+            dev = 0;
+            return false;
+        }
+    }
+    if (!command(CMD_DEVICE_RESET)) return false;
+    status = wait_idle();
+    if (status == 0xFF) return false;
+    channel = 0;                // the device reset selects channel 0
+    config = CONFIG_APU;
+    return write_config(config);
+}
+
+void OneWireDS2482::end(void)
+{
+    if (!dev) return;
+    i2c_master_bus_rm_device(dev);
+    dev = 0;
+}
+
+bool OneWireDS2482::select_channel(uint8_t c)
+{
+    // channel codes, and what the channel register reads back as
+    static const uint8_t code[8] = { 0xF0, 0xE1, 0xD2, 0xC3, 0xB4, 0xA5, 0x96, 0x87 };
+    static const uint8_t check[8] = { 0xB8, 0xB1, 0xAA, 0xA3, 0x9C, 0x95, 0x8E, 0x87 };
+    uint8_t r;
+
+    if (c > 7) return false;
+    if (!command(CMD_CHANNEL_SELECT, code[c])) return false;
+    if (i2c_master_receive(dev, &r, 1, I2C_TIMEOUT_MS) != ESP_OK) return false;
+    if (r != check[c]) return false;
+    channel = c;
+    return true;
+}
+
+uint8_t OneWireDS2482::reset(void)
+{
+    uint8_t status;
+
+    if (!command(CMD_1WIRE_RESET)) return 0;
+    status = wait_idle();
+    if (status == 0xFF || (status & STATUS_SD)) return 0;
+    return (status & STATUS_PPD) ? 1 : 0;
+}
+
+void OneWireDS2482::write(uint8_t v, uint8_t power /* = 0 */)
+{
+    // SPU holds the line high after the next byte, until the next command.
+    // The bridge clears the bit itself, so it is set afresh every time.
+    bool spu = power && write_config(config | CONFIG_SPU);
+    command(CMD_1WIRE_WRITE, v);
+    wait_idle();
+    strong = spu;
+}
+
+void OneWireDS2482::write_bytes(const uint8_t *buf, uint16_t count, bool power /* = 0 */)
+{
+    for (uint16_t i = 0 ; i < count ; i++)
+        write(buf[i], power && i == count - 1);
+}
+
+uint8_t OneWireDS2482::read(void)
+{
+    uint8_t ptr[2] = { CMD_SET_POINTER, PTR_DATA };
+    uint8_t r = 0xFF;
+
+    command(CMD_1WIRE_READ);
+    if (wait_idle() == 0xFF) return 0xFF;
+    i2c_master_transmit_receive(dev, ptr, 2, &r, 1, I2C_TIMEOUT_MS);
+    return r;
+}
+
+void OneWireDS2482::read_bytes(uint8_t *buf, uint16_t count)
+{
+    for (uint16_t i = 0 ; i < count ; i++)
+        buf[i] = read();
+}
+
+void OneWireDS2482::write_bit(uint8_t v)
+{
+    command(CMD_1WIRE_BIT, v ? 0x80 : 0x00);
+    wait_idle();
+}
+
+uint8_t OneWireDS2482::read_bit(void)
+{
+    // a read slot is a write 1 slot, sampled
+    command(CMD_1WIRE_BIT, 0x80);
+    uint8_t status = wait_idle();
+    return (status != 0xFF && (status & STATUS_SBR)) ? 1 : 0;
+}
+
+void OneWireDS2482::depower(void)
+{
+    end_pullup();
+}
+
+void OneWireDS2482::select(const uint8_t rom[8])
+{
+    uint8_t i;
+
+    write(0x55);           // Choose ROM
+
+    for (i = 0; i < 8; i++) write(rom[i]);
+}
+
+void OneWireDS2482::skip(void)
+{
+    write(0xCC);           // Skip ROM
+}
+
+uint8_t OneWireDS2482::triplet(uint8_t direction)
+{
+    if (!command(CMD_1WIRE_TRIPLET, direction ? 0x80 : 0x00)) return 0xFF;
+    return wait_idle();
+}
+
+#if ONEWIRE_SEARCH
+
+void OneWireDS2482::reset_search(void)
+{
+    onewire_search_reset(searchState[channel]);
+}
+
+void OneWireDS2482::target_search(uint8_t family_code)
+{
+    onewire_search_target(searchState[channel], family_code);
+}
+
+void OneWireDS2482::clear_search_stats(void)
+{
+    memset(&searchStats, 0, sizeof(searchStats));
+}
+
+bool OneWireDS2482::search(uint8_t *newAddr, bool search_mode /* = true */)
+{
+    return onewire_search(bus(), searchState[channel], newAddr, search_mode, &searchStats);
+}
+
+#endif
+
+static uint8_t ds2482_reset(void *ctx) { return ((OneWireDS2482 *)ctx)->reset(); }
+static void ds2482_write_bytes(void *ctx, const uint8_t *buf, uint16_t count, bool power) { ((OneWireDS2482 *)ctx)->write_bytes(buf, count, power); }
+static void ds2482_read_bytes(void *ctx, uint8_t *buf, uint16_t count) { ((OneWireDS2482 *)ctx)->read_bytes(buf, count); }
+static void ds2482_write_bit(void *ctx, uint8_t v) { ((OneWireDS2482 *)ctx)->write_bit(v); }
+static uint8_t ds2482_read_bit(void *ctx) { return ((OneWireDS2482 *)ctx)->read_bit(); }
+static void ds2482_depower(void *ctx) { ((OneWireDS2482 *)ctx)->depower(); }
+
+// The Triplet status bits in the OneWireBus::triplet encoding.  A bridge
+// that stopped answering reads as no device.
+static uint8_t ds2482_triplet(void *ctx, uint8_t direction)
+{
+    uint8_t status = ((OneWireDS2482 *)ctx)->triplet(direction);
+    if (status == 0xFF || (status & (STATUS_SBR | STATUS_TSB)) == (STATUS_SBR | STATUS_TSB))
+        return 3;
+    return ((status & STATUS_SBR) ? 1 : 0) | ((status & STATUS_TSB) ? 2 : 0) |
+           ((status & STATUS_DIR) ? 4 : 0);
+}
+
+OneWireBus OneWireDS2482::bus(void)
+{
+    OneWireBus b = { this, ds2482_reset, ds2482_write_bytes, ds2482_read_bytes,
+                     ds2482_write_bit, ds2482_read_bit, ds2482_depower, ds2482_triplet, 0 };
+    return b;
+}
@@ -0,0 +1,94 @@
+#ifndef OneWireESP_DS2482_h
+#define OneWireESP_DS2482_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "driver/i2c_master.h"
+#include "OneWireESP.h"
+
+// 1-Wire bus behind a DS2482-100 or DS2482-800 I2C bridge.
+//
+// The bridge generates the 1-Wire time slots itself, so the ESP only
+// spends time on the I2C transfers (which sleep on the I2C driver's
+// interrupt) and no GPIO timing is involved at all.  The calls match the
+// OneWire ones.  search() uses the bridge's 1-Wire Triplet command, one
+// I2C command per ROM bit instead of three separate slot requests.
+//
+// The bridge is a device on an I2C master bus created with
+// i2c_new_master_bus(); begin() adds it to the bus and end() removes it.
+
+class OneWireDS2482
+{
+  private:
+    i2c_master_bus_handle_t i2cBus;
+    i2c_master_dev_handle_t dev;
+    uint8_t address;
+    uint32_t sclHz;
+    // Configuration bits that stay set (APU).  SPU is not kept here: the
+    // bridge clears it by itself once the strong pullup starts.
+    uint8_t config;
+    bool strong;            // strong pullup on, until the next 1-Wire command
+    uint8_t channel;        // selected DS2482-800 channel, 0 on a -100
+
+#if ONEWIRE_SEARCH
+    // search state per channel, so searches of several channels can be
+    // interleaved; the stats are over all of them
+    OneWireSearchState searchState[8];
+    OneWireSearchStats searchStats;
+#endif
+
+    bool command(uint8_t cmd);
+    bool command(uint8_t cmd, uint8_t param);
+    uint8_t wait_idle(void);
+    bool write_config(uint8_t cfg);
+    void end_pullup(void);
+
+  public:
+    // 'address' is 0x18 plus the AD pin setting
+    OneWireDS2482(i2c_master_bus_handle_t bus, uint8_t address = 0x18,
+                  uint32_t scl_hz = 400000);
+    ~OneWireDS2482() { end(); }
+
+    // Add the bridge to the I2C bus, reset it and set the default
+    // configuration (active pullup on).  Returns false if the bridge
+    // does not answer.
+    bool begin(void);
+    void end(void);
+
+    // DS2482-800 only: route the 1-Wire calls to channel 0-7.  search(),
+    // reset_search() and target_search() then work on that channel's
+    // search, which picks up where it was left on it.
+    bool select_channel(uint8_t channel);
+
+    uint8_t reset(void);
+    void select(const uint8_t rom[8]);
+    void skip(void);
+    void write(uint8_t v, uint8_t power = 0);
+    void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0);
+    uint8_t read(void);
+    void read_bytes(uint8_t *buf, uint16_t count);
+    void write_bit(uint8_t v);
+    uint8_t read_bit(void);
+    void depower(void);
+
+    // One 1-Wire Triplet: read a bit and its complement and write the
+    // search direction, 'direction' if both were 0.  Returns the status
+    // register, whose top three bits are SBR, TSB and DIR.
+    uint8_t triplet(uint8_t direction);
+
+#if ONEWIRE_SEARCH
+    void reset_search(void);
+    void target_search(uint8_t family_code);
+    // onewire_search() on bus(), whose triplet call is the bridge's
+    bool search(uint8_t *newAddr, bool search_mode = true);
+    const OneWireSearchStats &search_stats() const { return searchStats; }
+    void clear_search_stats(void);
+#endif
+
+    // Call table for onewire_run() and the device drivers
+    OneWireBus bus(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_DS2482_h
@@ -0,0 +1,142 @@
+/*
+Priority bus arbitration for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_arbiter.h"
+#include "OneWireESP_program.h"
+#include "esp_timer.h"
+#include <string.h>
+
+OneWireArbiter::OneWireArbiter()
+{
+    portMUX_TYPE m = portMUX_INITIALIZER_UNLOCKED;
+    mux = m;
+    owner = 0;
+    ownerPrio = 0;
+    memset(waiters, 0, sizeof(waiters));
+    for (uint8_t i = 0; i < ONEWIRE_ARB_WAITERS; i++)
+        waiters[i].wake = xSemaphoreCreateBinaryStatic(&waiters[i].wakeBuf);
+    clear_stats();
+}
+
+void OneWireArbiter::clear_stats(void)
+{
+    memset(stats, 0, sizeof(stats));
+    yields = 0;
+}
+
+const OneWireArbStats &OneWireArbiter::get_stats(uint8_t prio) const
+{
+    if (prio >= ONEWIRE_ARB_PRIORITIES) prio = ONEWIRE_ARB_PRIORITIES - 1;
+    return stats[prio];
+}
+
+void OneWireArbiter::account(uint8_t prio, int64_t start, bool waited)
+{
+    OneWireArbStats &s = stats[prio];
+    uint32_t wait = (uint32_t)(esp_timer_get_time() - start);
+
+    s.grants++;
+    if (!waited) return;
+    s.contended++;
+    s.wait_us += wait;
+    if (wait > s.max_wait_us) s.max_wait_us = wait;
+}
+
+void OneWireArbiter::acquire(uint8_t prio)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    int64_t start = esp_timer_get_time();
+    uint8_t slot = 0;
+
+    if (prio >= ONEWIRE_ARB_PRIORITIES) prio = ONEWIRE_ARB_PRIORITIES - 1;
+
+    for (;;) {
+        portENTER_CRITICAL(&mux);
+        if (!owner) {
+            owner = self;
+            ownerPrio = prio;
+            portEXIT_CRITICAL(&mux);
+            account(prio, start, false);
+            return;
+        }
+        for (slot = 0; slot < ONEWIRE_ARB_WAITERS && waiters[slot].used; slot++) { }
+        if (slot < ONEWIRE_ARB_WAITERS) break;
+        // waiter table full, poll
+        portEXIT_CRITICAL(&mux);
+        vTaskDelay(1);
+    }
+    Waiter &w = waiters[slot];
+    w.task = self;
+    w.prio = prio;
+    w.since = start;
+    w.used = true;
+    w.granted = false;
+    portEXIT_CRITICAL(&mux);
+
+    // release() makes us the owner before it wakes us.  The slot stays
+    // taken until then so no other task can wait on the same semaphore.
+    xSemaphoreTake(w.wake, portMAX_DELAY);
+    portENTER_CRITICAL(&mux);
+    w.used = false;
+    portEXIT_CRITICAL(&mux);
+    account(prio, start, true);
+}
+
+bool OneWireArbiter::release(void)
+{
+    Waiter *next = 0;
+
+    portENTER_CRITICAL(&mux);
+    if (owner != xTaskGetCurrentTaskHandle()) {
+        portEXIT_CRITICAL(&mux);
+        return false;
+    }
+    for (uint8_t i = 0; i < ONEWIRE_ARB_WAITERS; i++) {
+        Waiter &w = waiters[i];
+        if (!w.used || w.granted) continue;
+        if (!next || w.prio > next->prio || (w.prio == next->prio && w.since < next->since))
+            next = &w;
+    }
+    owner = next ? next->task : 0;
+    if (next) {
+        ownerPrio = next->prio;
+        next->granted = true;
+    }
+    portEXIT_CRITICAL(&mux);
+
+    if (next) xSemaphoreGive(next->wake);
+    return true;
+}
+
+bool OneWireArbiter::yield(void)
+{
+    bool urgent = false;
+    uint8_t prio;
+
+    portENTER_CRITICAL(&mux);
+    if (owner != xTaskGetCurrentTaskHandle()) {
+        portEXIT_CRITICAL(&mux);
+        return false;
+    }
+    prio = ownerPrio;
+    for (uint8_t i = 0; i < ONEWIRE_ARB_WAITERS; i++) {
+        if (waiters[i].used && !waiters[i].granted && waiters[i].prio > prio) urgent = true;
+    }
+    portEXIT_CRITICAL(&mux);
+
+    if (!urgent) return false;
+    yields++;
+    release();
+    acquire(prio);
+    return true;
+}
+
+uint8_t OneWireArbiter::run(uint8_t prio, const OneWireBus &bus, const uint8_t *prog,
+                            const uint8_t *rom, const uint8_t *tx, uint8_t *rx)
+{
+    acquire(prio);
+    uint8_t r = onewire_run(bus, prog, rom, tx, rx);
+    release();
+    return r;
+}
@@ -0,0 +1,100 @@
+#ifndef OneWireESP_arbiter_h
+#define OneWireESP_arbiter_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWireESP_bus.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// Priority ordered ownership of one bus shared by several tasks.
+//
+// Take the bus with acquire() for the length of one transaction and give
+// it back with release(), or let run() do both around a transaction
+// program.  When the bus is released it goes to the most urgent waiting
+// task, oldest first among equals, rather than to whoever asks next.
+//
+// A long enumeration should not hold the bus for its whole length.  Call
+// yield() between devices: if a more urgent task is waiting it gets the
+// bus for its transaction, and the enumeration carries on afterwards from
+// where it was, since the search state lives in the OneWire object:
+//
+//    arb.acquire(0);
+//    ow.reset_search1();
+//    while (ow.search1(addr)) {
+//        ...
+//        arb.yield();
+//    }
+//    arb.release();
+//
+// Tasks that get the bus during a yield() must not search on the same
+// OneWire object.  Each waiting slot has its own binary semaphore, so
+// the arbiter leaves the tasks' notifications alone.
+
+// Priority levels, 0 is the least urgent
+#ifndef ONEWIRE_ARB_PRIORITIES
+#define ONEWIRE_ARB_PRIORITIES 4
+#endif
+
+// Most tasks that can wait on one bus at the same time
+#ifndef ONEWIRE_ARB_WAITERS
+#define ONEWIRE_ARB_WAITERS 8
+#endif
+
+// Wait statistics for one priority level
+struct OneWireArbStats {
+    uint32_t grants;        // times the bus was acquired
+    uint32_t contended;     // of those, how many had to wait
+    uint32_t wait_us;       // total time spent waiting
+    uint32_t max_wait_us;   // longest single wait
+};
+
+class OneWireArbiter
+{
+  private:
+    struct Waiter {
+        TaskHandle_t task;
+        uint8_t prio;
+        bool used;              // slot taken by a waiting task
+        bool granted;           // made owner, 'wake' given, not yet woken
+        int64_t since;
+        SemaphoreHandle_t wake;
+        StaticSemaphore_t wakeBuf;
+    };
+
+    portMUX_TYPE mux;
+    TaskHandle_t owner;
+    uint8_t ownerPrio;
+    Waiter waiters[ONEWIRE_ARB_WAITERS];
+    uint32_t yields;
+    OneWireArbStats stats[ONEWIRE_ARB_PRIORITIES];
+
+    void account(uint8_t prio, int64_t start, bool waited);
+
+  public:
+    OneWireArbiter();
+
+    // Wait until this task owns the bus.  'prio' is clamped to the
+    // highest level.
+    void acquire(uint8_t prio);
+    // Give the bus up.  Returns false, and does nothing, if the calling
+    // task does not own it.
+    bool release(void);
+
+    // Hand the bus to a more urgent waiting task, if there is one, and
+    // wait to get it back.  Returns true if the bus was given up.
+    bool yield(void);
+
+    // acquire(), onewire_run(), release()
+    uint8_t run(uint8_t prio, const OneWireBus &bus, const uint8_t *prog,
+                const uint8_t *rom = 0, const uint8_t *tx = 0, uint8_t *rx = 0);
+
+    const OneWireArbStats &get_stats(uint8_t prio) const;
+    uint32_t get_yields(void) const { return yields; }
+    void clear_stats(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_arbiter_h
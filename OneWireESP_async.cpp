@@ -0,0 +1,296 @@
+/*
+Interrupt driven slot engine for OneWireESP.  Same license as OneWireESP.cpp.
+
+Timing follows the blocking OneWire::reset1()/write_bit1()/read_bit1()
+code exactly, the only difference is who waits: every delay longer than
+a few microseconds becomes a GPTimer alarm instead of ets_delay_us().
+*/
+
+#include "OneWireESP_async.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "hal/gpio_ll.h"
+#include "soc/gpio_struct.h"
+#include <rom/ets_sys.h>
+#include <string.h>
+
+// ISR phases
+#define PH_OP           0   // start the next operation
+#define PH_RST_WAIT     1   // waiting for the line to float high
+#define PH_RST_RELEASE  2   // end of the 480uS reset low time
+#define PH_RST_SAMPLE   3   // presence sample point
+#define PH_OP_END       4   // end of the reset recovery time
+#define PH_BIT          5   // start of a write or read slot
+#define PH_W0_RELEASE   6   // end of the low time of a write 0 slot
+
+// Line control from inside the interrupt.  These are the register level
+// versions of gpio_set_level()/gpio_set_direction(), which live in flash.
+#define LINE_LOW(p)     do { gpio_ll_set_level(&GPIO, (p), 0); gpio_ll_output_enable(&GPIO, (p)); } while (0)
+#define LINE_HIGH(p)    gpio_ll_set_level(&GPIO, (p), 1)
+#define LINE_FLOAT(p)   gpio_ll_output_disable(&GPIO, (p))
+#define LINE_READ(p)    gpio_ll_get_level(&GPIO, (p))
+
+
+bool OneWireAsync::begin(gpio_num_t p)
+{
+	pin = p;
+	gpio_set_direction(pin, GPIO_MODE_INPUT);
+	opCount = 0;
+	clear_stats();
+
+	if (!done) done = xSemaphoreCreateBinaryStatic(&doneBuf);
+	if (!done) return false;
+	if (timer) return true;
+
+	// 1MHz so that alarm counts are microseconds
+	gptimer_config_t config = {};
+	config.clk_src = GPTIMER_CLK_SRC_DEFAULT;
+	config.direction = GPTIMER_COUNT_UP;
+	config.resolution_hz = 1000000;
+	if (gptimer_new_timer(&config, &timer) != ESP_OK) {
+		timer = 0;
+		return false;
+	}
+
+	gptimer_event_callbacks_t cbs = {};
+	cbs.on_alarm = on_alarm;
+	if (gptimer_register_event_callbacks(timer, &cbs, this) != ESP_OK ||
+	    gptimer_enable(timer) != ESP_OK) {
+		gptimer_del_timer(timer);
+		timer = 0;
+		return false;
+	}
+	return true;
+}
+
+void OneWireAsync::clear_stats()
+{
+	stats.transactions = 0;
+	stats.isr_us = 0;
+	stats.bus_us = 0;
+}
+
+//
+// Kick off the queued operations and sleep until the interrupt has
+// worked through them.
+//
+void OneWireAsync::run(void)
+{
+	int64_t start = esp_timer_get_time();
+
+	for (uint8_t i = 0; i < opCount; i++) {
+		if (ops[i].type == OW_ASYNC_READ)
+			memset(ops[i].rx, 0, (ops[i].bits + 7) / 8);
+	}
+	opIndex = 0;
+	phase = PH_OP;
+	presence = 1;
+
+	gptimer_alarm_config_t alarm = {};
+	alarm.alarm_count = 1;
+	gptimer_set_raw_count(timer, 0);
+	gptimer_set_alarm_action(timer, &alarm);
+	gptimer_start(timer);
+	xSemaphoreTake(done, portMAX_DELAY);
+
+	stats.transactions++;
+	stats.bus_us += (uint32_t)(esp_timer_get_time() - start);
+}
+
+//
+// Advance the state machine.  Called from the alarm interrupt, returns
+// the number of microseconds from the current alarm to the next one, or
+// 0 when the transaction is finished.  Delays are measured from the
+// alarm, so the short pulses done inline count towards the slot length.
+//
+uint32_t IRAM_ATTR OneWireAsync::step(void)
+{
+	for (;;) {
+		OneWireAsyncOp *op = &ops[opIndex];
+
+		switch (phase) {
+		case PH_OP:
+			if (opIndex >= opCount) return 0;
+			bitIndex = 0;
+			if (op->type == OW_ASYNC_RESET) {
+				LINE_FLOAT(pin);
+				retries = 125;
+				phase = PH_RST_WAIT;
+			} else {
+				phase = PH_BIT;
+			}
+			break;
+
+		case PH_RST_WAIT:
+			// wait until the wire is high... just in case
+			if (LINE_READ(pin)) {
+				LINE_LOW(pin);
+				phase = PH_RST_RELEASE;
+				return 480;
+			}
+			if (--retries == 0) {
+				presence = 0;
+				opIndex++;
+				phase = PH_OP;
+				break;
+			}
+			return 2;
+
+		case PH_RST_RELEASE:
+			LINE_FLOAT(pin);
+			phase = PH_RST_SAMPLE;
+			return 70;
+
+		case PH_RST_SAMPLE:
+			presence = !LINE_READ(pin);
+			phase = PH_OP_END;
+			return 410;
+
+		case PH_OP_END:
+			opIndex++;
+			phase = PH_OP;
+			break;
+
+		case PH_BIT:
+			if (bitIndex >= op->bits) {
+				if (op->type == OW_ASYNC_WRITE && !op->power)
+					LINE_FLOAT(pin);
+				opIndex++;
+				phase = PH_OP;
+				break;
+			}
+			if (op->type == OW_ASYNC_WRITE) {
+				if ((op->tx[bitIndex >> 3] >> (bitIndex & 7)) & 1) {
+					LINE_LOW(pin);
+					ets_delay_us(10);
+					LINE_HIGH(pin);
+					bitIndex++;
+					return 65;
+				}
+				LINE_LOW(pin);
+				phase = PH_W0_RELEASE;
+				return 65;
+			}
+			LINE_LOW(pin);
+			ets_delay_us(3);
+			LINE_FLOAT(pin);
+			ets_delay_us(10);
+			if (LINE_READ(pin))
+				op->rx[bitIndex >> 3] |= 1 << (bitIndex & 7);
+			bitIndex++;
+			return 66;
+
+		case PH_W0_RELEASE:
+			LINE_HIGH(pin);
+			bitIndex++;
+			phase = PH_BIT;
+			return 5;
+		}
+	}
+}
+
+bool IRAM_ATTR OneWireAsync::on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg)
+{
+	OneWireAsync *ow = (OneWireAsync *)arg;
+	int64_t start = esp_timer_get_time();
+	BaseType_t woken = pdFALSE;
+	uint32_t wait = ow->step();
+
+	if (wait) {
+		// An alarm that is already in the past fires straight away, so a
+		// late interrupt stretches the slot rather than stalling the bus.
+		gptimer_alarm_config_t alarm = {};
+		alarm.alarm_count = edata->alarm_value + wait;
+		gptimer_set_alarm_action(timer, &alarm);
+	} else {
+		gptimer_stop(timer);
+		xSemaphoreGiveFromISR(ow->done, &woken);
+	}
+	ow->stats.isr_us += (uint32_t)(esp_timer_get_time() - start);
+	return woken == pdTRUE;
+}
+
+uint8_t OneWireAsync::transaction(const OneWireAsyncOp *list, uint8_t count)
+{
+	if (count > ONEWIRE_ASYNC_MAX_OPS) return OW_BAD_PROGRAM;
+	memcpy(ops, list, count * sizeof(OneWireAsyncOp));
+	opCount = count;
+	run();
+	return presence ? OW_OK : OW_NO_PRESENCE;
+}
+
+uint8_t OneWireAsync::reset(void)
+{
+	OneWireAsyncOp op = { OW_ASYNC_RESET, 0, 0, 0, 0 };
+	return transaction(&op, 1) == OW_OK;
+}
+
+void OneWireAsync::write_bytes(const uint8_t *buf, uint16_t count, bool power /* = 0 */)
+{
+	OneWireAsyncOp op = { OW_ASYNC_WRITE, power, (uint32_t)count * 8, buf, 0 };
+	transaction(&op, 1);
+}
+
+void OneWireAsync::write(uint8_t v, uint8_t power /* = 0 */)
+{
+	write_bytes(&v, 1, power);
+}
+
+void OneWireAsync::write_bit(uint8_t v)
+{
+	// the bus is left powered, as with OneWire::write_bit1()
+	OneWireAsyncOp op = { OW_ASYNC_WRITE, 1, 1, &v, 0 };
+	transaction(&op, 1);
+}
+
+void OneWireAsync::read_bytes(uint8_t *buf, uint16_t count)
+{
+	OneWireAsyncOp op = { OW_ASYNC_READ, 0, (uint32_t)count * 8, 0, buf };
+	transaction(&op, 1);
+}
+
+uint8_t OneWireAsync::read(void)
+{
+	uint8_t r;
+	read_bytes(&r, 1);
+	return r;
+}
+
+uint8_t OneWireAsync::read_bit(void)
+{
+	uint8_t r;
+	OneWireAsyncOp op = { OW_ASYNC_READ, 0, 1, 0, &r };
+	transaction(&op, 1);
+	return r;
+}
+
+void OneWireAsync::select(const uint8_t rom[8])
+{
+	txbuf[0] = 0x55;           // Choose ROM
+	memcpy(&txbuf[1], rom, 8);
+	write_bytes(txbuf, 9);
+}
+
+void OneWireAsync::skip(void)
+{
+	write(0xCC);           // Skip ROM
+}
+
+void OneWireAsync::depower(void)
+{
+	gpio_set_direction(pin, GPIO_MODE_INPUT);
+}
+
+static uint8_t async_reset(void *ctx) { return ((OneWireAsync *)ctx)->reset(); }
+static void async_write_bytes(void *ctx, const uint8_t *buf, uint16_t count, bool power) { ((OneWireAsync *)ctx)->write_bytes(buf, count, power); }
+static void async_read_bytes(void *ctx, uint8_t *buf, uint16_t count) { ((OneWireAsync *)ctx)->read_bytes(buf, count); }
+static void async_write_bit(void *ctx, uint8_t v) { ((OneWireAsync *)ctx)->write_bit(v); }
+static uint8_t async_read_bit(void *ctx) { return ((OneWireAsync *)ctx)->read_bit(); }
+static void async_depower(void *ctx) { ((OneWireAsync *)ctx)->depower(); }
+
+OneWireBus OneWireAsync::bus(void)
+{
+	OneWireBus b = { this, async_reset, async_write_bytes, async_read_bytes,
+	                 async_write_bit, async_read_bit, async_depower, 0, 0 };
+	return b;
+}
@@ -0,0 +1,113 @@
+#ifndef OneWireESP_async_h
+#define OneWireESP_async_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+
+#include "driver/gpio.h"
+#include "driver/gptimer.h"
+#include "OneWireESP_bus.h"
+#include "OneWireESP_program.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Interrupt driven 1-Wire master for a single GPIO.
+//
+// The blocking OneWire calls busy-wait for the whole of every time slot,
+// including the 55uS/53uS recovery gaps at the end of a write 1 or read
+// slot and the 480uS halves of a reset.  OneWireAsync instead steps
+// through each slot from a GPTimer alarm interrupt.  Only the short
+// timing-critical parts of a slot (the 10uS write 1 pulse, the 3+10uS
+// read pulse and sample) are done inside the interrupt, everything else
+// is a timer deadline, and the calling task sleeps on a semaphore until
+// the queued transfer is complete.
+//
+// The methods mirror the blocking OneWire ones (without the bus number
+// suffix since each object owns one pin).  Search is not provided here,
+// enumerate with OneWire::search1()/search2() and use this for the
+// device traffic.
+
+// Largest number of operations in one transaction() call.
+#ifndef ONEWIRE_ASYNC_MAX_OPS
+#define ONEWIRE_ASYNC_MAX_OPS 8
+#endif
+
+// Operation types for OneWireAsyncOp
+#define OW_ASYNC_RESET      0   // reset pulse, presence stored in 'presence'
+#define OW_ASYNC_WRITE      1   // write 'bits' bits from 'tx', LSB first
+#define OW_ASYNC_READ       2   // read 'bits' bits into 'rx', LSB first
+
+struct OneWireAsyncOp {
+    uint8_t type;
+    uint8_t power;          // WRITE: leave the line driven high afterwards
+    uint32_t bits;
+    const uint8_t *tx;
+    uint8_t *rx;
+};
+
+// CPU cost of the transfers done so far.  isr_us is the time spent in
+// the alarm interrupt, bus_us the wall time of the transactions.  Their
+// ratio is the CPU utilisation; the blocking OneWire calls are 100%.
+struct OneWireAsyncStats {
+    uint32_t transactions;
+    uint32_t isr_us;
+    uint32_t bus_us;
+};
+
+class OneWireAsync
+{
+  private:
+    gpio_num_t pin;
+    gptimer_handle_t timer;
+    SemaphoreHandle_t done;
+    StaticSemaphore_t doneBuf;
+
+    // transaction being run by the interrupt
+    OneWireAsyncOp ops[ONEWIRE_ASYNC_MAX_OPS];
+    uint8_t opCount;
+    volatile uint8_t opIndex;
+    volatile uint8_t phase;
+    uint32_t bitIndex;
+    uint8_t retries;
+    uint8_t presence;
+    uint8_t txbuf[9];
+
+    OneWireAsyncStats stats;
+
+    void run(void);
+    uint32_t step(void);
+    static bool on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg);
+
+  public:
+    OneWireAsync() : timer(0), done(0) { }
+    OneWireAsync(gpio_num_t pin) : timer(0), done(0) { begin(pin); }
+    bool begin(gpio_num_t pin);
+
+    // Same behaviour as the OneWire calls of the same name.
+    uint8_t reset(void);
+    void select(const uint8_t rom[8]);
+    void skip(void);
+    void write(uint8_t v, uint8_t power = 0);
+    void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0);
+    uint8_t read(void);
+    void read_bytes(uint8_t *buf, uint16_t count);
+    void write_bit(uint8_t v);
+    uint8_t read_bit(void);
+    void depower(void);
+
+    // Run up to ONEWIRE_ASYNC_MAX_OPS operations back to back with a
+    // single wake-up at the end.  Returns OW_OK, OW_NO_PRESENCE when the
+    // last reset in the list saw no presence pulse, or OW_BAD_PROGRAM
+    // without touching the bus when 'count' is over ONEWIRE_ASYNC_MAX_OPS.
+    uint8_t transaction(const OneWireAsyncOp *list, uint8_t count);
+
+    // Call table for onewire_run() and the device drivers
+    OneWireBus bus(void);
+
+    const OneWireAsyncStats &get_stats() const { return stats; }
+    void clear_stats();
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_async_h
@@ -0,0 +1,42 @@
+#ifndef OneWireESP_bus_h
+#define OneWireESP_bus_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+
+// Byte level access to one 1-Wire bus.
+//
+// OneWire has a numbered copy of every call per bus (reset1/reset2, ...)
+// and OneWireAsync has its own object per pin.  Code that should work on
+// any of them (the transaction engine, the device drivers) takes one of
+// these tables instead.  Get one from OneWire::bus1()/bus2() or
+// OneWireAsync::bus(); 'ctx' is the object the calls are made on.
+//
+// The calls behave exactly like the OneWire ones of the same name.
+// 'triplet' is optional (0 if the bus has none): one ROM search step,
+// two read slots and then the write slot of the direction, for a bus
+// that does it in one operation.  'direction' is what to write when
+// both reads are 0.  It returns the first read in bit 0, the second in
+// bit 1 and the direction written in bit 2; both reads 1 (no device
+// answering) returns 3 with nothing written.
+//
+// 'flush' is optional too (0 if the bus has none): a bus that holds
+// written bytes back to send them together (OneWireLinux) sends them.
+// onewire_run() and onewire_transfer() call it at the end of every
+// transaction, and code that makes raw calls on the table calls
+// onewire_flush() after its last write.
+struct OneWireBus {
+    void *ctx;
+    uint8_t (*reset)(void *ctx);
+    void (*write_bytes)(void *ctx, const uint8_t *buf, uint16_t count, bool power);
+    void (*read_bytes)(void *ctx, uint8_t *buf, uint16_t count);
+    void (*write_bit)(void *ctx, uint8_t v);
+    uint8_t (*read_bit)(void *ctx);
+    void (*depower)(void *ctx);
+    uint8_t (*triplet)(void *ctx, uint8_t direction);
+    void (*flush)(void *ctx);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_bus_h
@@ -0,0 +1,142 @@
+/*
+Per device result cache for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_cache.h"
+#include "OneWireESP_program.h"
+#include "esp_timer.h"
+#include <string.h>
+
+OneWireCache::OneWireCache(const OneWireBus &b, const uint8_t *p, uint8_t l)
+{
+    bus = b;
+    prog = p ? p : onewire_prog_read_scratch;
+    // the program reads into a ONEWIRE_CACHE_DATA byte buffer
+    int32_t rx = onewire_prog_rx_len(prog);
+    if (rx < 0 || rx > ONEWIRE_CACHE_DATA) prog = 0;
+    // and no more is kept or handed out than it reads
+    len = prog && l > rx ? (uint8_t)rx : l;
+    memset(entries, 0, sizeof(entries));
+    for (uint8_t i = 0; i < ONEWIRE_CACHE_ENTRIES; i++)
+        entries[i].done = xSemaphoreCreateCountingStatic(255, 0, &entries[i].doneBuf);
+    lock = xSemaphoreCreateMutexStatic(&lockBuf);
+    busLock = xSemaphoreCreateMutexStatic(&busLockBuf);
+    clear_stats();
+}
+
+void OneWireCache::clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+//
+// Look up 'rom'.  With 'create' an unused or the least recently used
+// entry that is not being loaded is given to it.  Call with 'lock' held.
+//
+OneWireCache::Entry *OneWireCache::find(const uint8_t rom[8], bool create)
+{
+    Entry *victim = 0;
+
+    for (uint8_t i = 0; i < ONEWIRE_CACHE_ENTRIES; i++) {
+        Entry *e = &entries[i];
+        if (!e->valid && !e->loading) {
+            // free slot
+            if (!victim || victim->valid) victim = e;
+            continue;
+        }
+        if (memcmp(e->rom, rom, 8) == 0) return e;
+        if (e->valid && !e->loading && (!victim || (victim->valid && e->used < victim->used)))
+            victim = e;
+    }
+    if (!create || !victim) return 0;
+    memcpy(victim->rom, rom, 8);
+    victim->valid = false;
+    return victim;
+}
+
+uint8_t OneWireCache::read(const uint8_t rom[8], uint32_t ttl_ms, uint8_t *buf)
+{
+    int64_t maxAge = (int64_t)ttl_ms * 1000;
+    bool waited = false;
+    uint8_t data[ONEWIRE_CACHE_DATA];
+    Entry *e;
+
+    if (!prog) return OW_BAD_PROGRAM;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (;;) {
+        int64_t now = esp_timer_get_time();
+        e = find(rom, true);
+
+        if (!e) {
+            // every entry is being loaded, read without caching
+            xSemaphoreGive(lock);
+            xSemaphoreTake(busLock, portMAX_DELAY);
+            uint8_t r = onewire_run(bus, prog, rom, 0, data);
+            xSemaphoreGive(busLock);
+            if (r == OW_OK) memcpy(buf, data, len);
+            return r;
+        }
+        e->used = now;
+
+        if (e->valid && now - e->stamp <= maxAge) {
+            memcpy(buf, e->data, len);
+            if (waited) {
+                stats.coalesced++;
+            } else {
+                stats.hits++;
+                stats.saved_us += e->cost_us;
+            }
+            xSemaphoreGive(lock);
+            return OW_OK;
+        }
+
+        if (!e->loading) break;
+
+        // Somebody else is reading this device.  Sleep until the load
+        // ends and look again.
+        e->waiters++;
+        xSemaphoreGive(lock);
+        xSemaphoreTake(e->done, portMAX_DELAY);
+        xSemaphoreTake(lock, portMAX_DELAY);
+        waited = true;
+    }
+
+    // miss: load the entry with only the bus lock held, so hits on other
+    // devices are not held up by the transaction
+    e->loading = true;
+    xSemaphoreGive(lock);
+
+    xSemaphoreTake(busLock, portMAX_DELAY);
+    int64_t start = esp_timer_get_time();
+    uint8_t r = onewire_run(bus, prog, rom, 0, data);
+    int64_t end = esp_timer_get_time();
+    xSemaphoreTake(lock, portMAX_DELAY);
+    xSemaphoreGive(busLock);
+
+    e->loading = false;
+    e->cost_us = (uint32_t)(end - start);
+    stats.misses++;
+    stats.bus_us += e->cost_us;
+    if (r == OW_OK) {
+        memcpy(e->data, data, len);
+        e->stamp = end;
+        e->valid = true;
+        memcpy(buf, data, len);
+    } else {
+        e->valid = false;
+        stats.errors++;
+    }
+    // wake the tasks that came for the same device meanwhile
+    for (; e->waiters; e->waiters--) xSemaphoreGive(e->done);
+    xSemaphoreGive(lock);
+    return r;
+}
+
+void OneWireCache::invalidate(const uint8_t rom[8])
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Entry *e = find(rom, false);
+    if (e) e->valid = false;
+    xSemaphoreGive(lock);
+}
@@ -0,0 +1,91 @@
+#ifndef OneWireESP_cache_h
+#define OneWireESP_cache_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWireESP_bus.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Per device result cache for one bus.
+//
+// Every read() names how old a result the caller is willing to accept.
+// If the cache holds a copy of the device's data younger than that it is
+// returned without touching the bus.  Otherwise the device is read with
+// the cache's transaction program (by default onewire_prog_read_scratch,
+// a scratchpad read with CRC check) and the result stored.
+//
+// Several tasks may share one cache.  If a task misses on a device that
+// another task is already reading, it blocks until that read finishes
+// and takes its result instead of issuing a second transaction.
+
+#ifndef ONEWIRE_CACHE_ENTRIES
+#define ONEWIRE_CACHE_ENTRIES 16
+#endif
+
+// Largest result stored per device
+#ifndef ONEWIRE_CACHE_DATA
+#define ONEWIRE_CACHE_DATA 9
+#endif
+
+struct OneWireCacheStats {
+    uint32_t hits;          // served from memory
+    uint32_t misses;        // read from the bus
+    uint32_t coalesced;     // misses that waited for another task's read
+    uint32_t errors;        // bus reads that failed (nothing cached)
+    uint32_t bus_us;        // time spent in bus reads
+    uint32_t saved_us;      // bus time the hits would have cost
+};
+
+class OneWireCache
+{
+  private:
+    struct Entry {
+        uint8_t rom[8];
+        bool valid;
+        bool loading;
+        uint32_t cost_us;       // duration of the last bus read
+        int64_t stamp;          // when data was read
+        int64_t used;           // last lookup, for replacement
+        uint8_t waiters;        // tasks blocked on 'done'
+        SemaphoreHandle_t done; // given once per waiter when a load ends
+        StaticSemaphore_t doneBuf;
+        uint8_t data[ONEWIRE_CACHE_DATA];
+    };
+
+    OneWireBus bus;
+    const uint8_t *prog;
+    uint8_t len;
+    Entry entries[ONEWIRE_CACHE_ENTRIES];
+    SemaphoreHandle_t lock;         // protects entries and stats
+    SemaphoreHandle_t busLock;      // held for the duration of a miss
+    StaticSemaphore_t lockBuf;
+    StaticSemaphore_t busLockBuf;
+    OneWireCacheStats stats;
+
+    Entry *find(const uint8_t rom[8], bool create);
+
+  public:
+    // 'prog' is run with onewire_run(bus, prog, rom, 0, data) on a miss
+    // and 'len' bytes of what it reads are kept.  A 'len' longer than
+    // what the program reads is cut to that, and read() copies only that
+    // many bytes into 'buf'.  A program that reads more than
+    // ONEWIRE_CACHE_DATA bytes is not accepted: every read() then fails
+    // with OW_BAD_PROGRAM.
+    OneWireCache(const OneWireBus &bus, const uint8_t *prog = 0, uint8_t len = 9);
+
+    // Copy the data of 'rom' into 'buf', reading the device if the cached
+    // copy is older than ttl_ms.  A ttl of 0 always reads.  Returns the
+    // onewire_run() result, OW_OK for a hit.
+    uint8_t read(const uint8_t rom[8], uint32_t ttl_ms, uint8_t *buf);
+
+    // Drop the cached copy, e.g. after writing to the device.
+    void invalidate(const uint8_t rom[8]);
+
+    const OneWireCacheStats &get_stats() const { return stats; }
+    void clear_stats(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_cache_h
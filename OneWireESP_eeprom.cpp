@@ -0,0 +1,198 @@
+/*
+DS2431 / DS28EC20 EEPROM driver for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_eeprom.h"
+#include "OneWireESP_program.h"
+#include "OneWireESP_pm.h"
+#include "OneWireESP.h"
+#include "utils/OneWireESP_port.h"
+#include <string.h>
+
+#define DS28EC20_FAMILY     0x43
+#define COPY_TIME_US        10000   // tPROG
+
+OneWireEEPROM::OneWireEEPROM(const OneWireBus &b, const uint8_t r[8])
+{
+    bus = b;
+    memcpy(rom, r, 8);
+    if (rom[0] == DS28EC20_FAMILY) {
+        rowSize = 32;
+        memSize = 2560;
+    } else {
+        rowSize = 8;
+        memSize = 128;
+    }
+    copyStart = 0;
+    clear_stats();
+}
+
+void OneWireEEPROM::clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+uint32_t OneWireEEPROM::read_rate(void) const
+{
+    if (!stats.read_us) return 0;
+    return (uint32_t)((uint64_t)stats.bytes_read * 1000000 / stats.read_us);
+}
+
+uint32_t OneWireEEPROM::write_rate(void) const
+{
+    if (!stats.write_us) return 0;
+    return (uint32_t)((uint64_t)stats.bytes_written * 1000000 / stats.write_us);
+}
+
+//
+// Extended Read Memory (DS28EC20).  Each page ends with the inverted
+// CRC16 of that page, the first one also covering the command and
+// address.  Whole pages are read so every CRC can be checked.  The
+// caller holds the power management lock across the page reads.
+//
+uint8_t OneWireEEPROM::read_extended(uint16_t addr, uint8_t *buf, uint16_t len)
+{
+    static const uint8_t prog[] = { OW_RESET, OW_MATCH, OW_WRITE_TX, 3, OW_END };
+    uint8_t cmd[3] = { 0xA5, (uint8_t)(addr & 0xFF), (uint8_t)(addr >> 8) };
+    uint8_t page[32 + 2];
+    uint8_t r;
+
+    r = onewire_run(bus, prog, rom, cmd, 0);
+    if (r != OW_OK) return r;
+
+    uint16_t crc = OneWire::crc16(cmd, 3);
+    while (len) {
+        uint8_t n = 32 - (addr & 31);
+        bus.read_bytes(bus.ctx, page, n + 2);
+        if (OneWire::crc16(page, n + 2, crc) != 0xB001) {
+            bus.reset(bus.ctx);
+            return OW_CRC_ERROR;
+        }
+        uint8_t take = len < n ? len : n;
+        memcpy(buf, page, take);
+        buf += take;
+        len -= take;
+        addr += n;
+        crc = 0;
+    }
+    return OW_OK;
+}
+
+uint8_t OneWireEEPROM::read(uint16_t addr, uint8_t *buf, uint16_t len)
+{
+    static const uint8_t prog[] = { OW_RESET, OW_MATCH, OW_WRITE_TX, 3, OW_END };
+    int64_t start = ow_micros();
+    uint8_t r;
+
+    if ((uint32_t)addr + len > memSize) return OW_BAD_ADDRESS;
+    if (copyStart) return OW_BUSY;
+
+    // the data is read outside onewire_run(), so hold the lock for all of it
+    onewire_pm_bus_begin();
+    if (rowSize == 32) {
+        r = read_extended(addr, buf, len);
+    } else {
+        // Read Memory runs on to the end of memory with no CRC
+        uint8_t cmd[3] = { 0xF0, (uint8_t)(addr & 0xFF), (uint8_t)(addr >> 8) };
+        r = onewire_run(bus, prog, rom, cmd, 0);
+        if (r == OW_OK) bus.read_bytes(bus.ctx, buf, len);
+    }
+    onewire_pm_bus_end();
+    if (r == OW_OK) {
+        stats.bytes_read += len;
+        stats.read_us += (uint32_t)(ow_micros() - start);
+    }
+    return r;
+}
+
+uint8_t OneWireEEPROM::begin_write_row(uint16_t addr, const uint8_t *data)
+{
+    static const uint8_t copy[] = { OW_RESET, OW_MATCH, OW_PULLUP, OW_WRITE_TX, 4, OW_END };
+    uint8_t tx[3 + 32];
+    uint8_t rx[3 + 32 + 2];
+    uint8_t r;
+
+    if ((addr & (rowSize - 1)) || (uint32_t)addr + rowSize > memSize) return OW_BAD_ADDRESS;
+    // the device takes no commands until its copy is done
+    if (copyStart) return OW_BUSY;
+
+    // Write Scratchpad, the device answers with the CRC16 of all of it
+    uint8_t write[] = { OW_RESET, OW_MATCH, OW_WRITE_TX, (uint8_t)(3 + rowSize),
+                        OW_READ, 2, OW_CRC16, OW_END };
+    tx[0] = 0x0F;
+    tx[1] = addr & 0xFF;
+    tx[2] = addr >> 8;
+    memcpy(&tx[3], data, rowSize);
+    rowStart = ow_micros();
+    r = onewire_run(bus, write, rom, tx, rx);
+    if (r != OW_OK) return r;
+
+    // Read Scratchpad: TA1 TA2 E/S, the data, CRC16
+    uint8_t verify[] = { OW_RESET, OW_MATCH, OW_WRITE, 1, 0xAA,
+                         OW_READ, (uint8_t)(3 + rowSize + 2), OW_CRC16, OW_END };
+    r = onewire_run(bus, verify, rom, 0, rx);
+    if (r == OW_OK) {
+        // address must match, the ending offset must be the end of the
+        // row and the partial flag (PF) clear
+        if (rx[0] != tx[1] || rx[1] != tx[2] || (rx[2] & 0x20) ||
+            (rx[2] & (rowSize - 1)) != rowSize - 1 ||
+            memcmp(&rx[3], data, rowSize) != 0)
+            r = OW_VERIFY_ERROR;
+    }
+    if (r != OW_OK) return r;
+
+    // Copy Scratchpad with the authorization pattern just read back
+    uint8_t cmd[4] = { 0x55, rx[0], rx[1], rx[2] };
+    r = onewire_run(bus, copy, rom, cmd, 0);
+    if (r != OW_OK) {
+        onewire_pm_bus_begin();
+        bus.depower(bus.ctx);
+        onewire_pm_bus_end();
+        return r;
+    }
+    copyStart = ow_micros();
+    return OW_OK;
+}
+
+uint8_t OneWireEEPROM::finish_write_row(void)
+{
+    int64_t elapsed;
+    uint8_t v;
+
+    if (!copyStart) return OW_OK;
+
+    while ((elapsed = ow_micros() - copyStart) < COPY_TIME_US)
+        ow_delay_ms((uint32_t)((COPY_TIME_US - elapsed + 999) / 1000));
+
+    // a finished copy reads back as alternating 1s and 0s
+    onewire_pm_bus_begin();
+    bus.depower(bus.ctx);
+    bus.read_bytes(bus.ctx, &v, 1);
+    bus.reset(bus.ctx);
+    onewire_pm_bus_end();
+
+    stats.write_us += (uint32_t)(ow_micros() - rowStart);
+    copyStart = 0;
+    if (v != 0xAA) return OW_COPY_ERROR;
+    stats.bytes_written += rowSize;
+    return OW_OK;
+}
+
+uint8_t OneWireEEPROM::write(uint16_t addr, const uint8_t *data, uint16_t len)
+{
+    uint8_t r = OW_OK;
+
+    if ((addr | len) & (rowSize - 1)) return OW_BAD_ADDRESS;
+    if ((uint32_t)addr + len > memSize) return OW_BAD_ADDRESS;
+
+    for (uint16_t off = 0; off < len; off += rowSize) {
+        for (uint8_t tries = 0; tries < ONEWIRE_EEPROM_RETRIES; tries++) {
+            if (tries) stats.retries++;
+            r = begin_write_row(addr + off, data + off);
+            if (r == OW_OK) r = finish_write_row();
+            if (r == OW_OK) break;
+        }
+        if (r != OW_OK) return r;
+    }
+    return OW_OK;
+}
@@ -0,0 +1,83 @@
+#ifndef OneWireESP_eeprom_h
+#define OneWireESP_eeprom_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWireESP_bus.h"
+#include "OneWireESP_program.h"
+
+// DS2431 (1Kb, family 0x2D) and DS28EC20 (20Kb, family 0x43) EEPROMs.
+//
+// read() selects the device once and streams the whole range with Read
+// Memory.  On the DS28EC20 Extended Read Memory is used instead, which
+// carries a CRC16 after every 32 byte page, and each page is checked as
+// it arrives.
+//
+// Writes go a scratchpad row at a time (8 bytes on the DS2431, 32 on the
+// DS28EC20): Write Scratchpad, Read Scratchpad to verify, Copy
+// Scratchpad.  The CRC16s the device returns are checked while the bytes
+// are transferred, and a row that fails is retried on its own.
+//
+// The copy takes up to 10ms during which the device must not be
+// addressed.  write() simply waits it out.  To use that time for other
+// buses, call begin_write_row() on each device first and finish_write_row()
+// on each afterwards; finish only waits for whatever is left of the 10ms.
+
+// Attempts per row before write() gives up
+#ifndef ONEWIRE_EEPROM_RETRIES
+#define ONEWIRE_EEPROM_RETRIES 3
+#endif
+
+struct OneWireEEPROMStats {
+    uint32_t bytes_read;
+    uint32_t read_us;
+    uint32_t bytes_written;
+    uint32_t write_us;      // from first scratchpad write to copy confirmed
+    uint32_t retries;       // repeated row write attempts
+};
+
+class OneWireEEPROM
+{
+  private:
+    OneWireBus bus;
+    uint8_t rom[8];
+    uint8_t rowSize;
+    uint16_t memSize;
+    int64_t rowStart;       // first transfer of the row being written
+    int64_t copyStart;      // 0 when no copy is in progress
+    OneWireEEPROMStats stats;
+
+    uint8_t read_extended(uint16_t addr, uint8_t *buf, uint16_t len);
+
+  public:
+    // 'rom' must be a DS2431 or DS28EC20 ROM code
+    OneWireEEPROM(const OneWireBus &bus, const uint8_t rom[8]);
+
+    uint16_t size(void) const { return memSize; }
+    uint8_t row_size(void) const { return rowSize; }
+
+    // Read 'len' bytes from 'addr' under a single ROM select.  OW_BUSY
+    // while a copy started by begin_write_row() has not been finished.
+    uint8_t read(uint16_t addr, uint8_t *buf, uint16_t len);
+
+    // Write whole rows.  'addr' and 'len' must be multiples of row_size().
+    uint8_t write(uint16_t addr, const uint8_t *data, uint16_t len);
+
+    // Split row write: scratchpad write, verify and start of the copy.
+    // The line is left driven high for parasite powered parts.  Fails
+    // with OW_BUSY while the previous copy has not been finished.
+    uint8_t begin_write_row(uint16_t addr, const uint8_t *data);
+    // Wait for the rest of the copy time and check the confirmation.
+    uint8_t finish_write_row(void);
+
+    // bytes/sec achieved so far
+    uint32_t read_rate(void) const;
+    uint32_t write_rate(void) const;
+
+    const OneWireEEPROMStats &get_stats() const { return stats; }
+    void clear_stats(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_eeprom_h
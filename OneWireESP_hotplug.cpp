@@ -0,0 +1,276 @@
+/*
+Presence pulse hot-plug monitor for OneWireESP.  Same license as
+OneWireESP.cpp.
+*/
+
+#include "OneWireESP_hotplug.h"
+#include "OneWireESP.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <string.h>
+
+// Contacts bounce while a device is plugged in.  Let the bus settle
+// before searching it.
+#define SETTLE_MS       50
+
+
+OneWireHotplug::OneWireHotplug(const OneWireBus &b, gpio_num_t p,
+                               OneWireHotplugCallback cb, void *arg)
+    : presence(p, &stats.pulses)
+{
+    inner = b;
+    callback = cb;
+    callbackArg = arg;
+    count = 0;
+    onewire_search_reset(searchState);
+    clear_stats();
+}
+
+void OneWireHotplug::clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void OneWireHotplug::pause(void)
+{
+    presence.pause();
+}
+
+void OneWireHotplug::resume(void)
+{
+    presence.resume();
+}
+
+bool OneWireHotplug::begin(void)
+{
+    if (!presence.begin()) return false;
+    rescan();
+    return true;
+}
+
+void OneWireHotplug::end(void)
+{
+    presence.end();
+}
+
+bool OneWireHotplug::wait(uint32_t timeout_ms)
+{
+    return presence.wait(timeout_ms == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms));
+}
+
+uint8_t OneWireHotplug::rescan(void)
+{
+    bool seen[ONEWIRE_HOTPLUG_DEVICES] = {};
+    uint8_t rom[8];
+    uint8_t changes = 0;
+    int64_t start = esp_timer_get_time();
+
+    OneWireSearchStats search = OneWireSearchStats();
+
+    presence.disarm();
+    stats.rescans++;
+    onewire_search_reset(searchState);
+    while (onewire_search(inner, searchState, rom, true, &search)) {
+        uint8_t i;
+        for (i = 0; i < count; i++)
+            if (memcmp(roms[i], rom, 8) == 0) break;
+        if (i == count) {
+            if (count == ONEWIRE_HOTPLUG_DEVICES) continue;
+            memcpy(roms[count++], rom, 8);
+            stats.attached++;
+            changes++;
+            if (callback) callback(rom, true, callbackArg);
+        }
+        seen[i] = true;
+    }
+
+    // drop what did not answer, keeping the order of the rest
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (seen[i]) {
+            if (kept != i) memcpy(roms[kept], roms[i], 8);
+            kept++;
+            continue;
+        }
+        stats.detached++;
+        changes++;
+        if (callback) callback(roms[i], false, callbackArg);
+    }
+    count = kept;
+
+    if (!changes) stats.idle_rescans++;
+    stats.passes += search.passes;
+    stats.bus_us += (uint32_t)(esp_timer_get_time() - start);
+    presence.arm();
+    return changes;
+}
+
+static uint64_t rom_value(const uint8_t rom[8])
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | rom[i];
+    return v;
+}
+
+uint8_t OneWireHotplug::discover(void)
+{
+    static const uint8_t cmd = 0xF0;
+    uint64_t known[ONEWIRE_HOTPLUG_DEVICES];
+    bool match[ONEWIRE_HOTPLUG_DEVICES];
+    uint8_t found = 0, retries = 0;
+    bool empty = false;
+    int64_t start = esp_timer_get_time();
+
+    if (count == ONEWIRE_HOTPLUG_DEVICES) return 0;
+    for (uint8_t i = 0; i < count; i++) known[i] = rom_value(roms[i]);
+
+    presence.disarm();
+    stats.discoveries++;
+
+    // one pass along each known device, or a plain one on an empty bus
+    for (uint8_t p = 0; p < (count ? count : 1); ) {
+        uint64_t target = count ? known[p] : 0, rom = 0, bit;
+        uint8_t n, t, crc = 0;
+        bool old = false;
+
+        stats.passes++;
+        if (!inner.reset(inner.ctx)) break;
+        inner.write_bytes(inner.ctx, &cmd, 1, false);
+        for (uint8_t i = 0; i < count; i++) match[i] = true;
+
+        for (n = 0, bit = 1; n < 64; n++, bit <<= 1) {
+            // the ways the known devices on this path take here
+            bool zero = false, one = false;
+            for (uint8_t i = 0; i < count; i++) {
+                if (!match[i]) continue;
+                if (known[i] & bit) one = true;
+                else zero = true;
+            }
+
+            // a known branch: follow the target.  One known way: ask for
+            // the other, which only a new device can offer.  Past the
+            // known devices: the 0 way, as a search does.
+            uint8_t direction = (zero && one) ? (target & bit) != 0 : zero;
+            t = onewire_triplet(inner, direction);
+            if (t == 3) break;
+
+            uint8_t taken = (t >> 2) & 1;
+            if (taken) rom |= bit;
+            crc = (crc >> 1) ^ (((crc ^ taken) & 1) ? 0x8C : 0);
+            for (uint8_t i = 0; i < count; i++)
+                if (match[i] && ((known[i] ^ rom) & bit)) match[i] = false;
+        }
+
+        // retake a disturbed pass, as onewire_search() does, and give up
+        // on a 1/1 at the first bit only once it comes twice
+        if (n < 64 || crc) {
+            if ((n == 0 && empty) || retries++ == ONEWIRE_SEARCH_RETRIES) break;
+            empty = n == 0;
+            continue;
+        }
+        p++;
+        retries = 0;
+        empty = false;
+
+        for (uint8_t i = 0; i < count; i++) old |= match[i];
+        if (old || rom == 0) continue;      // a known device, or a bus held low
+
+        for (uint8_t i = 0; i < 8; i++) roms[count][i] = (uint8_t)(rom >> (8 * i));
+        stats.attached++;
+        found = 1;
+        if (callback) callback(roms[count], true, callbackArg);
+        count++;
+        break;
+    }
+
+    stats.bus_us += (uint32_t)(esp_timer_get_time() - start);
+    presence.arm();
+    return found;
+}
+
+void OneWireHotplug::run(uint32_t fallback_ms /* = 0 */)
+{
+    for (;;) {
+        if (wait(fallback_ms ? fallback_ms : portMAX_DELAY)) {
+            vTaskDelay(pdMS_TO_TICKS(SETTLE_MS));
+            presence.wait(0);               // pulses from the same plug-in
+            discover();
+        } else if (fallback_ms)
+            rescan();
+    }
+}
+
+uint8_t OneWireHotplug::bus_reset(void *ctx)
+{
+    OneWireHotplug *hp = (OneWireHotplug *)ctx;
+    hp->presence.disarm();
+    uint8_t r = hp->inner.reset(hp->inner.ctx);
+    hp->presence.arm();
+    return r;
+}
+
+void OneWireHotplug::bus_write_bytes(void *ctx, const uint8_t *buf, uint16_t count, bool power)
+{
+    OneWireHotplug *hp = (OneWireHotplug *)ctx;
+    hp->presence.disarm();
+    hp->inner.write_bytes(hp->inner.ctx, buf, count, power);
+    hp->presence.arm();
+}
+
+void OneWireHotplug::bus_read_bytes(void *ctx, uint8_t *buf, uint16_t count)
+{
+    OneWireHotplug *hp = (OneWireHotplug *)ctx;
+    hp->presence.disarm();
+    hp->inner.read_bytes(hp->inner.ctx, buf, count);
+    hp->presence.arm();
+}
+
+void OneWireHotplug::bus_write_bit(void *ctx, uint8_t v)
+{
+    OneWireHotplug *hp = (OneWireHotplug *)ctx;
+    hp->presence.disarm();
+    hp->inner.write_bit(hp->inner.ctx, v);
+    hp->presence.arm();
+}
+
+uint8_t OneWireHotplug::bus_read_bit(void *ctx)
+{
+    OneWireHotplug *hp = (OneWireHotplug *)ctx;
+    hp->presence.disarm();
+    uint8_t r = hp->inner.read_bit(hp->inner.ctx);
+    hp->presence.arm();
+    return r;
+}
+
+void OneWireHotplug::bus_depower(void *ctx)
+{
+    OneWireHotplug *hp = (OneWireHotplug *)ctx;
+    hp->presence.disarm();
+    hp->inner.depower(hp->inner.ctx);
+    hp->presence.arm();
+}
+
+uint8_t OneWireHotplug::bus_triplet(void *ctx, uint8_t direction)
+{
+    OneWireHotplug *hp = (OneWireHotplug *)ctx;
+    hp->presence.disarm();
+    uint8_t r = hp->inner.triplet(hp->inner.ctx, direction);
+    hp->presence.arm();
+    return r;
+}
+
+void OneWireHotplug::bus_flush(void *ctx)
+{
+    OneWireHotplug *hp = (OneWireHotplug *)ctx;
+    hp->presence.disarm();
+    hp->inner.flush(hp->inner.ctx);
+    hp->presence.arm();
+}
+
+OneWireBus OneWireHotplug::bus(void)
+{
+    OneWireBus b = { this, bus_reset, bus_write_bytes, bus_read_bytes,
+                     bus_write_bit, bus_read_bit, bus_depower,
+                     inner.triplet ? bus_triplet : 0, inner.flush ? bus_flush : 0 };
+    return b;
+}
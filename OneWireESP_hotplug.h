@@ -0,0 +1,125 @@
+#ifndef OneWireESP_hotplug_h
+#define OneWireESP_hotplug_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "OneWireESP_bus.h"
+#include "OneWireESP_program.h"
+#include "OneWireESP_presence.h"
+
+// Device attach detection without periodic searches.
+//
+// A 1-Wire device that is plugged into an idle bus announces itself with
+// a presence pulse, a 60-240uS low, without being asked.  OneWireHotplug
+// watches the bus pin for one whenever the bus is idle (OneWirePresence);
+// a presence pulse wakes wait() (or run()), and only then is the bus
+// searched for the new device.
+//
+// The monitor owns the bus.  Its own traffic has slots that look like
+// presence pulses (a write 0 slot is a 60-120uS low), so it must know
+// whenever the bus is busy: do all bus traffic through the table from
+// bus(), which disarms the interrupt for each call, or bracket traffic
+// that does not go through it (search1()/reset1() on the OneWire
+// object, another driver on the same pin) with pause() and resume().
+// Traffic it is not told about wakes it with false pulses; they cost a
+// discover() each but report nothing.
+//
+// discover() does not search the whole bus.  It follows the known
+// devices one pass each and, at every bit where the known devices all
+// take the same way, asks for the other way: a device that was not
+// there before shows up as a discrepancy there, and the pass goes on
+// into the new branch to read its ROM.  It stops at the first new
+// device, so a device plugged in near the start of the search order
+// costs one pass.
+//
+// Detaching makes no pulse.  Removed devices are noticed by rescan(),
+// run on its own or by the optional fallback period of run().
+
+#ifndef ONEWIRE_HOTPLUG_DEVICES
+#define ONEWIRE_HOTPLUG_DEVICES 32
+#endif
+
+// Called from discover() and rescan() for every device that appeared or
+// went away
+typedef void (*OneWireHotplugCallback)(const uint8_t rom[8], bool attached, void *arg);
+
+struct OneWireHotplugStats {
+    uint32_t pulses;        // presence pulses seen on the idle bus
+    uint32_t discoveries;   // discover() walks run
+    uint32_t rescans;       // full searches run
+    uint32_t passes;        // search passes of both
+    uint32_t attached;      // devices that appeared
+    uint32_t detached;      // devices that went away
+    uint32_t idle_rescans;  // rescans that found no change
+    uint32_t bus_us;        // time spent searching
+};
+
+class OneWireHotplug
+{
+  private:
+    OneWireBus inner;
+    OneWireHotplugCallback callback;
+    void *callbackArg;
+    uint8_t roms[ONEWIRE_HOTPLUG_DEVICES][8];
+    uint8_t count;
+    OneWireSearchState searchState;
+    OneWirePresence presence;
+    OneWireHotplugStats stats;
+
+    static uint8_t bus_reset(void *ctx);
+    static void bus_write_bytes(void *ctx, const uint8_t *buf, uint16_t count, bool power);
+    static void bus_read_bytes(void *ctx, uint8_t *buf, uint16_t count);
+    static void bus_write_bit(void *ctx, uint8_t v);
+    static uint8_t bus_read_bit(void *ctx);
+    static void bus_depower(void *ctx);
+    static uint8_t bus_triplet(void *ctx, uint8_t direction);
+    static void bus_flush(void *ctx);
+
+  public:
+    // 'bus' is the bus on 'pin'.  'cb' may be 0.
+    OneWireHotplug(const OneWireBus &bus, gpio_num_t pin,
+                   OneWireHotplugCallback cb = 0, void *arg = 0);
+
+    // Install the edge interrupt, search once and start watching.
+    // Returns false if the interrupt could not be set up.
+    bool begin(void);
+    void end(void);
+
+    // Call table that keeps the monitor off while the bus is in use
+    OneWireBus bus(void);
+
+    // Keep the monitor off across bus traffic that does not go through
+    // bus().  Calls nest; the interrupt is armed again by the last
+    // resume().
+    void pause(void);
+    void resume(void);
+
+    // Wait up to 'timeout_ms' (portMAX_DELAY for ever) for a presence
+    // pulse.  Returns true if one was seen.
+    bool wait(uint32_t timeout_ms);
+
+    // Look for a device that is not known yet, along the paths of the
+    // known ones (see above).  Returns 1 if one was found and reported,
+    // 0 if there is none or the device table is full.
+    uint8_t discover(void);
+
+    // Search the whole bus and report differences to the known devices.
+    // Returns the number of devices that appeared or went away.
+    uint8_t rescan(void);
+
+    // wait() and discover() for ever.  With 'fallback_ms' set, also
+    // rescan() when no pulse has been seen for that long, to notice
+    // removals.
+    void run(uint32_t fallback_ms = 0);
+
+    uint8_t device_count(void) const { return count; }
+    const uint8_t *device(uint8_t i) const { return roms[i]; }
+
+    const OneWireHotplugStats &get_stats() const { return stats; }
+    void clear_stats(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_hotplug_h
@@ -0,0 +1,373 @@
+/*
+Linux kernel w1 (sysfs) backend for OneWireESP.  Same license as
+OneWireESP.cpp.
+*/
+
+#include "OneWireESP_linux.h"
+
+#if defined(__linux__)
+
+#include "utils/OneWireESP_port.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Transaction phases
+#define PH_IDLE         0       // after reset, expecting a ROM command
+#define PH_MATCH        1       // collecting the Match ROM code
+#define PH_DATA         2       // slave chosen, buffering data bytes
+#define PH_SKIP         3       // Skip ROM, buffering data bytes
+#define PH_READ_ROM     4       // Read ROM, reads return the ROM code
+#define PH_NONE         5       // nothing the kernel can do, bytes dropped
+
+
+OneWireLinux::OneWireLinux(const char *m)
+{
+    snprintf(master, sizeof(master), "%s", m);
+    slaveCount = 0;
+    phase = PH_NONE;
+    romPos = 0;
+    fd = -1;
+    sent = false;
+    pendingLen = 0;
+    haveLast = false;
+    clear_stats();
+#if ONEWIRE_SEARCH
+    reset_search();
+    clear_search_stats();
+#endif
+}
+
+OneWireLinux::~OneWireLinux()
+{
+    close_slave();
+}
+
+void OneWireLinux::clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+//
+// Read w1_master_slaves: one "ff-ssssssssssss" id per line, family then
+// the 48 bit serial number most significant byte first, or "not found."
+// when the bus is empty.
+//
+bool OneWireLinux::load_slaves(void)
+{
+    char path[160], buf[ONEWIRE_LINUX_SLAVES * 16 + 1];
+    ssize_t n;
+    int f;
+
+    slaveCount = 0;
+    snprintf(path, sizeof(path), "%s/w1_master_slaves", master);
+    f = open(path, O_RDONLY);
+    stats.syscalls++;
+    if (f < 0) {
+        stats.errors++;
+        return false;
+    }
+    n = ::read(f, buf, sizeof(buf) - 1);
+    close(f);
+    stats.syscalls += 2;
+    if (n < 0) {
+        stats.errors++;
+        return false;
+    }
+    buf[n] = 0;
+
+    for (char *line = strtok(buf, "\n"); line && slaveCount < ONEWIRE_LINUX_SLAVES; line = strtok(0, "\n")) {
+        unsigned family;
+        unsigned long long serial;
+        uint8_t *rom = slaves[slaveCount];
+
+        if (sscanf(line, "%2x-%12llx", &family, &serial) != 2) continue;
+        rom[0] = (uint8_t)family;
+        for (int i = 1; i < 7; i++) {
+            rom[i] = (uint8_t)serial;
+            serial >>= 8;
+        }
+        rom[7] = OneWire::crc8(rom, 7);
+        slaveCount++;
+    }
+    return true;
+}
+
+bool OneWireLinux::open_slave(const uint8_t rom[8])
+{
+    char path[160];
+    unsigned long long serial = 0;
+
+    if (fd >= 0 && memcmp(rom, fdRom, 8) == 0) return true;
+    close_slave();
+
+    for (int i = 6; i >= 1; i--)
+        serial = (serial << 8) | rom[i];
+    snprintf(path, sizeof(path), "%s/%02x-%012llx/rw", master, rom[0], serial);
+    fd = open(path, O_RDWR);
+    stats.syscalls++;
+    if (fd < 0) {
+        stats.errors++;
+        return false;
+    }
+    memcpy(fdRom, rom, 8);
+    return true;
+}
+
+void OneWireLinux::close_slave(void)
+{
+    if (fd < 0) return;
+    close(fd);
+    stats.syscalls++;
+    fd = -1;
+}
+
+// One slave transaction: the kernel resets, selects 'rom' and writes 'buf'
+bool OneWireLinux::send(const uint8_t rom[8], const uint8_t *buf, uint16_t len)
+{
+    if (!open_slave(rom)) return false;
+    stats.transactions++;
+    stats.syscalls++;
+    if (::write(fd, buf, len) != (ssize_t)len) {
+        stats.errors++;
+        close_slave();
+        return false;
+    }
+    sent = true;
+    return true;
+}
+
+//
+// Send the buffered bytes.  'reading' says whether bytes are to be read
+// back in the same transaction, which a broadcast cannot do.
+//
+bool OneWireLinux::flush(bool reading)
+{
+    bool ok = true;
+
+    if (phase == PH_DATA) {
+        if (pendingLen) ok = send(target, pending, pendingLen);
+    } else if (phase == PH_SKIP) {
+        if (!load_slaves()) ok = false;
+        else if (reading) {
+            ok = slaveCount == 1;
+            if (ok) {
+                memcpy(target, slaves[0], 8);
+                phase = PH_DATA;
+                if (pendingLen) ok = send(target, pending, pendingLen);
+            } else
+                stats.errors++;
+        } else {
+            for (uint8_t i = 0; i < slaveCount; i++)
+                if (!send(slaves[i], pending, pendingLen)) ok = false;
+        }
+    }
+    pendingLen = 0;
+    if (!ok) phase = PH_NONE;
+    return ok;
+}
+
+uint8_t OneWireLinux::reset(void)
+{
+    if (pendingLen) flush(false);
+    phase = PH_IDLE;
+    romPos = 0;
+    sent = false;
+    if (!load_slaves()) return 0;
+    return slaveCount ? 1 : 0;
+}
+
+void OneWireLinux::select(const uint8_t rom[8])
+{
+    write(0x55);           // Choose ROM
+    write_bytes(rom, 8);
+}
+
+void OneWireLinux::skip(void)
+{
+    write(0xCC);           // Skip ROM
+}
+
+void OneWireLinux::write(uint8_t v, uint8_t /* power = 0 */)
+{
+    switch (phase) {
+    case PH_IDLE:
+        if (v == 0x55) {
+            phase = PH_MATCH;
+            romPos = 0;
+        } else if (v == 0xCC) {
+            phase = PH_SKIP;
+        } else if (v == 0xA5 && haveLast) {
+            memcpy(target, lastRom, 8);
+            phase = PH_DATA;
+        } else if (v == 0x33) {
+            phase = PH_READ_ROM;
+            romPos = 0;
+        } else {
+            // search and overdrive commands go through the kernel only
+            stats.errors++;
+            phase = PH_NONE;
+        }
+        break;
+    case PH_MATCH:
+        target[romPos++] = v;
+        if (romPos == 8) {
+            memcpy(lastRom, target, 8);
+            haveLast = true;
+            phase = PH_DATA;
+        }
+        break;
+    case PH_DATA:
+    case PH_SKIP:
+        if (pendingLen == sizeof(pending)) {
+            // a second write() would start a new kernel transaction
+            stats.errors++;
+            pendingLen = 0;
+            phase = PH_NONE;
+            break;
+        }
+        pending[pendingLen++] = v;
+        break;
+    default:
+        break;
+    }
+}
+
+void OneWireLinux::write_bytes(const uint8_t *buf, uint16_t count, bool /* power = 0 */)
+{
+    for (uint16_t i = 0 ; i < count ; i++)
+        write(buf[i]);
+}
+
+uint8_t OneWireLinux::read(void)
+{
+    uint8_t r;
+
+    read_bytes(&r, 1);
+    return r;
+}
+
+void OneWireLinux::read_bytes(uint8_t *buf, uint16_t count)
+{
+    if (phase == PH_READ_ROM) {
+        if (load_slaves() && slaveCount == 1) {
+            for (uint16_t i = 0; i < count; i++)
+                buf[i] = romPos < 8 ? slaves[0][romPos++] : 0xFF;
+            return;
+        }
+        phase = PH_NONE;
+    }
+    if ((phase == PH_DATA || phase == PH_SKIP) && flush(true)) {
+        // reading straight after the ROM command has nothing to send
+        if (sent) {
+            stats.syscalls++;
+            if (::read(fd, buf, count) == (ssize_t)count) return;
+            stats.errors++;
+            close_slave();
+            phase = PH_NONE;
+        }
+    }
+    // nothing answered: the line floats high
+    memset(buf, 0xFF, count);
+}
+
+bool OneWireLinux::kernel_search(int count)
+{
+    char path[160], value[16];
+    int f, n;
+    bool ok;
+
+    snprintf(path, sizeof(path), "%s/w1_master_search", master);
+    f = open(path, O_WRONLY | O_TRUNC);
+    stats.syscalls++;
+    if (f < 0) {
+        stats.errors++;
+        return false;
+    }
+    n = snprintf(value, sizeof(value), "%d\n", count);
+    ok = ::write(f, value, n) == n;
+    close(f);
+    stats.syscalls += 2;
+    if (!ok) stats.errors++;
+    return ok;
+}
+
+void OneWireLinux::write_bit(uint8_t)
+{
+}
+
+uint8_t OneWireLinux::read_bit(void)
+{
+    return 1;
+}
+
+void OneWireLinux::depower(void)
+{
+}
+
+void OneWireLinux::end(void)
+{
+    if (pendingLen && (phase == PH_DATA || phase == PH_SKIP)) flush(false);
+}
+
+#if ONEWIRE_SEARCH
+
+void OneWireLinux::reset_search(void)
+{
+    searchPos = 0;
+    searchFamily = -1;
+}
+
+void OneWireLinux::target_search(uint8_t family_code)
+{
+    searchPos = 0;
+    searchFamily = family_code;
+}
+
+void OneWireLinux::clear_search_stats(void)
+{
+    memset(&searchStats, 0, sizeof(searchStats));
+}
+
+bool OneWireLinux::search(uint8_t *newAddr, bool search_mode /* = true */)
+{
+    // the kernel has no alarm search over sysfs
+    if (!search_mode) return false;
+
+    if (searchPos == 0) {
+        int64_t start = ow_micros();
+        searchStats.passes++;
+        bool ok = load_slaves();
+        searchStats.bus_us += (uint32_t)(ow_micros() - start);
+        if (!ok) return false;
+    }
+    while (searchPos < slaveCount) {
+        const uint8_t *rom = slaves[searchPos++];
+        if (searchFamily >= 0 && rom[0] != searchFamily) continue;
+        memcpy(newAddr, rom, 8);
+        searchStats.devices++;
+        return true;
+    }
+    searchPos = 0;
+    return false;
+}
+
+#endif
+
+static uint8_t linux_reset(void *ctx) { return ((OneWireLinux *)ctx)->reset(); }
+static void linux_write_bytes(void *ctx, const uint8_t *buf, uint16_t count, bool power) { ((OneWireLinux *)ctx)->write_bytes(buf, count, power); }
+static void linux_read_bytes(void *ctx, uint8_t *buf, uint16_t count) { ((OneWireLinux *)ctx)->read_bytes(buf, count); }
+static void linux_write_bit(void *ctx, uint8_t v) { ((OneWireLinux *)ctx)->write_bit(v); }
+static uint8_t linux_read_bit(void *ctx) { return ((OneWireLinux *)ctx)->read_bit(); }
+static void linux_depower(void *ctx) { ((OneWireLinux *)ctx)->depower(); }
+static void linux_flush(void *ctx) { ((OneWireLinux *)ctx)->end(); }
+
+OneWireBus OneWireLinux::bus(void)
+{
+    OneWireBus b = { this, linux_reset, linux_write_bytes, linux_read_bytes,
+                     linux_write_bit, linux_read_bit, linux_depower, 0, linux_flush };
+    return b;
+}
+
+#endif // __linux__
@@ -0,0 +1,144 @@
+#ifndef OneWireESP_linux_h
+#define OneWireESP_linux_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWireESP.h"
+
+#if defined(__linux__)
+
+// 1-Wire bus run by the Linux kernel w1 subsystem, for the same drivers
+// and transaction programs on a Linux gateway.
+//
+// The kernel only offers byte access per slave, through the 'rw' file of
+// each slave directory: a write() does reset, Match ROM and the data, a
+// read() clocks in more bytes of the same transaction.  The calls here
+// look like the OneWire ones, but are collected rather than sent: the
+// ROM command picks the slave, data bytes are buffered, and the buffer
+// goes out in one write() when the first byte is read back or at the
+// next reset().  Each read_bytes() is one read().  A whole transaction
+// program therefore costs one write and one read instead of a syscall
+// per byte.  Since every write() to 'rw' starts with its own reset and
+// select, bytes written after a read begin a new transaction, and at
+// most ONEWIRE_LINUX_BUF bytes can be written before the first read.
+//
+// The 'rw' file only exists for slaves bound to the kernel's default
+// family driver.  A slave claimed by a family module (w1_therm for
+// DS18B20s, w1_ds2438, ...) has that module's files instead, and every
+// transaction to it fails and counts as an error.  Keep those modules
+// from loading (blacklist them, or build the kernel without them) so the
+// default driver takes every slave.
+//
+// The write() and the read() of one transaction are separate kernel
+// calls, and the kernel's bus mutex is free in between.  If the kernel's
+// periodic search runs there it resets the bus, and the read returns
+// whatever the slave sends outside a transaction, normally 0xFF; the
+// CRC check of a program catches that.  Stop the periodic search with
+// kernel_search(0) for a bus that must not be interrupted, and ask for a
+// single search with kernel_search(1) when devices may have changed.
+//
+// Skip ROM is only possible when it can be mapped onto slaves: writes
+// (a broadcast Convert T, say) are repeated to every slave, reads need
+// exactly one slave on the bus.  Read ROM (0x33) is answered from the
+// slave list.  write_bit()/read_bit() and strong pullup have no kernel
+// equivalent; read_bit() returns 1, as a bus with no device would.
+//
+// 'master' is the bus master directory.  Any directory with a
+// w1_master_slaves file and a '<slave id>/rw' file per slave will do, so
+// a test can point it at a fake tree of plain files.  A plain 'rw' file
+// works as a slave that answers with what follows the written bytes.
+
+#ifndef ONEWIRE_LINUX_SLAVES
+#define ONEWIRE_LINUX_SLAVES    32
+#endif
+
+#ifndef ONEWIRE_LINUX_BUF
+#define ONEWIRE_LINUX_BUF       64
+#endif
+
+struct OneWireLinuxStats {
+    uint32_t transactions;  // slave transactions started
+    uint32_t syscalls;      // open/read/write/close calls made
+    uint32_t errors;        // failed calls and unmappable transactions
+};
+
+class OneWireLinux
+{
+  private:
+    char master[128];
+    uint8_t slaves[ONEWIRE_LINUX_SLAVES][8];
+    uint8_t slaveCount;
+
+    uint8_t phase;          // where in the transaction the next byte goes
+    uint8_t target[8];      // selected slave
+    uint8_t romPos;
+    int fd;                 // rw file of 'target', or -1
+    bool sent;              // a kernel transaction is open since reset()
+    uint8_t fdRom[8];       // slave 'fd' belongs to
+    uint8_t pending[ONEWIRE_LINUX_BUF];
+    uint16_t pendingLen;
+    uint8_t lastRom[8];     // for Resume
+    bool haveLast;
+    OneWireLinuxStats stats;
+
+#if ONEWIRE_SEARCH
+    uint8_t searchPos;
+    int searchFamily;
+    OneWireSearchStats searchStats;
+#endif
+
+    bool load_slaves(void);
+    bool open_slave(const uint8_t rom[8]);
+    void close_slave(void);
+    bool send(const uint8_t rom[8], const uint8_t *buf, uint16_t len);
+    bool flush(bool reading);
+
+  public:
+    OneWireLinux(const char *master = "/sys/bus/w1/devices/w1_bus_master1");
+    ~OneWireLinux();
+
+    // Returns 1 if the kernel lists any slave on the bus.
+    uint8_t reset(void);
+    void select(const uint8_t rom[8]);
+    void skip(void);
+    void write(uint8_t v, uint8_t power = 0);
+    void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0);
+    uint8_t read(void);
+    void read_bytes(uint8_t *buf, uint16_t count);
+    void write_bit(uint8_t v);
+    uint8_t read_bit(void);
+    void depower(void);
+
+    // Send the bytes written since the last reset() or read.  Writes are
+    // held back to go to the kernel in one call; the bus() table calls
+    // this at the end of every transaction, so a program that only
+    // writes (Convert T, Copy Scratchpad) reaches the device too.
+    void end(void);
+
+#if ONEWIRE_SEARCH
+    // Walks the kernel's slave list, which the kernel keeps current by
+    // its own periodic search.
+    void reset_search(void);
+    void target_search(uint8_t family_code);
+    bool search(uint8_t *newAddr, bool search_mode = true);
+    const OneWireSearchStats &search_stats() const { return searchStats; }
+    void clear_search_stats(void);
+#endif
+
+    // Write w1_master_search: -1 searches periodically (the kernel
+    // default), 0 stops searching, n > 0 runs n more searches and stops.
+    // The kernel's search thread wakes at once.  Returns false if the
+    // file cannot be written.
+    bool kernel_search(int count);
+
+    const OneWireLinuxStats &get_stats() const { return stats; }
+    void clear_stats(void);
+
+    // Call table for onewire_run() and the device drivers
+    OneWireBus bus(void);
+};
+
+#endif // __linux__
+#endif // __cplusplus
+#endif // OneWireESP_linux_h
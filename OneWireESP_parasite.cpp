@@ -0,0 +1,184 @@
+/*
+Parasite power aware conversions for OneWireESP.  Same license as
+OneWireESP.cpp.
+*/
+
+#include "OneWireESP_parasite.h"
+#include "OneWireESP_pm.h"
+#include "utils/OneWireESP_port.h"
+#include <string.h>
+
+#define DS18S20_FAMILY  0x10
+
+// DS18B20 tCONV by resolution, 9 to 12 bits
+static const uint16_t conv_time[4] = { 94, 188, 375, 750 };
+
+
+OneWireParasite::OneWireParasite(const OneWireBus &b, uint16_t budget_ma, uint8_t duty_pct)
+{
+    bus = b;
+    budget = budget_ma;
+    duty = duty_pct ? (duty_pct > 100 ? 100 : duty_pct) : 1;
+    count = 0;
+    nextPullup = 0;
+    clear_stats();
+}
+
+void OneWireParasite::clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+int OneWireParasite::find(const uint8_t rom[8]) const
+{
+    for (uint8_t i = 0; i < count; i++)
+        if (memcmp(devices[i].rom, rom, 8) == 0) return i;
+    return -1;
+}
+
+bool OneWireParasite::parasite(const uint8_t rom[8]) const
+{
+    int i = find(rom);
+    return i >= 0 && devices[i].parasite;
+}
+
+uint8_t OneWireParasite::parasite_count(void) const
+{
+    uint8_t n = 0;
+
+    for (uint8_t i = 0; i < count; i++)
+        if (devices[i].parasite) n++;
+    return n;
+}
+
+uint16_t OneWireParasite::conversion_ms(const uint8_t rom[8]) const
+{
+    int i = find(rom);
+    return i < 0 ? 0 : devices[i].conv_ms;
+}
+
+uint8_t OneWireParasite::add_device(const uint8_t rom[8])
+{
+    static const uint8_t power_prog[] = { OW_RESET, OW_MATCH, OW_WRITE, 1, 0xB4, OW_END };
+    uint8_t scratch[9];
+    uint8_t r;
+    int i = find(rom);
+
+    if (i < 0) {
+        if (count == ONEWIRE_PARASITE_DEVICES) return OW_BAD_PROGRAM;
+        i = count;
+    }
+    Device &d = devices[i];
+
+    // a parasite powered device pulls the read slot low
+    onewire_pm_bus_begin();
+    r = onewire_run(bus, power_prog, rom);
+    if (r == OW_OK) d.parasite = bus.read_bit(bus.ctx) == 0;
+    onewire_pm_bus_end();
+    if (r != OW_OK) return r;
+
+    // resolution is in configuration register bits 5 and 6
+    d.conv_ms = conv_time[3];
+    if (rom[0] != DS18S20_FAMILY) {
+        r = onewire_run(bus, onewire_prog_read_scratch, rom, 0, scratch);
+        if (r != OW_OK) return r;
+        d.conv_ms = conv_time[(scratch[4] >> 5) & 3];
+    }
+    memcpy(d.rom, rom, 8);
+    if (i == count) count++;
+    return OW_OK;
+}
+
+//
+// Convert T with the line driven high for 'ms', on 'rom' or with Skip ROM
+// if 'rom' is 0.  Waits out the duty limit first.  The pullup goes off
+// only once ow_micros() has passed 'ms' from the end of the command, so
+// a sleep that ends early on a tick boundary cannot cut it short.
+//
+uint8_t OneWireParasite::hold(const uint8_t *rom, uint16_t ms)
+{
+    const uint8_t prog[] = {
+        OW_RESET, (uint8_t)(rom ? OW_MATCH : OW_SKIP),
+        OW_PULLUP, OW_WRITE, 1, 0x44,
+        OW_END
+    };
+    int64_t left;
+    uint8_t r;
+
+    ow_delay_until(nextPullup);
+    onewire_pm_bus_begin();
+    r = onewire_run(bus, prog, rom);
+    int64_t now = ow_micros();
+    int64_t until = now + (int64_t)ms * 1000;
+    if (r == OW_OK) {
+        while ((left = until - ow_micros()) > 0)
+            onewire_pm_wait((uint32_t)((left + 999) / 1000));
+    }
+    bus.depower(bus.ctx);
+    onewire_pm_bus_end();
+    if (r != OW_OK) return r;
+
+    int64_t held = ow_micros() - now;
+    stats.pullup_ms += (uint32_t)(held / 1000);
+    nextPullup = ow_micros() + held * (100 - duty) / duty;
+    return OW_OK;
+}
+
+//
+// After a Convert T without pullup the sensors send 0 read slots until
+// they are done.  Stop at the first 1, or when 'ms' has passed.
+//
+void OneWireParasite::wait_done(uint16_t ms)
+{
+    int64_t end = ow_micros() + (int64_t)ms * 1000;
+
+    // the lock is let go between polls, so the chip can sleep through them
+    onewire_pm_bus_begin();
+    while (!bus.read_bit(bus.ctx) && ow_micros() < end)
+        onewire_pm_wait(5);
+    onewire_pm_bus_end();
+}
+
+uint8_t OneWireParasite::convert(void)
+{
+    static const uint8_t match_convert[] = { OW_RESET, OW_MATCH, OW_WRITE, 1, 0x44, OW_END };
+    int64_t start = ow_micros();
+    uint16_t slowest = 0, slowestExt = 0;
+    uint8_t parasites = 0;
+    uint8_t r = OW_OK;
+
+    if (!count) return OW_OK;
+    for (uint8_t i = 0; i < count; i++) {
+        if (devices[i].parasite) {
+            parasites++;
+            if (devices[i].conv_ms > slowest) slowest = devices[i].conv_ms;
+        } else if (devices[i].conv_ms > slowestExt)
+            slowestExt = devices[i].conv_ms;
+    }
+
+    if (!parasites) {
+        r = onewire_run(bus, onewire_prog_convert_all);
+        if (r == OW_OK) wait_done(slowestExt);
+    } else if (!budget || (uint32_t)parasites * ONEWIRE_PARASITE_UA <= (uint32_t)budget * 1000) {
+        r = hold(0, slowest > slowestExt ? slowest : slowestExt);
+    } else {
+        // externally powered sensors convert while the parasite ones
+        // take their turns
+        for (uint8_t i = 0; i < count && r == OW_OK; i++)
+            if (!devices[i].parasite)
+                r = onewire_run(bus, match_convert, devices[i].rom);
+        for (uint8_t i = 0; i < count && r == OW_OK; i++)
+            if (devices[i].parasite)
+                r = hold(devices[i].rom, devices[i].conv_ms);
+        if (r == OW_OK) ow_delay_until(start + (int64_t)slowestExt * 1000);
+    }
+
+    uint32_t took = (uint32_t)((ow_micros() - start) / 1000);
+    stats.bus_ms += took;
+    if (r != OW_OK) return r;
+    uint32_t fixed = (uint32_t)(parasites ? parasites : 1) * conv_time[3];
+    if (fixed > took) stats.saved_ms += fixed - took;
+    stats.rounds++;
+    stats.conversions += count;
+    return OW_OK;
+}
@@ -0,0 +1,96 @@
+#ifndef OneWireESP_parasite_h
+#define OneWireESP_parasite_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWireESP_bus.h"
+#include "OneWireESP_program.h"
+
+// Temperature conversions on a bus with parasite powered sensors
+// (DS18B20, DS18S20, DS1822, DS1825).
+//
+// A parasite powered sensor takes its conversion current from the data
+// line, so the line has to be driven high (write with 'power' set) for
+// the whole conversion and nothing else may use the bus meanwhile.
+// add_device() asks each sensor whether it is parasite powered (Read
+// Power Supply, 0xB4) and reads its resolution, which sets how long the
+// conversion, and so the pullup, actually has to last: from 94 ms at 9
+// bits up to 750 ms at 12.
+//
+// convert() starts a conversion on every device added:
+//  - with no parasite devices, one Skip ROM Convert T, then read slots
+//    until the sensors report they are done;
+//  - when all parasite devices fit the pullup current budget, one Skip
+//    ROM Convert T with the pullup held for the slowest resolution;
+//  - otherwise the externally powered ones are started first, then the
+//    parasite ones one at a time, each with a pullup only as long as its
+//    own resolution needs.
+// A duty limit below 100% keeps the line undriven between pullups for
+// long enough that the pullup is on at most that share of the time,
+// which leaves the bus to other users in the gaps.
+
+#ifndef ONEWIRE_PARASITE_DEVICES
+#define ONEWIRE_PARASITE_DEVICES 16
+#endif
+
+// Conversion current of one parasite sensor, in uA
+#ifndef ONEWIRE_PARASITE_UA
+#define ONEWIRE_PARASITE_UA 1500
+#endif
+
+struct OneWireParasiteStats {
+    uint32_t rounds;        // convert() calls completed
+    uint32_t conversions;   // devices converted
+    uint32_t pullup_ms;     // time the line was driven high
+    uint32_t bus_ms;        // time convert() held the bus
+    uint32_t saved_ms;      // against a 750 ms hold per parasite device
+};
+
+class OneWireParasite
+{
+  private:
+    struct Device {
+        uint8_t rom[8];
+        bool parasite;
+        uint16_t conv_ms;
+    };
+
+    OneWireBus bus;
+    uint16_t budget;        // mA, 0 for no limit
+    uint8_t duty;           // percent
+    Device devices[ONEWIRE_PARASITE_DEVICES];
+    uint8_t count;
+    int64_t nextPullup;     // earliest start of the next pullup
+    OneWireParasiteStats stats;
+
+    int find(const uint8_t rom[8]) const;
+    uint8_t hold(const uint8_t *rom, uint16_t ms);
+    void wait_done(uint16_t ms);
+
+  public:
+    // 'budget_ma' is what the strong pullup can supply, 0 for no limit.
+    // 'duty_pct' is the largest share of time the pullup may be on.
+    OneWireParasite(const OneWireBus &bus, uint16_t budget_ma = 0, uint8_t duty_pct = 100);
+
+    // Add a sensor, or refresh what is known about one: power supply
+    // and resolution.  OW_BAD_PROGRAM if ONEWIRE_PARASITE_DEVICES are
+    // already added.
+    uint8_t add_device(const uint8_t rom[8]);
+
+    // Whether 'rom' needs the strong pullup (false if not added)
+    bool parasite(const uint8_t rom[8]) const;
+    uint8_t parasite_count(void) const;
+
+    // Conversion time at the device's resolution, 0 if not added
+    uint16_t conversion_ms(const uint8_t rom[8]) const;
+
+    // Convert every added device.  Returns when all results can be read.
+    uint8_t convert(void);
+
+    const OneWireParasiteStats &get_stats() const { return stats; }
+    void clear_stats(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_parasite_h
@@ -0,0 +1,162 @@
+/*
+Power management hooks for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_pm.h"
+#include "utils/OneWireESP_port.h"
+#include <atomic>
+
+#if ONEWIRE_PM
+#include "esp_pm.h"
+#endif
+
+// No lock of our own: buses run side by side (OneWireShards) would all
+// meet on it.  'busy' counts the callers between begin and end that are
+// not in a wait; only its 0 to 1 and 1 to 0 steps take or give back the
+// esp_pm locks and touch the active time.  That is kept as the sum of
+// the times of the 1 to 0 steps less those of the 0 to 1 steps, so the
+// two can be added in any order.
+static std::atomic<uint32_t> busy;
+static std::atomic<int64_t> activeSum;
+static std::atomic<uint64_t> waitUs;
+static std::atomic<uint32_t> waits;
+
+#if ONEWIRE_PM
+struct PmLocks {
+    esp_pm_lock_handle_t cpu;
+    esp_pm_lock_handle_t sleep;
+    PmLocks() {
+        cpu = sleep = 0;
+        esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "onewire", &cpu);
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "onewire", &sleep);
+    }
+};
+
+static PmLocks &pm_locks(void)
+{
+    static PmLocks locks;       // created on first use
+    return locks;
+}
+
+static void pm_acquire(void)
+{
+    PmLocks &l = pm_locks();
+    if (l.cpu) esp_pm_lock_acquire(l.cpu);
+    if (l.sleep) esp_pm_lock_acquire(l.sleep);
+}
+
+static void pm_release(void)
+{
+    PmLocks &l = pm_locks();
+    if (l.sleep) esp_pm_lock_release(l.sleep);
+    if (l.cpu) esp_pm_lock_release(l.cpu);
+}
+
+void onewire_pm_keep_pin(gpio_num_t pin)
+{
+    gpio_sleep_sel_dis(pin);
+}
+#else
+static void pm_acquire(void) { }
+static void pm_release(void) { }
+
+#if defined(ESP_PLATFORM)
+// no light sleep, so nothing to keep
+void onewire_pm_keep_pin(gpio_num_t pin)
+{
+    (void)pin;
+}
+#endif
+#endif
+
+//
+// The first caller takes the esp_pm locks before it counts itself in, so
+// whoever finds 'busy' above 0 can go straight on to its slots; if
+// another one got in first meanwhile, it gives its own take back.
+//
+static void busy_up(void)
+{
+    uint32_t b = busy.load();
+    for (;;) {
+        if (b) {
+            if (busy.compare_exchange_weak(b, b + 1)) return;
+            continue;
+        }
+        pm_acquire();
+        int64_t now = ow_micros();
+        if (busy.compare_exchange_strong(b, 1)) {
+            activeSum -= now;
+            return;
+        }
+        pm_release();
+    }
+}
+
+// False for an end without a begin
+static bool busy_down(void)
+{
+    uint32_t b = busy.load();
+    do {
+        if (!b) return false;
+    } while (!busy.compare_exchange_weak(b, b - 1));
+    if (b == 1) {
+        activeSum += ow_micros();
+        pm_release();
+    }
+    return true;
+}
+
+void onewire_pm_bus_begin(void)
+{
+    busy_up();
+}
+
+void onewire_pm_bus_end(void)
+{
+    busy_down();
+}
+
+void onewire_pm_wait(uint32_t ms)
+{
+    int64_t start = ow_micros();
+
+    bool held = busy_down();
+    ow_delay_ms(ms);
+    if (held) busy_up();
+
+    waitUs += (uint64_t)(ow_micros() - start);
+    waits++;
+}
+
+OneWirePmStats onewire_pm_stats(void)
+{
+    OneWirePmStats s;
+    int64_t active = activeSum.load();
+    // a stretch still going counts up to now
+    if (busy.load()) active += ow_micros();
+    s.active_us = active > 0 ? (uint64_t)active : 0;
+    s.wait_us = waitUs.load();
+    s.waits = waits.load();
+    return s;
+}
+
+void onewire_pm_clear_stats(void)
+{
+    // a stretch still going starts again now
+    activeSum = busy.load() ? -ow_micros() : 0;
+    waitUs = 0;
+    waits = 0;
+}
+
+uint64_t onewire_pm_energy_uj(uint16_t mv, uint16_t active_ma, uint16_t wait_ua)
+{
+    OneWirePmStats stats = onewire_pm_stats();
+
+    // mV * mA * us = 1e-12 J, mV * uA * us = 1e-15 J.  Whole ms first,
+    // so a product of years of counters still fits in 64 bits.
+    uint64_t active = (uint64_t)mv * active_ma * (stats.active_us / 1000) / 1000 +
+                      (uint64_t)mv * active_ma * (stats.active_us % 1000) / 1000000;
+    uint64_t wait = (uint64_t)mv * wait_ua * (stats.wait_us / 1000) / 1000000 +
+                    (uint64_t)mv * wait_ua * (stats.wait_us % 1000) / 1000000000;
+    return active + wait;
+}
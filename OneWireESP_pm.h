@@ -0,0 +1,79 @@
+#ifndef OneWireESP_pm_h
+#define OneWireESP_pm_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+
+#if defined(ESP_PLATFORM)
+#include "sdkconfig.h"
+#include "driver/gpio.h"
+#endif
+
+// Light sleep during long bus waits.
+//
+// With power management enabled (CONFIG_PM_ENABLE and esp_pm_configure()
+// with light_sleep_enable) the chip light sleeps whenever every task is
+// blocked and nobody holds a power management lock.  Bit-banged time
+// slots must not be stretched by a clock change or a sleep, so
+// onewire_run() holds a lock (CPU at full speed, no light sleep) for the
+// time slots, and its OW_DELAY waits (conversions, EEPROM copies, strong
+// pullups) go through onewire_pm_wait(), which lets go of the lock for
+// the wait so the chip can sleep through it.
+//
+// A strong pullup must stay on while the chip sleeps.  Call
+// onewire_pm_keep_pin() once for every bus pin so the pin keeps its
+// normal configuration in light sleep instead of the sleep one.  It is
+// there without power management too, and then does nothing.
+//
+// OneWire::search1()/search2() hold the lock themselves.  The other
+// OneWire calls (reset1(), write1(), read1() and so on) do not: when
+// calling them directly, bracket the whole transaction with
+// onewire_pm_bus_begin() and onewire_pm_bus_end(), or a CPU clock change
+// can stretch a time slot.
+//
+// The counters split the time spent in onewire_run() into the part with
+// the lock held and the part spent waiting, for an estimate of the
+// energy a reading costs.  Active time is counted once however many
+// callers hold the lock at the same time; waits are summed over the
+// callers.  The bookkeeping is atomic counters with no lock of its own,
+// and only the first begin and the last end of callers running side by
+// side touch the esp_pm locks.  Without CONFIG_PM_ENABLE
+// (or with ONEWIRE_PM defined to 0) the lock calls do nothing and
+// onewire_pm_wait() is a plain sleep, but the counters still run.
+
+#ifndef ONEWIRE_PM
+#if defined(CONFIG_PM_ENABLE)
+#define ONEWIRE_PM 1
+#else
+#define ONEWIRE_PM 0
+#endif
+#endif
+
+struct OneWirePmStats {
+    uint64_t active_us;     // time with the lock held, less the waits
+    uint64_t wait_us;       // time in onewire_pm_wait()
+    uint32_t waits;         // onewire_pm_wait() calls
+};
+
+// Take and give back the lock around time slots.  Calls nest.
+void onewire_pm_bus_begin(void);
+void onewire_pm_bus_end(void);
+
+// Wait 'ms' with the lock let go.  Only between onewire_pm_bus_begin()
+// and onewire_pm_bus_end().
+void onewire_pm_wait(uint32_t ms);
+
+#if defined(ESP_PLATFORM)
+void onewire_pm_keep_pin(gpio_num_t pin);
+#endif
+
+OneWirePmStats onewire_pm_stats(void);
+void onewire_pm_clear_stats(void);
+
+// Energy used so far in uJ, from the supply voltage and the current
+// drawn while active and while waiting (light sleep when enabled)
+uint64_t onewire_pm_energy_uj(uint16_t mv, uint16_t active_ma, uint16_t wait_ua);
+
+#endif // __cplusplus
+#endif // OneWireESP_pm_h
@@ -0,0 +1,106 @@
+/*
+Presence pulse watcher for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_presence.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "hal/gpio_ll.h"
+#include "soc/gpio_struct.h"
+
+
+OneWirePresence::OneWirePresence(gpio_num_t p, uint32_t *pulses)
+{
+    pin = p;
+    signal = xSemaphoreCreateBinaryStatic(&signalBuf);
+    watching = false;
+    paused = 0;
+    fallTime = 0;
+    pulseTime = 0;
+    counter = pulses;
+}
+
+OneWirePresence::~OneWirePresence()
+{
+    end();
+    if (signal) vSemaphoreDelete(signal);
+}
+
+void IRAM_ATTR OneWirePresence::on_edge(void *arg)
+{
+    OneWirePresence *pr = (OneWirePresence *)arg;
+    int64_t now = esp_timer_get_time();
+
+    // read the level rather than trusting the edge, so a stale
+    // interrupt from before arm() cannot start a pulse
+    if (!gpio_ll_get_level(&GPIO, pr->pin)) {
+        pr->fallTime = now;
+        return;
+    }
+    if (!pr->fallTime) return;
+    int64_t width = now - pr->fallTime;
+    pr->fallTime = 0;
+    if (width < ONEWIRE_PULSE_MIN_US || width > ONEWIRE_PULSE_MAX_US) return;
+
+    BaseType_t woken = pdFALSE;
+    if (pr->counter) (*pr->counter)++;
+    pr->pulseTime = now;
+    xSemaphoreGiveFromISR(pr->signal, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void OneWirePresence::arm(void)
+{
+    if (!watching || paused) return;
+    fallTime = 0;
+    gpio_intr_enable(pin);
+}
+
+void OneWirePresence::disarm(void)
+{
+    if (watching) gpio_intr_disable(pin);
+}
+
+void OneWirePresence::pause(void)
+{
+    paused++;
+    disarm();
+}
+
+void OneWirePresence::resume(void)
+{
+    if (paused && --paused == 0) arm();
+}
+
+bool OneWirePresence::begin(void)
+{
+    esp_err_t err;
+
+    if (!signal) return false;
+    if (watching) return true;
+
+    // the ISR service may already be installed by the application
+    err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) return false;
+    if (gpio_set_intr_type(pin, GPIO_INTR_ANYEDGE) != ESP_OK) return false;
+    if (gpio_isr_handler_add(pin, on_edge, this) != ESP_OK) return false;
+    gpio_intr_disable(pin);
+
+    watching = true;
+    return true;
+}
+
+void OneWirePresence::end(void)
+{
+    if (!watching) return;
+    disarm();
+    watching = false;
+    gpio_isr_handler_remove(pin);
+    gpio_set_intr_type(pin, GPIO_INTR_DISABLE);
+}
+
+bool OneWirePresence::wait(TickType_t ticks)
+{
+    return xSemaphoreTake(signal, ticks) == pdTRUE;
+}
@@ -0,0 +1,70 @@
+#ifndef OneWireESP_presence_h
+#define OneWireESP_presence_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Presence pulse watcher for an idle bus, shared by OneWireHotplug and
+// OneWireTouch.
+//
+// A device that comes onto an idle bus announces itself with a presence
+// pulse, a 60-240uS low, without being asked.  OneWirePresence times
+// every low on the pin with an edge interrupt while it is armed, and one
+// of presence pulse length wakes wait().
+//
+// Its owner's own bus traffic has slots that look like presence pulses,
+// so the owner disarms it around every transaction and arms it again
+// after.  pause() and resume() do the same for traffic the owner does
+// not make itself; while paused, arm() does nothing.
+
+// A presence pulse is 60-240uS low; allow some slack either side
+#define ONEWIRE_PULSE_MIN_US    50
+#define ONEWIRE_PULSE_MAX_US    300
+
+class OneWirePresence
+{
+  private:
+    gpio_num_t pin;
+    SemaphoreHandle_t signal;
+    StaticSemaphore_t signalBuf;
+    bool watching;                  // between begin() and end()
+    uint8_t paused;                 // pause() nesting
+    volatile int64_t fallTime;      // start of the current low, 0 if none
+    volatile int64_t pulseTime;     // end of the last presence pulse
+    uint32_t *counter;
+
+    static void on_edge(void *arg);
+
+  public:
+    // 'pulses', if given, is counted up for every presence pulse
+    OneWirePresence(gpio_num_t pin, uint32_t *pulses = 0);
+    ~OneWirePresence();
+
+    // Install the edge interrupt, disarmed.  Returns false if it could
+    // not be set up.
+    bool begin(void);
+    void end(void);
+    bool active(void) const { return watching; }
+
+    // Enable and disable the interrupt around the owner's traffic
+    void arm(void);
+    void disarm(void);
+
+    // Keep it disarmed across traffic the owner does not make.  Calls
+    // nest; the last resume() arms it again.
+    void pause(void);
+    void resume(void);
+
+    // Wait up to 'ticks' for a presence pulse.  True if one was seen.
+    bool wait(TickType_t ticks);
+
+    // esp_timer time of the end of the last presence pulse
+    int64_t last_pulse(void) const { return pulseTime; }
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_presence_h
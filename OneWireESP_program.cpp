@@ -0,0 +1,419 @@
+/*
+Transaction program engine for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_program.h"
+#include "OneWireESP.h"
+#include "OneWireESP_pm.h"
+#include "utils/OneWireESP_port.h"
+#include <string.h>
+
+#if defined(ESP_PLATFORM)
+#include "esp_attr.h"
+#else
+#define IRAM_ATTR
+#endif
+
+const uint8_t onewire_prog_read_rom[] = {
+    OW_RESET,
+    OW_WRITE, 1, 0x33,
+    OW_READ, 8,
+    OW_CRC8, 8,
+    OW_END
+};
+
+const uint8_t onewire_prog_convert_all[] = {
+    OW_RESET, OW_SKIP,
+    OW_WRITE, 1, 0x44,
+    OW_END
+};
+
+const uint8_t onewire_prog_read_scratch[] = {
+    OW_RESET, OW_MATCH,
+    OW_WRITE, 1, 0xBE,
+    OW_READ, 9,
+    OW_CRC8, 9,
+    OW_END
+};
+
+static uint8_t run(const OneWireBus &bus, OneWireProgramPos &pos, const uint8_t *rom)
+{
+    const uint8_t *prog = pos.prog;
+    const uint8_t *tx = pos.tx;
+    uint8_t *rx = pos.rx;
+    uint8_t *rxstart = rx;
+    uint16_t crc = 0;           // running CRC16 of the current data block
+    bool power = false;         // OW_PULLUP pending or in effect
+    uint8_t buf[9];
+    uint8_t n;
+
+    for (;;) {
+        switch (*prog++) {
+        case OW_END:
+            onewire_flush(bus);
+            return OW_OK;
+
+        case OW_RESET:
+            pos.prog = prog - 1;
+            pos.tx = tx;
+            pos.rx = rx;
+            if (!bus.reset(bus.ctx)) return OW_NO_PRESENCE;
+            crc = 0;
+            break;
+
+        case OW_MATCH:
+            if (!rom) return OW_BAD_PROGRAM;
+            buf[0] = 0x55;
+            memcpy(&buf[1], rom, 8);
+            bus.write_bytes(bus.ctx, buf, 9, false);
+            crc = 0;
+            break;
+
+        case OW_SKIP:
+            buf[0] = 0xCC;
+            bus.write_bytes(bus.ctx, buf, 1, false);
+            crc = 0;
+            break;
+
+        case OW_RESUME:
+            buf[0] = 0xA5;
+            bus.write_bytes(bus.ctx, buf, 1, false);
+            crc = 0;
+            break;
+
+        case OW_WRITE:
+            n = *prog++;
+            bus.write_bytes(bus.ctx, prog, n, power);
+            crc = OneWire::crc16(prog, n, crc);
+            prog += n;
+            break;
+
+        case OW_WRITE_TX:
+            n = *prog++;
+            bus.write_bytes(bus.ctx, tx, n, power);
+            crc = OneWire::crc16(tx, n, crc);
+            tx += n;
+            break;
+
+        case OW_READ:
+            n = *prog++;
+            bus.read_bytes(bus.ctx, rx, n);
+            crc = OneWire::crc16(rx, n, crc);
+            rx += n;
+            break;
+
+        case OW_CRC8:
+            n = *prog++;
+            if (rx - rxstart < n) return OW_BAD_PROGRAM;
+            // a block followed by its own CRC8 sums to zero
+            if (OneWire::crc8(rx - n, n) != 0) return OW_CRC_ERROR;
+            break;
+
+        case OW_CRC16:
+            // and a block followed by its inverted CRC16 sums to 0xB001
+            if (crc != 0xB001) return OW_CRC_ERROR;
+            crc = 0;
+            break;
+
+        case OW_PULLUP:
+            power = true;
+            break;
+
+        case OW_DELAY: {
+            uint16_t ms = prog[0] | (prog[1] << 8);
+            prog += 2;
+            // what was written must be on the bus before the wait
+            onewire_flush(bus);
+            onewire_pm_wait(ms);
+            if (power) {
+                bus.depower(bus.ctx);
+                power = false;
+            }
+            break;
+        }
+
+        default:
+            return OW_BAD_PROGRAM;
+        }
+    }
+}
+
+int32_t onewire_prog_rx_len(const uint8_t *prog)
+{
+    int32_t len = 0;
+
+    for (;;) {
+        switch (*prog++) {
+        case OW_END:
+            return len;
+        case OW_READ:
+            len += *prog++;
+            break;
+        case OW_WRITE:
+            prog += 1 + *prog;
+            break;
+        case OW_WRITE_TX:
+        case OW_CRC8:
+            prog++;
+            break;
+        case OW_DELAY:
+            prog += 2;
+            break;
+        case OW_RESET:
+        case OW_MATCH:
+        case OW_SKIP:
+        case OW_RESUME:
+        case OW_CRC16:
+        case OW_PULLUP:
+            break;
+        default:
+            return -1;
+        }
+    }
+}
+
+uint8_t onewire_run(const OneWireBus &bus, const uint8_t *prog,
+                    const uint8_t *rom, const uint8_t *tx, uint8_t *rx)
+{
+    OneWireProgramPos pos = { prog, tx, rx };
+    return onewire_resume(bus, pos, rom);
+}
+
+uint8_t onewire_resume(const OneWireBus &bus, OneWireProgramPos &pos, const uint8_t *rom)
+{
+    // no light sleep or clock change in the middle of a time slot, but
+    // OW_DELAY lets the chip sleep
+    onewire_pm_bus_begin();
+    uint8_t r = run(bus, pos, rom);
+    onewire_pm_bus_end();
+    return r;
+}
+
+uint8_t onewire_transfer(const OneWireBus &bus, const OneWireSegment *segs, uint16_t count)
+{
+    static const uint8_t match = 0x55, skip = 0xCC;
+    uint8_t r = OW_OK;
+
+    onewire_pm_bus_begin();
+    for (uint16_t i = 0; i < count && r == OW_OK; i++) {
+        const OneWireSegment &seg = segs[i];
+        uint32_t left = seg.len;
+        uint32_t done = 0;
+
+        switch (seg.type) {
+        case OW_SEG_RESET:
+            if (!bus.reset(bus.ctx)) r = OW_NO_PRESENCE;
+            break;
+
+        case OW_SEG_MATCH:
+            if (!seg.tx) {
+                r = OW_BAD_PROGRAM;
+                break;
+            }
+            bus.write_bytes(bus.ctx, &match, 1, false);
+            bus.write_bytes(bus.ctx, seg.tx, 8, false);
+            break;
+
+        case OW_SEG_SKIP:
+            bus.write_bytes(bus.ctx, &skip, 1, false);
+            break;
+
+        case OW_SEG_WRITE:
+            while (left) {
+                uint16_t n = left > 0xFFFF ? 0xFFFF : (uint16_t)left;
+                left -= n;
+                // only the last byte of the segment leaves the pullup on
+                bus.write_bytes(bus.ctx, seg.tx + done, n, seg.power && !left);
+                done += n;
+            }
+            break;
+
+        case OW_SEG_READ:
+            while (left) {
+                uint16_t n = left > 0xFFFF ? 0xFFFF : (uint16_t)left;
+                bus.read_bytes(bus.ctx, seg.rx + done, n);
+                left -= n;
+                done += n;
+            }
+            break;
+
+        default:
+            r = OW_BAD_PROGRAM;
+            break;
+        }
+    }
+    onewire_flush(bus);
+    onewire_pm_bus_end();
+    return r;
+}
+
+void onewire_flush(const OneWireBus &bus)
+{
+    if (bus.flush) bus.flush(bus.ctx);
+}
+
+void onewire_search_reset(OneWireSearchState &state)
+{
+    memset(&state, 0, sizeof(state));
+}
+
+void onewire_search_target(OneWireSearchState &state, uint8_t family)
+{
+    // follow the family code at every branch of the first 8 bits, then
+    // take 0 at the first branch of the serial number
+    memset(&state, 0, sizeof(state));
+    state.rom[0] = family;
+    state.last_discrepancy = 64;
+    state.target = true;
+}
+
+void onewire_search_skip_family(OneWireSearchState &state)
+{
+    state.last_discrepancy = state.last_family_discrepancy;
+    state.last_family_discrepancy = 0;
+
+    // no branch left in the family code: this was the last family
+    if (state.last_discrepancy == 0)
+        state.last_device = true;
+}
+
+// The way a search pass takes at a discrepancy on each bit, bit 0 for
+// ROM bit 1: the previous path below last_discrepancy, 1 at it and 0
+// above it.  Worked out once per pass, so a triplet only shifts it.
+static inline uint64_t search_choice(const uint8_t rom[8], uint8_t last_discrepancy)
+{
+    uint64_t path = 0;
+    for (int i = 7; i >= 0; i--) path = (path << 8) | rom[i];
+    if (last_discrepancy == 0) return 0;
+    uint64_t at = 1ULL << (last_discrepancy - 1);
+    return (path & (at - 1)) | at;
+}
+
+uint8_t IRAM_ATTR onewire_triplet(const OneWireBus &bus, uint8_t direction)
+{
+    if (bus.triplet) return bus.triplet(bus.ctx, direction);
+
+    uint8_t id_bit = bus.read_bit(bus.ctx);
+    uint8_t cmp_id_bit = bus.read_bit(bus.ctx);
+    if (id_bit & cmp_id_bit) return 3;
+    // devices disagree: take 'direction', else the only way there is
+    if (id_bit != cmp_id_bit) direction = id_bit;
+    bus.write_bit(bus.ctx, direction);
+    return id_bit | cmp_id_bit << 1 | direction << 2;
+}
+
+bool onewire_search(const OneWireBus &bus, OneWireSearchState &state, uint8_t *newAddr,
+                    bool search_mode, OneWireSearchStats *stats)
+{
+    const uint8_t cmd = search_mode ? 0xF0 : 0xEC;     // normal or conditional search
+    OneWireSearchStats unused;
+    OneWireSearchStats &st = stats ? *stats : unused;
+    bool found = false, vanished, recheck = false, empty = false;
+    uint64_t rom = 0, zeros, bit, choice;
+    uint8_t n, t, taken, crc, attempt = 0;
+
+    // state at the start of the pass, to go back to on a bad pass
+    OneWireSearchState start = state;
+
+    while (!state.last_device) {
+        int64_t t0 = ow_micros();
+        uint32_t start_slots = st.slots;
+        st.passes++;
+
+        if (!bus.reset(bus.ctx)) {
+            st.bus_us += (uint32_t)(ow_micros() - t0);
+            break;
+        }
+        bus.write_bytes(bus.ctx, &cmd, 1, false);
+
+        // the way to take at a discrepancy on every bit, worked out
+        // before the pass
+        choice = search_choice(state.rom, state.last_discrepancy);
+        rom = 0;
+        zeros = 0;
+        bit = 1;
+        crc = 0;
+        vanished = false;
+
+        // one triplet per ROM bit, LSB first, with the CRC8 of the bits
+        // taken kept as they come
+        for (n = 0; n < 64; n++, bit <<= 1, choice >>= 1) {
+            t = onewire_triplet(bus, (uint8_t)(choice & 1));
+            if (t == 3) {                       // nobody answered
+                st.slots += 2;
+                break;
+            }
+            st.slots += 3;
+            taken = (t >> 2) & 1;
+            if (taken) rom |= bit;
+            else if (!(t & 3)) zeros |= bit;    // a discrepancy, 0 taken
+            crc = (crc >> 1) ^ (((crc ^ taken) & 1) ? 0x8C : 0);
+
+            // Only the 0 side answered where the path this pass follows
+            // took 1: the devices it came for have gone (or the bit was
+            // misread).  Going on would walk the 0 side a second time.
+            // A path set by onewire_search_target() is a wish, not a way
+            // devices took.
+            if ((choice & 1) && !taken && !state.target) {
+                vanished = true;
+                break;
+            }
+        }
+        st.bus_us += (uint32_t)(ow_micros() - t0);
+
+        // the path taken, for the next pass to follow
+        for (uint8_t i = 0; i < 8; i++) state.rom[i] = (uint8_t)(rom >> (8 * i));
+        state.target = false;
+        // highest bit where 0 was picked, in the family code and in all
+        if ((uint8_t)zeros)
+            state.last_family_discrepancy = 32 - __builtin_clz((uint8_t)zeros);
+
+        // a ROM code followed by its own CRC8 leaves it zero
+        if (n == 64 && crc == 0) {
+            state.last_discrepancy = zeros ? 64 - __builtin_clzll(zeros) : 0;
+            if (state.last_discrepancy == 0) state.last_device = true;
+            found = true;
+            break;
+        }
+
+        // A branch that is still gone on a second look is given up: go
+        // on from the highest branch below it that this pass took 0 at,
+        // or end the enumeration if there is none.
+        if (vanished && (recheck || attempt == ONEWIRE_SEARCH_RETRIES)) {
+            recheck = false;
+            attempt = 0;
+            state.last_discrepancy = zeros ? 64 - __builtin_clzll(zeros) : 0;
+            if (state.last_discrepancy == 0) break;
+            start = state;
+            continue;
+        }
+
+        // No device at all (or none in alarm) answers 1/1 at the first
+        // bit, but so does a misread one: it ends the search only when
+        // the pass after it gets the same.  Anything else short of a full
+        // ROM with a good CRC, a vanished branch at the first bit too, is
+        // a disturbed pass: go back to where it started and take the
+        // same path again.
+        bool none = n == 0 && t == 3;
+        if ((none && empty) || attempt++ == ONEWIRE_SEARCH_RETRIES) break;
+        empty = none;
+        recheck = vanished;
+        st.retries++;
+        st.retry_slots += st.slots - start_slots;
+        state = start;
+    }
+
+    // A bus held low reads as a discrepancy at every bit and produces an
+    // all-zero ROM, which also has a good CRC.  Only that is rejected: a
+    // zero family code on its own is still a valid device and must not
+    // end the enumeration.
+    if (found && rom == 0) found = false;
+
+    if (!found) {
+        onewire_search_reset(state);
+        return false;
+    }
+    memcpy(newAddr, state.rom, 8);
+    st.devices++;
+    return true;
+}
@@ -0,0 +1,193 @@
+#ifndef OneWireESP_program_h
+#define OneWireESP_program_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWireESP_bus.h"
+
+// Transaction programs.
+//
+// A device access is nearly always the same shape: reset, select, a
+// command, maybe some bytes out, some bytes back, a CRC check.  Instead
+// of making each of those calls by hand, describe the access once as a
+// byte string and hand it to onewire_run(), which executes the whole
+// thing against any OneWireBus.  Programs are plain const arrays, so
+// they are built at compile time and live in flash:
+//
+//    // Read a DS18B20 scratchpad and check its CRC
+//    static const uint8_t read_temp[] = {
+//        OW_RESET, OW_MATCH,
+//        OW_WRITE, 1, 0xBE,
+//        OW_READ, 9,
+//        OW_CRC8, 9,
+//        OW_END
+//    };
+//    uint8_t data[9];
+//    if (onewire_run(ow.bus1(), read_temp, rom, 0, data) == OW_OK) ...
+//
+// OW_WRITE bytes come from the program itself, OW_WRITE_TX bytes from
+// the 'tx' argument and OW_READ bytes go to 'rx'.  Both pointers advance
+// through the program, so one call can send and receive several blocks.
+
+// Opcodes.  Operand bytes follow the opcode.
+#define OW_END          0x00    // end of program
+#define OW_RESET        0x01    // reset pulse, fails with OW_NO_PRESENCE
+#define OW_MATCH        0x02    // Match ROM (0x55) with the 'rom' argument
+#define OW_SKIP         0x03    // Skip ROM (0xCC)
+#define OW_RESUME       0x04    // Resume (0xA5)
+#define OW_WRITE        0x05    // n, n bytes: write bytes from the program
+#define OW_WRITE_TX     0x06    // n: write n bytes from 'tx'
+#define OW_READ         0x07    // n: read n bytes into 'rx'
+#define OW_CRC8         0x08    // n: the last n bytes read must have a good CRC8
+#define OW_CRC16        0x09    // the last two bytes read are the inverted CRC16
+                                //    of everything written and read since the
+                                //    ROM command or the previous OW_CRC16
+#define OW_PULLUP       0x0A    // drive the line high after every OW_WRITE and
+                                //    OW_WRITE_TX from here to the next OW_DELAY
+#define OW_DELAY        0x0B    // lo, hi: wait milliseconds, then drop any pullup
+
+// Helper for the two byte OW_DELAY operand
+#define OW_DELAY_MS(ms) OW_DELAY, (uint8_t)((ms) & 0xFF), (uint8_t)((ms) >> 8)
+
+// Results from onewire_run()
+#define OW_OK           0
+#define OW_NO_PRESENCE  1       // no presence pulse after OW_RESET
+#define OW_CRC_ERROR    2       // OW_CRC8 or OW_CRC16 check failed
+#define OW_BAD_PROGRAM  3       // unknown opcode, or OW_MATCH without a ROM
+#define OW_BUS_SHORT    4       // no presence and the line stays low (OneWireRetry)
+#define OW_BUS_BACKOFF  5       // not tried, the bus was shorted a moment ago
+
+// Results used by the device drivers
+#define OW_VERIFY_ERROR 0x10    // data read back or confirmation byte did not match
+#define OW_COPY_ERROR   0x11    // copy to memory not confirmed
+#define OW_BAD_ADDRESS  0x12    // address outside the device or not aligned
+#define OW_UNKNOWN_DEVICE 0x13  // device not found by OneWireTopology::discover()
+#define OW_SWITCH_ERROR 0x14    // coupler did not confirm a switch command
+#define OW_MAC_ERROR    0x15    // authenticator MAC did not match, or was refused
+#define OW_BUSY         0x16    // an earlier command has not been finished yet
+
+// Run 'prog' on 'bus'.  'rom' is used by OW_MATCH, 'tx' by OW_WRITE_TX
+// and 'rx' by OW_READ; pass 0 for any the program does not use.
+uint8_t onewire_run(const OneWireBus &bus, const uint8_t *prog,
+                    const uint8_t *rom = 0, const uint8_t *tx = 0, uint8_t *rx = 0);
+
+// Where a program stands: the next opcode and the 'tx' and 'rx' data
+// pointers.  onewire_resume() runs from 'pos' and, at every OW_RESET,
+// moves 'pos' to that reset, so after a failure it holds the start of
+// the phase that failed and running it again retakes only that phase.
+struct OneWireProgramPos {
+    const uint8_t *prog;
+    const uint8_t *tx;
+    uint8_t *rx;
+};
+
+uint8_t onewire_resume(const OneWireBus &bus, OneWireProgramPos &pos, const uint8_t *rom = 0);
+
+// Number of bytes 'prog' reads into 'rx' in all, or -1 if it has an
+// unknown opcode.  For checking a receive buffer against a program.
+int32_t onewire_prog_rx_len(const uint8_t *prog);
+
+// Commonly used programs
+extern const uint8_t onewire_prog_read_rom[];       // Read ROM (0x33), 8 bytes + CRC8 -> rx
+extern const uint8_t onewire_prog_convert_all[];    // Skip ROM, Convert T (0x44)
+extern const uint8_t onewire_prog_read_scratch[];   // Match ROM, Read Scratchpad, 9 bytes + CRC8 -> rx
+
+// Scatter-gather transfers.
+//
+// Where a transaction program takes its data from one 'tx' and one 'rx'
+// buffer, onewire_transfer() takes a list of segments, each with its own
+// pointer, so a command header, a payload and the fields of a reply can
+// each come from or land in the caller's own structures without being
+// gathered into a buffer first:
+//
+//    uint8_t cmd[3] = { 0xF0, (uint8_t)addr, (uint8_t)(addr >> 8) };  // Read Memory
+//    OneWireSegment segs[] = {
+//        { OW_SEG_RESET, 0, 0, 0, 0 },
+//        { OW_SEG_MATCH, 0, 8, rom, 0 },
+//        { OW_SEG_WRITE, 0, 3, cmd, 0 },
+//        { OW_SEG_READ, 0, sizeof(pkt->payload), 0, pkt->payload },
+//    };
+//    onewire_transfer(ow.bus1(), segs, 4);
+//
+// Lengths are 32 bit; longer segments are passed to the bus in 64KiB-1
+// pieces, so a memory read can stream any length straight to its
+// destination.
+
+#define OW_SEG_RESET    0       // reset pulse, fails with OW_NO_PRESENCE
+#define OW_SEG_MATCH    1       // Match ROM with the 8 bytes at 'tx'
+#define OW_SEG_SKIP     2       // Skip ROM
+#define OW_SEG_WRITE    3       // write 'len' bytes from 'tx'
+#define OW_SEG_READ     4       // read 'len' bytes into 'rx'
+
+struct OneWireSegment {
+    uint8_t type;
+    uint8_t power;          // WRITE: leave the line driven high afterwards
+    uint32_t len;
+    const uint8_t *tx;
+    uint8_t *rx;
+};
+
+uint8_t onewire_transfer(const OneWireBus &bus, const OneWireSegment *segs, uint16_t count);
+
+// ROM search over a bus table.  This is the library's one implementation
+// of the search algorithm: OneWire::search1()/search2() and
+// OneWireDS2482::search() call it with their own state.
+//
+// Zero the state (or call onewire_search_reset()) to start from the
+// first device; each onewire_search() call finds the next one, and
+// returns false once all have been found or on a bus error.  The CRC8 of
+// the ROM is kept bit by bit as the pass goes.  A pass with a bad CRC8,
+// or one that breaks off partway, is taken again from where it started,
+// up to ONEWIRE_SEARCH_RETRIES times.  A pass that finds the devices of
+// its path gone (only the 0 side answers where the path took 1) is taken
+// once more, and if they are still gone the search goes on from the
+// branch below, so a device that leaves or a misread never makes a
+// device come back twice.  Nothing answering at the first bit ends the
+// search only when the pass after it gets the same.  'search_mode'
+// false makes it a Conditional (alarm) Search.  If 'stats' is given the
+// pass is counted there.  A bus with a triplet call takes one call per
+// ROM bit instead of three.
+
+// Running totals of onewire_search(), so the cost of enumerating a bus
+// can be measured.  slots counts read and write time slots (three per
+// ROM bit), bus_us is the wall time spent inside the search calls.
+struct OneWireSearchStats {
+    uint32_t passes;      // search passes started (one reset each)
+    uint32_t devices;     // passes that returned a device
+    uint32_t slots;       // bit time slots issued
+    uint32_t bus_us;      // microseconds spent searching
+    uint32_t retries;     // passes retaken after a bad CRC or a broken pass
+    uint32_t retry_slots; // slots spent on the passes that were retaken
+};
+
+struct OneWireSearchState {
+    uint8_t rom[8];
+    uint8_t last_discrepancy;           // ROM bit (1-64) of the next branch, 0 for none
+    uint8_t last_family_discrepancy;    // the same within the family code
+    bool last_device;
+    bool target;                        // rom is from onewire_search_target()
+};
+
+void onewire_search_reset(OneWireSearchState &state);
+bool onewire_search(const OneWireBus &bus, OneWireSearchState &state, uint8_t *rom,
+                    bool search_mode = true, OneWireSearchStats *stats = 0);
+
+// One ROM search step on 'bus': its triplet call, or two read slots and
+// a write slot if it has none.  Returns the OneWireBus::triplet encoding.
+uint8_t onewire_triplet(const OneWireBus &bus, uint8_t direction);
+
+// Send whatever 'bus' holds back (OneWireBus::flush), if it does.  For
+// drivers that make raw calls on the table after onewire_run().
+void onewire_flush(const OneWireBus &bus);
+
+// Make the next onewire_search() start at the first device of 'family'
+// (or, if there is none, of the next family up)
+void onewire_search_target(OneWireSearchState &state, uint8_t family);
+
+// Go on past the family of the device onewire_search() just returned:
+// the next one starts at the next family
+void onewire_search_skip_family(OneWireSearchState &state);
+
+#endif // __cplusplus
+#endif // OneWireESP_program_h
@@ -0,0 +1,91 @@
+/*
+Retrying transactions for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_retry.h"
+#include "OneWireESP_pm.h"
+#include "utils/OneWireESP_port.h"
+#include <string.h>
+
+static const OneWireRetryPolicy default_policy = { 3, false, 0 };
+
+
+OneWireRetry::OneWireRetry(const OneWireBus &b, const OneWireRetryPolicy *p, uint16_t holdoff_ms)
+{
+    bus = b;
+    policy = p ? *p : default_policy;
+    holdoff = holdoff_ms;
+    shorted = false;
+    shortTime = 0;
+    clear_stats();
+}
+
+void OneWireRetry::clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool OneWireRetry::faulted(void)
+{
+    if (shorted && ow_micros() - shortTime >= (int64_t)holdoff * 1000)
+        shorted = false;
+    return shorted;
+}
+
+// After a reset without presence: an idle line is pulled up and reads
+// 1, a shorted one stays at 0.  Two slots, so one disturbed slot does
+// not count as a short.
+bool OneWireRetry::line_low(void)
+{
+    onewire_pm_bus_begin();
+    bool low = !bus.read_bit(bus.ctx) && !bus.read_bit(bus.ctx);
+    onewire_pm_bus_end();
+    return low;
+}
+
+uint8_t OneWireRetry::run(const uint8_t *prog, const uint8_t *rom, const uint8_t *tx,
+                          uint8_t *rx, const OneWireRetryPolicy *p)
+{
+    const OneWireRetryPolicy &pol = p ? *p : policy;
+    OneWireProgramPos start = { prog, tx, rx };
+    OneWireProgramPos pos = start;
+    uint8_t r;
+
+    stats.transactions++;
+    if (faulted()) {
+        stats.backoffs++;
+        stats.failed++;
+        return OW_BUS_BACKOFF;
+    }
+
+    for (uint8_t attempt = 1; ; attempt++) {
+        r = onewire_resume(bus, pos, rom);
+        if (r == OW_OK) {
+            if (attempt > 1) stats.recovered++;
+            return OW_OK;
+        }
+
+        if (r == OW_NO_PRESENCE) {
+            if (line_low()) {
+                shorted = true;
+                shortTime = ow_micros();
+                stats.shorts++;
+                r = OW_BUS_SHORT;
+                break;
+            }
+            stats.no_presence++;
+        } else if (r == OW_CRC_ERROR) {
+            stats.crc_errors++;
+        } else {
+            break;                  // a program or device error, retrying won't help
+        }
+
+        if (attempt >= pol.attempts) break;
+        stats.retries++;
+        // 'pos' is at the reset that started the failed phase
+        if (pol.whole) pos = start;
+        ow_delay_ms(pol.backoff_ms);
+    }
+    stats.failed++;
+    return r;
+}
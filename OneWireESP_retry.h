@@ -0,0 +1,76 @@
+#ifndef OneWireESP_retry_h
+#define OneWireESP_retry_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWireESP_bus.h"
+#include "OneWireESP_program.h"
+
+// Transaction programs with retries and bus fault detection.
+//
+// OneWireRetry runs onewire_run() programs on one bus and retakes the
+// ones that fail with OW_NO_PRESENCE or OW_CRC_ERROR, as set by a
+// retry policy.  By default only the failing phase is run again: the
+// program from its last OW_RESET on, so a CRC error while reading the
+// scratchpad does not start another conversion.
+//
+// A reset without a presence pulse is either an empty bus or a line
+// held low.  In the second case two read slots after the reset read 0
+// as well, which sets them apart; the program then fails at once with
+// OW_BUS_SHORT, without retries, and every run() in the next
+// 'holdoff_ms' fails with OW_BUS_BACKOFF without touching the bus.  The
+// first run() after that tries the bus again.
+//
+//    static const OneWireRetryPolicy persistent = { 5, false, 10 };
+//    OneWireRetry retry(ow.bus1());
+//    uint8_t r = retry.run(onewire_prog_read_scratch, rom, 0, data, &persistent);
+
+struct OneWireRetryPolicy {
+    uint8_t attempts;       // tries in all, 1 for no retry
+    bool whole;             // retake the whole program, not the failing phase
+    uint16_t backoff_ms;    // wait before each retry
+};
+
+struct OneWireRetryStats {
+    uint32_t transactions;  // run() calls
+    uint32_t retries;       // retaken phases or programs
+    uint32_t recovered;     // transactions that succeeded after a retry
+    uint32_t no_presence;   // attempts failed with OW_NO_PRESENCE
+    uint32_t crc_errors;    // attempts failed with OW_CRC_ERROR
+    uint32_t shorts;        // OW_BUS_SHORT results
+    uint32_t backoffs;      // OW_BUS_BACKOFF results
+    uint32_t failed;        // transactions that did not return OW_OK
+};
+
+class OneWireRetry
+{
+  private:
+    OneWireBus bus;
+    OneWireRetryPolicy policy;
+    uint16_t holdoff;       // ms
+    bool shorted;
+    int64_t shortTime;      // when the short was seen
+    OneWireRetryStats stats;
+
+    bool line_low(void);
+
+  public:
+    // 'policy' is used by run() calls that do not give their own; the
+    // default is three tries of the failing phase with no wait.
+    OneWireRetry(const OneWireBus &bus, const OneWireRetryPolicy *policy = 0,
+                 uint16_t holdoff_ms = 1000);
+
+    // onewire_run() with retries.  Returns the result of the last try.
+    uint8_t run(const uint8_t *prog, const uint8_t *rom = 0, const uint8_t *tx = 0,
+                uint8_t *rx = 0, const OneWireRetryPolicy *policy = 0);
+
+    // True while run() backs off from a short
+    bool faulted(void);
+
+    const OneWireRetryStats &get_stats() const { return stats; }
+    void clear_stats(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_retry_h
@@ -0,0 +1,188 @@
+/*
+Multi-bus sampling scheduler for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_scheduler.h"
+#include "OneWireESP_program.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+OneWireScheduler::OneWireScheduler(OneWireSampleCallback cb, void *arg)
+{
+    deviceCount = 0;
+    busCount = 0;
+    callback = cb;
+    callbackArg = arg;
+    clear_stats();
+}
+
+int8_t OneWireScheduler::add_bus(const OneWireBus &bus, uint16_t conversion_ms)
+{
+    if (busCount >= ONEWIRE_SCHED_MAX_BUSES) return -1;
+    Bus &b = buses[busCount];
+    b.bus = bus;
+    b.conversion_us = (uint32_t)conversion_ms * 1000;
+    b.converting = false;
+    b.ready = 0;
+    memset(&b.stats, 0, sizeof(b.stats));
+    return busCount++;
+}
+
+bool OneWireScheduler::add_device(uint8_t bus, const uint8_t rom[8], uint32_t period_ms)
+{
+    if (bus >= busCount || deviceCount >= ONEWIRE_SCHED_MAX_DEVICES) return false;
+    Device &d = devices[deviceCount++];
+    memcpy(d.rom, rom, 8);
+    d.bus = bus;
+    d.pending = false;
+    d.period_us = (int64_t)period_ms * 1000;
+    // first sample as soon as a conversion can be done
+    d.due = esp_timer_get_time() + buses[bus].conversion_us;
+    return true;
+}
+
+uint8_t OneWireScheduler::transact(uint8_t b, const uint8_t *prog, const uint8_t *rom, uint8_t *rx)
+{
+    int64_t start = esp_timer_get_time();
+    uint8_t r = onewire_run(buses[b].bus, prog, rom, 0, rx);
+    buses[b].stats.busy_us += esp_timer_get_time() - start;
+    return r;
+}
+
+//
+// Do the next piece of work on one bus, if any is due.  Returns the time
+// at which this bus next needs attention.
+//
+int64_t OneWireScheduler::service(uint8_t b, int64_t now)
+{
+    Bus &bs = buses[b];
+    uint8_t i;
+
+    for (i = 0; i < deviceCount; i++) {
+        Device &d = devices[i];
+        if (d.bus != b || d.pending) continue;
+        // a whole period went by without a sample
+        while (now >= d.due + d.period_us) {
+            d.due += d.period_us;
+            bs.stats.missed++;
+        }
+    }
+
+    if (bs.converting) {
+        if (now < bs.ready) return bs.ready;
+
+        // read one converted device per call, so other buses get a turn
+        for (i = 0; i < deviceCount; i++) {
+            Device &d = devices[i];
+            if (d.bus != b || !d.pending) continue;
+
+            uint8_t scratch[9];
+            uint8_t r = transact(b, onewire_prog_read_scratch, d.rom, scratch);
+            d.pending = false;
+            d.due += d.period_us;
+            bs.stats.samples++;
+            if (r != OW_OK) bs.stats.errors++;
+            if (callback) callback(b, d.rom, scratch, r, callbackArg);
+            return now;
+        }
+        bs.converting = false;
+    }
+
+    // Start a broadcast conversion as soon as any device needs one, and
+    // take along every device that would be due within half its period.
+    int64_t next = INT64_MAX;
+    bool start = false;
+    for (i = 0; i < deviceCount; i++) {
+        Device &d = devices[i];
+        if (d.bus != b) continue;
+        int64_t t = d.due - bs.conversion_us;
+        if (t <= now) start = true;
+        if (t < next) next = t;
+    }
+    if (!start) return next;
+
+    if (transact(b, onewire_prog_convert_all, 0, 0) != OW_OK) {
+        // nobody answered the reset, try again a conversion time later
+        bs.stats.errors++;
+        return now + bs.conversion_us;
+    }
+    uint8_t n = 0;
+    for (i = 0; i < deviceCount; i++) {
+        Device &d = devices[i];
+        if (d.bus != b) continue;
+        if (now + bs.conversion_us + d.period_us / 2 >= d.due) {
+            d.pending = true;
+            n++;
+        }
+    }
+    bs.stats.conversions++;
+    if (n > 1) bs.stats.coalesced += n - 1;
+    bs.converting = true;
+    bs.ready = now + bs.conversion_us;
+    return bs.ready;
+}
+
+//
+// Service every bus once and return when the next piece of work is due,
+// INT64_MAX if there is none.
+//
+int64_t OneWireScheduler::poll_until(void)
+{
+    int64_t next = INT64_MAX;
+
+    for (uint8_t b = 0; b < busCount; b++) {
+        int64_t t = service(b, esp_timer_get_time());
+        if (t < next) next = t;
+    }
+    return next;
+}
+
+uint32_t OneWireScheduler::poll(void)
+{
+    int64_t next = poll_until();
+    int64_t now = esp_timer_get_time();
+    if (next <= now) return 0;
+    if (next == INT64_MAX) return 1000;
+    return (uint32_t)((next - now + 999) / 1000);
+}
+
+void OneWireScheduler::run(void)
+{
+    const int64_t tick_us = 1000000 / configTICK_RATE_HZ;
+
+    for (;;) {
+        int64_t next = poll_until();
+        if (next == INT64_MAX) next = esp_timer_get_time() + 1000000;
+        int64_t wait = next - esp_timer_get_time();
+        if (wait <= 0) {
+            // more work is due already; let tasks of the same priority in
+            taskYIELD();
+            continue;
+        }
+        // round up, so the task does not wake before the deadline and
+        // poll for nothing
+        vTaskDelay((TickType_t)((wait + tick_us - 1) / tick_us));
+    }
+}
+
+const OneWireSchedStats &OneWireScheduler::stats(uint8_t bus)
+{
+    buses[bus].stats.elapsed_us = esp_timer_get_time() - statsStart;
+    return buses[bus].stats;
+}
+
+uint8_t OneWireScheduler::utilisation(uint8_t bus)
+{
+    const OneWireSchedStats &s = stats(bus);
+    if (!s.elapsed_us) return 0;
+    return (uint8_t)(s.busy_us * 100 / s.elapsed_us);
+}
+
+void OneWireScheduler::clear_stats(void)
+{
+    for (uint8_t b = 0; b < busCount; b++)
+        memset(&buses[b].stats, 0, sizeof(buses[b].stats));
+    statsStart = esp_timer_get_time();
+}
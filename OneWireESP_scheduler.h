@@ -0,0 +1,105 @@
+#ifndef OneWireESP_scheduler_h
+#define OneWireESP_scheduler_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWireESP_bus.h"
+
+// Periodic temperature sampling across several buses.
+//
+// Each device is given its own sampling period.  The scheduler does not
+// convert devices one at a time: when any device on a bus needs a new
+// sample it broadcasts one Convert T (Skip ROM, 0x44) and every device on
+// that bus which is due within half of its own period rides along.
+// While a bus waits for its conversion the scheduler does reads and
+// conversions on the other buses, one transaction per bus per poll(), so
+// no bus sits idle waiting on another.
+//
+// A sample is delivered on time if it arrives before the next one is due.
+// Every period that passes without a delivery counts as a missed deadline.
+//
+// Devices are assumed to be externally powered; the broadcast convert
+// does not hold a strong pullup.
+
+#ifndef ONEWIRE_SCHED_MAX_BUSES
+#define ONEWIRE_SCHED_MAX_BUSES 4
+#endif
+
+#ifndef ONEWIRE_SCHED_MAX_DEVICES
+#define ONEWIRE_SCHED_MAX_DEVICES 32
+#endif
+
+// Called for every sample read.  'scratch' is the 9 byte scratchpad and
+// 'status' the onewire_run() result; scratch is only valid for OW_OK.
+typedef void (*OneWireSampleCallback)(uint8_t bus, const uint8_t rom[8],
+                                      const uint8_t *scratch, uint8_t status, void *arg);
+
+struct OneWireSchedStats {
+    uint64_t busy_us;       // time spent in bus transactions
+    uint64_t elapsed_us;    // time since the stats were cleared
+    uint32_t conversions;   // broadcast conversions issued
+    uint32_t samples;       // devices read
+    uint32_t coalesced;     // conversions saved by sharing a broadcast
+    uint32_t missed;        // periods that passed without a sample
+    uint32_t errors;        // reads that did not return OW_OK
+};
+
+class OneWireScheduler
+{
+  private:
+    struct Device {
+        uint8_t rom[8];
+        uint8_t bus;
+        bool pending;           // converted, waiting to be read
+        int64_t period_us;
+        int64_t due;            // when the next sample should be taken
+    };
+    struct Bus {
+        OneWireBus bus;
+        uint32_t conversion_us;
+        bool converting;
+        int64_t ready;          // conversion complete time
+        OneWireSchedStats stats;
+    };
+
+    Device devices[ONEWIRE_SCHED_MAX_DEVICES];
+    Bus buses[ONEWIRE_SCHED_MAX_BUSES];
+    uint8_t deviceCount;
+    uint8_t busCount;
+    int64_t statsStart;
+    OneWireSampleCallback callback;
+    void *callbackArg;
+
+    uint8_t transact(uint8_t b, const uint8_t *prog, const uint8_t *rom, uint8_t *rx);
+    int64_t service(uint8_t b, int64_t now);
+    int64_t poll_until(void);
+
+  public:
+    OneWireScheduler(OneWireSampleCallback cb, void *arg = 0);
+
+    // Add a bus.  conversion_ms is the worst case conversion time of the
+    // devices on it (750 for a DS18B20 at 12 bits).  Returns the bus
+    // index to use with add_device(), or -1 if the table is full.
+    int8_t add_bus(const OneWireBus &bus, uint16_t conversion_ms = 750);
+
+    // Sample 'rom' on bus 'bus' every 'period_ms'.
+    bool add_device(uint8_t bus, const uint8_t rom[8], uint32_t period_ms);
+
+    // Do whatever bus work is due now, at most one transaction per bus.
+    // Returns the number of milliseconds until more work will be due.
+    uint32_t poll(void);
+
+    // poll() forever, blocked in between until the next piece of work is
+    // due.  Suitable as a task body.
+    void run(void);
+
+    // Per bus statistics.  utilisation() is busy time as a percentage of
+    // the time since clear_stats().
+    const OneWireSchedStats &stats(uint8_t bus);
+    uint8_t utilisation(uint8_t bus);
+    void clear_stats(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_scheduler_h
@@ -0,0 +1,328 @@
+/*
+DS28E15 / DS28E25 SHA-256 authenticator driver for OneWireESP.  Same
+license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_sha.h"
+#include "OneWireESP.h"
+#include "OneWireESP_pm.h"
+#include "utils/OneWireESP_port.h"
+#include <string.h>
+
+#if ONEWIRE_SHA_MBEDTLS
+#include "mbedtls/sha256.h"
+
+void onewire_sha256(const uint8_t *msg, uint16_t len, uint8_t digest[32])
+{
+    mbedtls_sha256(msg, len, digest, 0);
+}
+#else
+static const uint32_t sha_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t h[8], const uint8_t *p)
+{
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, k;
+    uint8_t i;
+
+    for (i = 0; i < 16; i++, p += 4)
+        w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    for (; i < 64; i++) {
+        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = h[0]; b = h[1]; c = h[2]; d = h[3];
+    e = h[4]; f = h[5]; g = h[6]; k = h[7];
+    for (i = 0; i < 64; i++) {
+        uint32_t t1 = k + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + sha_k[i] + w[i];
+        uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+void onewire_sha256(const uint8_t *msg, uint16_t len, uint8_t digest[32])
+{
+    uint32_t h[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    uint8_t block[64];
+    uint16_t left = len;
+
+    for (; left >= 64; left -= 64, msg += 64) sha256_block(h, msg);
+
+    // padding: a 1 bit, zeros, then the length in bits
+    memset(block, 0, sizeof(block));
+    memcpy(block, msg, left);
+    block[left] = 0x80;
+    if (left >= 56) {
+        sha256_block(h, block);
+        memset(block, 0, sizeof(block));
+    }
+    uint32_t bits = (uint32_t)len * 8;
+    block[60] = bits >> 24;
+    block[61] = bits >> 16;
+    block[62] = bits >> 8;
+    block[63] = bits;
+    sha256_block(h, block);
+
+    for (uint8_t i = 0; i < 8; i++) {
+        digest[4 * i] = h[i] >> 24;
+        digest[4 * i + 1] = h[i] >> 16;
+        digest[4 * i + 2] = h[i] >> 8;
+        digest[4 * i + 3] = h[i];
+    }
+}
+#endif
+
+
+OneWireSha::OneWireSha(const OneWireBus &b, const uint8_t s[32])
+{
+    bus = b;
+    set_secret(s);
+    manid[0] = manid[1] = 0;
+    clear_stats();
+}
+
+void OneWireSha::set_secret(const uint8_t s[32])
+{
+    memcpy(secret, s, 32);
+}
+
+void OneWireSha::clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+//
+// Host side MAC: SHA-256 of the secret followed by 'msg'.  'deviceDone'
+// is when the device will have its own, to count how much of the host
+// computation it hid, or 0 when the device is not computing.
+//
+void OneWireSha::compute(const uint8_t *msg, uint16_t len, uint8_t mac[32], int64_t deviceDone)
+{
+    uint8_t buf[32 + 75];
+    int64_t start = ow_micros();
+
+    memcpy(buf, secret, 32);
+    memcpy(&buf[32], msg, len);
+    onewire_sha256(buf, 32 + len, mac);
+    memset(buf, 0, 32);
+
+    int64_t end = ow_micros();
+    int64_t hidden = (end < deviceDone ? end : deviceDone) - start;
+    stats.macs++;
+    stats.host_us += (uint32_t)(end - start);
+    if (hidden > 0) stats.hidden_us += (uint32_t)hidden;
+}
+
+//
+// Pages of memory by family: DS28E15 has 2, DS28E25 has 16.  0 for a
+// device this driver does not know.
+//
+static uint8_t page_count(const uint8_t rom[8])
+{
+    switch (rom[0]) {
+    case DS28E15_FAMILY:
+        return 2;
+    case DS28E25_FAMILY:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+uint8_t OneWireSha::read_page(const uint8_t rom[8], uint8_t page, uint8_t data[32])
+{
+    // Read Memory: CRC16 of command and parameter, then of the page
+    static const uint8_t prog[] = {
+        OW_RESET, OW_MATCH,
+        OW_WRITE_TX, 2,
+        OW_READ, 2, OW_CRC16,
+        OW_READ, 34, OW_CRC16,
+        OW_END
+    };
+    uint8_t cmd[2] = { 0xF0, page };
+    uint8_t rx[2 + 34];
+
+    if (page >= page_count(rom)) return OW_BAD_ADDRESS;
+    uint8_t r = onewire_run(bus, prog, rom, cmd, rx);
+    if (r == OW_OK) memcpy(data, &rx[2], 32);
+    return r;
+}
+
+uint8_t OneWireSha::write_scratchpad(const uint8_t rom[8], const uint8_t data[32])
+{
+    // Read/Write Scratchpad, parameter 0 for a write
+    static const uint8_t prog[] = {
+        OW_RESET, OW_MATCH,
+        OW_WRITE_TX, 2,
+        OW_READ, 2, OW_CRC16,
+        OW_WRITE_TX, 32,
+        OW_READ, 2, OW_CRC16,
+        OW_END
+    };
+    uint8_t tx[2 + 32];
+    uint8_t rx[4];
+
+    tx[0] = 0x0F;
+    tx[1] = 0x00;
+    memcpy(&tx[2], data, 32);
+    return onewire_run(bus, prog, rom, tx, rx);
+}
+
+uint8_t OneWireSha::authenticate(const uint8_t rom[8], uint8_t page, const uint8_t challenge[32],
+                                 const uint8_t *data, bool anonymous)
+{
+    static const uint8_t start[] = {
+        OW_RESET, OW_MATCH,
+        OW_WRITE_TX, 2,
+        OW_READ, 2, OW_CRC16,
+        OW_END
+    };
+    uint8_t pagebuf[32];
+    uint8_t msg[32 + 32 + 8 + 1 + 2];
+    uint8_t expect[32];
+    uint8_t reply[1 + 32 + 2];
+    uint8_t r;
+
+    if (page >= page_count(rom)) return OW_BAD_ADDRESS;
+    r = write_scratchpad(rom, challenge);
+    if (r == OW_OK && !data) {
+        r = read_page(rom, page, pagebuf);
+        data = pagebuf;
+    }
+    if (r != OW_OK) return r;
+
+    // Compute and Read Page MAC.  The device needs 2 tCSHA from here.
+    uint8_t cmd[2] = { 0xA5, (uint8_t)((anonymous ? 0xE0 : 0) | page) };
+    uint8_t rx[2];
+    // the reply is read outside onewire_run(), so hold the lock until then
+    onewire_pm_bus_begin();
+    r = onewire_run(bus, start, rom, cmd, rx);
+    if (r != OW_OK) {
+        onewire_pm_bus_end();
+        return r;
+    }
+    int64_t ready = ow_micros() + 2 * ONEWIRE_SHA_TCSHA_US;
+
+    // MAC input after the secret: page, challenge, ROM code (all 1s when
+    // anonymous), page number, manufacturer ID
+    memcpy(msg, data, 32);
+    memcpy(&msg[32], challenge, 32);
+    if (anonymous) memset(&msg[64], 0xFF, 8);
+    else memcpy(&msg[64], rom, 8);
+    msg[72] = page;
+    msg[73] = manid[0];
+    msg[74] = manid[1];
+    compute(msg, sizeof(msg), expect, ready);
+    ow_delay_until(ready);
+
+    // result byte, the MAC and its CRC16
+    bus.read_bytes(bus.ctx, reply, sizeof(reply));
+    bus.reset(bus.ctx);
+    onewire_pm_bus_end();
+    if (OneWire::crc16(&reply[1], 34) != 0xB001) return OW_CRC_ERROR;
+    if (reply[0] != 0xAA) return OW_VERIFY_ERROR;
+    if (memcmp(&reply[1], expect, 32) != 0) {
+        stats.failed++;
+        return OW_MAC_ERROR;
+    }
+    return OW_OK;
+}
+
+uint8_t OneWireSha::write_segment(const uint8_t rom[8], uint8_t page, uint8_t segment,
+                                  const uint8_t old_data[4], const uint8_t new_data[4])
+{
+    static const uint8_t start[] = {
+        OW_RESET, OW_MATCH,
+        OW_WRITE_TX, 2,
+        OW_READ, 2, OW_CRC16,
+        OW_WRITE_TX, 4,
+        OW_READ, 2, OW_CRC16,
+        OW_END
+    };
+    static const uint8_t release = 0xAA;
+    uint8_t tx[2 + 4];
+    uint8_t rx[4];
+    uint8_t msg[8 + 1 + 1 + 2 + 4 + 4];
+    uint8_t mac[32];
+    uint8_t crc[2];
+    uint8_t cs;
+
+    if (segment > 7 || page >= page_count(rom)) return OW_BAD_ADDRESS;
+
+    // MAC input after the secret: ROM code, segment and page numbers,
+    // manufacturer ID, old and new segment data.  The device checks it
+    // against its own, which it only starts once it has the MAC, so
+    // there is nothing to hide this computation behind.
+    memcpy(msg, rom, 8);
+    msg[8] = segment;
+    msg[9] = page;
+    msg[10] = manid[0];
+    msg[11] = manid[1];
+    memcpy(&msg[12], old_data, 4);
+    memcpy(&msg[16], new_data, 4);
+    compute(msg, sizeof(msg), mac, 0);
+
+    // Authenticated Write Memory
+    tx[0] = 0x5A;
+    tx[1] = (uint8_t)((segment << 5) | page);
+    memcpy(&tx[2], new_data, 4);
+    // the rest is raw bus calls, so hold the lock until the last of them
+    onewire_pm_bus_begin();
+    uint8_t r = onewire_run(bus, start, rom, tx, rx);
+    if (r != OW_OK) {
+        onewire_pm_bus_end();
+        return r;
+    }
+
+    // the MAC and its CRC16; the device needs tCSHA after that before
+    // it can say whether it accepted the MAC
+    bus.write_bytes(bus.ctx, mac, 32, false);
+    bus.read_bytes(bus.ctx, crc, 2);
+    int64_t ready = ow_micros() + ONEWIRE_SHA_TCSHA_US;
+    if (OneWire::crc16(crc, 2, OneWire::crc16(mac, 32)) != 0xB001) {
+        bus.reset(bus.ctx);
+        onewire_pm_bus_end();
+        return OW_CRC_ERROR;
+    }
+    ow_delay_until(ready);
+    bus.read_bytes(bus.ctx, &cs, 1);
+    if (cs != 0xAA) {
+        bus.reset(bus.ctx);
+        onewire_pm_bus_end();
+        stats.failed++;
+        return OW_MAC_ERROR;
+    }
+
+    // release the write and hold the line up while the EEPROM programs;
+    // the lock is let go for that wait, the pullup stays on
+    bus.write_bytes(bus.ctx, &release, 1, true);
+    onewire_flush(bus);
+    int64_t until = ow_micros() + ONEWIRE_SHA_TPRD_US;
+    int64_t left;
+    while ((left = until - ow_micros()) > 0)
+        onewire_pm_wait((uint32_t)((left + 999) / 1000));
+    bus.depower(bus.ctx);
+    bus.read_bytes(bus.ctx, &cs, 1);
+    bus.reset(bus.ctx);
+    onewire_pm_bus_end();
+    return cs == 0xAA ? OW_OK : OW_COPY_ERROR;
+}
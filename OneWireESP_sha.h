@@ -0,0 +1,106 @@
+#ifndef OneWireESP_sha_h
+#define OneWireESP_sha_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWireESP_bus.h"
+#include "OneWireESP_program.h"
+
+// DS28E15 (family 0x17) and DS28E25 (family 0x47) SHA-256 secure
+// authenticators.
+//
+// authenticate() proves a device holds the same secret as the host: it
+// writes a random challenge to the scratchpad and has the device compute
+// a MAC over one memory page, the challenge, its ROM code and the secret.
+// The host computes the same MAC itself and compares.  The device takes
+// two SHA-256 computation times (tCSHA) before the MAC can be read; the
+// host's own computation runs inside that wait rather than after it, so
+// it normally costs no time at all.
+//
+// write_segment() changes one 4 byte segment of a page with Authenticated
+// Write Memory, which the device only accepts with a MAC over the old
+// and new data made with the secret.  The device computes its own MAC
+// to compare only after it has received the host's, so this one is not
+// hidden: the host computes it first and then waits tCSHA for the
+// answer.
+//
+// Pages are 0-1 on a DS28E15 and 0-15 on a DS28E25; a page outside the
+// device, or a device of another family, gives OW_BAD_ADDRESS.
+//
+// SHA-256 runs through mbedTLS under ESP-IDF, which uses the chip's SHA
+// accelerator when CONFIG_MBEDTLS_HARDWARE_SHA is set, and through a
+// plain software version elsewhere.
+
+#define DS28E15_FAMILY  0x17
+#define DS28E25_FAMILY  0x47
+
+// SHA-256 computation time, and EEPROM programming time
+#ifndef ONEWIRE_SHA_TCSHA_US
+#define ONEWIRE_SHA_TCSHA_US 3000
+#endif
+#ifndef ONEWIRE_SHA_TPRD_US
+#define ONEWIRE_SHA_TPRD_US 10000
+#endif
+
+#ifndef ONEWIRE_SHA_MBEDTLS
+#if defined(ESP_PLATFORM)
+#define ONEWIRE_SHA_MBEDTLS 1
+#else
+#define ONEWIRE_SHA_MBEDTLS 0
+#endif
+#endif
+
+struct OneWireShaStats {
+    uint32_t macs;          // MACs computed by the host
+    uint32_t host_us;       // time spent computing them
+    uint32_t hidden_us;     // of that, time inside the device's own computation
+    uint32_t failed;        // MACs that did not match, or writes refused
+};
+
+// SHA-256 of 'len' bytes, with whichever implementation is built in
+void onewire_sha256(const uint8_t *msg, uint16_t len, uint8_t digest[32]);
+
+class OneWireSha
+{
+  private:
+    OneWireBus bus;
+    uint8_t secret[32];
+    uint8_t manid[2];
+    OneWireShaStats stats;
+
+    void compute(const uint8_t *msg, uint16_t len, uint8_t mac[32], int64_t deviceDone);
+
+  public:
+    // 'secret' is the 32 byte secret the devices were loaded with
+    OneWireSha(const OneWireBus &bus, const uint8_t secret[32]);
+
+    void set_secret(const uint8_t s[32]);
+    // Manufacturer ID that goes into every MAC, 0x0000 unless customised
+    void set_manid(uint8_t lo, uint8_t hi) { manid[0] = lo; manid[1] = hi; }
+
+    // Read one 32 byte page, CRC16 checked
+    uint8_t read_page(const uint8_t rom[8], uint8_t page, uint8_t data[32]);
+
+    // Write the 32 byte scratchpad (the challenge for authenticate())
+    uint8_t write_scratchpad(const uint8_t rom[8], const uint8_t data[32]);
+
+    // Check the device against the secret over 'page'.  'data' is the
+    // page contents, or 0 to read them first.  With 'anonymous' set the
+    // ROM code is left out of the MAC.  Returns OW_OK, OW_MAC_ERROR for
+    // a wrong MAC, or the transfer error.
+    uint8_t authenticate(const uint8_t rom[8], uint8_t page, const uint8_t challenge[32],
+                         const uint8_t *data = 0, bool anonymous = false);
+
+    // Replace segment 'segment' (0-7) of 'page'.  'old_data' must be the
+    // segment's current contents.  OW_MAC_ERROR if the device refused
+    // the MAC, OW_COPY_ERROR if the programming was not confirmed.
+    uint8_t write_segment(const uint8_t rom[8], uint8_t page, uint8_t segment,
+                          const uint8_t old_data[4], const uint8_t new_data[4]);
+
+    const OneWireShaStats &get_stats() const { return stats; }
+    void clear_stats(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_sha_h
@@ -0,0 +1,186 @@
+/*
+Per core bus engines for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_shard.h"
+#include "OneWireESP_program.h"
+#include "esp_timer.h"
+#include <string.h>
+
+OneWireShards::OneWireShards()
+{
+    busCount = 0;
+    collector = 0;
+    running = false;
+    for (uint8_t i = 0; i < portNUM_PROCESSORS; i++) {
+        cores[i].owner = this;
+        cores[i].index = i;
+        cores[i].task = 0;
+        perCore[i] = 0;
+    }
+    clear_stats();
+}
+
+OneWireShards::~OneWireShards()
+{
+    stop();
+}
+
+void OneWireShards::clear_stats(void)
+{
+    for (uint8_t i = 0; i < portNUM_PROCESSORS; i++)
+        memset(&cores[i].stats, 0, sizeof(cores[i].stats));
+    statsStart = esp_timer_get_time();
+}
+
+int8_t OneWireShards::add_bus(const OneWireBus &bus, int8_t core)
+{
+    if (running || busCount >= ONEWIRE_SHARD_BUSES || core >= portNUM_PROCESSORS)
+        return -1;
+
+    if (core < 0) {
+        core = 0;
+        for (uint8_t i = 1; i < portNUM_PROCESSORS; i++)
+            if (perCore[i] < perCore[core]) core = i;
+    }
+    buses[busCount].bus = bus;
+    buses[busCount].core = core;
+    perCore[core]++;
+    return busCount++;
+}
+
+bool OneWireShards::start(UBaseType_t priority)
+{
+    if (running) return false;
+    running = true;
+    for (uint8_t i = 0; i < portNUM_PROCESSORS; i++) {
+        if (!perCore[i]) continue;
+        TaskHandle_t task = xTaskCreateStaticPinnedToCore(engine, "onewire",
+                                ONEWIRE_SHARD_STACK, &cores[i], priority,
+                                cores[i].stack, &cores[i].taskBuf, i);
+        if (!task) {
+            stop();
+            return false;
+        }
+        cores[i].task = task;
+    }
+    return true;
+}
+
+void OneWireShards::stop(void)
+{
+    running = false;
+    for (uint8_t i = 0; i < portNUM_PROCESSORS; i++) {
+        TaskHandle_t task = cores[i].task;
+        if (task) xTaskNotifyGive(task);
+    }
+    // each engine clears its handle on the way out
+    for (uint8_t i = 0; i < portNUM_PROCESSORS; i++)
+        while (cores[i].task) vTaskDelay(1);
+}
+
+bool OneWireShards::submit(uint8_t bus, const uint8_t *prog, const uint8_t *rom,
+                           const uint8_t *tx, uint8_t *rx, uint32_t tag)
+{
+    if (bus >= busCount) return false;
+
+    Job job;
+    job.prog = prog;
+    job.tx = tx;
+    job.rx = rx;
+    job.match = rom != 0;
+    if (rom) memcpy(job.rom, rom, 8);
+    job.tag = tag;
+
+    Bus &b = buses[bus];
+    if (!b.jobs.push(job)) return false;
+    TaskHandle_t task = cores[b.core].task;
+    if (task) xTaskNotifyGive(task);
+    return true;
+}
+
+bool OneWireShards::collect(OneWireShardResult &result, uint32_t timeout_ms)
+{
+    TickType_t wait = pdMS_TO_TICKS(timeout_ms);
+    TickType_t start = xTaskGetTickCount();
+    bool found = false;
+
+    // engines only notify while 'collector' is set
+    collector = xTaskGetCurrentTaskHandle();
+    for (;;) {
+        for (uint8_t i = 0; i < portNUM_PROCESSORS && !found; i++) {
+            Core &c = cores[i];
+            if (!c.results.pop(result)) continue;
+            // The engine may be waiting for room.  Checking whether the
+            // ring was full first would race with the engine filling it
+            // and going to sleep in between, so it is always woken.
+            TaskHandle_t task = c.task;
+            if (task) xTaskNotifyGive(task);
+            found = true;
+        }
+        TickType_t gone = xTaskGetTickCount() - start;
+        if (found || gone >= wait) break;
+        ulTaskNotifyTake(pdTRUE, wait - gone);
+    }
+    collector = 0;
+    return found;
+}
+
+//
+// Run at most one job from every bus of this core.  Returns false if
+// there was nothing to do or no room for a result.
+//
+bool OneWireShards::service(Core &c)
+{
+    bool did = false;
+
+    for (uint8_t i = 0; i < busCount; i++) {
+        Bus &b = buses[i];
+        if (b.core != c.index) continue;
+        if (c.results.full()) {
+            c.stats.stalls++;
+            return false;
+        }
+
+        Job job;
+        if (!b.jobs.pop(job)) continue;
+
+        int64_t start = esp_timer_get_time();
+        OneWireShardResult r;
+        r.status = onewire_run(b.bus, job.prog, job.match ? job.rom : 0, job.tx, job.rx);
+        r.bus_us = (uint32_t)(esp_timer_get_time() - start);
+        r.tag = job.tag;
+        r.bus = i;
+        c.results.push(r);
+        c.stats.jobs++;
+        c.stats.busy_us += r.bus_us;
+        did = true;
+
+        TaskHandle_t waiting = collector;
+        if (waiting) xTaskNotifyGive(waiting);
+    }
+    return did;
+}
+
+void OneWireShards::engine(void *arg)
+{
+    Core &c = *(Core *)arg;
+    OneWireShards &s = *c.owner;
+
+    while (s.running) {
+        if (!s.service(c)) {
+            c.stats.sleeps++;
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+    c.task = 0;
+    vTaskDelete(0);
+}
+
+uint32_t OneWireShards::jobs_per_second(void) const
+{
+    uint64_t jobs = 0;
+    for (uint8_t i = 0; i < portNUM_PROCESSORS; i++) jobs += cores[i].stats.jobs;
+    int64_t elapsed = esp_timer_get_time() - statsStart;
+    return elapsed > 0 ? (uint32_t)(jobs * 1000000 / elapsed) : 0;
+}
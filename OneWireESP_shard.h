@@ -0,0 +1,166 @@
+#ifndef OneWireESP_shard_h
+#define OneWireESP_shard_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include <atomic>
+#include "OneWireESP_bus.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Independent buses run in parallel on both cores.
+//
+// Bit-banged time slots keep a CPU busy for the whole transaction, so
+// two buses driven from one task take twice as long as one.  OneWireShards
+// gives every core an engine task, pinned to it, and hands each bus to
+// one of the engines.  A transaction program submitted for a bus is run
+// by that bus's engine and its result comes back through collect():
+//
+//    OneWireShards shards;
+//    int8_t a = shards.add_bus(ow.bus1());        // core 0
+//    int8_t b = shards.add_bus(ow.bus2());        // core 1
+//    shards.start();
+//    shards.submit(a, onewire_prog_read_scratch, rom1, 0, data1, 1);
+//    shards.submit(b, onewire_prog_read_scratch, rom2, 0, data2, 2);
+//    OneWireShardResult r;
+//    while (shards.collect(r, 1000)) ...          // r.tag is 1 or 2
+//
+// Jobs and results go through single producer, single consumer rings
+// with no lock, one job ring per bus and one result ring per core, so
+// the engines never wait on each other.  That makes the rules: one task
+// submits to any one bus, and one task collects.  Waking a sleeping
+// engine or the collecting task uses its task notification, so the
+// collecting task should not wait on other notifications meanwhile.
+
+#ifndef ONEWIRE_SHARD_BUSES
+#define ONEWIRE_SHARD_BUSES 8
+#endif
+
+// Ring sizes, a power of two
+#ifndef ONEWIRE_SHARD_JOBS
+#define ONEWIRE_SHARD_JOBS 8
+#endif
+#ifndef ONEWIRE_SHARD_RESULTS
+#define ONEWIRE_SHARD_RESULTS 16
+#endif
+
+// Engine task stack, in bytes, held in the OneWireShards object
+#ifndef ONEWIRE_SHARD_STACK
+#define ONEWIRE_SHARD_STACK 3072
+#endif
+
+// Lock free ring between exactly one producer and one consumer task
+template <typename T, uint16_t N>
+class OneWireSpsc
+{
+    static_assert(N && (N & (N - 1)) == 0, "ring size must be a power of two");
+
+    T items[N];
+    std::atomic<uint16_t> head;     // next to write, producer only
+    std::atomic<uint16_t> tail;     // next to read, consumer only
+
+  public:
+    OneWireSpsc() : head(0), tail(0) { }
+
+    bool full(void) const {
+        return (uint16_t)(head.load(std::memory_order_relaxed) -
+                          tail.load(std::memory_order_acquire)) == N;
+    }
+    bool push(const T &v) {
+        uint16_t h = head.load(std::memory_order_relaxed);
+        if ((uint16_t)(h - tail.load(std::memory_order_acquire)) == N) return false;
+        items[h & (N - 1)] = v;
+        head.store((uint16_t)(h + 1), std::memory_order_release);
+        return true;
+    }
+    bool pop(T &v) {
+        uint16_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        v = items[t & (N - 1)];
+        tail.store((uint16_t)(t + 1), std::memory_order_release);
+        return true;
+    }
+};
+
+struct OneWireShardResult {
+    uint32_t tag;           // as given to submit()
+    uint8_t bus;            // add_bus() index
+    uint8_t status;         // onewire_run() result
+    uint32_t bus_us;        // time the transaction took
+};
+
+struct OneWireShardStats {
+    uint32_t jobs;          // transactions run by this core's engine
+    uint32_t busy_us;       // time spent in them
+    uint32_t sleeps;        // times the engine found nothing to do
+    uint32_t stalls;        // times it waited for collect() to make room
+};
+
+class OneWireShards
+{
+  private:
+    struct Job {
+        const uint8_t *prog;
+        const uint8_t *tx;
+        uint8_t *rx;
+        uint8_t rom[8];
+        bool match;             // 'rom' is set
+        uint32_t tag;
+    };
+    struct Bus {
+        OneWireBus bus;
+        uint8_t core;
+        OneWireSpsc<Job, ONEWIRE_SHARD_JOBS> jobs;
+    };
+    struct Core {
+        OneWireShards *owner;
+        uint8_t index;
+        TaskHandle_t volatile task;
+        OneWireSpsc<OneWireShardResult, ONEWIRE_SHARD_RESULTS> results;
+        OneWireShardStats stats;
+        StaticTask_t taskBuf;
+        StackType_t stack[ONEWIRE_SHARD_STACK / sizeof(StackType_t)];
+    };
+
+    Bus buses[ONEWIRE_SHARD_BUSES];
+    Core cores[portNUM_PROCESSORS];
+    uint8_t busCount;
+    uint8_t perCore[portNUM_PROCESSORS];
+    TaskHandle_t volatile collector;   // the task blocked in collect()
+    volatile bool running;
+    int64_t statsStart;
+
+    static void engine(void *arg);
+    bool service(Core &c);
+
+  public:
+    OneWireShards();
+    ~OneWireShards();
+
+    // Add a bus before start(), on 'core' or, with -1, on the core with
+    // the fewest buses.  Returns the bus index, or -1 if the table is full.
+    int8_t add_bus(const OneWireBus &bus, int8_t core = -1);
+
+    // Create the engine tasks, one per core that has a bus.
+    bool start(UBaseType_t priority = 5);
+    // Let the engines finish their current job and end.
+    void stop(void);
+
+    // Queue onewire_run(bus, prog, rom, tx, rx).  'rom' is copied; 'prog',
+    // 'tx' and 'rx' must stay valid until the result is collected.
+    // Returns false if the bus's job ring is full.
+    bool submit(uint8_t bus, const uint8_t *prog, const uint8_t *rom = 0,
+                const uint8_t *tx = 0, uint8_t *rx = 0, uint32_t tag = 0);
+
+    // Get a finished job's result, waiting up to 'timeout_ms' for one.
+    bool collect(OneWireShardResult &result, uint32_t timeout_ms = 0);
+
+    // Per core counters, and all jobs done per second since clear_stats()
+    const OneWireShardStats &stats(uint8_t core) const { return cores[core].stats; }
+    uint32_t jobs_per_second(void) const;
+    void clear_stats(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_shard_h
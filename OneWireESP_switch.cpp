@@ -0,0 +1,167 @@
+/*
+DS2408 / DS2413 switch driver for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_switch.h"
+#include "OneWireESP.h"
+#include "OneWireESP_pm.h"
+#include "utils/OneWireESP_port.h"
+#include <string.h>
+
+#define DS2408_FAMILY   0x29
+
+OneWireSwitch::OneWireSwitch(const OneWireBus &b, const uint8_t r[8])
+{
+    bus = b;
+    memcpy(rom, r, 8);
+    streaming = false;
+    blockLen = 0;
+    blockPos = 0;
+    clear_stats();
+}
+
+void OneWireSwitch::clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+uint32_t OneWireSwitch::sample_rate(void) const
+{
+    if (!stats.sample_us) return 0;
+    return (uint32_t)((uint64_t)stats.samples * 1000000 / stats.sample_us);
+}
+
+uint8_t OneWireSwitch::begin_stream(void)
+{
+    static const uint8_t prog[] = { OW_RESET, OW_MATCH, OW_WRITE, 1, 0xF5, OW_END };
+    static const uint8_t cmd = 0xF5;
+
+    streaming = false;
+    blockLen = 0;
+    blockPos = 0;
+    uint8_t r = onewire_run(bus, prog, rom);
+    if (r != OW_OK) return r;
+    // the first DS2408 CRC also covers the command byte
+    crc = OneWire::crc16(&cmd, 1);
+    streaming = true;
+    return OW_OK;
+}
+
+void OneWireSwitch::end_stream(void)
+{
+    streaming = false;
+    blockLen = 0;
+    blockPos = 0;
+    onewire_pm_bus_begin();
+    bus.reset(bus.ctx);
+    onewire_pm_bus_end();
+}
+
+//
+// Read and check the next block of samples.  'wanted' limits how far a
+// DS2413 reads ahead; the DS2408 always sends whole 32 sample blocks.
+//
+uint8_t OneWireSwitch::fill_block(uint16_t wanted)
+{
+    blockPos = 0;
+    blockLen = 0;
+
+    if (rom[0] == DS2408_FAMILY) {
+        uint8_t inv[2];
+        bus.read_bytes(bus.ctx, block, 32);
+        bus.read_bytes(bus.ctx, inv, 2);
+        crc = OneWire::crc16(block, 32, crc);
+        if (OneWire::crc16(inv, 2, crc) != 0xB001) return OW_CRC_ERROR;
+        crc = 0;
+        blockLen = 32;
+        return OW_OK;
+    }
+
+    uint8_t n = wanted < 32 ? wanted : 32;
+    bus.read_bytes(bus.ctx, block, n);
+    for (uint8_t i = 0; i < n; i++) {
+        // high nibble is the complement of the low one
+        if (((block[i] >> 4) ^ 0x0F) != (block[i] & 0x0F)) return OW_CRC_ERROR;
+        block[i] &= 0x0F;
+    }
+    blockLen = n;
+    return OW_OK;
+}
+
+uint8_t OneWireSwitch::read_samples(uint8_t *ring, uint16_t size, uint16_t *head, uint16_t count)
+{
+    int64_t start = ow_micros();
+    uint16_t h = *head;
+    uint8_t r = OW_OK;
+
+    if (!size || h >= size) return OW_BAD_ADDRESS;
+    // the blocks are read outside onewire_run(), so hold the lock here
+    onewire_pm_bus_begin();
+    if (!streaming) {
+        r = begin_stream();
+        if (r != OW_OK) {
+            onewire_pm_bus_end();
+            return r;
+        }
+    }
+
+    while (count) {
+        if (blockPos == blockLen) {
+            r = fill_block(count);
+            if (r != OW_OK) {
+                stats.errors++;
+                end_stream();
+                break;
+            }
+        }
+        uint16_t n = blockLen - blockPos;
+        if (n > count) n = count;
+        if (n > size - h) n = size - h;     // up to the end of the ring
+        memcpy(&ring[h], &block[blockPos], n);
+        blockPos += n;
+        count -= n;
+        stats.samples += n;
+        h += n;
+        if (h == size) h = 0;
+    }
+    onewire_pm_bus_end();
+    *head = h;
+    stats.sample_us += (uint32_t)(ow_micros() - start);
+    return r;
+}
+
+uint8_t OneWireSwitch::write_outputs(const uint8_t *values, uint16_t count, uint8_t *states)
+{
+    static const uint8_t prog[] = { OW_RESET, OW_MATCH, OW_WRITE, 1, 0x5A, OW_END };
+    uint8_t r;
+
+    // any stream is ended by the reset
+    streaming = false;
+    blockLen = 0;
+    blockPos = 0;
+    onewire_pm_bus_begin();
+    r = onewire_run(bus, prog, rom);
+    if (r != OW_OK) {
+        onewire_pm_bus_end();
+        return r;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        uint8_t v = values[i];
+        if (rom[0] != DS2408_FAMILY) v |= 0xFC;     // unused DS2413 bits must be 1
+        uint8_t out[2] = { v, (uint8_t)~v };
+        uint8_t in[2];
+        bus.write_bytes(bus.ctx, out, 2, false);
+        bus.read_bytes(bus.ctx, in, 2);
+        if (in[0] != 0xAA) {
+            bus.reset(bus.ctx);
+            onewire_pm_bus_end();
+            return OW_VERIFY_ERROR;
+        }
+        if (states) states[i] = in[1];
+        stats.writes++;
+    }
+    bus.reset(bus.ctx);
+    onewire_pm_bus_end();
+    return OW_OK;
+}
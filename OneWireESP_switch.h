@@ -0,0 +1,81 @@
+#ifndef OneWireESP_switch_h
+#define OneWireESP_switch_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWireESP_bus.h"
+#include "OneWireESP_program.h"
+
+// DS2408 (8 channel, family 0x29) and DS2413 (2 channel, family 0x3A)
+// addressable switches.
+//
+// Sampling inputs one reset/select/command at a time costs about 12 bus
+// bytes per sample.  Both parts instead have a channel access read
+// (0xF5) which, once selected, returns a fresh PIO sample for every byte
+// read until the next reset.  begin_stream() selects the device and
+// issues it; read_samples() then just keeps reading.  DS2408 samples come
+// in blocks of 32 followed by a CRC16, DS2413 samples carry their own
+// complement, and only samples that pass the check are handed out.
+//
+// write_outputs() sends several output values under one select with
+// Channel Access Write (0x5A), checking the 0xAA confirmation for each.
+
+// Results besides the onewire_run() ones: a DS2413 sample with a bad
+// complement is reported as OW_CRC_ERROR, a missing write confirmation
+// as OW_VERIFY_ERROR.
+
+struct OneWireSwitchStats {
+    uint32_t samples;       // good samples delivered
+    uint32_t sample_us;     // time spent in read_samples()
+    uint32_t errors;        // failed CRC or complement checks
+    uint32_t writes;        // output values confirmed
+};
+
+class OneWireSwitch
+{
+  private:
+    OneWireBus bus;
+    uint8_t rom[8];
+    bool streaming;
+    uint16_t crc;           // DS2408 running CRC16 of the current block
+    uint8_t block[32];      // checked samples not yet handed out
+    uint8_t blockLen;
+    uint8_t blockPos;
+    OneWireSwitchStats stats;
+
+    uint8_t fill_block(uint16_t wanted);
+
+  public:
+    // 'rom' must be a DS2408 or DS2413 ROM code
+    OneWireSwitch(const OneWireBus &bus, const uint8_t rom[8]);
+
+    // Select the device and start channel access reads.
+    uint8_t begin_stream(void);
+
+    // Append 'count' samples to the ring buffer 'ring' of 'size' bytes at
+    // *head, advancing *head (modulo size).  A DS2408 sample is the PIO
+    // pin state byte, a DS2413 one the low status nibble (bit 0 PIOA pin,
+    // bit 1 PIOA latch, bit 2 PIOB pin, bit 3 PIOB latch).  On an error
+    // the stream is closed and samples already appended stay valid.
+    // Returns OW_BAD_ADDRESS, without touching the bus, if 'size' is 0
+    // or *head is not inside the ring.
+    uint8_t read_samples(uint8_t *ring, uint16_t size, uint16_t *head, uint16_t count);
+
+    // Stop streaming (issues a reset).
+    void end_stream(void);
+
+    // Write 'count' output latch values in turn.  On a DS2413 bit 0 is
+    // PIOA and bit 1 PIOB.  If 'states' is given it receives the pin
+    // state the device reports after each write.
+    uint8_t write_outputs(const uint8_t *values, uint16_t count, uint8_t *states = 0);
+
+    // samples/sec achieved by read_samples()
+    uint32_t sample_rate(void) const;
+
+    const OneWireSwitchStats &get_stats() const { return stats; }
+    void clear_stats(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_switch_h
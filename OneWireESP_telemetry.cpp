@@ -0,0 +1,107 @@
+/*
+Binary telemetry frames for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_telemetry.h"
+#include "OneWireESP.h"
+
+// Writer and reader over a caller's buffer.  Running past the end sets
+// 'pos' beyond 'size' and every later call does nothing.
+
+struct FrameOut {
+    uint8_t *buf;
+    uint16_t size;
+    uint32_t pos;
+
+    void byte(uint8_t v) {
+        if (pos < size) buf[pos] = v;
+        pos++;
+    }
+    void varint(uint32_t v) {
+        while (v >= 0x80) {
+            byte((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        byte((uint8_t)v);
+    }
+    void zigzag(int32_t v) {
+        varint(((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+    }
+};
+
+struct FrameIn {
+    const uint8_t *buf;
+    uint16_t size;
+    uint32_t pos;
+
+    uint8_t byte(void) {
+        return pos < size ? buf[pos++] : (pos++, 0);
+    }
+    uint32_t varint(void) {
+        uint32_t v = 0;
+        for (uint8_t shift = 0; shift < 35; shift += 7) {
+            uint8_t b = byte();
+            v |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) break;
+        }
+        return v;
+    }
+    int32_t zigzag(void) {
+        uint32_t v = varint();
+        return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+    }
+};
+
+uint16_t onewire_frame_encode(const OneWireReading *readings, uint16_t count,
+                              uint8_t *buf, uint16_t size)
+{
+    FrameOut out = { buf, size, 0 };
+    uint32_t time = count ? readings[0].time_ms : 0;
+    int32_t value = 0;
+
+    out.byte(ONEWIRE_FRAME_VERSION);
+    out.varint(count);
+    out.varint(time);
+    for (uint16_t i = 0; i < count; i++) {
+        const OneWireReading &r = readings[i];
+        out.varint(((uint32_t)r.device << 1) | (r.status ? 1 : 0));
+        if (r.status) out.byte(r.status);
+        out.zigzag((int32_t)(r.time_ms - time));
+        out.zigzag((int32_t)((uint32_t)r.value - (uint32_t)value));
+        time = r.time_ms;
+        value = r.value;
+    }
+    if (out.pos + 2 > size) return 0;
+
+    uint16_t crc = ~OneWire::crc16(buf, (uint16_t)out.pos);
+    out.byte((uint8_t)crc);
+    out.byte((uint8_t)(crc >> 8));
+    return (uint16_t)out.pos;
+}
+
+int onewire_frame_decode(const uint8_t *buf, uint16_t len,
+                         OneWireReading *readings, uint16_t max)
+{
+    // the frame followed by its inverted CRC16 sums to 0xB001
+    if (len < 5 || OneWire::crc16(buf, len) != 0xB001) return -1;
+
+    FrameIn in = { buf, (uint16_t)(len - 2), 0 };
+    if (in.byte() != ONEWIRE_FRAME_VERSION) return -1;
+    uint32_t count = in.varint();
+    uint32_t time = in.varint();
+    int32_t value = 0;
+    if (count > max) return -1;
+
+    for (uint32_t i = 0; i < count; i++) {
+        OneWireReading &r = readings[i];
+        uint32_t v = in.varint();
+        r.device = (uint16_t)(v >> 1);
+        r.status = (v & 1) ? in.byte() : 0;
+        time += (uint32_t)in.zigzag();
+        value = (int32_t)((uint32_t)value + (uint32_t)in.zigzag());
+        r.time_ms = time;
+        r.value = value;
+    }
+    if (in.pos != in.size) return -1;
+    return (int)count;
+}
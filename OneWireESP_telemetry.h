@@ -0,0 +1,51 @@
+#ifndef OneWireESP_telemetry_h
+#define OneWireESP_telemetry_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+
+// Compact binary frames for shipping batches of readings off the board.
+//
+// A reading names its device by index into a ROM table the sender and
+// receiver share (sent once, or fixed at build time) instead of by the 8
+// byte ROM code.  Timestamps and values are stored as the difference to
+// the previous reading, zigzag and varint coded, so a batch of
+// temperatures taken together costs a few bytes per reading.
+//
+// Frame layout:
+//    version             1 byte, ONEWIRE_FRAME_VERSION
+//    count               varint
+//    first time          varint, the first reading's time_ms
+//    count times:
+//        index, status   varint of (device << 1 | status != 0)
+//        status          1 byte, only if not 0
+//        time delta      zigzag varint, against the previous reading
+//        value delta     zigzag varint, against the previous reading
+//    CRC16               inverted OneWire::crc16() of all the above,
+//                        low byte first, as 1-Wire devices send it
+//
+// Both functions work in the caller's buffers and allocate nothing.
+
+#define ONEWIRE_FRAME_VERSION 1
+
+struct OneWireReading {
+    uint16_t device;        // index into the shared ROM table
+    uint32_t time_ms;       // time of the reading (may wrap)
+    int32_t value;          // raw value, e.g. the scratchpad temperature
+    uint8_t status;         // onewire_run() result, OW_OK normally
+};
+
+// Encode 'count' readings into 'buf'.  Returns the frame length, or 0 if
+// it does not fit in 'size' bytes (the buffer may then be partly written).
+uint16_t onewire_frame_encode(const OneWireReading *readings, uint16_t count,
+                              uint8_t *buf, uint16_t size);
+
+// Decode a frame of 'len' bytes into at most 'max' readings.  Returns
+// the number of readings, or -1 for a bad CRC, an unknown version, a
+// truncated frame or more readings than 'max'.
+int onewire_frame_decode(const uint8_t *buf, uint16_t len,
+                         OneWireReading *readings, uint16_t max);
+
+#endif // __cplusplus
+#endif // OneWireESP_telemetry_h
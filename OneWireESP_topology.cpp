@@ -0,0 +1,243 @@
+/*
+DS2409 coupler topology for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_topology.h"
+#include <string.h>
+
+#define DS2409_FAMILY   0x1F
+
+// DS2409 commands
+#define SMART_ON_MAIN   0xCC
+#define SMART_ON_AUX    0x33
+#define ALL_LINES_OFF   0x66
+
+
+OneWireTopology::OneWireTopology(const OneWireBus &b)
+{
+    bus = b;
+    deviceCount = 0;
+    branchCount = 1;        // the trunk
+    active = 0;
+    clear_stats();
+}
+
+void OneWireTopology::clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+int OneWireTopology::find(const uint8_t rom[8]) const
+{
+    for (uint8_t i = 0; i < deviceCount; i++)
+        if (memcmp(roms[i], rom, 8) == 0) return i;
+    return -1;
+}
+
+int OneWireTopology::branch_of(const uint8_t rom[8]) const
+{
+    int i = find(rom);
+    return i < 0 ? -1 : where[i];
+}
+
+// 'branch' is the trunk, the active branch or one of its ancestors
+bool OneWireTopology::reachable(uint8_t branch) const
+{
+    uint8_t b = active;
+
+    if (branch == 0) return true;
+    while (b) {
+        if (b == branch) return true;
+        b = branches[b].parent;
+    }
+    return false;
+}
+
+//
+// Send a command to a coupler and check its confirmation.  Smart-On is
+// followed by a reset stimulus, for which the coupler resets the branch
+// and reports the presence result before confirming.
+//
+uint8_t OneWireTopology::coupler_cmd(const uint8_t rom[8], uint8_t cmd)
+{
+    static const uint8_t smart_on[] = {
+        OW_RESET, OW_MATCH, OW_WRITE_TX, 1, OW_WRITE, 1, 0xFF, OW_READ, 2, OW_END
+    };
+    static const uint8_t simple[] = {
+        OW_RESET, OW_MATCH, OW_WRITE_TX, 1, OW_READ, 1, OW_END
+    };
+    uint8_t rx[2];
+    uint8_t r;
+    bool smart = (cmd == SMART_ON_MAIN || cmd == SMART_ON_AUX);
+
+    stats.switches++;
+    r = onewire_run(bus, smart ? smart_on : simple, rom, &cmd, rx);
+    if (r == OW_OK && rx[smart ? 1 : 0] != cmd) r = OW_SWITCH_ERROR;
+    if (r != OW_OK) stats.errors++;
+    return r;
+}
+
+uint8_t OneWireTopology::lines_off(uint8_t branch)
+{
+    return coupler_cmd(roms[branches[branch].coupler], ALL_LINES_OFF);
+}
+
+uint8_t OneWireTopology::switch_to(uint8_t branch)
+{
+    uint8_t path[ONEWIRE_TOPO_BRANCHES];
+    uint8_t depth = 0;
+    uint8_t b = branch;
+    uint8_t r;
+
+    if (branch >= branchCount) return OW_BAD_PROGRAM;
+    if (reachable(branch)) {
+        stats.avoided++;
+        return OW_OK;
+    }
+
+    // branches to switch on, from 'branch' up to the first one on
+    while (b && !reachable(b)) {
+        path[depth++] = b;
+        b = branches[b].parent;
+    }
+
+    // Switch off what is on below that one, deepest first.  A coupler
+    // that is to switch to its other branch needs no All Lines Off: a
+    // DS2409 has one branch on at a time and Smart-On drops the other.
+    while (active != b) {
+        if (branches[active].parent == b &&
+            branches[active].coupler == branches[path[depth - 1]].coupler) {
+            active = b;
+            break;
+        }
+        r = lines_off(active);
+        if (r != OW_OK) return r;
+        active = branches[active].parent;
+    }
+    while (depth) {
+        const Branch &on = branches[path[--depth]];
+        r = coupler_cmd(roms[on.coupler], on.aux ? SMART_ON_AUX : SMART_ON_MAIN);
+        if (r != OW_OK) return r;
+        active = path[depth];
+    }
+    return OW_OK;
+}
+
+uint8_t OneWireTopology::all_off(void)
+{
+    uint8_t r;
+
+    while (active) {
+        r = lines_off(active);
+        if (r != OW_OK) return r;
+        active = branches[active].parent;
+    }
+    return OW_OK;
+}
+
+//
+// Record the devices that appear on 'branch' (already switched on), then
+// map the branches of the couplers found there.
+//
+uint8_t OneWireTopology::explore(uint8_t branch)
+{
+    uint8_t seen[ONEWIRE_TOPO_BRANCHES][8];
+    uint8_t seenCount = 0;
+    uint8_t first = deviceCount;
+    uint8_t rom[8];
+    bool more;
+    uint8_t r;
+
+    // Couplers not met before may have branches on from an earlier run,
+    // which would put their devices here: switch those off until no new
+    // coupler shows up.
+    do {
+        more = false;
+        onewire_search_reset(searchState);
+        while (onewire_search(bus, searchState, rom)) {
+            bool known = false;
+            if (rom[0] != DS2409_FAMILY || find(rom) >= 0) continue;
+            for (uint8_t i = 0; i < seenCount; i++)
+                if (memcmp(seen[i], rom, 8) == 0) known = true;
+            if (known || seenCount == ONEWIRE_TOPO_BRANCHES) continue;
+            memcpy(seen[seenCount++], rom, 8);
+            more = true;
+        }
+        for (uint8_t i = 0; more && i < seenCount; i++)
+            coupler_cmd(seen[i], ALL_LINES_OFF);
+    } while (more);
+
+    onewire_search_reset(searchState);
+    while (onewire_search(bus, searchState, rom)) {
+        if (find(rom) >= 0) continue;
+        if (deviceCount == ONEWIRE_TOPO_DEVICES) break;
+        memcpy(roms[deviceCount], rom, 8);
+        where[deviceCount++] = branch;
+    }
+
+    // only the couplers on this branch: the ones further down are added
+    // to the list by the calls below and explored there
+    uint8_t last = deviceCount;
+    for (uint8_t i = first; i < last; i++) {
+        if (roms[i][0] != DS2409_FAMILY) continue;
+        for (uint8_t aux = 0; aux < 2; aux++) {
+            if (branchCount == ONEWIRE_TOPO_BRANCHES) return OW_BAD_PROGRAM;
+            uint8_t nb = branchCount++;
+            branches[nb].coupler = i;
+            branches[nb].aux = aux;
+            branches[nb].parent = branch;
+            r = switch_to(nb);
+            if (r == OW_OK) r = explore(nb);
+            if (r != OW_OK) return r;
+        }
+    }
+    return OW_OK;
+}
+
+uint8_t OneWireTopology::discover(void)
+{
+    uint8_t r;
+
+    deviceCount = 0;
+    branchCount = 1;
+    active = 0;
+    r = explore(0);
+    if (r == OW_OK) r = all_off();
+    return r;
+}
+
+uint8_t OneWireTopology::run(const uint8_t rom[8], const uint8_t *prog,
+                             const uint8_t *tx /* = 0 */, uint8_t *rx /* = 0 */)
+{
+    int i = find(rom);
+    uint8_t r;
+
+    if (i < 0) return OW_UNKNOWN_DEVICE;
+    r = switch_to(where[i]);
+    if (r != OW_OK) return r;
+    return onewire_run(bus, prog, rom, tx, rx);
+}
+
+void OneWireTopology::order(const uint8_t **list, uint8_t count) const
+{
+    uint16_t key[256];
+
+    // reachable devices first, then by branch, unknown ones last
+    for (uint8_t i = 0; i < count; i++) {
+        int b = branch_of(list[i]);
+        key[i] = b < 0 ? 0xFFFF : reachable(b) ? 0 : b;
+    }
+    // insertion sort, stable so callers' order holds within a branch
+    for (uint8_t i = 1; i < count; i++) {
+        const uint8_t *p = list[i];
+        uint16_t k = key[i];
+        uint8_t j = i;
+        while (j && key[j - 1] > k) {
+            list[j] = list[j - 1];
+            key[j] = key[j - 1];
+            j--;
+        }
+        list[j] = p;
+        key[j] = k;
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef OneWireESP_topology_h
+#define OneWireESP_topology_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "OneWireESP_bus.h"
+#include "OneWireESP_program.h"
+
+// Tree of DS2409 MicroLAN couplers (family 0x1F) on one bus.
+//
+// Each coupler has a main and an auxiliary branch; devices on a branch
+// are only reachable while it is switched on, and so are couplers further
+// down.  discover() maps the tree once: it switches every branch on in
+// turn and records which branch each device answered on.  After that,
+// run() switches to the device's branch only if it is not already
+// reachable, so consecutive accesses to one branch (or to devices on the
+// trunk, which are always reachable) issue no coupler commands at all.
+//
+// Branch 0 is the trunk.  Branches are numbered in discovery order.
+
+#ifndef ONEWIRE_TOPO_DEVICES
+#define ONEWIRE_TOPO_DEVICES    64
+#endif
+
+#ifndef ONEWIRE_TOPO_BRANCHES
+#define ONEWIRE_TOPO_BRANCHES   16
+#endif
+
+// Results besides the onewire_run() ones: OW_UNKNOWN_DEVICE for a ROM
+// code discover() did not find, OW_SWITCH_ERROR when a coupler does not
+// confirm a command.
+
+struct OneWireTopoStats {
+    uint32_t switches;      // coupler commands issued
+    uint32_t avoided;       // accesses that needed no switching
+    uint32_t errors;        // coupler commands not confirmed
+};
+
+class OneWireTopology
+{
+  private:
+    struct Branch {
+        uint8_t coupler;        // device index of the DS2409
+        uint8_t aux;            // 0 main, 1 auxiliary
+        uint8_t parent;         // branch the coupler sits on
+    };
+
+    OneWireBus bus;
+    uint8_t roms[ONEWIRE_TOPO_DEVICES][8];
+    uint8_t where[ONEWIRE_TOPO_DEVICES];    // branch of each device
+    uint8_t deviceCount;
+    Branch branches[ONEWIRE_TOPO_BRANCHES];
+    uint8_t branchCount;
+    uint8_t active;         // deepest branch switched on, 0 if none
+    OneWireTopoStats stats;
+
+    OneWireSearchState searchState;
+
+    int find(const uint8_t rom[8]) const;
+    bool reachable(uint8_t branch) const;
+    uint8_t coupler_cmd(const uint8_t rom[8], uint8_t cmd);
+    uint8_t lines_off(uint8_t branch);
+    uint8_t explore(uint8_t branch);
+
+  public:
+    OneWireTopology(const OneWireBus &bus);
+
+    // Map the tree.  All branches are left off.  Returns OW_OK, or the
+    // first error; devices found before it are still recorded.  A tree
+    // with more than ONEWIRE_TOPO_BRANCHES branches gives OW_BAD_PROGRAM.
+    uint8_t discover(void);
+
+    uint8_t device_count(void) const { return deviceCount; }
+    const uint8_t *device(uint8_t i) const { return roms[i]; }
+
+    // Branch of 'rom', or -1 if it was not discovered
+    int branch_of(const uint8_t rom[8]) const;
+
+    // Make 'branch' reachable, switching only the couplers that differ
+    // from the current state.
+    uint8_t switch_to(uint8_t branch);
+
+    // Make 'rom' reachable and run a transaction program on it.
+    uint8_t run(const uint8_t rom[8], const uint8_t *prog,
+                const uint8_t *tx = 0, uint8_t *rx = 0);
+
+    // Reorder 'count' ROM codes so that devices reachable now come first
+    // and the rest are grouped by branch, which keeps switching to one
+    // round per branch when they are accessed in that order.
+    void order(const uint8_t **list, uint8_t count) const;
+
+    // Switch every branch off.
+    uint8_t all_off(void);
+
+    const OneWireTopoStats &get_stats() const { return stats; }
+    void clear_stats(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_topology_h
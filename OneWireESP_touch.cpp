@@ -0,0 +1,125 @@
+/*
+iButton touch reader for OneWireESP.  Same license as OneWireESP.cpp.
+*/
+
+#include "OneWireESP_touch.h"
+#include "OneWireESP_pm.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <string.h>
+
+
+OneWireTouch::OneWireTouch(const OneWireBus &b, gpio_num_t p, OneWireTouchCallback cb,
+                           void *arg, uint16_t debounce_ms, uint16_t probe_ms)
+    : presence(p, &stats.pulses)
+{
+    bus = b;
+    callback = cb;
+    callbackArg = arg;
+    debounce = debounce_ms;
+    probe = probe_ms;
+    memset(last, 0, sizeof(last));
+    held = false;
+    lastSeen = 0;
+    clear_stats();
+}
+
+void OneWireTouch::clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool OneWireTouch::begin(void)
+{
+    if (!presence.begin()) return false;
+    presence.arm();
+    return true;
+}
+
+void OneWireTouch::end(void)
+{
+    presence.end();
+}
+
+//
+// Read the ROM of whatever is on the probe and deliver it unless it is
+// a repeat.  'since' is when the touch was noticed.
+//
+bool OneWireTouch::read(int64_t since)
+{
+    uint8_t rom[8];
+    uint8_t r = OW_NO_PRESENCE;
+    int64_t start = esp_timer_get_time();
+
+    presence.disarm();
+    for (uint8_t i = 0; i < ONEWIRE_TOUCH_READS; i++) {
+        r = onewire_run(bus, onewire_prog_read_rom, 0, 0, rom);
+        if (r == OW_OK) break;
+        stats.bad_reads++;
+    }
+    presence.arm();
+
+    int64_t now = esp_timer_get_time();
+    stats.bus_us += (uint32_t)(now - start);
+    if (r != OW_OK) return false;
+
+    // still held, or back within the debounce time
+    bool repeat = memcmp(rom, last, 8) == 0 &&
+                  (held || now - lastSeen < (int64_t)debounce * 1000);
+    held = true;
+    lastSeen = now;
+    if (repeat) {
+        stats.repeats++;
+        return false;
+    }
+
+    memcpy(last, rom, 8);
+    uint32_t latency = (uint32_t)(now - since);
+    stats.touches++;
+    stats.latency_us += latency;
+    if (latency > stats.max_latency_us) stats.max_latency_us = latency;
+    if (callback) callback(rom, callbackArg);
+    return true;
+}
+
+bool OneWireTouch::poll(uint32_t timeout_ms)
+{
+    // a held button is checked every debounce time, an empty probe
+    // every probe time
+    uint32_t check = held ? debounce : probe;
+    uint32_t wait = check && check < timeout_ms ? check : timeout_ms;
+    TickType_t ticks = wait == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(wait);
+    bool pulse;
+
+    if (presence.active()) {
+        pulse = presence.wait(ticks);
+    } else {
+        vTaskDelay(ticks);
+        pulse = false;
+    }
+    if (pulse) return read(presence.last_pulse());
+    if (!check || wait != check) return false;
+
+    // a reset is enough to tell whether anything is on the probe
+    int64_t start = esp_timer_get_time();
+    presence.disarm();
+    onewire_pm_bus_begin();
+    uint8_t present = bus.reset(bus.ctx);
+    onewire_pm_bus_end();
+    presence.arm();
+    int64_t now = esp_timer_get_time();
+    stats.probes++;
+    stats.bus_us += (uint32_t)(now - start);
+
+    if (held) {
+        if (present) lastSeen = now;
+        else held = false;
+        return false;
+    }
+    return present ? read(start) : false;
+}
+
+void OneWireTouch::run(void)
+{
+    for (;;) poll(portMAX_DELAY);
+}
@@ -0,0 +1,99 @@
+#ifndef OneWireESP_touch_h
+#define OneWireESP_touch_h
+
+#ifdef __cplusplus
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "OneWireESP_bus.h"
+#include "OneWireESP_program.h"
+#include "OneWireESP_presence.h"
+
+// iButton touch reader.
+//
+// A reader port has at most one device on it, and only for as long as
+// someone holds an iButton against the probe.  Instead of looping on
+// reset and Read ROM, OneWireTouch waits: an iButton announces contact
+// with a presence pulse on the idle line, which an edge interrupt picks
+// up (OneWirePresence, as in OneWireHotplug), and the waiting task then does Read ROM
+// (0x33) straight away, retried on a bad CRC while the contact settles.
+// The ID goes to the callback a few milliseconds after the touch: the
+// task wake-up plus about 6ms per Read ROM attempt.
+//
+// Where the interrupt cannot be used (or as a backstop for a pulse lost
+// to contact bounce), a 'probe_ms' period adds a reset every so often
+// and reads the ROM only if something answers it.  Each probe is a
+// reset's worth of busy-waiting, and the touch waits for the next one:
+// on the simulated bus (bench_touch in test/) probing every 50ms keeps
+// the bus busy 1.9% of the time and delivers in 34ms on average, where
+// the interrupt costs nothing idle and delivers in 5.7ms.
+//
+// While the button stays on the probe it is checked with a reset alone
+// every 'debounce_ms'; the same ID is not delivered again until it has
+// been off the probe for that long.
+//
+// The port belongs to the reader: other traffic on it would look like
+// touches to the interrupt.
+
+// Read ROM attempts per touch
+#ifndef ONEWIRE_TOUCH_READS
+#define ONEWIRE_TOUCH_READS 3
+#endif
+
+// Called from poll() with the ID of a new touch
+typedef void (*OneWireTouchCallback)(const uint8_t rom[8], void *arg);
+
+struct OneWireTouchStats {
+    uint32_t pulses;        // presence pulses seen on the idle line
+    uint32_t probes;        // resets done to look for a button
+    uint32_t touches;       // IDs delivered
+    uint32_t repeats;       // a held or quickly retouched button, not delivered
+    uint32_t bad_reads;     // Read ROM attempts that failed
+    uint32_t latency_us;    // touch to callback, summed over the touches
+    uint32_t max_latency_us;
+    uint32_t bus_us;        // time spent on probes and reads
+};
+
+class OneWireTouch
+{
+  private:
+    OneWireBus bus;
+    OneWireTouchCallback callback;
+    void *callbackArg;
+    uint16_t debounce;      // ms
+    uint16_t probe;         // ms, 0 for none
+    uint8_t last[8];        // last ID delivered
+    bool held;              // a button is on the probe
+    int64_t lastSeen;       // when it last answered
+    OneWirePresence presence;
+    OneWireTouchStats stats;
+
+    bool read(int64_t since);
+
+  public:
+    // 'bus' is the reader port on 'pin'.
+    OneWireTouch(const OneWireBus &bus, gpio_num_t pin, OneWireTouchCallback cb,
+                 void *arg = 0, uint16_t debounce_ms = 500, uint16_t probe_ms = 0);
+
+    // Install the edge interrupt.  Returns false if it could not be set
+    // up; probing still works then if 'probe_ms' was given.
+    bool begin(void);
+    void end(void);
+
+    // Wait up to 'timeout_ms' for a touch and deliver it.  Returns true
+    // if the callback was called.
+    bool poll(uint32_t timeout_ms);
+
+    // poll() for ever.  Suitable as a task body.
+    void run(void);
+
+    // Whether a button is on the probe, and the last ID delivered
+    bool touched(void) const { return held; }
+    const uint8_t *id(void) const { return last; }
+
+    const OneWireTouchStats &get_stats() const { return stats; }
+    void clear_stats(void);
+};
+
+#endif // __cplusplus
+#endif // OneWireESP_touch_h
@@ -0,0 +1,74 @@
+// CPU utilisation of OneWireAsync against the blocking OneWire calls,
+// for the same transactions on the same simulated bus.
+//
+// The blocking calls busy-wait through every slot, so they use the CPU
+// for 100% of the bus time.  OneWireAsync only spends the short inline
+// pulses (10us write 1, 3+10us read) inside its alarm interrupt; on the
+// host the interrupt runs on the virtual clock, so isr_us is exactly that
+// inline time.  The entry and exit cost of each interrupt is not
+// modelled and is added per alarm for a few assumed values instead.
+
+#include "OneWireESP.h"
+#include "OneWireESP_async.h"
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+#define ROUNDS  100
+
+static const double overheads[] = { 0, 2, 5 };     // us per interrupt
+
+int main()
+{
+    host_virtual_clock(true);
+
+    SimWire wire;
+    SimThermometer t(sim_rom(0x28, 0x0102030405ull));
+    uint8_t rom[8], data[9];
+    sim_rom_bytes(t.rom, rom);
+    wire.attach(&t);
+    host_gpio_attach(OW1_PIN, &wire);
+
+    struct {
+        const char *name;
+        const uint8_t *prog;
+        const uint8_t *rom;
+    } loads[] = {
+        { "read scratchpad", onewire_prog_read_scratch, rom },
+        { "read ROM", onewire_prog_read_rom, 0 },
+    };
+
+    OneWire blocking(OW1_PIN);
+    OneWireAsync async(OW1_PIN);
+
+    printf("CPU use per transaction; the blocking calls use 100%% of their bus time\n");
+    printf("%-16s %11s %8s %8s %8s %7s", "transaction", "blocking us", "async us", "isr us",
+           "alarms", "async");
+    for (size_t k = 1; k < sizeof(overheads) / sizeof(overheads[0]); k++)
+        printf("  +%.0fus/irq", overheads[k]);
+    printf("\n");
+
+    for (size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); i++) {
+        int64_t start = host_time_us();
+        for (int r = 0; r < ROUNDS; r++)
+            CHECK_EQ(onewire_run(blocking.bus1(), loads[i].prog, loads[i].rom, 0, data), OW_OK);
+        double blockingUs = (double)(host_time_us() - start) / ROUNDS;
+
+        async.clear_stats();
+        uint64_t alarms = host_gptimer_alarms();
+        for (int r = 0; r < ROUNDS; r++)
+            CHECK_EQ(onewire_run(async.bus(), loads[i].prog, loads[i].rom, 0, data), OW_OK);
+        const OneWireAsyncStats &s = async.get_stats();
+        double bus = (double)s.bus_us / ROUNDS;
+        double isr = (double)s.isr_us / ROUNDS;
+        double irqs = (double)(host_gptimer_alarms() - alarms) / ROUNDS;
+
+        printf("%-16s %11.0f %8.0f %8.0f %8.0f %6.1f%%", loads[i].name, blockingUs, bus, isr,
+               irqs, 100.0 * isr / bus);
+        for (size_t k = 1; k < sizeof(overheads) / sizeof(overheads[0]); k++)
+            printf("  %8.1f%%", 100.0 * (isr + irqs * overheads[k]) / bus);
+        printf("\n");
+        CHECK(bus >= blockingUs * 0.95 && bus <= blockingUs * 1.05);
+    }
+    return test_result("bench_async");
+}
@@ -0,0 +1,66 @@
+// OneWireShards throughput as the number of buses grows: each bus has a
+// DS18B20 read in a loop, on the real clock, with the slots spun in full
+// (a bit-banged slot keeps its CPU busy).  One engine per core, so with
+// two cores the rate should double from one bus to two and then stay.
+//
+// The host's engine tasks are plain threads, not pinned.  On a host with
+// one CPU they take turns on it and the rate cannot grow at all; the
+// CPU count is printed with the results so they are read that way.
+
+#include "OneWireESP_shard.h"
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+#include <unistd.h>
+
+#define MAX_BUSES   ONEWIRE_SHARD_BUSES
+#define RUN_US      1000000
+#define DIVIDER     10          // slots 10 times short: ~1.1 ms per reading
+
+int main()
+{
+    static SimWire wires[MAX_BUSES];
+    SimThermometer *sensors[MAX_BUSES];
+    uint8_t roms[MAX_BUSES][8], data[MAX_BUSES][9];
+    double single = 0;
+
+    for (int i = 0; i < MAX_BUSES; i++) {
+        sensors[i] = new SimThermometer(sim_rom(0x28, i + 1));
+        wires[i].attach(sensors[i]);
+        wires[i].time_divider = DIVIDER;
+        sim_rom_bytes(sensors[i]->rom, roms[i]);
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("%ld host CPU(s), %d engine cores; Read Scratchpad per second\n", cpus, portNUM_PROCESSORS);
+    if (cpus < portNUM_PROCESSORS)
+        printf("  fewer CPUs than engines: they share the CPU, so the rate cannot grow here\n");
+    printf("%5s %10s %8s %9s\n", "buses", "jobs/s", "speedup", "ideal");
+    for (int n = 1; n <= MAX_BUSES; n *= 2) {
+        OneWireShards shards;
+        for (int i = 0; i < n; i++) CHECK_EQ(shards.add_bus(wires[i].bus()), i);
+        CHECK(shards.start());
+
+        // one job in flight per bus, resubmitted as it comes back
+        for (int i = 0; i < n; i++)
+            CHECK(shards.submit(i, onewire_prog_read_scratch, roms[i], 0, data[i], i));
+        shards.clear_stats();
+        int64_t start = host_time_us();
+        while (host_time_us() - start < RUN_US) {
+            OneWireShardResult r;
+            if (!shards.collect(r, 1000)) break;
+            CHECK_EQ(r.status, OW_OK);
+            CHECK(shards.submit(r.bus, onewire_prog_read_scratch, roms[r.bus], 0, data[r.bus], r.bus));
+        }
+        uint32_t rate = shards.jobs_per_second();
+        shards.stop();
+
+        if (n == 1) single = rate;
+        int ideal = n < portNUM_PROCESSORS ? n : portNUM_PROCESSORS;
+        printf("%5d %10u %7.2fx %8dx\n", n, rate, single ? rate / single : 0, ideal);
+    }
+
+    for (int i = 0; i < MAX_BUSES; i++) delete sensors[i];
+    return test_result("bench_shard");
+}
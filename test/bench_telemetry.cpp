@@ -0,0 +1,75 @@
+// Cost of shipping readings: binary frames against one JSON object per
+// reading (ROM as hex, as the application used to send them), for a
+// batch of DS18B20 readings taken together.  Real clock, so the times
+// are this host's, not an ESP32's; the ratio and the bytes are what
+// carry over.
+
+#include "OneWireESP_telemetry.h"
+#include "host/host.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BATCH   32
+#define ROUNDS  20000
+
+static volatile uint32_t sink;
+
+int main()
+{
+    static OneWireReading readings[BATCH], decoded[BATCH];
+    static uint8_t roms[BATCH][8];
+    static uint8_t frame[BATCH * 16];
+    static char json[BATCH * 96];
+
+    for (int i = 0; i < BATCH; i++) {
+        static const uint8_t base[8] = { 0x28, 0xFF, 0x4C, 0x19, 0x60, 0x17, 0x05, 0x00 };
+        memcpy(roms[i], base, 8);
+        roms[i][1] = (uint8_t)(i * 37);
+        readings[i].device = (uint16_t)i;
+        readings[i].time_ms = 86400000u + (uint32_t)i * 3;
+        readings[i].value = 0x0191 + (i % 5) - 2;
+        readings[i].status = i == 7 ? 2 : 0;
+    }
+
+    int64_t start = host_time_us();
+    uint16_t frameLen = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        readings[0].time_ms += 1000;
+        frameLen = onewire_frame_encode(readings, BATCH, frame, sizeof(frame));
+        sink += frameLen;
+    }
+    double encodeNs = (host_time_us() - start) * 1000.0 / ROUNDS / BATCH;
+
+    start = host_time_us();
+    for (int r = 0; r < ROUNDS; r++)
+        sink += (uint32_t)onewire_frame_decode(frame, frameLen, decoded, BATCH);
+    double decodeNs = (host_time_us() - start) * 1000.0 / ROUNDS / BATCH;
+    CHECK_EQ(onewire_frame_decode(frame, frameLen, decoded, BATCH), BATCH);
+
+    start = host_time_us();
+    size_t jsonLen = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        readings[0].time_ms += 1000;
+        jsonLen = 0;
+        for (int i = 0; i < BATCH; i++) {
+            const uint8_t *a = roms[readings[i].device];
+            jsonLen += (size_t)snprintf(json + jsonLen, sizeof(json) - jsonLen,
+                "{\"rom\":\"%02X%02X%02X%02X%02X%02X%02X%02X\",\"t\":%u,\"v\":%d,\"s\":%u}\n",
+                a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7],
+                (unsigned)readings[i].time_ms, (int)readings[i].value,
+                (unsigned)readings[i].status);
+        }
+        sink += (uint32_t)jsonLen;
+    }
+    double jsonNs = (host_time_us() - start) * 1000.0 / ROUNDS / BATCH;
+
+    printf("%d readings per batch, per reading:\n", BATCH);
+    printf("  %-14s %6.1f bytes  %7.1f ns encode  %7.1f ns decode\n", "binary frame",
+           (double)frameLen / BATCH, encodeNs, decodeNs);
+    printf("  %-14s %6.1f bytes  %7.1f ns encode\n", "JSON", (double)jsonLen / BATCH, jsonNs);
+    CHECK(frameLen * 8 < jsonLen);
+
+    return test_result("bench_telemetry");
+}
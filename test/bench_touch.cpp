@@ -0,0 +1,126 @@
+// Touch to callback latency and CPU cost of OneWireTouch, woken by the
+// presence pulse against probing with a reset every so often.
+//
+// Virtual clock: the latency is the bus time of the probe and the Read
+// ROM plus, when probing, the wait for the next probe.  The task wake-up
+// after the interrupt is not modelled.  A touch lands at a random point
+// of the probe period: the button is put on the probe as the wait
+// starts, which changes nothing until the next probe, and the random
+// offset is taken off the measured time.
+//
+// The CPU cost is the bus time: the bit-banged bus busy-waits through it.
+// Idle is a minute with nothing on the probe; the edge interrupts of a
+// touch (two per pulse) are not counted.
+
+#include "OneWireESP_touch.h"
+#include "sim.h"
+#include "test.h"
+
+#include <stdio.h>
+
+#define TOUCH_PIN   GPIO_NUM_4
+#define TOUCHES     50
+#define IDLE_US     60000000
+
+class PulseLine : public HostLine
+{
+  public:
+    PulseLine() : low(false) { }
+    void master(int state) { (void)state; }
+    int level(void) { return !low; }
+
+    void pulse(uint32_t us)
+    {
+        low = true;
+        host_gpio_edge(TOUCH_PIN);
+        host_advance_us(us);
+        low = false;
+        host_gpio_edge(TOUCH_PIN);
+    }
+
+  private:
+    bool low;
+};
+
+static int64_t delivered;
+
+static void on_touch(const uint8_t rom[8], void *arg)
+{
+    (void)rom;
+    (void)arg;
+    delivered = host_time_us();
+}
+
+static uint32_t next_random(uint32_t &s)
+{
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+}
+
+int main()
+{
+    host_virtual_clock(true);
+    PulseLine line;
+    host_gpio_attach(TOUCH_PIN, &line);
+
+    struct {
+        const char *name;
+        bool interrupt;
+        uint16_t probe_ms;
+    } modes[] = {
+        { "interrupt", true, 0 },
+        { "interrupt + 1s probe", true, 1000 },
+        { "probe 50ms", false, 50 },
+        { "probe 200ms", false, 200 },
+        { "probe 1s", false, 1000 },
+    };
+
+    printf("%-22s %9s %9s %10s %9s\n", "mode", "mean ms", "max ms", "idle CPU", "touch us");
+    uint32_t seed = 12345;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        SimWire wire;
+        SimDevice button(sim_rom(0x01, 0x4242));
+        OneWireTouch touch(wire.bus(), TOUCH_PIN, on_touch, 0, 500, modes[m].probe_ms);
+        if (modes[m].interrupt) CHECK(touch.begin());
+
+        // idle
+        int64_t start = host_time_us();
+        while (host_time_us() - start < IDLE_US) CHECK(!touch.poll(1000));
+        double idle = 100.0 * touch.get_stats().bus_us / (double)(host_time_us() - start);
+
+        double sum = 0, max = 0;
+        uint64_t busUs = 0;
+        for (int i = 0; i < TOUCHES; i++) {
+            int64_t at;
+            uint32_t before = touch.get_stats().bus_us;
+            wire.attach(&button);
+            if (modes[m].interrupt) {
+                line.pulse(120);
+                at = host_time_us();
+            } else {
+                at = host_time_us() + next_random(seed) % (modes[m].probe_ms * 1000);
+            }
+            delivered = -1;
+            while (delivered < 0) touch.poll(1000);
+            busUs += touch.get_stats().bus_us - before;
+            double ms = (delivered - at) / 1000.0;
+            sum += ms;
+            if (ms > max) max = ms;
+
+            // off the probe for longer than the debounce time
+            wire.detach(&button);
+            while (touch.touched()) touch.poll(1000);
+            host_advance_us(600000);
+        }
+        CHECK_EQ(touch.get_stats().touches, TOUCHES);
+        CHECK_EQ(touch.get_stats().bad_reads, 0);
+        printf("%-22s %9.2f %9.2f %9.3f%% %9.0f\n", modes[m].name, sum / TOUCHES, max, idle,
+               (double)busUs / TOUCHES);
+        touch.end();
+    }
+
+    host_gpio_attach(TOUCH_PIN, 0);
+    return test_result("bench_touch");
+}
@@ -0,0 +1,3 @@
+#pragma once
+// Host stand-in: OneWireESP.h only wants the critical section macros
+#include "freertos/FreeRTOS.h"
@@ -0,0 +1,4 @@
+#pragma once
+// Host stand-in: there is no IRAM on the host
+#define IRAM_ATTR
+#define DRAM_ATTR
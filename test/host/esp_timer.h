@@ -0,0 +1,5 @@
+#pragma once
+#include <stdint.h>
+
+// Host stand-in: the host clock, see host.h
+int64_t esp_timer_get_time(void);
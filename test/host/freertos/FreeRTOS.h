@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+// Host stand-in for the part of FreeRTOS the library uses.  Tasks are
+// threads, critical sections share one recursive lock, and the tick is
+// 10ms as in a default ESP-IDF configuration.  See host.h.
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint8_t StackType_t;
+
+#define configTICK_RATE_HZ      100
+#define portTICK_PERIOD_MS      (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define portMAX_DELAY           ((TickType_t)0xffffffffu)
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  1
+#define pdFAIL                  0
+#define portNUM_PROCESSORS      2
+#define tskNO_AFFINITY          0x7FFFFFFF
+
+typedef struct { int unused; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+
+void portENTER_CRITICAL(portMUX_TYPE *mux);
+void portEXIT_CRITICAL(portMUX_TYPE *mux);
+#define portENTER_CRITICAL_ISR(m)   portENTER_CRITICAL(m)
+#define portEXIT_CRITICAL_ISR(m)    portEXIT_CRITICAL(m)
+#define portYIELD_FROM_ISR(x)       (void)(x)
@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+#include "soc/gpio_struct.h"
+
+// Host stand-ins for the register level pin calls.  The pin's output
+// enable and output level drive the HostLine attached to it, reads come
+// from that line (see host.h).
+void gpio_ll_set_level(gpio_dev_t *hw, uint32_t gpio_num, uint32_t level);
+int gpio_ll_get_level(gpio_dev_t *hw, uint32_t gpio_num);
+void gpio_ll_output_enable(gpio_dev_t *hw, uint32_t gpio_num);
+void gpio_ll_output_disable(gpio_dev_t *hw, uint32_t gpio_num);
+void gpio_ll_input_enable(gpio_dev_t *hw, uint32_t gpio_num);
@@ -0,0 +1,696 @@
+// Host implementations of the ESP-IDF and FreeRTOS calls the library makes.
+
+#include "host.h"
+#include "esp_timer.h"
+#include "rom/ets_sys.h"
+#include "driver/gpio.h"
+#include "hal/gpio_ll.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "driver/gptimer.h"
+#include "driver/i2c_master.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+//
+// Clock
+//
+
+static std::atomic<bool> virtualClock(false);
+static std::atomic<int64_t> virtualNow(1000000);
+
+static int64_t real_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void host_virtual_clock(bool on)
+{
+    virtualClock = on;
+}
+
+bool host_virtual(void)
+{
+    return virtualClock;
+}
+
+int64_t host_time_us(void)
+{
+    return virtualClock ? virtualNow.load() : real_us();
+}
+
+void host_advance_us(int64_t us)
+{
+    if (us <= 0) return;
+    if (virtualClock) {
+        virtualNow += us;
+        return;
+    }
+    int64_t until = real_us() + us;
+    while (real_us() < until) { }
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return host_time_us();
+}
+
+void ets_delay_us(uint32_t us)
+{
+    host_advance_us(us);
+}
+
+// Wait for 'cv' until 'ready', at most 'ticks'.  With the virtual clock
+// a timed wait does not sleep: if it is not ready at once the clock moves
+// on by the timeout.
+template <class Ready>
+static bool wait_ticks(std::unique_lock<std::mutex> &lock, std::condition_variable &cv,
+                       TickType_t ticks, Ready ready)
+{
+    if (ready()) return true;
+    if (ticks == 0) return false;
+    if (ticks == portMAX_DELAY) {
+        cv.wait(lock, ready);
+        return true;
+    }
+    int64_t us = (int64_t)ticks * 1000000 / configTICK_RATE_HZ;
+    if (virtualClock) {
+        virtualNow += us;
+        return false;
+    }
+    return cv.wait_for(lock, std::chrono::microseconds(us), ready);
+}
+
+//
+// Critical sections: one lock for all of them, as on a single core
+//
+
+static std::recursive_mutex criticalLock;
+
+void portENTER_CRITICAL(portMUX_TYPE *)
+{
+    criticalLock.lock();
+}
+
+void portEXIT_CRITICAL(portMUX_TYPE *)
+{
+    criticalLock.unlock();
+}
+
+//
+// Tasks
+//
+
+struct HostTask {
+    std::mutex m;
+    std::condition_variable cv;
+    uint32_t notify = 0;
+    UBaseType_t prio = 1;
+    TaskFunction_t fn = 0;
+    void *arg = 0;
+    bool owned = false;     // allocated by xTaskCreatePinnedToCore()
+};
+
+static_assert(sizeof(HostTask) <= sizeof(StaticTask_t), "StaticTask_t too small");
+
+static thread_local HostTask *self;
+
+static HostTask *current(void)
+{
+    static thread_local HostTask own;
+    if (!self) self = &own;
+    return self;
+}
+
+void host_task_priority(unsigned prio)
+{
+    current()->prio = prio;
+}
+
+static void *task_main(void *p)
+{
+    HostTask *t = (HostTask *)p;
+    self = t;
+    t->fn(t->arg);
+    fprintf(stderr, "host: task function returned\n");
+    abort();
+}
+
+static TaskHandle_t start_task(HostTask *t, TaskFunction_t fn, void *arg, UBaseType_t prio)
+{
+    t->fn = fn;
+    t->arg = arg;
+    t->prio = prio;
+    pthread_t thread;
+    if (pthread_create(&thread, 0, task_main, t) != 0) return 0;
+    pthread_detach(thread);
+    return t;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *, uint32_t, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *task, BaseType_t)
+{
+    HostTask *t = new HostTask;
+    t->owned = true;
+    TaskHandle_t h = start_task(t, fn, arg, prio);
+    if (task) *task = h;
+    return h ? pdPASS : pdFAIL;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char *, uint32_t, void *arg,
+                                           UBaseType_t prio, StackType_t *, StaticTask_t *taskBuf,
+                                           BaseType_t)
+{
+    return start_task(new (taskBuf) HostTask, fn, arg, prio);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task && task != current()) {
+        fprintf(stderr, "host: vTaskDelete() of another task is not supported\n");
+        abort();
+    }
+    pthread_exit(0);
+}
+
+static std::atomic<uint64_t> delays;
+
+uint64_t host_task_delays(void)
+{
+    return delays;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    delays++;
+    int64_t us = (int64_t)ticks * 1000000 / configTICK_RATE_HZ;
+    if (virtualClock) {
+        virtualNow += us;
+        return;
+    }
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (long)(us % 1000000) * 1000;
+    nanosleep(&ts, 0);
+}
+
+void taskYIELD(void)
+{
+    sched_yield();
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_time_us() * configTICK_RATE_HZ / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current();
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return (task ? task : current())->prio;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    HostTask *t = current();
+    std::unique_lock<std::mutex> lock(t->m);
+    if (!wait_ticks(lock, t->cv, ticks, [t] { return t->notify != 0; })) return 0;
+    uint32_t v = t->notify;
+    t->notify = clear ? 0 : v - 1;
+    return v;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(task->m);
+        task->notify++;
+    }
+    task->cv.notify_all();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyGive(task);
+    if (woken) *woken = pdTRUE;
+}
+
+//
+// Semaphores
+//
+
+struct HostSemaphore {
+    std::mutex m;
+    std::condition_variable cv;
+    unsigned count;
+    unsigned max;
+};
+
+static_assert(sizeof(HostSemaphore) <= sizeof(StaticSemaphore_t), "StaticSemaphore_t too small");
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buf)
+{
+    return xSemaphoreCreateCountingStatic(1, 0, buf);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCountingStatic(UBaseType_t max, UBaseType_t initial,
+                                                 StaticSemaphore_t *buf)
+{
+    HostSemaphore *s = new (buf) HostSemaphore;
+    s->count = initial;
+    s->max = max;
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf)
+{
+    return xSemaphoreCreateCountingStatic(1, 1, buf);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(s->m);
+    if (!wait_ticks(lock, s->cv, ticks, [s] { return s->count != 0; })) return pdFALSE;
+    s->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    {
+        std::lock_guard<std::mutex> lock(s->m);
+        if (s->count >= s->max) return pdFALSE;
+        s->count++;
+    }
+    s->cv.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t s, BaseType_t *woken)
+{
+    BaseType_t r = xSemaphoreGive(s);
+    if (woken) *woken = r;
+    return r;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t s)
+{
+    s->~HostSemaphore();
+}
+
+//
+// GPIO
+//
+
+gpio_dev_t GPIO;
+
+struct HostPin {
+    bool oe;
+    uint32_t out;
+    HostLine *line;
+    gpio_int_type_t intr;
+    bool enabled;
+    gpio_isr_t handler;
+    void *arg;
+};
+
+static HostPin pins[GPIO_NUM_MAX];
+static bool isrService;
+
+static int drive_state(const HostPin &p)
+{
+    return p.oe ? (int)p.out : -1;
+}
+
+static int read_level(const HostPin &p)
+{
+    if (p.line) return p.line->level();
+    return p.oe ? (int)p.out : 1;
+}
+
+static void isr(HostPin &p)
+{
+    if (p.handler && p.enabled && p.intr != GPIO_INTR_DISABLE) p.handler(p.arg);
+}
+
+// Apply a change of the pin's output enable or level
+static void update(uint32_t pin, bool oe, uint32_t out)
+{
+    HostPin &p = pins[pin];
+    int before = drive_state(p);
+    int was = read_level(p);
+    p.oe = oe;
+    p.out = out ? 1 : 0;
+    int after = drive_state(p);
+    if (after == before) return;
+    if (p.line) p.line->master(after);
+    if (read_level(p) != was) isr(p);
+}
+
+void host_gpio_attach(int pin, HostLine *line)
+{
+    pins[pin].line = line;
+    if (line) line->master(drive_state(pins[pin]));
+}
+
+int host_gpio_drive(int pin)
+{
+    return drive_state(pins[pin]);
+}
+
+void host_gpio_edge(int pin)
+{
+    isr(pins[pin]);
+}
+
+void gpio_ll_set_level(gpio_dev_t *, uint32_t n, uint32_t level)
+{
+    update(n, pins[n].oe, level);
+}
+
+int gpio_ll_get_level(gpio_dev_t *, uint32_t n)
+{
+    return read_level(pins[n]);
+}
+
+void gpio_ll_output_enable(gpio_dev_t *, uint32_t n)
+{
+    update(n, true, pins[n].out);
+}
+
+void gpio_ll_output_disable(gpio_dev_t *, uint32_t n)
+{
+    update(n, false, pins[n].out);
+}
+
+void gpio_ll_input_enable(gpio_dev_t *, uint32_t)
+{
+}
+
+int gpio_get_level(gpio_num_t n)
+{
+    return read_level(pins[n]);
+}
+
+esp_err_t gpio_set_level(gpio_num_t n, uint32_t level)
+{
+    update(n, pins[n].oe, level);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t n, gpio_mode_t mode)
+{
+    bool oe = mode == GPIO_MODE_OUTPUT || mode == GPIO_MODE_OUTPUT_OD ||
+              mode == GPIO_MODE_INPUT_OUTPUT_OD || mode == GPIO_MODE_INPUT_OUTPUT;
+    update(n, oe, pins[n].out);
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int)
+{
+    if (isrService) return ESP_ERR_INVALID_STATE;
+    isrService = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t n, gpio_int_type_t type)
+{
+    pins[n].intr = type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t n, gpio_isr_t handler, void *arg)
+{
+    if (!isrService) return ESP_ERR_INVALID_STATE;
+    pins[n].handler = handler;
+    pins[n].arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t n)
+{
+    pins[n].handler = 0;
+    pins[n].arg = 0;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t n)
+{
+    pins[n].enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t n)
+{
+    pins[n].enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_sleep_sel_dis(gpio_num_t)
+{
+    return ESP_OK;
+}
+
+//
+// GPTimer
+//
+
+struct gptimer_t {
+    gptimer_event_callbacks_t cbs;
+    void *arg;
+    bool enabled;
+    bool running;
+    bool alarmSet;
+    uint64_t alarm;
+    uint64_t count0;        // count at 'base'
+    int64_t base;
+};
+
+static std::atomic<int> timersLive;
+static std::atomic<uint64_t> timerAlarms;
+static bool failRegister;
+
+int host_gptimer_live(void)
+{
+    return timersLive;
+}
+
+uint64_t host_gptimer_alarms(void)
+{
+    return timerAlarms;
+}
+
+void host_gptimer_fail(bool register_callbacks)
+{
+    failRegister = register_callbacks;
+}
+
+static uint64_t timer_count(gptimer_handle_t t)
+{
+    return t->count0 + (uint64_t)(host_time_us() - t->base);
+}
+
+esp_err_t gptimer_new_timer(const gptimer_config_t *config, gptimer_handle_t *ret)
+{
+    if (!config || config->resolution_hz != 1000000) return ESP_ERR_INVALID_ARG;
+    gptimer_t *t = new gptimer_t();
+    t->base = host_time_us();
+    timersLive++;
+    *ret = t;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_del_timer(gptimer_handle_t t)
+{
+    if (t->enabled) return ESP_ERR_INVALID_STATE;
+    delete t;
+    timersLive--;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_register_event_callbacks(gptimer_handle_t t, const gptimer_event_callbacks_t *cbs,
+                                           void *arg)
+{
+    if (failRegister) {
+        failRegister = false;
+        return ESP_ERR_NO_MEM;
+    }
+    if (t->enabled) return ESP_ERR_INVALID_STATE;
+    t->cbs = *cbs;
+    t->arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_enable(gptimer_handle_t t)
+{
+    if (t->enabled) return ESP_ERR_INVALID_STATE;
+    t->enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_disable(gptimer_handle_t t)
+{
+    if (!t->enabled || t->running) return ESP_ERR_INVALID_STATE;
+    t->enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_start(gptimer_handle_t t)
+{
+    if (!t->enabled || t->running) return ESP_ERR_INVALID_STATE;
+    t->base = host_time_us();
+    t->running = true;
+    while (t->running && t->alarmSet && t->cbs.on_alarm) {
+        uint64_t now = timer_count(t);
+        if (now < t->alarm) host_advance_us((int64_t)(t->alarm - now));
+        t->alarmSet = false;
+        gptimer_alarm_event_data_t edata = { timer_count(t), t->alarm };
+        timerAlarms++;
+        t->cbs.on_alarm(t, &edata, t->arg);
+    }
+    return ESP_OK;
+}
+
+esp_err_t gptimer_stop(gptimer_handle_t t)
+{
+    if (!t->running) return ESP_ERR_INVALID_STATE;
+    t->count0 = timer_count(t);
+    t->base = host_time_us();
+    t->running = false;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_set_raw_count(gptimer_handle_t t, uint64_t value)
+{
+    t->count0 = value;
+    t->base = host_time_us();
+    return ESP_OK;
+}
+
+esp_err_t gptimer_get_raw_count(gptimer_handle_t t, uint64_t *value)
+{
+    *value = t->running ? timer_count(t) : t->count0;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t t, const gptimer_alarm_config_t *config)
+{
+    t->alarmSet = config != 0;
+    if (config) t->alarm = config->alarm_count;
+    return ESP_OK;
+}
+
+//
+// I2C master
+//
+
+struct i2c_master_bus_t {
+    i2c_port_num_t port;
+};
+
+struct i2c_master_dev_t {
+    uint16_t address;
+    uint32_t sclHz;
+};
+
+static HostI2cDevice *i2cDevices[128];
+static std::atomic<int> i2cLive;
+static std::atomic<uint64_t> i2cTransfers;
+
+void host_i2c_attach(uint16_t address, HostI2cDevice *dev)
+{
+    i2cDevices[address & 0x7F] = dev;
+}
+
+int host_i2c_live(void)
+{
+    return i2cLive;
+}
+
+uint64_t host_i2c_transfers(void)
+{
+    return i2cTransfers;
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *config, i2c_master_bus_handle_t *ret_bus)
+{
+    i2c_master_bus_t *b = new i2c_master_bus_t;
+    b->port = config->i2c_port;
+    *ret_bus = b;
+    return ESP_OK;
+}
+
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus)
+{
+    delete bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus, const i2c_device_config_t *config,
+                                    i2c_master_dev_handle_t *ret_handle)
+{
+    if (!bus || !config->scl_speed_hz || config->dev_addr_length != I2C_ADDR_BIT_LEN_7)
+        return ESP_ERR_INVALID_ARG;
+    i2c_master_dev_t *d = new i2c_master_dev_t;
+    d->address = config->device_address & 0x7F;
+    d->sclHz = config->scl_speed_hz;
+    *ret_handle = d;
+    i2cLive++;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle)
+{
+    delete handle;
+    i2cLive--;
+    return ESP_OK;
+}
+
+// Address byte plus 'bytes', nine clocks each
+static void i2c_spend(i2c_master_dev_handle_t dev, size_t bytes)
+{
+    host_advance_us((int64_t)((bytes + 1) * 9 * 1000000ull / dev->sclHz));
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t dev, const uint8_t *write_buffer,
+                              size_t write_size, int)
+{
+    HostI2cDevice *d = i2cDevices[dev->address];
+    i2cTransfers++;
+    i2c_spend(dev, write_size);
+    return d && d->write(write_buffer, write_size) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t dev, uint8_t *read_buffer,
+                             size_t read_size, int)
+{
+    HostI2cDevice *d = i2cDevices[dev->address];
+    i2cTransfers++;
+    i2c_spend(dev, read_size);
+    return d && d->read(read_buffer, read_size) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t dev, const uint8_t *write_buffer,
+                                      size_t write_size, uint8_t *read_buffer, size_t read_size,
+                                      int timeout_ms)
+{
+    esp_err_t r = i2c_master_transmit(dev, write_buffer, write_size, timeout_ms);
+    if (r != ESP_OK) return r;
+    return i2c_master_receive(dev, read_buffer, read_size, timeout_ms);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Test side controls of the ESP-IDF and FreeRTOS stand-ins in this
+// directory.  They are just enough to run the library on a Linux host:
+// tasks are threads, semaphores and notifications are condition
+// variables, and the clock is either the real monotonic clock or a
+// virtual one that only moves when something waits.
+//
+// With the virtual clock ets_delay_us(), vTaskDelay() and the timed out
+// semaphore and notification waits advance the clock instead of
+// sleeping, so bus timing is exact and a test takes no wall time.  A wait
+// with portMAX_DELAY still blocks for real, for another thread to end.
+
+// Switch between the real (default) and the virtual clock
+void host_virtual_clock(bool on);
+bool host_virtual(void);
+
+// Microseconds, the same clock as esp_timer_get_time()
+int64_t host_time_us(void);
+
+// Let 'us' microseconds pass: move the virtual clock, or spin on the real one
+void host_advance_us(int64_t us);
+
+// The wire on a pin.  master() is told every change of what the pin
+// drives: -1 released, 0 low, 1 high.  level() is what the pin reads.
+class HostLine
+{
+  public:
+    virtual ~HostLine() { }
+    virtual void master(int state) = 0;
+    virtual int level(void) = 0;
+};
+
+// Put a line on a pin (0 takes it off; a bare pin reads what it drives,
+// or 1 when released, as with a pullup)
+void host_gpio_attach(int pin, HostLine *line);
+
+// The pin's current drive state, as passed to HostLine::master()
+int host_gpio_drive(int pin);
+
+// Run the pin's GPIO interrupt handler if it is installed and enabled.
+// Edges the master makes itself are delivered without this; a test calls
+// it for edges a device makes on its own.
+void host_gpio_edge(int pin);
+
+// Priority uxTaskPriorityGet() reports for the calling thread (default 1)
+void host_task_priority(unsigned prio);
+
+// vTaskDelay() calls made so far, by all tasks
+uint64_t host_task_delays(void);
+
+// GPTimer counters: timers allocated and not deleted, and alarm
+// callbacks run.  host_gptimer_fail() makes the next
+// gptimer_register_event_callbacks() call fail.
+int host_gptimer_live(void);
+uint64_t host_gptimer_alarms(void);
+void host_gptimer_fail(bool register_callbacks);
+
+// A slave on the I2C stand-in.  write() gets the bytes of a write
+// transfer and read() fills a read transfer; returning false NACKs it.
+class HostI2cDevice
+{
+  public:
+    virtual ~HostI2cDevice() { }
+    virtual bool write(const uint8_t *buf, size_t len) = 0;
+    virtual bool read(uint8_t *buf, size_t len) = 0;
+};
+
+// Put a device at a 7 bit address (0 takes it off)
+void host_i2c_attach(uint16_t address, HostI2cDevice *dev);
+
+// Device handles added with i2c_master_bus_add_device() and not removed,
+// and transfers made so far
+int host_i2c_live(void);
+uint64_t host_i2c_transfers(void);
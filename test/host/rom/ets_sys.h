@@ -0,0 +1,5 @@
+#pragma once
+#include <stdint.h>
+
+// Host stand-in: advances the virtual clock, or spins on the real one
+void ets_delay_us(uint32_t us);
@@ -0,0 +1,2 @@
+#pragma once
+// Host stand-in: no Kconfig options are set
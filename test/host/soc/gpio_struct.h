@@ -0,0 +1,4 @@
+#pragma once
+
+typedef struct gpio_dev_s { int unused; } gpio_dev_t;
+extern gpio_dev_t GPIO;
@@ -0,0 +1,1133 @@
+// Simulated 1-Wire bus for the host tests, see sim.h.
+
+#include "sim.h"
+#include "OneWireESP_sha.h"
+#include <algorithm>
+#include <string.h>
+
+uint8_t sim_crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0;
+    while (len--) {
+        uint8_t b = *data++;
+        for (int i = 0; i < 8; i++) {
+            uint8_t mix = (crc ^ b) & 1;
+            crc >>= 1;
+            if (mix) crc ^= 0x8C;
+            b >>= 1;
+        }
+    }
+    return crc;
+}
+
+uint64_t sim_rom(uint8_t family, uint64_t serial)
+{
+    uint8_t b[8];
+    uint64_t v = family | (serial & 0xFFFFFFFFFFFFull) << 8;
+    sim_rom_bytes(v, b);
+    b[7] = sim_crc8(b, 7);
+    return sim_rom_value(b);
+}
+
+void sim_rom_bytes(uint64_t rom, uint8_t out[8])
+{
+    for (int i = 0; i < 8; i++) out[i] = (uint8_t)(rom >> (8 * i));
+}
+
+uint64_t sim_rom_value(const uint8_t rom[8])
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = v << 8 | rom[i];
+    return v;
+}
+
+//
+// Device
+//
+
+SimDevice::SimDevice(uint64_t r)
+    : rom(r), alarm(false), wire(0), coupler(0), branch(0), listening(true), state(S_IDLE), pos(0), phase(0),
+      shift(0), matched(false), resumable(false), txSlot(false), txBit(0)
+{
+}
+
+bool SimDevice::connected(void) const
+{
+    return !coupler || coupler->on(branch);
+}
+
+bool SimDevice::reset(void)
+{
+    state = S_CMD;
+    pos = 0;
+    shift = 0;
+    tx.clear();
+    txBit = 0;
+    txSlot = false;
+    return true;
+}
+
+void SimDevice::send(const uint8_t *buf, size_t len)
+{
+    tx.insert(tx.end(), buf, buf + len);
+}
+
+void SimDevice::enter_function(void)
+{
+    state = S_FUNC;
+    shift = 0;
+    pos = 0;
+    listening = true;
+    select();
+}
+
+void SimDevice::command(uint8_t cmd)
+{
+    pos = 0;
+    phase = 0;
+    switch (cmd) {
+    case 0x33:                  // Read ROM
+        state = S_READ_ROM;
+        break;
+    case 0x55:                  // Match ROM
+        state = S_MATCH;
+        matched = true;
+        break;
+    case 0xF0:                  // Search ROM
+        state = S_SEARCH;
+        break;
+    case 0xEC:                  // Alarm Search
+        state = alarm ? S_SEARCH : S_IDLE;
+        break;
+    case 0xCC:                  // Skip ROM
+        enter_function();
+        break;
+    case 0xA5:                  // Resume
+        if (resumable) enter_function();
+        else state = S_IDLE;
+        break;
+    default:
+        state = S_IDLE;
+        break;
+    }
+}
+
+uint8_t SimDevice::drive(void)
+{
+    txSlot = false;
+    switch (state) {
+    case S_READ_ROM:
+        return rom_bit(pos);
+    case S_SEARCH:
+        if (phase == 0) return rom_bit(pos);
+        if (phase == 1) return !rom_bit(pos);
+        return 1;
+    case S_FUNC:
+        if (txBit == tx.size() * 8) {
+            uint8_t v;
+            tx.clear();
+            txBit = 0;
+            if (pos == 0 && fetch(v)) tx.push_back(v);
+        }
+        if (txBit < tx.size() * 8) {
+            txSlot = true;
+            return (tx[txBit / 8] >> (txBit % 8)) & 1;
+        }
+        return idle_bit();
+    default:
+        return 1;
+    }
+}
+
+void SimDevice::sample(uint8_t line)
+{
+    switch (state) {
+    case S_CMD:
+        shift |= line << pos;
+        if (++pos == 8) command(shift);
+        break;
+
+    case S_READ_ROM:
+        if (++pos == 64) {
+            resumable = true;
+            enter_function();
+        }
+        break;
+
+    case S_MATCH:
+        if (line != rom_bit(pos)) matched = false;
+        if (++pos == 64) {
+            resumable = matched;
+            if (matched) enter_function();
+            else state = S_IDLE;
+        }
+        break;
+
+    case S_SEARCH:
+        if (phase < 2) {
+            phase++;
+            break;
+        }
+        phase = 0;
+        if (line != rom_bit(pos)) {
+            state = S_IDLE;
+            resumable = false;
+            break;
+        }
+        if (++pos == 64) {
+            resumable = true;
+            enter_function();
+        }
+        break;
+
+    case S_FUNC:
+        if (txSlot) {
+            txBit++;
+            break;
+        }
+        if (!listening) break;
+        if (pos == 0) shift = 0;
+        shift |= line << pos;
+        if (++pos == 8) {
+            pos = 0;
+            received(shift);
+            shift = 0;
+        }
+        break;
+    }
+}
+
+//
+// DS18B20
+//
+
+SimThermometer::SimThermometer(uint64_t r, int16_t t)
+    : SimDevice(r), raw(t), parasite(false), conversions(0), brownouts(0), cmd(0), count(0),
+      readyAt(0), latched(0x0550), powerCheck(false), pullupAtConvert(0)
+{
+    static const uint8_t init[9] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0 };
+    memcpy(scratch, init, sizeof(scratch));
+}
+
+uint32_t SimThermometer::conversion_us(void) const
+{
+    return 750000 >> (3 - ((scratch[4] >> 5) & 3));
+}
+
+void SimThermometer::select(void)
+{
+    cmd = 0;
+    count = 0;
+}
+
+void SimThermometer::received(uint8_t v)
+{
+    if (cmd == 0x4E) {
+        // TH, TL, configuration
+        if (count < 3) scratch[2 + count++] = v;
+        return;
+    }
+    if (cmd) return;
+    cmd = v;
+    switch (v) {
+    case 0x44:
+        readyAt = host_time_us() + conversion_us();
+        latched = raw;
+        conversions++;
+        listening = false;
+        powerCheck = parasite;
+        pullupAtConvert = wire->stats.pullup_us;
+        break;
+    case 0xBE:
+        if (powerCheck && host_time_us() >= readyAt) {
+            // the pullup, which starts after this byte, must cover the conversion
+            powerCheck = false;
+            if (wire->stats.pullup_us - pullupAtConvert < conversion_us()) {
+                latched = 0x0550;
+                brownouts++;
+            }
+        }
+        if (host_time_us() >= readyAt) {
+            scratch[0] = (uint8_t)latched;
+            scratch[1] = (uint8_t)(latched >> 8);
+        }
+        scratch[8] = sim_crc8(scratch, 8);
+        send(scratch, 9);
+        break;
+    case 0xB4:
+        listening = false;
+        break;
+    }
+}
+
+uint8_t SimThermometer::idle_bit(void)
+{
+    if (cmd == 0x44) return host_time_us() >= readyAt;
+    if (cmd == 0xB4) return !parasite;
+    return 1;
+}
+
+//
+// DS28E15 / DS28E25
+//
+
+// CRC16 of the 1-Wire memory commands, sent inverted
+static uint16_t sim_crc16(const uint8_t *data, size_t len, uint16_t crc = 0)
+{
+    while (len--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) crc = crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    return crc;
+}
+
+SimAuthenticator::SimAuthenticator(uint64_t r, const uint8_t s[32])
+    : SimDevice(r), pages((r & 0xFF) == DS28E25_FAMILY ? 16 : 2), macs(0), writes(0),
+      refused(0), early(0), brownouts(0), cmd(0), param(0), count(0), accepted(false),
+      outLen(0), outPos(0), readyAt(0), pullupAtRelease(0)
+{
+    memcpy(secret, s, 32);
+    manid[0] = manid[1] = 0;
+    for (size_t i = 0; i < sizeof(memory); i++) memory[i] = (uint8_t)(i * 7 + 3);
+    memset(scratch, 0, sizeof(scratch));
+    memset(last_mac, 0, sizeof(last_mac));
+}
+
+void SimAuthenticator::select(void)
+{
+    cmd = 0;
+    count = 0;
+    outLen = outPos = 0;
+}
+
+void SimAuthenticator::send_crc(const uint8_t *buf, size_t len)
+{
+    uint16_t crc = ~sim_crc16(buf, len);
+    uint8_t b[2] = { (uint8_t)crc, (uint8_t)(crc >> 8) };
+    send(b, 2);
+}
+
+void SimAuthenticator::mac(const uint8_t *msg, size_t len, uint8_t digest[32])
+{
+    uint8_t buf[32 + 75];
+    memcpy(buf, secret, 32);
+    memcpy(&buf[32], msg, len);
+    onewire_sha256(buf, (uint16_t)(32 + len), digest);
+}
+
+void SimAuthenticator::received(uint8_t v)
+{
+    // the CRC16 bytes the master reads before a computation starts
+    const int64_t crcRead = 16 * SIM_READ_US;
+
+    if (count == 0) {
+        cmd = v;
+        count++;
+        return;
+    }
+    if (count == 1) {
+        param = v;
+        count++;
+        uint8_t head[2] = { cmd, param };
+        send_crc(head, 2);
+        uint8_t page = param & 0x0F;
+        switch (cmd) {
+        case 0x0F:                  // Read/Write Scratchpad
+            if (param) {
+                send(scratch, 32);
+                send_crc(scratch, 32);
+                listening = false;
+            }
+            break;
+        case 0xF0:                  // Read Memory
+            listening = false;
+            if (param < pages) {
+                send(&memory[param * 32], 32);
+                send_crc(&memory[param * 32], 32);
+            }
+            break;
+        case 0xA5: {                // Compute and Read Page MAC
+            listening = false;
+            if (page >= pages) break;
+            uint8_t msg[75];
+            memcpy(msg, &memory[page * 32], 32);
+            memcpy(&msg[32], scratch, 32);
+            if ((param & 0xE0) == 0xE0) memset(&msg[64], 0xFF, 8);
+            else sim_rom_bytes(rom, &msg[64]);
+            msg[72] = page;
+            msg[73] = manid[0];
+            msg[74] = manid[1];
+            out[0] = 0xAA;
+            mac(msg, sizeof(msg), &out[1]);
+            memcpy(last_mac, &out[1], 32);
+            uint16_t crc = ~sim_crc16(&out[1], 32);
+            out[33] = (uint8_t)crc;
+            out[34] = (uint8_t)(crc >> 8);
+            outLen = 35;
+            readyAt = host_time_us() + crcRead + 2 * ONEWIRE_SHA_TCSHA_US;
+            macs++;
+            break;
+        }
+        case 0x5A:                  // Authenticated Write Memory
+            if (page >= pages) listening = false;
+            break;
+        default:
+            listening = false;
+            break;
+        }
+        return;
+    }
+
+    uint8_t n = count++ - 2;
+    if (cmd == 0x0F && !param) {
+        scratch[n] = v;
+        if (n == 31) {
+            send_crc(scratch, 32);
+            listening = false;
+        }
+    } else if (cmd == 0x5A && n < 36) {
+        in[n] = v;
+        if (n == 3) send_crc(in, 4);
+        if (n < 35) return;
+        send_crc(&in[4], 32);
+        listening = false;
+        memcpy(last_mac, &in[4], 32);
+
+        uint8_t seg = param >> 5, page = param & 0x0F;
+        uint8_t *data = &memory[page * 32 + seg * 4];
+        uint8_t msg[20], expect[32];
+        sim_rom_bytes(rom, msg);
+        msg[8] = seg;
+        msg[9] = page;
+        msg[10] = manid[0];
+        msg[11] = manid[1];
+        memcpy(&msg[12], data, 4);
+        memcpy(&msg[16], in, 4);
+        mac(msg, sizeof(msg), expect);
+        accepted = !memcmp(expect, &in[4], 32);
+        if (!accepted) refused++;
+        out[0] = accepted ? 0xAA : 0x55;
+        outLen = 1;
+        outPos = 0;
+        readyAt = host_time_us() + crcRead + ONEWIRE_SHA_TCSHA_US;
+    } else if (cmd == 0x5A && n == 36 && v == 0xAA) {
+        // release: program with the strong pullup on from here
+        listening = false;
+        pullupAtRelease = wire->stats.pullup_us;
+        out[0] = 0;
+        outLen = 1;
+        outPos = 0;
+        readyAt = host_time_us() + ONEWIRE_SHA_TPRD_US;
+    }
+}
+
+bool SimAuthenticator::fetch(uint8_t &v)
+{
+    if (listening || outPos >= outLen) return false;
+    if (host_time_us() < readyAt) {
+        early++;
+        outLen = 0;
+        return false;
+    }
+    v = out[outPos++];
+    if (cmd != 0x5A || outPos < outLen) return true;
+
+    if (count == 2 + 36) {
+        // the CS byte: a release byte follows when the MAC was accepted
+        if (accepted) listening = true;
+    } else if (wire->stats.pullup_us - pullupAtRelease >= ONEWIRE_SHA_TPRD_US) {
+        memcpy(&memory[(param & 0x0F) * 32 + (param >> 5) * 4], in, 4);
+        writes++;
+        v = 0xAA;
+    } else {
+        brownouts++;
+        v = 0x55;
+    }
+    return true;
+}
+
+//
+// DS2409
+//
+
+SimCoupler::SimCoupler(uint64_t r)
+    : SimDevice(r), line(-1), smart_ons(0), lines_off(0), bad_stimulus(0), cmd(0)
+{
+}
+
+void SimCoupler::add(SimDevice *d, uint8_t aux)
+{
+    d->coupler = this;
+    d->branch = aux;
+    devices[aux].push_back(d);
+}
+
+void SimCoupler::select(void)
+{
+    cmd = 0;
+}
+
+// The reset a Smart-On puts on the branch it switches on, passed on
+// through the couplers on it that are on themselves
+bool SimCoupler::reset_branch(uint8_t aux)
+{
+    bool presence = false;
+    for (size_t i = 0; i < devices[aux].size(); i++) {
+        SimDevice *d = devices[aux][i];
+        presence |= d->reset();
+        SimCoupler *c = dynamic_cast<SimCoupler *>(d);
+        if (c && c->line >= 0) presence |= c->reset_branch(c->line);
+    }
+    return presence;
+}
+
+void SimCoupler::received(uint8_t v)
+{
+    if (!cmd) {
+        cmd = v;
+        if (v == 0x66) {                    // All Lines Off
+            line = -1;
+            lines_off++;
+            send(v);
+            listening = false;
+        } else if (v != 0xCC && v != 0x33) {
+            listening = false;
+        }
+        return;
+    }
+
+    // Smart-On: the reset stimulus, then presence and confirmation
+    listening = false;
+    if (v != 0xFF) {
+        bad_stimulus++;
+        return;
+    }
+    line = cmd == 0x33;
+    smart_ons++;
+    send(reset_branch(line) ? 0x00 : 0xFF);
+    send(cmd);
+}
+
+//
+// DS2431 / DS28EC20
+//
+
+SimEEPROM::SimEEPROM(uint64_t r)
+    : SimDevice(r), row((r & 0xFF) == 0x43 ? 32 : 8), size((r & 0xFF) == 0x43 ? 2560 : 128),
+      es(0), copies(0), early(0), brownouts(0), cmd(0), count(0), addr(0), crc(0), outLen(0),
+      outPos(0), copyAt(0), pullupAtCopy(0)
+{
+    for (size_t i = 0; i < sizeof(memory); i++) memory[i] = (uint8_t)(i * 5 + 1);
+    memset(scratch, 0xFF, sizeof(scratch));
+    ta[0] = ta[1] = 0;
+}
+
+// Whether a copy in progress has finished.  One that has not is ended by
+// whatever the master does now.
+bool SimEEPROM::copy_done(void)
+{
+    if (!copyAt) return false;
+    int64_t at = copyAt;
+    copyAt = 0;
+    if (host_time_us() < at) {
+        early++;
+        return false;
+    }
+    if (wire->stats.pullup_us - pullupAtCopy < SIM_EEPROM_TPROG_US) {
+        brownouts++;
+        return false;
+    }
+    memcpy(&memory[(ta[0] | ta[1] << 8) & ~(row - 1)], scratch, row);
+    copies++;
+    return true;
+}
+
+void SimEEPROM::select(void)
+{
+    copy_done();
+    cmd = 0;
+    count = 0;
+    outLen = outPos = 0;
+}
+
+void SimEEPROM::received(uint8_t v)
+{
+    uint8_t buf[4 + 32];
+
+    if (count == 0) {
+        cmd = v;
+        count++;
+        if (cmd == 0xAA) {
+            // Read Scratchpad: TA1 TA2 E/S, the data up to E/S, CRC16
+            uint8_t from = ta[0] & (row - 1), to = es & (row - 1);
+            buf[0] = cmd;
+            buf[1] = ta[0];
+            buf[2] = ta[1];
+            buf[3] = es;
+            memcpy(&buf[4], &scratch[from], to - from + 1);
+            send(&buf[1], 3 + to - from + 1);
+            uint16_t c = ~sim_crc16(buf, 4 + to - from + 1);
+            send((uint8_t)c);
+            send((uint8_t)(c >> 8));
+            listening = false;
+        } else if (cmd != 0x0F && cmd != 0x55 && cmd != 0xF0 && !(cmd == 0xA5 && row == 32)) {
+            listening = false;
+        }
+        return;
+    }
+
+    uint8_t n = count++ - 1;
+    if (cmd == 0x0F) {
+        // Write Scratchpad: TA1 TA2, then data to the end of the row
+        if (n < 2) {
+            ta[n] = v;
+            es = (ta[0] & (row - 1)) | 0x20;        // PF until a byte arrives
+            return;
+        }
+        uint8_t off = (ta[0] & (row - 1)) + n - 2;
+        scratch[off] = v;
+        es = off;
+        if (off < row - 1) return;
+        // the CRC16 of command, address and data
+        uint8_t from = ta[0] & (row - 1);
+        buf[0] = cmd;
+        buf[1] = ta[0];
+        buf[2] = ta[1];
+        memcpy(&buf[3], &scratch[from], row - from);
+        uint16_t c = ~sim_crc16(buf, 3 + row - from);
+        send((uint8_t)c);
+        send((uint8_t)(c >> 8));
+        listening = false;
+    } else if (cmd == 0x55) {
+        // Copy Scratchpad: TA1 TA2 E/S as the authorization
+        out[n] = v;
+        if (n < 2) return;
+        listening = false;
+        if (out[0] == ta[0] && out[1] == ta[1] && out[2] == es && !(es & 0x20)) {
+            copyAt = host_time_us() + SIM_EEPROM_TPROG_US;
+            pullupAtCopy = wire->stats.pullup_us;
+        }
+    } else if (cmd == 0xF0 || cmd == 0xA5) {
+        if (n == 0) {
+            addr = v;
+            return;
+        }
+        addr |= v << 8;
+        listening = false;
+        if (cmd == 0xA5) {
+            // the first page CRC also covers command and address
+            buf[0] = cmd;
+            buf[1] = (uint8_t)addr;
+            buf[2] = (uint8_t)(addr >> 8);
+            crc = sim_crc16(buf, 3);
+        }
+    }
+}
+
+bool SimEEPROM::fetch(uint8_t &v)
+{
+    if (listening) return false;
+    if (cmd == 0x55) {
+        // after the copy, alternating 1s and 0s; 1s if it failed
+        if (copyAt) outLen = copy_done();
+        if (!outLen) return false;
+        v = 0xAA;
+        return true;
+    }
+    if (cmd == 0xF0) {
+        if (addr >= size) return false;
+        v = memory[addr++];
+        return true;
+    }
+    if (cmd != 0xA5) return false;
+    if (outPos == outLen) {
+        // the rest of the page, then its CRC16
+        if (addr >= size) return false;
+        uint8_t n = 32 - (addr & 31);
+        memcpy(out, &memory[addr], n);
+        uint16_t c = ~sim_crc16(out, n, crc);
+        out[n] = (uint8_t)c;
+        out[n + 1] = (uint8_t)(c >> 8);
+        crc = 0;
+        addr += n;
+        outLen = n + 2;
+        outPos = 0;
+    }
+    v = out[outPos++];
+    return true;
+}
+
+//
+// DS2408 / DS2413
+//
+
+SimSwitch::SimSwitch(uint64_t r)
+    : SimDevice(r), latch((r & 0xFF) == 0x29 ? 0xFF : 0x03), samples(0), writes(0), cmd(0),
+      count(0), value(0), haveValue(false), crc(0)
+{
+}
+
+uint8_t SimSwitch::sample(void)
+{
+    uint8_t outside = levels.empty() ? 0xFF : levels[samples % levels.size()];
+    uint8_t pins = latch & outside;
+    samples++;
+    if ((rom & 0xFF) == 0x29) return pins;
+    uint8_t s = (pins & 1) | (latch & 1) << 1 | (pins & 2) << 1 | (latch & 2) << 2;
+    return (uint8_t)(s | (~s & 0x0F) << 4);
+}
+
+void SimSwitch::select(void)
+{
+    cmd = 0;
+    count = 0;
+    haveValue = false;
+}
+
+void SimSwitch::received(uint8_t v)
+{
+    if (!cmd) {
+        cmd = v;
+        if (cmd == 0xF5) crc = sim_crc16(&cmd, 1);
+        if (cmd != 0x5A) listening = false;
+        return;
+    }
+
+    // Channel Access Write: the value, then its complement
+    if (!haveValue) {
+        value = v;
+        haveValue = true;
+        return;
+    }
+    haveValue = false;
+    if ((uint8_t)~v != value) {
+        listening = false;                  // no confirmation, reads as 1s
+        return;
+    }
+    latch = (rom & 0xFF) == 0x29 ? value : value & 0x03;
+    writes++;
+    send(0xAA);
+    send(sample());
+}
+
+bool SimSwitch::fetch(uint8_t &v)
+{
+    if (listening || cmd != 0xF5) return false;
+    if ((rom & 0xFF) != 0x29) {
+        v = sample();
+        return true;
+    }
+    if (count < 32) {
+        v = sample();
+        crc = sim_crc16(&v, 1, crc);
+    } else {
+        uint16_t c = ~crc;
+        v = (uint8_t)(count == 32 ? c : c >> 8);
+    }
+    if (++count == 34) {
+        count = 0;
+        crc = 0;
+    }
+    return true;
+}
+
+//
+// Wire
+//
+
+SimWire::SimWire()
+    : shorted(false), last_pullup_us(0), time_divider(1), errorRate(0), rng(1),
+      pullupStart(-1), masterState(-1), lowStart(0), devLowUntil(0), presenceFrom(0),
+      presenceUntil(0), slotDrive(1), slotFlip(false), slotListed(false)
+{
+    clear_stats();
+}
+
+void SimWire::attach(SimDevice *d)
+{
+    d->wire = this;
+    devices.push_back(d);
+}
+
+void SimWire::detach(SimDevice *d)
+{
+    devices.erase(std::remove(devices.begin(), devices.end(), d), devices.end());
+    d->wire = 0;
+}
+
+void SimWire::clear_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void SimWire::flip_slot(uint32_t n)
+{
+    flips.push_back(stats.slots + n);
+}
+
+void SimWire::drop_presence(uint32_t n)
+{
+    drops.push_back(stats.resets + n);
+}
+
+void SimWire::remove_at_slot(SimDevice *d, uint32_t n)
+{
+    removals.push_back(std::make_pair(stats.slots + n, d));
+}
+
+void SimWire::bit_errors(uint32_t one_in, uint32_t seed)
+{
+    errorRate = one_in;
+    rng = seed ? seed : 1;
+}
+
+void SimWire::clear_faults(void)
+{
+    flips.clear();
+    drops.clear();
+    removals.clear();
+    errorRate = 0;
+    shorted = false;
+}
+
+bool SimWire::take(std::vector<uint32_t> &list, uint32_t index)
+{
+    std::vector<uint32_t>::iterator it = std::find(list.begin(), list.end(), index);
+    if (it == list.end()) return false;
+    list.erase(it);
+    return true;
+}
+
+bool SimWire::flip_now(uint8_t master, uint32_t index)
+{
+    bool flip = take(flips, index);
+    slotListed = flip;
+    if (master && errorRate) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        if (rng % errorRate == 0) flip = true;
+    }
+    if (flip) stats.flips++;
+    return flip;
+}
+
+// Start of a slot: devices leaving now go, the rest say what they drive
+uint8_t SimWire::begin_slot(uint32_t index)
+{
+    for (size_t i = 0; i < removals.size();) {
+        if (removals[i].first == index) {
+            detach(removals[i].second);
+            removals.erase(removals.begin() + i);
+        } else {
+            i++;
+        }
+    }
+    uint8_t line = 1;
+    for (size_t i = 0; i < devices.size(); i++)
+        if (devices[i]->connected()) line &= devices[i]->drive();
+    return line;
+}
+
+void SimWire::end_slot(uint8_t line)
+{
+    for (size_t i = 0; i < devices.size(); i++)
+        if (devices[i]->connected()) devices[i]->sample(line);
+}
+
+bool SimWire::reset(void)
+{
+    end_pullup();
+    uint32_t index = stats.resets++;
+    bool presence = false;
+    for (size_t i = 0; i < devices.size(); i++)
+        if (devices[i]->connected()) presence |= devices[i]->reset();
+    if (take(drops, index)) presence = false;
+    if (shorted) return false;
+    return presence;
+}
+
+uint8_t SimWire::slot(uint8_t master)
+{
+    end_pullup();
+    uint32_t index = stats.slots++;
+    uint8_t line = master & begin_slot(index);
+    if (shorted) line = 0;
+    end_slot(line);
+    return line ^ flip_now(master, index);
+}
+
+void SimWire::spend(uint32_t us)
+{
+    stats.bus_us += us;
+    if (host_virtual()) host_advance_us(us);
+    else host_advance_us(us / (time_divider ? time_divider : 1));
+}
+
+void SimWire::end_pullup(void)
+{
+    if (pullupStart < 0) return;
+    last_pullup_us = host_time_us() - pullupStart;
+    stats.pullup_us += last_pullup_us;
+    pullupStart = -1;
+}
+
+OneWireBus SimWire::bus(void)
+{
+    OneWireBus b = { this, bus_reset, bus_write_bytes, bus_read_bytes, bus_write_bit,
+                     bus_read_bit, bus_depower, 0, 0 };
+    return b;
+}
+
+uint8_t SimWire::bus_reset(void *ctx)
+{
+    SimWire *w = (SimWire *)ctx;
+    uint8_t r = w->reset();
+    w->spend(SIM_RESET_US);
+    return r;
+}
+
+void SimWire::bus_write_bytes(void *ctx, const uint8_t *buf, uint16_t count, bool power)
+{
+    SimWire *w = (SimWire *)ctx;
+    for (uint16_t i = 0; i < count; i++) {
+        for (uint8_t bit = 0; bit < 8; bit++) bus_write_bit(ctx, (buf[i] >> bit) & 1);
+    }
+    if (power) w->pullupStart = host_time_us();
+}
+
+void SimWire::bus_read_bytes(void *ctx, uint8_t *buf, uint16_t count)
+{
+    for (uint16_t i = 0; i < count; i++) {
+        uint8_t v = 0;
+        for (uint8_t bit = 0; bit < 8; bit++) v |= bus_read_bit(ctx) << bit;
+        buf[i] = v;
+    }
+}
+
+void SimWire::bus_write_bit(void *ctx, uint8_t v)
+{
+    SimWire *w = (SimWire *)ctx;
+    w->slot(v & 1);
+    w->spend(v & 1 ? SIM_WRITE1_US : SIM_WRITE0_US);
+}
+
+uint8_t SimWire::bus_read_bit(void *ctx)
+{
+    SimWire *w = (SimWire *)ctx;
+    uint8_t r = w->slot(1);
+    w->spend(SIM_READ_US);
+    return r;
+}
+
+void SimWire::bus_depower(void *ctx)
+{
+    ((SimWire *)ctx)->end_pullup();
+}
+
+//
+// Waveform decoder.  A falling edge starts a slot, the devices decide
+// then what they drive; a device sending 0 holds the line for 30us.  The
+// length of the master's low pulse tells the rest: 480us and more is a
+// reset, and the presence pulse follows 15us after it for 120us; under
+// 15us is a 1 (or a read), anything longer a 0.
+//
+
+void SimWire::master(int s)
+{
+    int64_t now = host_time_us();
+    int was = masterState;
+    masterState = s;
+
+    if (was != 0 && s == 0) {
+        lowStart = now;
+        uint32_t index = stats.slots;
+        slotDrive = begin_slot(index);
+        slotFlip = flip_now(1, index);
+        devLowUntil = slotDrive ? now : now + 30;
+        presenceUntil = 0;
+    } else if (was == 0 && s != 0) {
+        int64_t low = now - lowStart;
+        if (low >= 400) {
+            // not a slot after all, leave its flip for the next one
+            if (slotListed) flips.push_back(stats.slots);
+            if (slotFlip) stats.flips--;
+            devLowUntil = 0;
+            slotFlip = false;
+            bool presence = reset();
+            presenceFrom = now + 15;
+            presenceUntil = presence ? now + 135 : 0;
+        } else {
+            stats.slots++;
+            uint8_t line = (low < 15 ? 1 : 0) & slotDrive;
+            if (shorted) line = 0;
+            end_slot(line);
+        }
+    }
+}
+
+int SimWire::level(void)
+{
+    int64_t now = host_time_us();
+    if (shorted || masterState == 0) return 0;
+    if (masterState == 1) return 1;
+    int v = 1;
+    if (now < devLowUntil) v = 0;
+    if (now >= presenceFrom && now < presenceUntil) v = 0;
+    if (slotFlip && now < lowStart + 60) v ^= 1;
+    return v;
+}
+
+//
+// DS2482
+//
+
+#define DS_STATUS_1WB   0x01
+#define DS_STATUS_PPD   0x02
+#define DS_STATUS_SD    0x04
+#define DS_STATUS_RST   0x10
+#define DS_STATUS_SBR   0x20
+#define DS_STATUS_TSB   0x40
+#define DS_STATUS_DIR   0x80
+#define DS_CONFIG_SPU   0x04
+
+static const uint8_t channelCode[8] = { 0xF0, 0xE1, 0xD2, 0xC3, 0xB4, 0xA5, 0x96, 0x87 };
+static const uint8_t channelCheck[8] = { 0xB8, 0xB1, 0xAA, 0xA3, 0x9C, 0x95, 0x8E, 0x87 };
+
+SimDS2482::SimDS2482(SimWire &wire, uint8_t ch)
+    : channels(ch), busy_polls(2), config(0), commands(0), pointer(0xF0),
+      status(DS_STATUS_RST), data(0), channel(0), busy(0), strong(false)
+{
+    memset(wires, 0, sizeof(wires));
+    wires[0] = &wire;
+}
+
+OneWireBus SimDS2482::bus(void)
+{
+    return wires[channel]->bus();
+}
+
+void SimDS2482::end_strong(void)
+{
+    if (strong) wires[channel]->bus().depower(wires[channel]);
+    strong = false;
+}
+
+bool SimDS2482::one_wire(uint8_t cmd, uint8_t param)
+{
+    if (!wires[channel]) return false;
+    OneWireBus b = bus();
+    bool spu = config & DS_CONFIG_SPU;
+    uint8_t v;
+
+    end_strong();
+    commands++;
+    status &= ~(DS_STATUS_SBR | DS_STATUS_TSB | DS_STATUS_DIR | DS_STATUS_RST);
+    switch (cmd) {
+    case 0xB4:                                  // 1-Wire Reset
+        status &= ~(DS_STATUS_PPD | DS_STATUS_SD);
+        if (b.reset(b.ctx)) status |= DS_STATUS_PPD;
+        if (wires[channel]->shorted) status |= DS_STATUS_SD;
+        spu = false;
+        break;
+    case 0x87:                                  // 1-Wire Single Bit
+        if (param & 0x80) v = b.read_bit(b.ctx);
+        else v = (b.write_bit(b.ctx, 0), 0);
+        if (v) status |= DS_STATUS_SBR;
+        break;
+    case 0xA5:                                  // 1-Wire Write Byte
+        b.write_bytes(b.ctx, &param, 1, spu);
+        break;
+    case 0x96:                                  // 1-Wire Read Byte
+        b.read_bytes(b.ctx, &data, 1);
+        spu = false;
+        break;
+    case 0x78: {                                // 1-Wire Triplet
+        uint8_t id = b.read_bit(b.ctx);
+        uint8_t cmp = b.read_bit(b.ctx);
+        uint8_t dir = id != cmp ? id : (id ? 1 : param >> 7);
+        b.write_bit(b.ctx, dir);
+        if (id) status |= DS_STATUS_SBR;
+        if (cmp) status |= DS_STATUS_TSB;
+        if (dir) status |= DS_STATUS_DIR;
+        spu = false;
+        break;
+    }
+    }
+    if (spu && cmd == 0xA5) {
+        strong = true;
+        config &= ~DS_CONFIG_SPU;
+    }
+    busy = busy_polls;
+    pointer = 0xF0;
+    return true;
+}
+
+bool SimDS2482::write(const uint8_t *buf, size_t len)
+{
+    if (!len) return true;
+    uint8_t cmd = buf[0], param = len > 1 ? buf[1] : 0;
+
+    if (busy && cmd != 0xE1) return false;      // only Set Read Pointer while busy
+    switch (cmd) {
+    case 0xF0:                                  // Device Reset
+        end_strong();
+        config = 0;
+        channel = 0;
+        status = DS_STATUS_RST;
+        pointer = 0xF0;
+        return len == 1;
+    case 0xE1:                                  // Set Read Pointer
+        if (len != 2 || (param != 0xF0 && param != 0xE1 && param != 0xC3 &&
+                         !(param == 0xD2 && channels == 8)))
+            return false;
+        pointer = param;
+        return true;
+    case 0xD2:                                  // Write Configuration
+        if (len != 2 || ((param >> 4) ^ 0x0F) != (param & 0x0F)) return false;
+        config = param & 0x0F;
+        if (!(config & DS_CONFIG_SPU)) end_strong();
+        pointer = 0xC3;
+        return true;
+    case 0xC3:                                  // Channel Select
+        if (len != 2 || channels != 8) return false;
+        for (uint8_t i = 0; i < 8; i++) {
+            if (channelCode[i] != param) continue;
+            end_strong();
+            channel = i;
+            pointer = 0xD2;
+            return true;
+        }
+        return false;
+    case 0xB4:
+    case 0x96:
+        return len == 1 && one_wire(cmd, 0);
+    case 0x87:
+    case 0xA5:
+    case 0x78:
+        return len == 2 && one_wire(cmd, param);
+    }
+    return false;
+}
+
+bool SimDS2482::read(uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        switch (pointer) {
+        case 0xF0:
+            buf[i] = status | (busy ? DS_STATUS_1WB : 0);
+            if (busy) busy--;
+            break;
+        case 0xE1:
+            buf[i] = data;
+            break;
+        case 0xC3:
+            buf[i] = config;
+            break;
+        default:
+            buf[i] = channelCheck[channel];
+            break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,403 @@
+#ifndef sim_h
+#define sim_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "OneWireESP_bus.h"
+#include "host/host.h"
+
+// A simulated 1-Wire bus for the host tests.
+//
+// SimDevice models the ROM layer of a slave (Read/Match/Skip/Search/
+// Alarm Search/Resume ROM) one time slot at a time; subclasses add the
+// function commands.  SimWire is the wire with its devices on it and can
+// be driven two ways:
+//
+//  - as a OneWireBus table (bus()), one call per slot, with the clock
+//    advanced by the nominal slot times below;
+//  - as the HostLine on a GPIO pin, decoding the pulses the bit-banged
+//    OneWire and OneWireAsync code makes, so that code runs unchanged.
+//
+// Faults can be injected per slot or per reset: a bit the master reads
+// inverted, a presence pulse it misses, a device that leaves the bus
+// partway through a transaction, or random bit errors.
+
+#define SIM_RESET_US    960     // reset low, presence and recovery
+#define SIM_WRITE1_US   65
+#define SIM_WRITE0_US   70
+#define SIM_READ_US     66
+
+// ROMs are handled as 64 bit values, family code in the low byte
+uint8_t sim_crc8(const uint8_t *data, size_t len);
+uint64_t sim_rom(uint8_t family, uint64_t serial);
+void sim_rom_bytes(uint64_t rom, uint8_t out[8]);
+uint64_t sim_rom_value(const uint8_t rom[8]);
+
+class SimWire;
+class SimCoupler;
+
+class SimDevice
+{
+  public:
+    explicit SimDevice(uint64_t rom);
+    virtual ~SimDevice() { }
+
+    uint64_t rom;
+    bool alarm;                 // answers Alarm Search
+    SimWire *wire;              // set while attached
+
+    // Called by SimWire: a reset pulse (returns the presence pulse), and
+    // per time slot what the device drives (0 pulls the line low) and
+    // the level it then samples.
+    bool reset(void);
+    uint8_t drive(void);
+    void sample(uint8_t line);
+
+    bool selected(void) const { return state == S_FUNC; }
+
+    // A device behind a SimCoupler is on the wire only while the branch
+    // it hangs from is switched on (see SimCoupler::add())
+    const SimCoupler *coupler;
+    uint8_t branch;
+    bool connected(void) const;
+
+  protected:
+    // Function layer: select() once a ROM command has addressed the
+    // device, received() for every byte the master writes after that,
+    // and fetch() when the master reads and nothing is queued.  Bytes
+    // queued with send() go out first.  While 'listening' is false read
+    // slots are not taken as written bits (status polling), and
+    // idle_bit() is what the device answers them with.
+    virtual void select(void) { }
+    virtual void received(uint8_t v) { (void)v; }
+    virtual bool fetch(uint8_t &v) { (void)v; return false; }
+    virtual uint8_t idle_bit(void) { return 1; }
+
+    void send(const uint8_t *buf, size_t len);
+    void send(uint8_t v) { send(&v, 1); }
+    bool listening;
+
+  private:
+    enum { S_IDLE, S_CMD, S_READ_ROM, S_MATCH, S_SEARCH, S_FUNC };
+    uint8_t state;
+    uint8_t pos;                // bit in the command or the ROM
+    uint8_t phase;              // search: own bit, complement, direction
+    uint8_t shift;
+    bool matched;
+    bool resumable;
+    bool txSlot;                // this slot carries a bit of 'tx'
+    std::vector<uint8_t> tx;
+    size_t txBit;
+
+    void command(uint8_t cmd);
+    void enter_function(void);
+    uint8_t rom_bit(uint8_t n) const { return (rom >> n) & 1; }
+};
+
+// DS18B20 (family 0x28): Convert T, Read/Write/Copy Scratchpad and Read
+// Power Supply.  The conversion takes the datasheet time for the
+// resolution in the configuration byte, on the host clock; read slots
+// during it return 0.  'raw' is the temperature in 1/16 degC.  A
+// parasite powered one needs the strong pullup of the bus() table on for
+// the whole conversion, or it reads back the power-on value (85 degC).
+class SimThermometer : public SimDevice
+{
+  public:
+    explicit SimThermometer(uint64_t rom, int16_t raw = 0x0191);
+
+    int16_t raw;
+    bool parasite;              // reports parasite power to 0xB4
+    uint32_t conversions;
+    uint32_t brownouts;         // parasite conversions the pullup cut short
+    uint8_t scratch[9];
+
+    uint32_t conversion_us(void) const;
+
+  protected:
+    void select(void);
+    void received(uint8_t v);
+    uint8_t idle_bit(void);
+
+  private:
+    uint8_t cmd;
+    uint8_t count;
+    int64_t readyAt;
+    int16_t latched;
+    bool powerCheck;            // parasite conversion not checked yet
+    uint64_t pullupAtConvert;   // wire->stats.pullup_us at Convert T
+};
+
+// DS28E15 (family 0x17, 2 pages) or DS28E25 (0x47, 16 pages) SHA-256
+// authenticator: Read/Write Scratchpad, Read Memory, Compute and Read
+// Page MAC and Authenticated Write Memory, with the MACs made the way
+// OneWireSha makes them.  The computations take ONEWIRE_SHA_TCSHA_US
+// (two of them for a page MAC) from when the master has read the CRC16
+// before them, and programming takes ONEWIRE_SHA_TPRD_US of strong
+// pullup from the release byte; a byte read before its result is ready
+// reads as 0xFF and is counted in 'early'.  A refused MAC or a write
+// without enough power answers 0x55 instead of 0xAA.
+class SimAuthenticator : public SimDevice
+{
+  public:
+    SimAuthenticator(uint64_t rom, const uint8_t secret[32]);
+
+    uint8_t secret[32];
+    uint8_t manid[2];
+    uint8_t pages;
+    uint8_t memory[16 * 32];
+    uint8_t scratch[32];
+    uint32_t macs;              // page MACs computed
+    uint32_t writes;            // segments programmed
+    uint32_t refused;           // write MACs that did not match
+    uint32_t early;             // reads before a result was ready
+    uint32_t brownouts;         // writes the pullup cut short
+    uint8_t last_mac[32];       // the last page MAC sent or write MAC received
+
+  protected:
+    void select(void);
+    void received(uint8_t v);
+    bool fetch(uint8_t &v);
+
+  private:
+    uint8_t cmd;
+    uint8_t param;
+    uint8_t count;              // bytes received since the command
+    uint8_t in[36];             // segment data and MAC of a write
+    bool accepted;
+    uint8_t out[35];            // results that take time, sent by fetch()
+    uint8_t outLen, outPos;
+    int64_t readyAt;
+    uint64_t pullupAtRelease;
+
+    void send_crc(const uint8_t *buf, size_t len);
+    void mac(const uint8_t *msg, size_t len, uint8_t digest[32]);
+};
+
+// DS2409 MicroLAN coupler (family 0x1F): Smart-On Main and Smart-On
+// Auxiliary with the 0xFF reset stimulus after the command, answered by
+// a presence byte for the branch (0x00 if a device answered its reset,
+// 0xFF if none) and the command as confirmation, and All Lines Off,
+// confirmed by the command.  One branch is on at a time: switching one on
+// turns the other off.  The devices of a branch are attached to the same
+// SimWire as the coupler and added to the branch with add().
+class SimCoupler : public SimDevice
+{
+  public:
+    explicit SimCoupler(uint64_t rom);
+
+    void add(SimDevice *d, uint8_t aux);
+    bool on(uint8_t aux) const { return line == aux && connected(); }
+
+    int8_t line;                // -1 off, 0 main, 1 auxiliary
+    uint32_t smart_ons;
+    uint32_t lines_off;
+    uint32_t bad_stimulus;      // Smart-On followed by something else than 0xFF
+
+  protected:
+    void select(void);
+    void received(uint8_t v);
+
+  private:
+    uint8_t cmd;
+    std::vector<SimDevice *> devices[2];
+
+    bool reset_branch(uint8_t aux);
+};
+
+// DS2431 (family 0x2D, 128 bytes in 8 byte rows) or DS28EC20 (0x43,
+// 2560 bytes in 32 byte rows): Write, Read and Copy Scratchpad, Read
+// Memory and, on the DS28EC20, Extended Read Memory with the inverted
+// CRC16 after every page.  A copy takes SIM_EEPROM_TPROG_US of strong
+// pullup from its last authorization byte and then reads back as 0xAA.
+// Addressing the device or reading before that ends the copy with
+// memory unchanged ('early'), as does a pullup cut short ('brownouts').
+#define SIM_EEPROM_TPROG_US 10000
+
+class SimEEPROM : public SimDevice
+{
+  public:
+    explicit SimEEPROM(uint64_t rom);
+
+    uint8_t row;                // scratchpad size
+    uint16_t size;
+    uint8_t memory[2560];
+    uint8_t scratch[32];
+    uint8_t ta[2], es;          // target address and E/S of the scratchpad
+    uint32_t copies;            // rows programmed
+    uint32_t early;             // copies cut short by the master
+    uint32_t brownouts;         // copies the pullup cut short
+
+  protected:
+    void select(void);
+    void received(uint8_t v);
+    bool fetch(uint8_t &v);
+
+  private:
+    uint8_t cmd;
+    uint8_t count;              // bytes received since the command
+    uint16_t addr;              // next byte of a memory read
+    uint16_t crc;               // CRC16 of a page of Extended Read Memory
+    uint8_t out[34];            // a page and its CRC16
+    uint8_t outLen, outPos;
+    int64_t copyAt;             // 0 when no copy is in progress
+    uint64_t pullupAtCopy;
+
+    bool copy_done(void);
+};
+
+// DS2408 (family 0x29, 8 PIOs) or DS2413 (0x3A, PIOA and PIOB): Channel
+// Access Read (0xF5), one fresh sample per byte read until the next
+// reset, with the inverted CRC16 after every 32 on the DS2408 (the first
+// one also covering the command) and the complement in the high nibble
+// on the DS2413, and Channel Access Write (0x5A), a value and its
+// complement answered by 0xAA and the new sample.  A pin reads low when
+// its latch is 0 or the outside pulls it low: 'levels' is what the
+// outside does at each sample in turn (repeating; bit 0 PIOA and bit 1
+// PIOB on a DS2413), all high when empty.
+class SimSwitch : public SimDevice
+{
+  public:
+    explicit SimSwitch(uint64_t rom);
+
+    uint8_t latch;              // output latches, 1 off
+    std::vector<uint8_t> levels;
+    uint32_t samples;           // samples taken by Channel Access Read
+    uint32_t writes;            // values latched by Channel Access Write
+
+    // The sample a read would return now (with its complement on a
+    // DS2413), taking it
+    uint8_t sample(void);
+
+  protected:
+    void select(void);
+    void received(uint8_t v);
+    bool fetch(uint8_t &v);
+
+  private:
+    uint8_t cmd;
+    uint8_t count;              // DS2408: samples in this block, then CRC bytes
+    uint8_t value;              // Channel Access Write: the value before its complement
+    bool haveValue;
+    uint16_t crc;
+};
+
+struct SimStats {
+    uint32_t resets;
+    uint32_t slots;
+    uint32_t flips;             // reads the fault injection inverted
+    uint64_t bus_us;            // time spent through the bus() table
+    uint64_t pullup_us;         // strong pullup time through bus()
+};
+
+class SimWire : public HostLine
+{
+  public:
+    SimWire();
+
+    // Devices join and leave at any time (hot plug)
+    void attach(SimDevice *d);
+    void detach(SimDevice *d);
+    std::vector<SimDevice *> devices;
+
+    // One reset (returns presence) and one time slot: 'master' is 1 for
+    // a read or write 1 slot, 0 for a write 0 slot; returns what the
+    // master samples
+    bool reset(void);
+    uint8_t slot(uint8_t master);
+
+    // Byte level access with the slot times of the real bus
+    OneWireBus bus(void);
+
+    // Faults, counted from now: the master reads slot 'n' inverted,
+    // misses the presence pulse of reset 'n', or 'd' leaves the bus
+    // before slot 'n'.  bit_errors() inverts each read with a
+    // probability of 1 in 'one_in' (0 stops it).
+    void flip_slot(uint32_t n);
+    void drop_presence(uint32_t n);
+    void remove_at_slot(SimDevice *d, uint32_t n);
+    void bit_errors(uint32_t one_in, uint32_t seed);
+    void clear_faults(void);
+    bool shorted;               // line held low
+
+    // Strong pullup state through bus(): on from a powered write until
+    // the next slot, reset or depower
+    bool pullup(void) const { return pullupStart >= 0; }
+    int64_t last_pullup_us;
+
+    // With the real clock, bus() spins each slot time divided by this
+    uint32_t time_divider;
+
+    SimStats stats;
+    void clear_stats(void);
+
+    // HostLine
+    void master(int state);
+    int level(void);
+
+  private:
+    std::vector<uint32_t> flips;
+    std::vector<uint32_t> drops;
+    std::vector<std::pair<uint32_t, SimDevice *> > removals;
+    uint32_t errorRate;
+    uint32_t rng;
+    int64_t pullupStart;
+
+    // waveform decoder
+    int masterState;
+    int64_t lowStart;
+    int64_t devLowUntil;
+    int64_t presenceFrom, presenceUntil;
+    uint8_t slotDrive;
+    bool slotFlip;
+    bool slotListed;
+
+    bool take(std::vector<uint32_t> &list, uint32_t index);
+    bool flip_now(uint8_t master, uint32_t index);
+    uint8_t begin_slot(uint32_t index);
+    void end_slot(uint8_t line);
+    void spend(uint32_t us);
+    void end_pullup(void);
+
+    static uint8_t bus_reset(void *ctx);
+    static void bus_write_bytes(void *ctx, const uint8_t *buf, uint16_t count, bool power);
+    static void bus_read_bytes(void *ctx, uint8_t *buf, uint16_t count);
+    static void bus_write_bit(void *ctx, uint8_t v);
+    static uint8_t bus_read_bit(void *ctx);
+    static void bus_depower(void *ctx);
+};
+
+// DS2482-100/-800 I2C to 1-Wire bridge on the host I2C stand-in, driving
+// a SimWire per channel through its bus() table.  Every 1-Wire command
+// leaves 1WB set in the status register for 'busy_polls' status reads.
+// SPU clears itself when the strong pullup it asked for starts; the
+// pullup lasts until the next 1-Wire command, a configuration write with
+// SPU = 0 or a device reset.  A -100 (one channel) NACKs Channel Select.
+class SimDS2482 : public HostI2cDevice
+{
+  public:
+    explicit SimDS2482(SimWire &wire, uint8_t channels = 1);
+
+    SimWire *wires[8];          // per channel, 0 for none
+    uint8_t channels;
+    uint8_t busy_polls;
+    uint8_t config;             // low nibble of the configuration register
+    uint32_t commands;          // 1-Wire commands run
+
+    bool write(const uint8_t *buf, size_t len);
+    bool read(uint8_t *buf, size_t len);
+
+  private:
+    uint8_t pointer;
+    uint8_t status;
+    uint8_t data;
+    uint8_t channel;
+    uint8_t busy;
+    bool strong;
+
+    OneWireBus bus(void);
+    void end_strong(void);
+    bool one_wire(uint8_t cmd, uint8_t param);
+};
+
+#endif
@@ -0,0 +1,38 @@
+// Object sizes for the README table.  Not a test: built for a 32-bit
+// target with -m32 -c and read back with nm -S by "make sizes".  Each
+// size_<class> symbol is as long as the object, less the FreeRTOS
+// storage inside it (StaticSemaphore_t, StaticTask_t and task stacks),
+// whose size here is the host stand-in's and not the target's.
+
+#include "OneWireESP.h"
+#include "OneWireESP_DS2482.h"
+#include "OneWireESP_retry.h"
+#include "OneWireESP_async.h"
+#include "OneWireESP_arbiter.h"
+#include "OneWireESP_parasite.h"
+#include "OneWireESP_hotplug.h"
+#include "OneWireESP_touch.h"
+#include "OneWireESP_topology.h"
+#include "OneWireESP_cache.h"
+#include "OneWireESP_scheduler.h"
+#include "OneWireESP_shard.h"
+
+#define SEM         sizeof(StaticSemaphore_t)
+#define TASK        (sizeof(StaticTask_t) + ONEWIRE_SHARD_STACK)
+
+#define SIZE(type, rtos) \
+    extern const char size_##type[sizeof(type) - (rtos)]; \
+    const char size_##type[sizeof(type) - (rtos)] = { 0 }
+
+SIZE(OneWire, 0);
+SIZE(OneWireDS2482, 0);
+SIZE(OneWireRetry, 0);
+SIZE(OneWireAsync, SEM);
+SIZE(OneWireArbiter, ONEWIRE_ARB_WAITERS * SEM);
+SIZE(OneWireParasite, 0);
+SIZE(OneWireHotplug, SEM);
+SIZE(OneWireTouch, SEM);
+SIZE(OneWireTopology, 0);
+SIZE(OneWireCache, (2 + ONEWIRE_CACHE_ENTRIES) * SEM);
+SIZE(OneWireScheduler, 0);
+SIZE(OneWireShards, portNUM_PROCESSORS * TASK);
@@ -0,0 +1,37 @@
+#ifndef test_h
+#define test_h
+
+#include <stdio.h>
+
+// Checks for the host tests.  A failed check is reported and counted and
+// the test goes on; test_result() gives the exit status for main().
+
+static int test_failures;
+
+#define CHECK(c) do { \
+    if (!(c)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #c); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long long va_ = (long long)(a), vb_ = (long long)(b); \
+    if (va_ != vb_) { \
+        fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", \
+                __FILE__, __LINE__, #a, #b, va_, vb_); \
+        test_failures++; \
+    } \
+} while (0)
+
+static inline int test_result(const char *name)
+{
+    if (test_failures) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif
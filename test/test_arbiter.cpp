@@ -0,0 +1,75 @@
+// OneWireArbiter: only the owner can release, the bus goes to the most
+// urgent waiter first, and waiting leaves the task notification alone.
+
+#include "OneWireESP_arbiter.h"
+#include "test.h"
+
+#include <atomic>
+#include <pthread.h>
+#include <unistd.h>
+
+static OneWireArbiter arb;
+static std::atomic<int> order[3];
+static std::atomic<int> granted;
+
+struct Contender {
+    uint8_t prio;
+    uint32_t notified;          // notifications left after owning the bus
+    bool stranger_release;      // release() from a task that does not own it
+    pthread_t thread;
+};
+
+static void *contend(void *arg)
+{
+    Contender *c = (Contender *)arg;
+    // a notification pending from elsewhere must survive the wait
+    xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+    arb.acquire(c->prio);
+    order[granted++] = c->prio;
+    c->notified = ulTaskNotifyTake(pdTRUE, 0);
+    CHECK(arb.release());
+    return 0;
+}
+
+static void *stranger(void *arg)
+{
+    ((Contender *)arg)->stranger_release = arb.release();
+    return 0;
+}
+
+int main()
+{
+    arb.acquire(0);
+
+    // Somebody else's release() leaves the owner in place
+    Contender s = Contender();
+    pthread_create(&s.thread, 0, stranger, &s);
+    pthread_join(s.thread, 0);
+    CHECK(!s.stranger_release);
+    CHECK(!arb.yield());
+
+    // Waiters arrive least urgent first and are served most urgent first
+    static const uint8_t prios[3] = { 0, 2, 1 };
+    Contender c[3];
+    for (int i = 0; i < 3; i++) {
+        c[i] = Contender();
+        c[i].prio = prios[i];
+        pthread_create(&c[i].thread, 0, contend, &c[i]);
+        usleep(5000);
+    }
+    CHECK_EQ(granted.load(), 0);
+    CHECK(arb.release());
+    CHECK(!arb.release());
+    for (int i = 0; i < 3; i++) pthread_join(c[i].thread, 0);
+
+    CHECK_EQ(granted.load(), 3);
+    CHECK_EQ(order[0].load(), 2);
+    CHECK_EQ(order[1].load(), 1);
+    CHECK_EQ(order[2].load(), 0);
+    for (int i = 0; i < 3; i++) CHECK_EQ(c[i].notified, 1);
+    CHECK_EQ(arb.get_stats(0).contended, 1);
+    CHECK_EQ(arb.get_stats(1).contended, 1);
+    CHECK_EQ(arb.get_stats(2).contended, 1);
+
+    return test_result("test_arbiter");
+}
@@ -0,0 +1,67 @@
+// OneWireAsync over the simulated line: transfers match the blocking
+// OneWire calls, oversized transactions are refused, and a failed begin()
+// gives its timer back.
+
+#include "OneWireESP.h"
+#include "OneWireESP_async.h"
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+#include <string.h>
+
+int main()
+{
+    host_virtual_clock(true);
+
+    SimWire wire;
+    SimThermometer t(sim_rom(0x28, 0x0102030405ull), 0x0173);
+    uint8_t rom[8];
+    sim_rom_bytes(t.rom, rom);
+    host_gpio_attach(OW1_PIN, &wire);
+
+    // A failed callback registration frees the timer, a retry works
+    OneWireAsync ow;
+    host_gptimer_fail(true);
+    CHECK(!ow.begin(OW1_PIN));
+    CHECK_EQ(host_gptimer_live(), 0);
+    CHECK(ow.begin(OW1_PIN));
+    CHECK_EQ(host_gptimer_live(), 1);
+
+    // Empty bus
+    CHECK_EQ(ow.reset(), 0);
+    OneWireAsyncOp rst = { OW_ASYNC_RESET, 0, 0, 0, 0 };
+    CHECK_EQ(ow.transaction(&rst, 1), OW_NO_PRESENCE);
+
+    wire.attach(&t);
+    CHECK_EQ(ow.reset(), 1);
+    CHECK_EQ(ow.transaction(&rst, 1), OW_OK);
+
+    // More operations than fit are refused without touching the bus
+    OneWireAsyncOp many[ONEWIRE_ASYNC_MAX_OPS + 1];
+    for (int i = 0; i <= ONEWIRE_ASYNC_MAX_OPS; i++) many[i] = rst;
+    uint32_t resets = wire.stats.resets;
+    CHECK_EQ(ow.transaction(many, ONEWIRE_ASYNC_MAX_OPS + 1), OW_BAD_PROGRAM);
+    CHECK_EQ(wire.stats.resets, resets);
+    CHECK_EQ(ow.transaction(many, ONEWIRE_ASYNC_MAX_OPS), OW_OK);
+
+    // Read the scratchpad through the async bus and the blocking one
+    uint8_t a[9], b[9];
+    CHECK_EQ(onewire_run(ow.bus(), onewire_prog_read_scratch, rom, 0, a), OW_OK);
+    OneWire blocking(OW1_PIN);
+    CHECK_EQ(onewire_run(blocking.bus1(), onewire_prog_read_scratch, rom, 0, b), OW_OK);
+    CHECK(memcmp(a, b, 9) == 0);
+    CHECK(memcmp(a, t.scratch, 9) == 0);
+
+    // Conversion with status polling, then the new temperature
+    uint8_t cmd[2] = { 0xCC, 0x44 };
+    CHECK_EQ(ow.reset(), 1);
+    ow.write_bytes(cmd, 2);
+    int64_t start = host_time_us();
+    while (!ow.read_bit()) { }
+    CHECK(host_time_us() - start >= t.conversion_us());
+    CHECK_EQ(onewire_run(ow.bus(), onewire_prog_read_scratch, rom, 0, a), OW_OK);
+    CHECK_EQ(a[0] | a[1] << 8, 0x0173);
+
+    return test_result("test_async");
+}
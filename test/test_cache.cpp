@@ -0,0 +1,115 @@
+// OneWireCache: tasks that miss on a device another task is reading
+// sleep until that read ends and share its result, a 'len' longer than
+// the program reads hands out only what was read, and a program that
+// reads more than an entry holds is refused.
+
+#include "OneWireESP_cache.h"
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct Reader {
+    OneWireCache *cache;
+    const uint8_t *rom;
+    uint8_t status;
+    uint8_t data[9];
+    int64_t cpu_us;             // CPU time this thread used in read()
+    pthread_t thread;
+};
+
+static int64_t thread_cpu_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void *reader(void *arg)
+{
+    Reader *r = (Reader *)arg;
+    int64_t start = thread_cpu_us();
+    r->status = r->cache->read(r->rom, 10000, r->data);
+    r->cpu_us = thread_cpu_us() - start;
+    return 0;
+}
+
+int main()
+{
+    // Real clock: the simulated bus spins for the slot times, ~11ms for
+    // a scratchpad read, so the readers really overlap
+    SimWire wire;
+    SimThermometer t(sim_rom(0x28, 0x0102030405ull));
+    uint8_t rom[8];
+    sim_rom_bytes(t.rom, rom);
+    wire.attach(&t);
+
+    {
+        OneWireCache cache(wire.bus());
+        Reader r[4];
+        for (int i = 0; i < 4; i++) {
+            r[i] = Reader();
+            r[i].cache = &cache;
+            r[i].rom = rom;
+        }
+        pthread_create(&r[0].thread, 0, reader, &r[0]);
+        usleep(2000);
+        for (int i = 1; i < 4; i++) pthread_create(&r[i].thread, 0, reader, &r[i]);
+        for (int i = 0; i < 4; i++) pthread_join(r[i].thread, 0);
+
+        const OneWireCacheStats &st = cache.get_stats();
+        CHECK_EQ(st.misses, 1);
+        CHECK_EQ(st.coalesced, 3);
+        CHECK_EQ(wire.stats.resets, 1);
+        for (int i = 0; i < 4; i++) {
+            CHECK_EQ(r[i].status, OW_OK);
+            CHECK(memcmp(r[i].data, t.scratch, 9) == 0);
+        }
+        // the waiters slept through the load instead of polling for it
+        for (int i = 1; i < 4; i++) CHECK(r[i].cpu_us < r[0].cpu_us / 4);
+        printf("  loader %lld us CPU, waiters %lld %lld %lld us\n",
+               (long long)r[0].cpu_us, (long long)r[1].cpu_us,
+               (long long)r[2].cpu_us, (long long)r[3].cpu_us);
+    }
+
+    // A 'len' past what the program reads: only the bytes read are
+    // copied out, on a miss and on a hit
+    {
+        static const uint8_t two[] = { OW_RESET, OW_MATCH, OW_WRITE, 1, 0xBE,
+                                       OW_READ, 2, OW_END };
+        OneWireCache cache(wire.bus(), two, 9);
+        uint8_t buf[9];
+        for (int i = 0; i < 2; i++) {
+            memset(buf, 0xEE, sizeof(buf));
+            CHECK_EQ(cache.read(rom, 10000, buf), OW_OK);
+            CHECK(memcmp(buf, t.scratch, 2) == 0);
+            for (int j = 2; j < 9; j++) CHECK_EQ(buf[j], 0xEE);
+        }
+        CHECK_EQ(cache.get_stats().misses, 1);
+        CHECK_EQ(cache.get_stats().hits, 1);
+    }
+
+    // A program reading more than ONEWIRE_CACHE_DATA bytes never runs
+    {
+        static const uint8_t too_long[] = { OW_RESET, OW_MATCH, OW_WRITE, 1, 0xBE,
+                                            OW_READ, 9, OW_READ, 1, OW_END };
+        static const uint8_t unknown[] = { OW_RESET, 0x7F, OW_END };
+        CHECK_EQ(onewire_prog_rx_len(too_long), 10);
+        CHECK_EQ(onewire_prog_rx_len(unknown), -1);
+        CHECK_EQ(onewire_prog_rx_len(onewire_prog_read_scratch), 9);
+
+        wire.clear_stats();
+        uint8_t buf[ONEWIRE_CACHE_DATA + 1];
+        OneWireCache bad(wire.bus(), too_long, 10);
+        CHECK_EQ(bad.read(rom, 0, buf), OW_BAD_PROGRAM);
+        OneWireCache odd(wire.bus(), unknown, 1);
+        CHECK_EQ(odd.read(rom, 0, buf), OW_BAD_PROGRAM);
+        CHECK_EQ(wire.stats.resets, 0);
+    }
+
+    return test_result("test_cache");
+}
@@ -0,0 +1,146 @@
+// OneWireDS2482 through the host I2C master stand-in, against the
+// SimDS2482 bridge model: device setup and removal, search by triplets,
+// a transaction program, the strong pullup set afresh for every
+// powered byte after the bridge has cleared SPU, and searches of two
+// DS2482-800 channels taken in turns.
+
+#include "OneWireESP_DS2482.h"
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+#include <set>
+#include <string.h>
+#include <vector>
+
+int main()
+{
+    host_virtual_clock(true);
+
+    SimWire wire;
+    SimThermometer t(sim_rom(0x28, 0x0102030405ull));
+    SimDevice a(sim_rom(0x28, 0x0102030406ull)), b(sim_rom(0x3A, 0x99ull));
+    wire.attach(&t);
+    wire.attach(&a);
+    wire.attach(&b);
+    SimDS2482 bridge(wire);
+    host_i2c_attach(0x18, &bridge);
+
+    i2c_master_bus_config_t bc = {};
+    i2c_master_bus_handle_t i2c;
+    CHECK_EQ(i2c_new_master_bus(&bc, &i2c), ESP_OK);
+
+    // Nobody at 0x19
+    {
+        OneWireDS2482 none(i2c, 0x19);
+        CHECK(!none.begin());
+    }
+    CHECK_EQ(host_i2c_live(), 0);
+
+    {
+        OneWireDS2482 ds(i2c);
+        CHECK(ds.begin());
+        CHECK_EQ(host_i2c_live(), 1);
+        CHECK_EQ(bridge.config, 0x01);     // APU
+        CHECK(!ds.select_channel(1));       // a -100 has one channel
+
+        std::set<uint64_t> found;
+        uint8_t rom[8];
+        ds.reset_search();
+        while (ds.search(rom)) CHECK(found.insert(sim_rom_value(rom)).second);
+        CHECK_EQ(found.size(), 3);
+        CHECK(found.count(t.rom) && found.count(a.rom) && found.count(b.rom));
+
+        uint8_t scratch[9];
+        sim_rom_bytes(t.rom, rom);
+        CHECK_EQ(onewire_run(ds.bus(), onewire_prog_read_scratch, rom, 0, scratch), OW_OK);
+        CHECK(memcmp(scratch, t.scratch, 9) == 0);
+
+        // The bridge clears SPU once the pullup starts; the next powered
+        // byte must set it again
+        for (int i = 0; i < 2; i++) {
+            CHECK(ds.reset());
+            ds.skip();
+            ds.write(0x44, 1);
+            CHECK(wire.pullup());
+            CHECK_EQ(bridge.config & 0x04, 0);
+            host_advance_us(10000);
+            ds.depower();
+            CHECK(!wire.pullup());
+            CHECK(wire.last_pullup_us >= 10000);
+        }
+        // a 1-Wire command ends the pullup by itself
+        CHECK(ds.reset());
+        ds.skip();
+        ds.write(0x44, 1);
+        CHECK(wire.pullup());
+        uint64_t transfers = host_i2c_transfers();
+        CHECK(ds.reset());
+        CHECK(!wire.pullup());
+        CHECK_EQ(bridge.config, 0x01);
+        CHECK(host_i2c_transfers() - transfers <= (uint64_t)(2 + bridge.busy_polls));
+    }
+    CHECK_EQ(host_i2c_live(), 0);
+
+    // A -800 switches channels
+    {
+        SimWire other;
+        SimDevice c(sim_rom(0x10, 0x55ull));
+        other.attach(&c);
+        SimDS2482 eight(wire, 8);
+        eight.wires[3] = &other;
+        host_i2c_attach(0x1B, &eight);
+        OneWireDS2482 ds(i2c, 0x1B);
+        CHECK(ds.begin());
+        CHECK(ds.select_channel(3));
+        uint8_t rom[8];
+        ds.reset_search();
+        CHECK(ds.search(rom));
+        CHECK_EQ(sim_rom_value(rom), c.rom);
+        CHECK(!ds.search(rom));
+        host_i2c_attach(0x1B, 0);
+    }
+
+    // Searches of two channels taken in turns each go on where they were
+    {
+        SimWire w3, w5;
+        std::vector<SimDevice *> devs;
+        std::set<uint64_t> on3, on5;
+        for (int i = 0; i < 4; i++) {
+            devs.push_back(new SimDevice(sim_rom(0x28, 0x300 + i * 0x11)));
+            w3.attach(devs.back());
+            on3.insert(devs.back()->rom);
+            devs.push_back(new SimDevice(sim_rom(0x10 + i, 0x5A7 + i * 0x2C3)));
+            w5.attach(devs.back());
+            on5.insert(devs.back()->rom);
+        }
+        SimDS2482 eight(wire, 8);
+        eight.wires[3] = &w3;
+        eight.wires[5] = &w5;
+        host_i2c_attach(0x1C, &eight);
+        OneWireDS2482 ds(i2c, 0x1C);
+        CHECK(ds.begin());
+        std::set<uint64_t> got3, got5;
+        uint8_t rom[8];
+        CHECK(ds.select_channel(3));
+        ds.reset_search();
+        CHECK(ds.select_channel(5));
+        ds.reset_search();
+        for (int i = 0; i < 5; i++) {
+            CHECK(ds.select_channel(3));
+            if (ds.search(rom)) CHECK(got3.insert(sim_rom_value(rom)).second);
+            CHECK(ds.select_channel(5));
+            if (ds.search(rom)) CHECK(got5.insert(sim_rom_value(rom)).second);
+        }
+        CHECK(got3 == on3);
+        CHECK(got5 == on5);
+        CHECK_EQ(w3.stats.resets, 4);
+        CHECK_EQ(w5.stats.resets, 4);
+        CHECK(!ds.select_channel(8));
+        host_i2c_attach(0x1C, 0);
+        for (size_t i = 0; i < devs.size(); i++) delete devs[i];
+    }
+
+    i2c_del_master_bus(i2c);
+    return test_result("test_ds2482");
+}
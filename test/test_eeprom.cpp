@@ -0,0 +1,230 @@
+// OneWireEEPROM against the simulated DS2431 and DS28EC20: Read Memory
+// and Extended Read Memory with a CRC16 per page, row writes through the
+// scratchpad with their verify and copy, a row retried after a disturbed
+// read, the copy given its full programming time under the strong
+// pullup, no command while it runs, two copies overlapped on two buses,
+// and the bytes/sec the driver reports against the slot times.
+
+#include "OneWireESP_eeprom.h"
+#include "sim.h"
+#include "test.h"
+
+#include <string.h>
+
+// slots of a Match ROM: the command and the ROM code
+#define MATCH_SLOTS     (9 * 8)
+
+static void read_memory(void)
+{
+    SimWire wire;
+    SimEEPROM dev(sim_rom(0x2D, 0x31));
+    uint8_t rom[8], buf[128];
+    wire.attach(&dev);
+    sim_rom_bytes(dev.rom, rom);
+
+    OneWireEEPROM ee(wire.bus(), rom);
+    CHECK_EQ(ee.size(), 128);
+    CHECK_EQ(ee.row_size(), 8);
+
+    // the whole array under one select, and a part of it
+    CHECK_EQ(ee.read(0, buf, 128), OW_OK);
+    CHECK(!memcmp(buf, dev.memory, 128));
+    CHECK_EQ(wire.stats.resets, 1);
+    CHECK_EQ(ee.read(13, buf, 40), OW_OK);
+    CHECK(!memcmp(buf, &dev.memory[13], 40));
+    CHECK_EQ(ee.get_stats().bytes_read, 168);
+
+    // past the end: refused without touching the bus
+    CHECK_EQ(ee.read(120, buf, 9), OW_BAD_ADDRESS);
+    CHECK_EQ(wire.stats.resets, 2);
+
+    // Read Memory has no CRC, the time the slots take is all there is:
+    // the rate cannot beat 8 read slots a byte
+    uint32_t rate = ee.read_rate();
+    CHECK(rate > 0);
+    CHECK(rate <= 1000000 / (8 * SIM_READ_US));
+    CHECK(rate > 1000000 / (8 * SIM_READ_US) / 2);
+}
+
+static void read_extended(void)
+{
+    SimWire wire;
+    SimEEPROM dev(sim_rom(0x43, 0x32));
+    uint8_t rom[8], buf[200];
+    wire.attach(&dev);
+    sim_rom_bytes(dev.rom, rom);
+
+    OneWireEEPROM ee(wire.bus(), rom);
+    CHECK_EQ(ee.size(), 2560);
+    CHECK_EQ(ee.row_size(), 32);
+
+    // across pages, from a page start and from the middle of one
+    CHECK_EQ(ee.read(0, buf, 100), OW_OK);
+    CHECK(!memcmp(buf, dev.memory, 100));
+    CHECK_EQ(ee.read(2500, buf, 60), OW_OK);
+    CHECK(!memcmp(buf, &dev.memory[2500], 60));
+    CHECK_EQ(ee.read(40, buf, 200), OW_OK);
+    CHECK(!memcmp(buf, &dev.memory[40], 200));
+
+    // one read inverted in the second page (the first is 24 bytes and
+    // its CRC16 from address 40): that page's CRC16 fails
+    wire.flip_slot(MATCH_SLOTS + 3 * 8 + (24 + 2 + 5) * 8 + 3);
+    CHECK_EQ(ee.read(40, buf, 200), OW_CRC_ERROR);
+    CHECK_EQ(wire.stats.flips, 1);
+    CHECK_EQ(ee.get_stats().bytes_read, 360);
+}
+
+static void write_rows(void)
+{
+    SimWire wire;
+    SimEEPROM dev(sim_rom(0x2D, 0x33));
+    uint8_t rom[8], data[16], buf[16];
+    wire.attach(&dev);
+    sim_rom_bytes(dev.rom, rom);
+    for (int i = 0; i < 16; i++) data[i] = (uint8_t)(0xA0 + i);
+
+    OneWireEEPROM ee(wire.bus(), rom);
+
+    // not whole rows, or past the end
+    CHECK_EQ(ee.write(4, data, 8), OW_BAD_ADDRESS);
+    CHECK_EQ(ee.write(8, data, 12), OW_BAD_ADDRESS);
+    CHECK_EQ(ee.write(120, data, 16), OW_BAD_ADDRESS);
+    CHECK_EQ(dev.copies, 0);
+
+    int64_t start = host_time_us();
+    CHECK_EQ(ee.write(16, data, 16), OW_OK);
+    CHECK_EQ(dev.copies, 2);
+    CHECK(!memcmp(&dev.memory[16], data, 16));
+    CHECK(host_time_us() - start >= 2 * SIM_EEPROM_TPROG_US);
+    CHECK(wire.last_pullup_us >= SIM_EEPROM_TPROG_US);
+    CHECK_EQ(dev.early, 0);
+    CHECK_EQ(dev.brownouts, 0);
+    CHECK_EQ(ee.get_stats().bytes_written, 16);
+    CHECK_EQ(ee.get_stats().retries, 0);
+    CHECK_EQ(ee.read(16, buf, 16), OW_OK);
+    CHECK(!memcmp(buf, data, 16));
+
+    // the programming time bounds the write rate
+    uint32_t rate = ee.write_rate();
+    CHECK(rate > 0);
+    CHECK(rate < 8 * 1000000 / SIM_EEPROM_TPROG_US);
+
+    // A read inverted in the Read Scratchpad reply (the scratchpad write
+    // is the select, 3 + 8 bytes and the CRC16): the row is written again
+    const uint32_t writeSlots = MATCH_SLOTS + (3 + 8 + 2) * 8;
+    const uint32_t verifyAt = writeSlots + MATCH_SLOTS + 8;
+    const uint32_t attempt = verifyAt + (3 + 8 + 2) * 8;
+    for (int i = 0; i < 8; i++) data[i] = (uint8_t)(0x50 + i);
+    wire.flip_slot(verifyAt + 2);
+    CHECK_EQ(ee.write(40, data, 8), OW_OK);
+    CHECK_EQ(ee.get_stats().retries, 1);
+    CHECK_EQ(dev.copies, 3);
+    CHECK(!memcmp(&dev.memory[40], data, 8));
+
+    // disturbed on every attempt: given up, memory untouched
+    uint8_t before[8];
+    memcpy(before, &dev.memory[48], 8);
+    for (int i = 0; i < ONEWIRE_EEPROM_RETRIES; i++) wire.flip_slot(i * attempt + verifyAt + 2);
+    CHECK_EQ(ee.write(48, data, 8), OW_CRC_ERROR);
+    CHECK_EQ(ee.get_stats().retries, ONEWIRE_EEPROM_RETRIES);
+    CHECK_EQ(dev.copies, 3);
+    CHECK(!memcmp(&dev.memory[48], before, 8));
+
+    // DS28EC20: 32 byte rows
+    SimEEPROM big(sim_rom(0x43, 0x34));
+    uint8_t big_rom[8], row[64];
+    wire.attach(&big);
+    sim_rom_bytes(big.rom, big_rom);
+    for (int i = 0; i < 64; i++) row[i] = (uint8_t)(i ^ 0x5A);
+    OneWireEEPROM ee20(wire.bus(), big_rom);
+    CHECK_EQ(ee20.write(2496, row, 64), OW_OK);
+    CHECK_EQ(big.copies, 2);
+    CHECK(!memcmp(&big.memory[2496], row, 64));
+    CHECK_EQ(ee20.write(2528, row, 64), OW_BAD_ADDRESS);
+}
+
+static void copy_wait(void)
+{
+    SimWire wire;
+    SimEEPROM dev(sim_rom(0x2D, 0x35));
+    uint8_t rom[8], data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 }, buf[8];
+    wire.attach(&dev);
+    sim_rom_bytes(dev.rom, rom);
+    OneWireEEPROM ee(wire.bus(), rom);
+
+    // nothing else is started while the copy runs
+    CHECK_EQ(ee.begin_write_row(0, data), OW_OK);
+    uint32_t resets = wire.stats.resets;
+    CHECK_EQ(ee.begin_write_row(8, data), OW_BUSY);
+    CHECK_EQ(ee.read(0, buf, 8), OW_BUSY);
+    CHECK_EQ(wire.stats.resets, resets);
+    CHECK_EQ(ee.finish_write_row(), OW_OK);
+    CHECK_EQ(dev.copies, 1);
+    CHECK_EQ(dev.early, 0);
+    CHECK_EQ(ee.finish_write_row(), OW_OK);     // nothing left to finish
+    CHECK_EQ(ee.read(0, buf, 8), OW_OK);
+    CHECK(!memcmp(buf, data, 8));
+
+    // The model: addressing the device before the programming time is
+    // up loses the copy, and the confirmation is not there
+    static const uint8_t poke[] = { OW_RESET, OW_MATCH, OW_END };
+    data[0] = 0x99;
+    CHECK_EQ(ee.begin_write_row(0, data), OW_OK);
+    CHECK_EQ(onewire_run(wire.bus(), poke, rom), OW_OK);
+    CHECK_EQ(ee.finish_write_row(), OW_COPY_ERROR);
+    CHECK_EQ(dev.early, 1);
+    CHECK_EQ(dev.memory[0], 1);
+
+    // and so does a pullup dropped partway
+    CHECK_EQ(ee.begin_write_row(0, data), OW_OK);
+    OneWireBus bus = wire.bus();
+    bus.depower(bus.ctx);
+    CHECK_EQ(ee.finish_write_row(), OW_COPY_ERROR);
+    CHECK_EQ(dev.brownouts, 1);
+    CHECK_EQ(dev.memory[0], 1);
+}
+
+// Two buses: both copies started, then both finished, wait out one
+// programming time between them where two write() calls wait out two
+static void overlap(void)
+{
+    SimWire w1, w2;
+    SimEEPROM d1(sim_rom(0x2D, 0x36)), d2(sim_rom(0x2D, 0x37));
+    uint8_t r1[8], r2[8], data[8] = { 9, 8, 7, 6, 5, 4, 3, 2 };
+    w1.attach(&d1);
+    w2.attach(&d2);
+    sim_rom_bytes(d1.rom, r1);
+    sim_rom_bytes(d2.rom, r2);
+    OneWireEEPROM e1(w1.bus(), r1), e2(w2.bus(), r2);
+
+    int64_t start = host_time_us();
+    CHECK_EQ(e1.write(56, data, 8), OW_OK);
+    CHECK_EQ(e2.write(56, data, 8), OW_OK);
+    int64_t serial = host_time_us() - start;
+
+    start = host_time_us();
+    CHECK_EQ(e1.begin_write_row(64, data), OW_OK);
+    CHECK_EQ(e2.begin_write_row(64, data), OW_OK);
+    CHECK_EQ(e1.finish_write_row(), OW_OK);
+    CHECK_EQ(e2.finish_write_row(), OW_OK);
+    int64_t overlapped = host_time_us() - start;
+    CHECK(serial - overlapped >= SIM_EEPROM_TPROG_US * 9 / 10);
+    CHECK(!memcmp(&d1.memory[64], data, 8));
+    CHECK(!memcmp(&d2.memory[64], data, 8));
+    CHECK_EQ(d1.copies + d2.copies, 4);
+    printf("  a row on each of two buses: %.1f ms one after the other, %.1f ms overlapped\n",
+           serial / 1000.0, overlapped / 1000.0);
+}
+
+int main()
+{
+    host_virtual_clock(true);
+
+    read_memory();
+    read_extended();
+    write_rows();
+    copy_wait();
+    overlap();
+
+    return test_result("test_eeprom");
+}
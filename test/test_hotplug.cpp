@@ -0,0 +1,168 @@
+// OneWireHotplug: discover() finds a device plugged in anywhere in the
+// search order along the known paths, in fewer passes than a rescan()
+// on average, and never reports a known device again, also with a read
+// inverted at any slot.  pause() keeps presence pulses from foreign
+// traffic out.
+
+#include "OneWireESP_hotplug.h"
+#include "sim.h"
+#include "test.h"
+
+#include <set>
+#include <string.h>
+#include <vector>
+
+#define PULSE_PIN GPIO_NUM_4
+
+static uint64_t next_random(uint64_t &s)
+{
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+// A pin a test pulls low by hand, as a device's presence pulse would
+class PulseLine : public HostLine
+{
+  public:
+    PulseLine() : low(false) { }
+    void master(int state) { (void)state; }
+    int level(void) { return !low; }
+
+    void pulse(uint32_t us)
+    {
+        low = true;
+        host_gpio_edge(PULSE_PIN);
+        host_advance_us(us);
+        low = false;
+        host_gpio_edge(PULSE_PIN);
+    }
+
+  private:
+    bool low;
+};
+
+static bool known(const OneWireHotplug &hp, uint64_t rom)
+{
+    for (uint8_t i = 0; i < hp.device_count(); i++)
+        if (sim_rom_value(hp.device(i)) == rom) return true;
+    return false;
+}
+
+static bool table_ok(const OneWireHotplug &hp, const std::set<uint64_t> &on_bus)
+{
+    std::set<uint64_t> seen;
+    for (uint8_t i = 0; i < hp.device_count(); i++) {
+        uint64_t r = sim_rom_value(hp.device(i));
+        if (!on_bus.count(r) || !seen.insert(r).second) return false;
+    }
+    return true;
+}
+
+int main()
+{
+    host_virtual_clock(true);
+    PulseLine line;
+    host_gpio_attach(PULSE_PIN, &line);
+
+    uint64_t seed = 7;
+    SimWire wire;
+    std::vector<SimDevice *> devs;
+    std::set<uint64_t> on_bus;
+    for (int i = 0; i < 16; i++) {
+        devs.push_back(new SimDevice(sim_rom((uint8_t)next_random(seed), next_random(seed))));
+        wire.attach(devs.back());
+        on_bus.insert(devs.back()->rom);
+    }
+
+    OneWireHotplug hp(wire.bus(), PULSE_PIN);
+    CHECK(hp.begin());
+    CHECK_EQ(hp.device_count(), 16);
+
+    // nothing new: one pass per known device, nothing reported
+    uint32_t resets = wire.stats.resets;
+    CHECK_EQ(hp.discover(), 0);
+    CHECK_EQ(wire.stats.resets - resets, 16);
+    CHECK_EQ(hp.device_count(), 16);
+
+    // one device plugged in at a time, anywhere in the search order
+    uint32_t discoverPasses = 0, rescanPasses = 0, maxPasses = 0;
+    const int plugs = 64;
+    for (int k = 0; k < plugs; k++) {
+        SimDevice d(sim_rom((uint8_t)next_random(seed), next_random(seed)));
+        wire.attach(&d);
+        resets = wire.stats.resets;
+        CHECK_EQ(hp.discover(), 1);
+        uint32_t passes = wire.stats.resets - resets;
+        discoverPasses += passes;
+        if (passes > maxPasses) maxPasses = passes;
+        CHECK(known(hp, d.rom));
+        CHECK_EQ(hp.device_count(), 17);
+
+        wire.detach(&d);
+        resets = wire.stats.resets;
+        CHECK_EQ(hp.rescan(), 1);
+        rescanPasses += wire.stats.resets - resets;
+        CHECK_EQ(hp.device_count(), 16);
+    }
+    CHECK(maxPasses <= 16);
+    CHECK(discoverPasses < rescanPasses);
+    printf("  new device among 16: discover %.2f passes (max %u), rescan %.2f passes\n",
+           (double)discoverPasses / plugs, maxPasses, (double)rescanPasses / plugs);
+
+    // a read inverted at each slot of the walk in turn: the new device
+    // is found or not, but nothing known or foreign is added
+    uint32_t found = 0, runs = 0;
+    for (uint32_t n = 0; n < 4 * (8 + 64 * 3); n += 3) {
+        SimDevice d(sim_rom(0x28, next_random(seed)));
+        std::set<uint64_t> now = on_bus;
+        now.insert(d.rom);
+        wire.attach(&d);
+        wire.flip_slot(n);
+        found += hp.discover();
+        runs++;
+        wire.clear_faults();
+        CHECK(table_ok(hp, now));
+        wire.detach(&d);
+        hp.rescan();
+        CHECK_EQ(hp.device_count(), 16);
+    }
+    printf("  one flipped read: %u of %u discovered\n", found, runs);
+
+    // an empty bus takes one pass to find its first device
+    SimWire empty;
+    OneWireHotplug hp2(empty.bus(), GPIO_NUM_5);
+    CHECK(hp2.begin());
+    CHECK_EQ(hp2.device_count(), 0);
+    SimDevice first(sim_rom(0x10, 0x42));
+    empty.attach(&first);
+    resets = empty.stats.resets;
+    CHECK_EQ(hp2.discover(), 1);
+    CHECK_EQ(empty.stats.resets - resets, 1);
+    CHECK(known(hp2, first.rom));
+    hp2.end();
+
+    // presence pulses wake wait(), except while paused
+    hp.clear_stats();
+    line.pulse(120);
+    CHECK_EQ(hp.get_stats().pulses, 1);
+    CHECK(hp.wait(0));
+    line.pulse(20);                         // too short to be presence
+    CHECK_EQ(hp.get_stats().pulses, 1);
+    hp.pause();
+    hp.pause();
+    line.pulse(120);
+    hp.resume();
+    line.pulse(120);
+    CHECK_EQ(hp.get_stats().pulses, 1);
+    CHECK(!hp.wait(0));
+    hp.resume();
+    line.pulse(120);
+    CHECK_EQ(hp.get_stats().pulses, 2);
+
+    hp.end();
+    host_gpio_attach(PULSE_PIN, 0);
+    for (size_t i = 0; i < devs.size(); i++) delete devs[i];
+    return test_result("test_hotplug");
+}
@@ -0,0 +1,145 @@
+// OneWireLinux against a fake sysfs tree of plain files in a temporary
+// directory: the slave list, a read transaction, a broadcast write,
+// programs that only write, a slave without 'rw' (bound to a family
+// module) and w1_master_search.
+//
+// A plain 'rw' file answers a transaction with the bytes that follow
+// the ones the master writes, so each one is set up as placeholders for
+// the written bytes and then the answer.
+
+#include "OneWireESP_linux.h"
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static std::string dir;
+
+static void put(const std::string &name, const void *data, size_t len)
+{
+    FILE *f = fopen((dir + "/" + name).c_str(), "wb");
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+static std::string get(const std::string &name)
+{
+    std::string s;
+    FILE *f = fopen((dir + "/" + name).c_str(), "rb");
+    if (!f) return s;
+    int c;
+    while ((c = fgetc(f)) != EOF) s += (char)c;
+    fclose(f);
+    return s;
+}
+
+// Slave directory name, as the kernel writes it
+static std::string slave_id(uint64_t rom)
+{
+    char id[32];
+    snprintf(id, sizeof(id), "%02x-%012llx", (unsigned)(rom & 0xFF),
+             (unsigned long long)((rom >> 8) & 0xFFFFFFFFFFFFull));
+    return id;
+}
+
+int main()
+{
+    char tmpl[] = "/tmp/onewire_w1.XXXXXX";
+    dir = mkdtemp(tmpl);
+
+    uint64_t a = sim_rom(0x28, 0x0000AABBCCDDull), b = sim_rom(0x3A, 0x000011223344ull);
+    uint64_t claimed = sim_rom(0x26, 0x000000000042ull);
+    std::string list = slave_id(a) + "\n" + slave_id(b) + "\n" + slave_id(claimed) + "\n";
+    put("w1_master_slaves", list.data(), list.size());
+    put("w1_master_search", "-1\n", 3);
+    mkdir((dir + "/" + slave_id(a)).c_str(), 0755);
+    mkdir((dir + "/" + slave_id(b)).c_str(), 0755);
+    mkdir((dir + "/" + slave_id(claimed)).c_str(), 0755);      // no rw file
+
+    // a: one placeholder for the Read Scratchpad command, then 9 bytes
+    uint8_t scratch[10] = { 0, 0x91, 0x01, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0 };
+    scratch[9] = sim_crc8(scratch + 1, 8);
+    put(slave_id(a) + "/rw", scratch, sizeof(scratch));
+    put(slave_id(b) + "/rw", "", 0);
+
+    OneWireLinux lx(dir.c_str());
+
+    // The slave list, with the CRC byte the kernel leaves out
+    uint8_t rom[8];
+    CHECK_EQ(lx.reset(), 1);
+    lx.reset_search();
+    CHECK(lx.search(rom));
+    CHECK_EQ(sim_rom_value(rom), a);
+    CHECK(lx.search(rom));
+    CHECK_EQ(sim_rom_value(rom), b);
+    CHECK(lx.search(rom));
+    CHECK(!lx.search(rom));
+    lx.target_search(0x3A);
+    CHECK(lx.search(rom));
+    CHECK_EQ(sim_rom_value(rom), b);
+
+    // A whole program is one write() and one read()
+    uint8_t data[9];
+    sim_rom_bytes(a, rom);
+    lx.clear_stats();
+    CHECK_EQ(onewire_run(lx.bus(), onewire_prog_read_scratch, rom, 0, data), OW_OK);
+    CHECK(memcmp(data, scratch + 1, 9) == 0);
+    CHECK_EQ(get(slave_id(a) + "/rw")[0], (char)0xBE);
+    CHECK_EQ(lx.get_stats().transactions, 1);
+    CHECK_EQ(lx.get_stats().errors, 0);
+
+    // Skip ROM writes go to every slave; the one without rw fails
+    lx.clear_stats();
+    lx.reset();
+    lx.skip();
+    lx.write(0x44);
+    lx.reset();
+    CHECK_EQ(get(slave_id(a) + "/rw")[10], 0x44);
+    CHECK(get(slave_id(b) + "/rw") == std::string(1, 0x44));
+    CHECK_EQ(lx.get_stats().transactions, 2);
+    CHECK_EQ(lx.get_stats().errors, 1);
+
+    // Programs that only write reach the devices when they end, with no
+    // reset or read after them
+    put(slave_id(a) + "/rw", "", 0);
+    put(slave_id(b) + "/rw", "", 0);
+    {
+        static const uint8_t copy[] = { OW_RESET, OW_MATCH, OW_WRITE, 1, 0x48, OW_END };
+        OneWireLinux lx2(dir.c_str());
+        CHECK_EQ(onewire_run(lx2.bus(), onewire_prog_convert_all), OW_OK);
+        CHECK(get(slave_id(a) + "/rw") == std::string(1, 0x44));
+        CHECK(get(slave_id(b) + "/rw") == std::string(1, 0x44));
+        sim_rom_bytes(b, rom);
+        CHECK_EQ(onewire_run(lx2.bus(), copy, rom), OW_OK);
+        // (a new open writes the plain file from the start again)
+        CHECK(get(slave_id(b) + "/rw") == std::string(1, 0x48));
+
+        // and before an OW_DELAY: the command is there during the wait
+        static const uint8_t convert[] = { OW_RESET, OW_MATCH, OW_WRITE, 1, 0x44,
+                                           OW_DELAY_MS(1), OW_WRITE, 1, 0x48, OW_END };
+        sim_rom_bytes(a, rom);
+        CHECK_EQ(onewire_run(lx2.bus(), convert, rom), OW_OK);
+        CHECK(get(slave_id(a) + "/rw") == std::string("\x44\x48", 2));
+        CHECK_EQ(lx2.get_stats().transactions, 5);
+    }
+
+    // A slave claimed by a family module reads as an empty bus
+    sim_rom_bytes(claimed, rom);
+    CHECK_EQ(onewire_run(lx.bus(), onewire_prog_read_scratch, rom, 0, data), OW_CRC_ERROR);
+
+    // The kernel's own search
+    CHECK(lx.kernel_search(0));
+    CHECK(get("w1_master_search") == "0\n");
+    CHECK(lx.kernel_search(1));
+    CHECK(get("w1_master_search") == "1\n");
+
+    std::string rm = "rm -rf " + dir;
+    CHECK_EQ(system(rm.c_str()), 0);
+    return test_result("test_linux");
+}
@@ -0,0 +1,93 @@
+// OneWireParasite on the simulated bus: the strong pullup stays on for
+// each parasite sensor's whole conversion (a SimThermometer reads 85 degC
+// otherwise), one at a time over the current budget, and the duty limit
+// spaces the pullups out.
+
+#include "OneWireESP_parasite.h"
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+static int16_t temperature(SimWire &wire, const SimThermometer &t)
+{
+    uint8_t rom[8], s[9];
+    sim_rom_bytes(t.rom, rom);
+    if (onewire_run(wire.bus(), onewire_prog_read_scratch, rom, 0, s) != OW_OK) return -1;
+    return (int16_t)(s[0] | s[1] << 8);
+}
+
+int main()
+{
+    host_virtual_clock(true);
+
+    SimWire wire;
+    SimThermometer fast(sim_rom(0x28, 1), 0x0191), slow(sim_rom(0x28, 2), 0x0192);
+    SimThermometer ext(sim_rom(0x28, 3), 0x0193);
+    fast.parasite = slow.parasite = true;
+    fast.scratch[4] = 0x1F;                 // 9 bits, 94 ms
+    wire.attach(&fast);
+    wire.attach(&slow);
+    wire.attach(&ext);
+
+    // The model: a pullup shorter than the conversion browns it out
+    {
+        static const uint8_t brief[] = { OW_RESET, OW_SKIP, OW_PULLUP, OW_WRITE, 1, 0x44,
+                                         OW_DELAY_MS(10), OW_END };
+        CHECK_EQ(onewire_run(wire.bus(), brief), OW_OK);
+        host_advance_us(800000);
+        CHECK_EQ(temperature(wire, fast), 0x0550);
+        CHECK_EQ(temperature(wire, slow), 0x0550);
+        CHECK_EQ(temperature(wire, ext), 0x0193);
+        CHECK_EQ(fast.brownouts + slow.brownouts, 2);
+        slow.brownouts = fast.brownouts = 0;
+    }
+
+    uint8_t rom[8];
+    OneWireParasite all(wire.bus());
+    const SimThermometer *devs[3] = { &fast, &slow, &ext };
+    for (int i = 0; i < 3; i++) {
+        sim_rom_bytes(devs[i]->rom, rom);
+        CHECK_EQ(all.add_device(rom), OW_OK);
+    }
+    CHECK_EQ(all.parasite_count(), 2);
+    sim_rom_bytes(fast.rom, rom);
+    CHECK_EQ(all.conversion_ms(rom), 94);
+
+    // Within budget: one Skip ROM Convert T held for the slowest sensor
+    wire.clear_stats();
+    CHECK_EQ(all.convert(), OW_OK);
+    CHECK(wire.last_pullup_us >= 750000);
+    CHECK_EQ(temperature(wire, fast), 0x0191);
+    CHECK_EQ(temperature(wire, slow), 0x0192);
+    CHECK_EQ(temperature(wire, ext), 0x0193);
+
+    // Over budget: each parasite sensor on its own, held for its own time
+    OneWireParasite one(wire.bus(), 1);
+    for (int i = 0; i < 3; i++) {
+        sim_rom_bytes(devs[i]->rom, rom);
+        CHECK_EQ(one.add_device(rom), OW_OK);
+    }
+    fast.raw = 0x0201;
+    slow.raw = 0x0202;
+    wire.clear_stats();
+    CHECK_EQ(one.convert(), OW_OK);
+    CHECK(wire.stats.pullup_us >= 750000 + 94000);
+    CHECK(wire.stats.pullup_us < 750000 + 94000 + 50000);
+    CHECK_EQ(temperature(wire, fast), 0x0201);
+    CHECK_EQ(temperature(wire, slow), 0x0202);
+    CHECK_EQ(fast.brownouts + slow.brownouts, 0);
+
+    // A 50% duty limit: the second round waits as long as the first held
+    OneWireParasite half(wire.bus(), 0, 50);
+    for (int i = 0; i < 3; i++) {
+        sim_rom_bytes(devs[i]->rom, rom);
+        CHECK_EQ(half.add_device(rom), OW_OK);
+    }
+    CHECK_EQ(half.convert(), OW_OK);
+    int64_t start = host_time_us();
+    CHECK_EQ(half.convert(), OW_OK);
+    CHECK(host_time_us() - start >= 2 * 750000);
+    CHECK_EQ(fast.brownouts + slow.brownouts, 0);
+
+    return test_result("test_parasite");
+}
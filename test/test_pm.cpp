@@ -0,0 +1,135 @@
+// Power management counters on the virtual clock: a DS18B20 reading
+// splits into the bus time (lock held) and the conversion wait, which
+// gives its energy; search1() counts as active time like onewire_run();
+// the counters do not wrap after 71 minutes; callers side by side count
+// their common time once, a wait only stops the count once nobody else is
+// busy, and threads beginning and ending at once leave nothing held.
+
+#include "OneWireESP.h"
+#include "OneWireESP_pm.h"
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+#include <thread>
+#include <vector>
+
+// 3.3 V, 40 mA running, 0.8 mA in light sleep
+#define MV          3300
+#define ACTIVE_MA   40
+#define SLEEP_UA    800
+
+int main()
+{
+    host_virtual_clock(true);
+
+    SimWire wire;
+    SimThermometer t(sim_rom(0x28, 1), 0x0191);
+    wire.attach(&t);
+
+    // there without power management, and does nothing
+    onewire_pm_keep_pin(OW1_PIN);
+
+    // One reading: Convert T, the 750 ms wait, Read Scratchpad
+    static const uint8_t convert[] = { OW_RESET, OW_SKIP, OW_WRITE, 1, 0x44,
+                                       OW_DELAY_MS(750), OW_END };
+    uint8_t rom[8], s[9];
+    sim_rom_bytes(t.rom, rom);
+    onewire_pm_clear_stats();
+    wire.clear_stats();
+    CHECK_EQ(onewire_run(wire.bus(), convert), OW_OK);
+    CHECK_EQ(onewire_run(wire.bus(), onewire_prog_read_scratch, rom, 0, s), OW_OK);
+    CHECK_EQ(s[0] | s[1] << 8, 0x0191);
+
+    OneWirePmStats pm = onewire_pm_stats();
+    CHECK_EQ(pm.waits, 1);
+    CHECK(pm.wait_us >= 750000 && pm.wait_us <= 770000);
+    // the virtual clock only moves for the slots and the wait
+    CHECK(pm.active_us >= wire.stats.bus_us);
+    CHECK(pm.active_us <= wire.stats.bus_us + 100);
+
+    uint64_t sleeping = onewire_pm_energy_uj(MV, ACTIVE_MA, SLEEP_UA);
+    uint64_t busy = onewire_pm_energy_uj(MV, ACTIVE_MA, ACTIVE_MA * 1000);
+    CHECK(sleeping * 10 < busy);
+    printf("  one reading: %.2f ms active, %.1f ms waiting, %.1f mJ light sleeping, %.1f mJ awake\n",
+           pm.active_us / 1000.0, pm.wait_us / 1000.0, sleeping / 1000.0, busy / 1000.0);
+
+    // search1() holds the lock for the search, so its time is active
+    host_gpio_attach(OW1_PIN, &wire);
+    OneWire ow(OW1_PIN);
+    onewire_pm_clear_stats();
+    ow.reset_search1();
+    CHECK(ow.search1(rom));
+    CHECK_EQ(sim_rom_value(rom), t.rom);
+    pm = onewire_pm_stats();
+    CHECK(pm.active_us > 64 * 3 * SIM_WRITE1_US);
+    CHECK_EQ(pm.waits, 0);
+    host_gpio_attach(OW1_PIN, 0);
+
+    // 5000 s of waiting is more than 32 bits of microseconds
+    onewire_pm_clear_stats();
+    onewire_pm_bus_begin();
+    onewire_pm_wait(5000000);
+    onewire_pm_bus_end();
+    pm = onewire_pm_stats();
+    CHECK(pm.wait_us >= 5000000000ull);
+    CHECK(pm.active_us < 1000);
+    uint64_t uj = onewire_pm_energy_uj(MV, ACTIVE_MA, SLEEP_UA);
+    CHECK(uj >= (uint64_t)MV * SLEEP_UA * 5000 / 1000);
+    CHECK(uj < (uint64_t)MV * SLEEP_UA * 5001 / 1000);
+
+    // two callers side by side: the time counts once
+    onewire_pm_clear_stats();
+    onewire_pm_bus_begin();
+    host_advance_us(1000);
+    onewire_pm_bus_begin();
+    host_advance_us(1000);
+    onewire_pm_bus_end();
+    host_advance_us(500);
+    onewire_pm_bus_end();
+    host_advance_us(700);
+    pm = onewire_pm_stats();
+    CHECK_EQ(pm.active_us, 2500);
+
+    // one waits while the other is busy: still active; then the other
+    // waits alone
+    onewire_pm_clear_stats();
+    int64_t start = host_time_us();
+    onewire_pm_bus_begin();
+    onewire_pm_bus_begin();
+    onewire_pm_wait(100);
+    onewire_pm_bus_end();
+    int64_t alone = host_time_us();
+    onewire_pm_wait(200);
+    onewire_pm_bus_end();
+    pm = onewire_pm_stats();
+    CHECK_EQ(pm.active_us, alone - start);
+    CHECK_EQ(pm.wait_us, host_time_us() - start);
+    CHECK(pm.active_us >= 100000);
+    CHECK_EQ(pm.waits, 2);
+
+    // an end without a begin changes nothing
+    onewire_pm_bus_end();
+    onewire_pm_clear_stats();
+    host_advance_us(1000);
+    CHECK_EQ(onewire_pm_stats().active_us, 0);
+
+    // threads in and out at once: none left counted in
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.push_back(std::thread([] {
+            for (int k = 0; k < 100000; k++) {
+                onewire_pm_bus_begin();
+                onewire_pm_bus_begin();
+                onewire_pm_bus_end();
+                onewire_pm_bus_end();
+            }
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+    onewire_pm_clear_stats();
+    host_advance_us(1000);
+    CHECK_EQ(onewire_pm_stats().active_us, 0);
+
+    return test_result("test_pm");
+}
@@ -0,0 +1,36 @@
+// ow_delay_ms() and ow_delay_until() on the FreeRTOS tick (100Hz here):
+// never shorter than asked, even when the first tick comes at once.
+
+#include "utils/OneWireESP_port.h"
+#include "sim.h"
+#include "test.h"
+
+int main()
+{
+    host_virtual_clock(true);
+
+    static const uint32_t ms[] = { 1, 9, 10, 15, 20, 999, 1001 };
+    for (size_t i = 0; i < sizeof(ms) / sizeof(ms[0]); i++) {
+        // a tick boundary may be due right away: one tick is lost
+        int64_t start = host_time_us();
+        uint64_t delays = host_task_delays();
+        ow_delay_ms(ms[i]);
+        int64_t slept = host_time_us() - start - 1000000 / configTICK_RATE_HZ;
+        CHECK(slept >= (int64_t)ms[i] * 1000);
+        CHECK(host_time_us() - start <= (int64_t)ms[i] * 1000 + 2 * 1000000 / configTICK_RATE_HZ);
+        CHECK_EQ(host_task_delays() - delays, 1);
+    }
+
+    int64_t start = host_time_us();
+    ow_delay_ms(0);
+    CHECK_EQ(host_time_us(), start);
+
+    int64_t deadline = start + 123456;
+    ow_delay_until(deadline);
+    CHECK(host_time_us() >= deadline);
+    start = host_time_us();
+    ow_delay_until(deadline);
+    CHECK_EQ(host_time_us(), start);
+
+    return test_result("test_port");
+}
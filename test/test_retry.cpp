@@ -0,0 +1,148 @@
+// OneWireRetry on the simulated bus: a CRC error in the second phase of
+// a program retakes only that phase (no second conversion) unless the
+// policy asks for the whole program, missed presence pulses are retried
+// up to the policy's attempts with its backoff between them, a shorted
+// line fails at once and is left alone for the holdoff, and one
+// disturbed slot after an empty reset is not taken for a short.
+
+#include "OneWireESP_retry.h"
+#include "sim.h"
+#include "test.h"
+
+#include <string.h>
+
+// Convert T with Skip ROM, then Read Scratchpad of one sensor
+static const uint8_t convert_read[] = {
+    OW_RESET, OW_SKIP, OW_WRITE, 1, 0x44, OW_DELAY_MS(750),
+    OW_RESET, OW_MATCH, OW_WRITE, 1, 0xBE, OW_READ, 9, OW_CRC8, 9,
+    OW_END
+};
+
+// slots of the first phase, and where the second reads the scratchpad
+#define CONVERT_SLOTS   (2 * 8)
+#define READ_AT         (CONVERT_SLOTS + 9 * 8 + 8)
+
+static void phases(void)
+{
+    SimWire wire;
+    SimThermometer t(sim_rom(0x28, 0x41), 0x0123);
+    uint8_t rom[8], s[9];
+    wire.attach(&t);
+    sim_rom_bytes(t.rom, rom);
+
+    OneWireRetry retry(wire.bus());
+
+    // a read inverted in the scratchpad: only the read is taken again
+    wire.flip_slot(READ_AT + 5);
+    CHECK_EQ(retry.run(convert_read, rom, 0, s), OW_OK);
+    CHECK_EQ(t.conversions, 1);
+    CHECK_EQ(wire.stats.resets, 3);
+    CHECK_EQ(s[0] | s[1] << 8, 0x0123);
+    CHECK_EQ(retry.get_stats().crc_errors, 1);
+    CHECK_EQ(retry.get_stats().retries, 1);
+    CHECK_EQ(retry.get_stats().recovered, 1);
+    CHECK_EQ(retry.get_stats().failed, 0);
+
+    // the same with the whole program retaken: a second conversion
+    static const OneWireRetryPolicy whole = { 3, true, 0 };
+    wire.flip_slot(READ_AT + 5);
+    CHECK_EQ(retry.run(convert_read, rom, 0, s, &whole), OW_OK);
+    CHECK_EQ(t.conversions, 3);
+    CHECK_EQ(wire.stats.resets, 3 + 4);
+
+    // every attempt disturbed: the last result, counted as failed
+    uint32_t phase = READ_AT + 9 * 8;
+    for (int i = 0; i < 3; i++) wire.flip_slot(READ_AT + 5 + i * (phase - CONVERT_SLOTS));
+    CHECK_EQ(retry.run(convert_read, rom, 0, s), OW_CRC_ERROR);
+    CHECK_EQ(t.conversions, 4);
+    CHECK_EQ(retry.get_stats().crc_errors, 1 + 1 + 3);
+    CHECK_EQ(retry.get_stats().failed, 1);
+    CHECK_EQ(retry.get_stats().transactions, 3);
+}
+
+static void presence(void)
+{
+    SimWire wire;
+    SimThermometer t(sim_rom(0x28, 0x42));
+    uint8_t rom[8], s[9];
+    wire.attach(&t);
+    sim_rom_bytes(t.rom, rom);
+
+    OneWireRetry retry(wire.bus());
+
+    // a missed presence pulse is tried again, and the line is not low
+    wire.drop_presence(1);
+    CHECK_EQ(retry.run(convert_read, rom, 0, s), OW_OK);
+    CHECK_EQ(retry.get_stats().no_presence, 1);
+    CHECK_EQ(retry.get_stats().recovered, 1);
+    CHECK_EQ(retry.get_stats().shorts, 0);
+    CHECK(!retry.faulted());
+
+    // the backoff comes between the attempts
+    static const OneWireRetryPolicy slow = { 4, false, 20 };
+    int64_t start = host_time_us();
+    CHECK_EQ(retry.run(onewire_prog_read_scratch, rom, 0, s, &slow), OW_OK);
+    int64_t plain = host_time_us() - start;
+    wire.drop_presence(0);
+    wire.drop_presence(1);
+    start = host_time_us();
+    CHECK_EQ(retry.run(onewire_prog_read_scratch, rom, 0, s, &slow), OW_OK);
+    int64_t slowed = host_time_us() - start;
+    CHECK(slowed - plain >= 2 * 20000);
+    CHECK_EQ(retry.get_stats().no_presence, 3);
+
+    // an empty bus: all attempts, then OW_NO_PRESENCE; one read after
+    // the reset disturbed to 0 is no short
+    wire.detach(&t);
+    wire.flip_slot(0);
+    CHECK_EQ(retry.run(onewire_prog_read_scratch, rom, 0, s), OW_NO_PRESENCE);
+    CHECK_EQ(retry.get_stats().no_presence, 3 + 3);
+    CHECK_EQ(retry.get_stats().shorts, 0);
+    CHECK(!retry.faulted());
+}
+
+static void shorted(void)
+{
+    SimWire wire;
+    SimThermometer t(sim_rom(0x28, 0x43));
+    uint8_t rom[8], s[9];
+    wire.attach(&t);
+    sim_rom_bytes(t.rom, rom);
+
+    OneWireRetry retry(wire.bus(), 0, 500);
+
+    // a short fails at once, with no retry
+    wire.shorted = true;
+    CHECK_EQ(retry.run(onewire_prog_read_scratch, rom, 0, s), OW_BUS_SHORT);
+    CHECK_EQ(wire.stats.resets, 1);
+    CHECK_EQ(retry.get_stats().shorts, 1);
+    CHECK_EQ(retry.get_stats().retries, 0);
+    CHECK(retry.faulted());
+
+    // and for the holdoff nothing goes on the bus, short or not
+    wire.shorted = false;
+    uint32_t slots = wire.stats.slots;
+    CHECK_EQ(retry.run(onewire_prog_read_scratch, rom, 0, s), OW_BUS_BACKOFF);
+    host_advance_us(499000);
+    CHECK_EQ(retry.run(onewire_prog_read_scratch, rom, 0, s), OW_BUS_BACKOFF);
+    CHECK_EQ(wire.stats.resets, 1);
+    CHECK_EQ(wire.stats.slots, slots);
+    CHECK_EQ(retry.get_stats().backoffs, 2);
+
+    // after it, the bus is tried again
+    host_advance_us(1000);
+    CHECK(!retry.faulted());
+    CHECK_EQ(retry.run(onewire_prog_read_scratch, rom, 0, s), OW_OK);
+    CHECK_EQ(retry.get_stats().failed, 3);
+}
+
+int main()
+{
+    host_virtual_clock(true);
+
+    phases();
+    presence();
+    shorted();
+
+    return test_result("test_retry");
+}
@@ -0,0 +1,243 @@
+// OneWireScheduler on the virtual clock: devices on one bus share a
+// broadcast conversion and a slow one only rides along when it is due
+// within half its period, buses interleave their work so a fast bus is
+// read several times while a slow one converts, periods and statistics
+// past 2^32 microseconds, and run() sleeping straight to each deadline.
+
+#include "OneWireESP_scheduler.h"
+#include "OneWireESP_program.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sim.h"
+#include "test.h"
+
+#include <vector>
+
+struct Samples {
+    uint32_t count;
+    uint32_t stop_at;
+    SemaphoreHandle_t done;
+};
+
+static void on_sample(uint8_t, const uint8_t *, const uint8_t *, uint8_t status, void *arg)
+{
+    Samples *s = (Samples *)arg;
+    CHECK_EQ(status, OW_OK);
+    if (++s->count == s->stop_at) {
+        xSemaphoreGive(s->done);
+        vTaskDelete(0);
+    }
+}
+
+static void run_task(void *arg)
+{
+    ((OneWireScheduler *)arg)->run();
+}
+
+// Every sample, in the order delivered
+struct Log {
+    struct Entry {
+        uint8_t bus;
+        uint64_t rom;
+        int16_t raw;
+        int64_t at;
+    };
+    std::vector<Entry> entries;
+
+    uint32_t count(uint64_t rom) const
+    {
+        uint32_t n = 0;
+        for (size_t i = 0; i < entries.size(); i++)
+            if (entries[i].rom == rom) n++;
+        return n;
+    }
+};
+
+static void on_log(uint8_t bus, const uint8_t *rom, const uint8_t *scratch, uint8_t status,
+                   void *arg)
+{
+    CHECK_EQ(status, OW_OK);
+    Log::Entry e = { bus, sim_rom_value(rom), (int16_t)(scratch[0] | scratch[1] << 8),
+                     host_time_us() };
+    ((Log *)arg)->entries.push_back(e);
+}
+
+static void poll_for(OneWireScheduler &sched, int64_t us)
+{
+    int64_t start = host_time_us();
+    while (host_time_us() - start < us) {
+        uint32_t ms = sched.poll();
+        host_advance_us((int64_t)(ms ? ms : 1) * 1000);
+    }
+}
+
+static void coalescing(void)
+{
+    SimWire wire;
+    SimThermometer fast[4] = {
+        SimThermometer(sim_rom(0x28, 0x61), 0x0101), SimThermometer(sim_rom(0x28, 0x62), 0x0102),
+        SimThermometer(sim_rom(0x28, 0x63), 0x0103), SimThermometer(sim_rom(0x28, 0x64), 0x0104),
+    };
+    SimThermometer slow(sim_rom(0x28, 0x65), 0x0105);
+    uint8_t rom[8];
+
+    Log log;
+    OneWireScheduler sched(on_log, &log);
+    int8_t b = sched.add_bus(wire.bus());
+    for (int i = 0; i < 4; i++) {
+        wire.attach(&fast[i]);
+        sim_rom_bytes(fast[i].rom, rom);
+        CHECK(sched.add_device(b, rom, 1000));
+    }
+    wire.attach(&slow);
+    sim_rom_bytes(slow.rom, rom);
+    CHECK(sched.add_device(b, rom, 3500));
+
+    // the first poll converts all five with one broadcast
+    sched.poll();
+    CHECK_EQ(sched.stats(b).conversions, 1);
+    CHECK_EQ(sched.stats(b).coalesced, 4);
+    CHECK_EQ(wire.stats.resets, 1);
+
+    // conversions every second, read by 0.8s into it: stop between
+    // the last read and the next conversion
+    poll_for(sched, 20900000ll);
+    const OneWireSchedStats &st = sched.stats(b);
+    uint32_t n = log.count(fast[0].rom);
+    CHECK(n >= 19);
+    // the four with the same period are always converted together
+    CHECK_EQ(st.conversions, n);
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ(log.count(fast[i].rom), n);
+        CHECK_EQ(fast[i].conversions, n);
+    }
+    // the slow one, out of step with them, rides along with the next
+    // conversion within half its period and never converts alone
+    uint32_t s = log.count(slow.rom);
+    CHECK(s >= n * 2 / 7 && s <= n * 2 / 7 + 1);
+    CHECK_EQ(slow.conversions, n);
+    CHECK_EQ(st.samples, 4 * n + s);
+    CHECK_EQ(st.coalesced, st.samples - st.conversions);
+    CHECK_EQ(st.missed, 0);
+    CHECK_EQ(st.errors, 0);
+    for (size_t i = 0; i < log.entries.size(); i++)
+        CHECK_EQ(log.entries[i].raw, (int16_t)(0x0100 + (log.entries[i].rom >> 8 & 0xFF) - 0x60));
+}
+
+static void interleaving(void)
+{
+    SimWire slowWire, fastWire;
+    SimThermometer s0(sim_rom(0x28, 0x71), 0x0201), s1(sim_rom(0x28, 0x72), 0x0202);
+    SimThermometer f0(sim_rom(0x28, 0x73), 0x0203), f1(sim_rom(0x28, 0x74), 0x0204);
+    // 9 bits on the fast bus: 93.75ms conversions
+    f0.scratch[4] = f1.scratch[4] = 0x1F;
+    slowWire.attach(&s0);
+    slowWire.attach(&s1);
+    fastWire.attach(&f0);
+    fastWire.attach(&f1);
+    uint8_t rom[8];
+
+    Log log;
+    OneWireScheduler sched(on_log, &log);
+    int8_t sb = sched.add_bus(slowWire.bus(), 750);
+    int8_t fb = sched.add_bus(fastWire.bus(), 94);
+    sim_rom_bytes(s0.rom, rom);
+    CHECK(sched.add_device(sb, rom, 1000));
+    sim_rom_bytes(s1.rom, rom);
+    CHECK(sched.add_device(sb, rom, 1000));
+    sim_rom_bytes(f0.rom, rom);
+    CHECK(sched.add_device(fb, rom, 200));
+    sim_rom_bytes(f1.rom, rom);
+    CHECK(sched.add_device(fb, rom, 200));
+
+    // one poll starts the conversions on both buses
+    int64_t start = host_time_us();
+    sched.poll();
+    CHECK_EQ(s0.conversions, 1);
+    CHECK_EQ(f0.conversions, 1);
+
+    // while the slow bus converts, the fast one converts and is read
+    // every period
+    poll_for(sched, 3 * 1000000ll);
+    size_t first = 0;
+    while (first < log.entries.size() && log.entries[first].bus != sb) first++;
+    CHECK(first < log.entries.size());
+    CHECK(log.entries[first].at - start >= 750000);
+    CHECK(log.entries[first].at - start < 750000 + 100000);
+    CHECK(first >= 2 * 3);
+    for (size_t i = 0; i < first; i++) CHECK_EQ(log.entries[i].bus, fb);
+
+    // and the slow bus's reads take turns with the fast bus's work
+    // rather than waiting for it
+    uint32_t gaps = 0;
+    for (size_t i = first + 1; i < log.entries.size(); i++)
+        if (log.entries[i].bus == sb && log.entries[i - 1].bus == sb &&
+            log.entries[i].at - log.entries[i - 1].at > 50000)
+            gaps++;
+    CHECK_EQ(gaps, 0);
+    CHECK_EQ(log.count(s0.rom), log.count(s1.rom));
+    CHECK(log.count(s0.rom) >= 2);
+    CHECK(log.count(f0.rom) >= 4 * log.count(s0.rom));
+    CHECK_EQ(sched.stats(sb).missed, 0);
+    CHECK_EQ(sched.stats(fb).missed, 0);
+    for (size_t i = 0; i < log.entries.size(); i++)
+        CHECK_EQ(log.entries[i].raw, (int16_t)(0x0200 + (log.entries[i].rom >> 8 & 0xFF) - 0x70));
+}
+
+int main()
+{
+    host_virtual_clock(true);
+
+    coalescing();
+    interleaving();
+
+    SimWire wire;
+    SimThermometer t(sim_rom(0x28, 0x0A0B0C0D0Eull));
+    uint8_t rom[8];
+    sim_rom_bytes(t.rom, rom);
+    wire.attach(&t);
+
+    // A 75 minute period is 4.5e9us, over the range of 32 bits
+    {
+        Samples s = { 0, 0, 0 };
+        OneWireScheduler sched(on_sample, &s);
+        int8_t b = sched.add_bus(wire.bus());
+        CHECK(sched.add_device(b, rom, 75 * 60 * 1000));
+        // samples at 0.75s and then every period: four in 299 minutes
+        int64_t start = host_time_us();
+        while (host_time_us() - start < 299 * 60 * 1000000ll) {
+            uint32_t ms = sched.poll();
+            host_advance_us((int64_t)(ms ? ms : 1) * 1000);
+        }
+        const OneWireSchedStats &st = sched.stats(b);
+        CHECK_EQ(s.count, 4);
+        CHECK_EQ(st.missed, 0);
+        CHECK(st.elapsed_us >= 299 * 60 * 1000000ull);
+        CHECK(st.busy_us > 0 && st.busy_us < 100000);
+        CHECK(sched.utilisation(b) == 0);
+    }
+
+    // run() as a task: one sleep for each conversion and one up to the
+    // next, rounded up to whole ticks rather than waking early
+    {
+        StaticSemaphore_t buf;
+        Samples s = { 0, 20, xSemaphoreCreateBinaryStatic(&buf) };
+        OneWireScheduler sched(on_sample, &s);
+        int8_t b = sched.add_bus(wire.bus());
+        CHECK(sched.add_device(b, rom, 1005));
+
+        uint64_t delays = host_task_delays();
+        int64_t start = host_time_us();
+        TaskHandle_t task;
+        xTaskCreatePinnedToCore(run_task, "sched", 4096, &sched, 1, &task, 0);
+        xSemaphoreTake(s.done, portMAX_DELAY);
+
+        uint64_t n = host_task_delays() - delays;
+        printf("  run(): %u samples, %llu sleeps, %.1f s\n", s.count, (unsigned long long)n,
+               (host_time_us() - start) / 1e6);
+        CHECK(n <= 2 * s.count + 2);
+        CHECK_EQ(sched.stats(b).missed, 0);
+    }
+
+    return test_result("test_scheduler");
+}
@@ -0,0 +1,496 @@
+// ROM search over the simulated bus, through onewire_search() on a bus
+// table and through the bit-banged OneWire::search1().
+//
+// Populations: random ROMs, devices sharing all but the last serial
+// byte, a pair of ROMs differing at every bit in turn (a discrepancy at
+// every depth), and a full binary tree.  Faults: a read inverted at each
+// slot of a pass in turn, a read disturbed at the first ROM bit, a
+// missed presence pulse, a device leaving in the middle of a pass, and
+// random bit errors.  A fault may cost devices
+// but never returns one twice or one that is not there.  Prints passes,
+// slots and bus time per device for each population.
+//
+// OneWire::search_family() and count_families() on a bus of mixed
+// families, for a family that is not there and on an empty bus.
+
+#include "OneWireESP.h"
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+#include <algorithm>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+struct Population {
+    const char *name;
+    std::vector<uint64_t> roms;
+};
+
+static uint64_t next_random(uint64_t &s)
+{
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+static Population random_population(const char *name, size_t n, uint64_t seed)
+{
+    Population p = { name, std::vector<uint64_t>() };
+    std::set<uint64_t> seen;
+    while (p.roms.size() < n) {
+        uint64_t r = sim_rom((uint8_t)next_random(seed), next_random(seed));
+        if (seen.insert(r).second) p.roms.push_back(r);
+    }
+    return p;
+}
+
+// Same family and first five serial bytes, only the last one differs
+static Population shared_prefix(size_t n)
+{
+    Population p = { "shared prefix", std::vector<uint64_t>() };
+    for (size_t i = 0; i < n; i++)
+        p.roms.push_back(sim_rom(0x28, 0x00A1B2C3D4E5ull | (uint64_t)(i * 37 % 256) << 40));
+    return p;
+}
+
+// A base ROM and one that differs from it at family/serial bit 'd'
+static Population pair_at(int d)
+{
+    Population p = { "pair", std::vector<uint64_t>() };
+    uint64_t base = 0x00A5C3F00FA50F28ull;
+    p.roms.push_back(sim_rom((uint8_t)base, base >> 8));
+    uint64_t other = base ^ (1ull << d);
+    p.roms.push_back(sim_rom((uint8_t)other, other >> 8));
+    return p;
+}
+
+// The base ROM and every single bit variant of it: discrepancies at all
+// 56 depths in one enumeration
+static Population every_depth(void)
+{
+    Population p = { "every depth", std::vector<uint64_t>() };
+    uint64_t base = 0x00A5C3F00FA50F28ull;
+    p.roms.push_back(sim_rom((uint8_t)base, base >> 8));
+    for (int d = 0; d < 56; d++) {
+        uint64_t v = base ^ (1ull << d);
+        p.roms.push_back(sim_rom((uint8_t)v, v >> 8));
+    }
+    return p;
+}
+
+// All combinations of six bits spread over family and serial
+static Population full_tree(void)
+{
+    static const int bits[6] = { 0, 9, 20, 31, 42, 55 };
+    Population p = { "full tree", std::vector<uint64_t>() };
+    for (int m = 0; m < 64; m++) {
+        uint64_t v = 0x0012345678900010ull;
+        for (int b = 0; b < 6; b++) {
+            if (m & (1 << b)) v ^= 1ull << bits[b];
+        }
+        p.roms.push_back(sim_rom((uint8_t)v, v >> 8));
+    }
+    return p;
+}
+
+class Searcher
+{
+  public:
+    virtual ~Searcher() { }
+    virtual const char *name(void) = 0;
+    virtual void restart(void) = 0;
+    virtual bool next(uint8_t rom[8]) = 0;
+};
+
+class ProgramSearcher : public Searcher
+{
+  public:
+    explicit ProgramSearcher(SimWire &w) : bus(w.bus()) { restart(); }
+    const char *name(void) { return "onewire_search"; }
+    void restart(void) { onewire_search_reset(state); }
+    bool next(uint8_t rom[8]) { return onewire_search(bus, state, rom); }
+
+  private:
+    OneWireBus bus;
+    OneWireSearchState state;
+};
+
+class GpioSearcher : public Searcher
+{
+  public:
+    explicit GpioSearcher(SimWire &w)
+    {
+        host_gpio_attach(OW1_PIN, &w);
+        ow.begin(OW1_PIN);
+    }
+    ~GpioSearcher() { host_gpio_attach(OW1_PIN, 0); }
+    const char *name(void) { return "search1"; }
+    void restart(void) { ow.reset_search1(); }
+    bool next(uint8_t rom[8]) { return ow.search1(rom); }
+
+  private:
+    OneWire ow;
+};
+
+struct Outcome {
+    std::vector<uint64_t> order;
+    size_t missing;
+    size_t duplicates;
+    size_t foreign;             // not on the bus: a corrupted ROM got through
+    uint32_t passes;
+    uint32_t slots;
+    int64_t bus_us;
+};
+
+static Outcome enumerate(Searcher &s, SimWire &wire, const std::vector<uint64_t> &pop)
+{
+    Outcome o = Outcome();
+    std::set<uint64_t> want(pop.begin(), pop.end()), got;
+    uint32_t resets = wire.stats.resets, slots = wire.stats.slots;
+    int64_t start = host_time_us();
+    uint8_t rom[8];
+
+    s.restart();
+    for (size_t i = 0; i < 2 * pop.size() + 8 && s.next(rom); i++) {
+        uint64_t r = sim_rom_value(rom);
+        o.order.push_back(r);
+        if (!want.count(r)) o.foreign++;
+        else if (!got.insert(r).second) o.duplicates++;
+    }
+    o.missing = want.size() - got.size();
+    o.passes = wire.stats.resets - resets;
+    o.slots = wire.stats.slots - slots;
+    o.bus_us = host_time_us() - start;
+    return o;
+}
+
+// Search order: ROMs compared from the least significant bit up
+static uint64_t bit_reverse(uint64_t v)
+{
+    uint64_t r = 0;
+    for (int i = 0; i < 64; i++, v >>= 1) r = r << 1 | (v & 1);
+    return r;
+}
+
+static bool search_ordered(const std::vector<uint64_t> &order)
+{
+    for (size_t i = 1; i < order.size(); i++) {
+        if (bit_reverse(order[i - 1]) >= bit_reverse(order[i])) return false;
+    }
+    return true;
+}
+
+struct Bus {
+    SimWire wire;
+    std::vector<SimDevice *> devs;
+
+    explicit Bus(const std::vector<uint64_t> &roms)
+    {
+        for (size_t i = 0; i < roms.size(); i++) {
+            devs.push_back(new SimDevice(roms[i]));
+            wire.attach(devs.back());
+        }
+    }
+    ~Bus()
+    {
+        for (size_t i = 0; i < devs.size(); i++) delete devs[i];
+    }
+};
+
+template <class S>
+static void check_population(const Population &p, bool print)
+{
+    Bus b(p.roms);
+    S s(b.wire);
+    Outcome o = enumerate(s, b.wire, p.roms);
+    CHECK_EQ(o.missing, 0);
+    CHECK_EQ(o.duplicates, 0);
+    CHECK_EQ(o.foreign, 0);
+    CHECK_EQ(o.passes, p.roms.size());
+    CHECK(search_ordered(o.order));
+    if (print) {
+        size_t n = p.roms.size();
+        printf("  %-14s %-14s %4zu devices  %5.2f passes  %6.1f slots  %6.2f ms per device\n",
+               s.name(), p.name, n, (double)o.passes / n, (double)o.slots / n,
+               o.bus_us / 1000.0 / n);
+    }
+}
+
+template <class S>
+static void populations(void)
+{
+    check_population<S>(random_population("random", 1, 1), true);
+    check_population<S>(random_population("random", 10, 2), true);
+    check_population<S>(random_population("random", 100, 3), true);
+    check_population<S>(shared_prefix(64), true);
+    check_population<S>(every_depth(), true);
+    check_population<S>(full_tree(), true);
+    for (int d = 0; d < 56; d++) check_population<S>(pair_at(d), false);
+
+    // family 0 and an empty bus
+    Population zero = { "family 0", std::vector<uint64_t>(1, sim_rom(0x00, 1)) };
+    check_population<S>(zero, false);
+    Bus empty((std::vector<uint64_t>()));
+    S s(empty.wire);
+    uint8_t rom[8];
+    CHECK(!s.next(rom));
+}
+
+struct FaultTally {
+    uint32_t runs, complete, duplicates, foreign;
+};
+
+static void print_tally(const char *searcher, const char *fault, const FaultTally &t)
+{
+    printf("  %-14s %-22s %4u runs  %4u complete  %3u with duplicates  %u foreign\n",
+           searcher, fault, t.runs, t.complete, t.duplicates, t.foreign);
+}
+
+static void tally(FaultTally &t, const Outcome &o)
+{
+    t.runs++;
+    if (!o.missing) t.complete++;
+    if (o.duplicates) t.duplicates++;
+    t.foreign += o.foreign;
+}
+
+template <class S>
+static void faults(void)
+{
+    Population p = random_population("random", 8, 11);
+    const char *name = 0;
+
+    // One inverted read at each slot of the first two passes in turn
+    FaultTally flip = FaultTally();
+    for (uint32_t n = 0; n < 2 * (8 + 64 * 3); n++) {
+        Bus b(p.roms);
+        S s(b.wire);
+        name = s.name();
+        b.wire.flip_slot(n);
+        tally(flip, enumerate(s, b.wire, p.roms));
+    }
+    CHECK_EQ(flip.foreign, 0);
+    CHECK_EQ(flip.duplicates, 0);
+    print_tally(name, "one flipped read", flip);
+
+    // A missed presence pulse ends the enumeration early; a new one is whole
+    FaultTally drop = FaultTally();
+    for (uint32_t n = 0; n < p.roms.size(); n++) {
+        Bus b(p.roms);
+        S s(b.wire);
+        b.wire.drop_presence(n);
+        Outcome o = enumerate(s, b.wire, p.roms);
+        tally(drop, o);
+        CHECK_EQ(o.duplicates, 0);
+        CHECK_EQ(o.foreign, 0);
+        Outcome again = enumerate(s, b.wire, p.roms);
+        CHECK_EQ(again.missing, 0);
+        CHECK_EQ(again.duplicates, 0);
+    }
+    print_tally(name, "missed presence", drop);
+
+    // Each device leaves at some slot of the enumeration
+    FaultTally removal = FaultTally();
+    uint64_t seed = 99;
+    for (size_t i = 0; i < p.roms.size(); i++) {
+        for (int k = 0; k < 16; k++) {
+            Bus b(p.roms);
+            S s(b.wire);
+            uint32_t at = (uint32_t)(next_random(seed) % (p.roms.size() * (8 + 64 * 3)));
+            b.wire.remove_at_slot(b.devs[i], at);
+            Outcome o = enumerate(s, b.wire, p.roms);
+            removal.runs++;
+            removal.foreign += o.foreign;
+            if (o.duplicates) removal.duplicates++;
+            if (o.missing <= 1) removal.complete++;     // all but the one that left
+        }
+    }
+    CHECK_EQ(removal.foreign, 0);
+    CHECK_EQ(removal.duplicates, 0);
+    print_tally(name, "device leaves", removal);
+
+    // Random bit errors on reads
+    FaultTally noise = FaultTally();
+    for (uint32_t seedN = 1; seedN <= 50; seedN++) {
+        Bus b(p.roms);
+        S s(b.wire);
+        b.wire.bit_errors(500, seedN * 7919);
+        tally(noise, enumerate(s, b.wire, p.roms));
+    }
+    CHECK_EQ(noise.foreign, 0);
+    CHECK_EQ(noise.duplicates, 0);
+    print_tally(name, "1/500 read errors", noise);
+}
+
+// A read disturbed at the first ROM bit is retaken like any other: a
+// misread 1/1 there (devices that all have a 0 first bit, the bit read
+// flipped to 1 next to its complement) and a branch that seems gone
+// there (0x28 and 0x29: the second pass takes 1 and the complement read
+// flips to say only the 0 side is there).  Only a 1/1
+// that comes again ends the search: an alarm search with no device in
+// alarm takes two passes.
+template <class S>
+static void first_bit(void)
+{
+    const uint32_t pass = 8 + 64 * 3;       // slots of a whole pass
+    Population same = shared_prefix(2);
+    Population pair = pair_at(0);
+
+    // id bit of the first pass read as 1 next to its complement
+    {
+        Bus b(same.roms);
+        S s(b.wire);
+        b.wire.flip_slot(8);
+        Outcome o = enumerate(s, b.wire, same.roms);
+        CHECK_EQ(o.missing, 0);
+        CHECK_EQ(o.passes, 3);
+        CHECK_EQ(b.wire.stats.flips, 1);
+    }
+    // complement bit of the second pass, where the path takes 1
+    {
+        Bus b(pair.roms);
+        S s(b.wire);
+        b.wire.flip_slot(pass + 9);
+        Outcome o = enumerate(s, b.wire, pair.roms);
+        CHECK_EQ(o.missing, 0);
+        CHECK_EQ(o.duplicates, 0);
+        CHECK_EQ(b.wire.stats.flips, 1);
+    }
+}
+
+static void alarm_none(void)
+{
+    Population p = shared_prefix(3);
+    Bus b(p.roms);
+    OneWireBus bus = b.wire.bus();
+    OneWireSearchState st;
+    uint8_t rom[8];
+
+    onewire_search_reset(st);
+    CHECK(!onewire_search(bus, st, rom, false));
+    CHECK_EQ(b.wire.stats.resets, 2);
+
+    b.devs[1]->alarm = true;
+    onewire_search_reset(st);
+    CHECK(onewire_search(bus, st, rom, false));
+    CHECK_EQ(sim_rom_value(rom), p.roms[1]);
+    CHECK(!onewire_search(bus, st, rom, false));
+}
+
+// Families in search order, with the number of devices of each
+static std::vector<std::pair<uint8_t, uint8_t> > family_runs(const std::vector<uint64_t> &order)
+{
+    std::vector<std::pair<uint8_t, uint8_t> > runs;
+    for (size_t i = 0; i < order.size(); i++) {
+        uint8_t f = (uint8_t)order[i];
+        if (runs.empty() || runs.back().first != f) runs.push_back(std::make_pair(f, 0));
+        runs.back().second++;
+    }
+    return runs;
+}
+
+static void families(void)
+{
+    // 0x28 and 0x29 differ at the first bit, 0x10 and 0x12 only deeper
+    static const struct {
+        uint8_t family;
+        uint8_t count;
+    } mix[] = { { 0x28, 5 }, { 0x29, 2 }, { 0x10, 3 }, { 0x12, 1 }, { 0x3A, 4 } };
+    std::vector<uint64_t> roms;
+    uint64_t seed = 23;
+    for (size_t i = 0; i < sizeof(mix) / sizeof(mix[0]); i++)
+        for (int k = 0; k < mix[i].count; k++) roms.push_back(sim_rom(mix[i].family, next_random(seed)));
+
+    Bus b(roms);
+    GpioSearcher s(b.wire);
+    Outcome all = enumerate(s, b.wire, roms);
+    CHECK_EQ(all.missing, 0);
+    std::vector<std::pair<uint8_t, uint8_t> > runs = family_runs(all.order);
+    CHECK_EQ(runs.size(), 5);
+
+    OneWire ow(OW1_PIN);
+    host_gpio_attach(OW1_PIN, &b.wire);
+
+    // count_families(): one pass per device, the families in search order
+    uint8_t fam[8], cnt[8];
+    uint32_t resets = b.wire.stats.resets;
+    CHECK_EQ(ow.count_families1(fam, cnt, 8), 5);
+    CHECK_EQ(b.wire.stats.resets - resets, roms.size());
+    for (size_t i = 0; i < runs.size(); i++) {
+        CHECK_EQ(fam[i], runs[i].first);
+        CHECK_EQ(cnt[i], runs[i].second);
+    }
+
+    // fewer slots than families: the first ones filled, all counted
+    memset(fam, 0xEE, sizeof(fam));
+    CHECK_EQ(ow.count_families1(fam, cnt, 2), 5);
+    CHECK_EQ(fam[1], runs[1].first);
+    CHECK_EQ(cnt[1], runs[1].second);
+    CHECK_EQ(fam[2], 0xEE);
+
+    // search_family(): every device of the family and nothing else, with
+    // no pass after the last one, whatever came before
+    for (size_t i = 0; i < runs.size(); i++) {
+        uint8_t rom[8];
+        std::set<uint64_t> got;
+        if (i & 1) CHECK(ow.search1(rom));
+        resets = b.wire.stats.resets;
+        while (ow.search_family1(rom, runs[i].first)) {
+            CHECK_EQ(rom[0], runs[i].first);
+            got.insert(sim_rom_value(rom));
+            CHECK(got.size() <= runs[i].second);
+        }
+        CHECK_EQ(got.size(), runs[i].second);
+        CHECK_EQ(b.wire.stats.resets - resets, runs[i].second);
+    }
+
+    // a family that is not there: one pass, nothing returned, again after
+    uint8_t rom[8];
+    resets = b.wire.stats.resets;
+    CHECK(!ow.search_family1(rom, 0x26));
+    CHECK(!ow.search_family1(rom, 0x26));
+    CHECK_EQ(b.wire.stats.resets - resets, 2);
+    CHECK(ow.search_family1(rom, 0x12));
+    CHECK(!ow.search_family1(rom, 0x12));
+
+    // the second bus
+    host_gpio_attach(OW2_PIN, &b.wire);
+    OneWire ow2(OW2_PIN);
+    CHECK_EQ(ow2.count_families2(fam, cnt, 8), 5);
+    CHECK(ow2.search_family2(rom, 0x3A));
+    CHECK_EQ(rom[0], 0x3A);
+    CHECK(!ow2.search_family2(rom, 0x26));
+    host_gpio_attach(OW2_PIN, 0);
+
+    // an empty bus: no families, no devices
+    SimWire empty;
+    host_gpio_attach(OW1_PIN, &empty);
+    CHECK_EQ(ow.count_families1(fam, cnt, 8), 0);
+    CHECK(!ow.search_family1(rom, 0x28));
+    CHECK(!ow.search_family1(rom, 0x28));
+    CHECK_EQ(empty.stats.resets, 3);
+    host_gpio_attach(OW1_PIN, 0);
+}
+
+int main()
+{
+    host_virtual_clock(true);
+
+    printf("populations:\n");
+    populations<ProgramSearcher>();
+    populations<GpioSearcher>();
+
+    printf("faults:\n");
+    faults<ProgramSearcher>();
+    faults<GpioSearcher>();
+    first_bit<ProgramSearcher>();
+    first_bit<GpioSearcher>();
+    alarm_none();
+    families();
+
+    return test_result("test_search");
+}
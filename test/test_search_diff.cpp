@@ -0,0 +1,305 @@
+// onewire_search() against the byte/mask search it replaced (the one from
+// the Dallas Semiconductor application note, as the library had it), on
+// fault-free simulated buses: every call must return the same ROM, leave
+// the same search state and take the same number of time slots.  Covers
+// plain and alarm searches, target_search() and skip_family().
+//
+// The intended differences are left out: the old search ended the
+// enumeration at a device with family code 0, the new one returns it,
+// and the new one takes a pass that nothing answers at the first bit (an
+// alarm search with no device in alarm) a second time before it ends.
+
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+#include <set>
+#include <string.h>
+#include <vector>
+
+// The previous implementation, kept here as the reference
+struct RefState {
+    uint8_t ROM_NO[8];
+    uint8_t LastDiscrepancy;
+    uint8_t LastFamilyDiscrepancy;
+    bool LastDeviceFlag;
+};
+
+static void ref_reset(RefState &s)
+{
+    memset(&s, 0, sizeof(s));
+}
+
+static void ref_target(RefState &s, uint8_t family_code)
+{
+    s.ROM_NO[0] = family_code;
+    for (uint8_t i = 1; i < 8; i++)
+        s.ROM_NO[i] = 0;
+    s.LastDiscrepancy = 64;
+    s.LastFamilyDiscrepancy = 0;
+    s.LastDeviceFlag = false;
+}
+
+static void ref_skip_family(RefState &s)
+{
+    s.LastDiscrepancy = s.LastFamilyDiscrepancy;
+    s.LastFamilyDiscrepancy = 0;
+    if (s.LastDiscrepancy == 0)
+        s.LastDeviceFlag = true;
+}
+
+static bool ref_search(const OneWireBus &bus, RefState &s, uint8_t *newAddr, bool search_mode)
+{
+    uint8_t id_bit_number = 1;
+    uint8_t last_zero = 0, rom_byte_number = 0;
+    uint8_t id_bit, cmp_id_bit;
+    unsigned char rom_byte_mask = 1, search_direction;
+    bool search_result = false;
+
+    if (!s.LastDeviceFlag) {
+        if (!bus.reset(bus.ctx)) {
+            s.LastDiscrepancy = 0;
+            s.LastDeviceFlag = false;
+            s.LastFamilyDiscrepancy = 0;
+            return false;
+        }
+        uint8_t cmd = search_mode ? 0xF0 : 0xEC;
+        bus.write_bytes(bus.ctx, &cmd, 1, false);
+
+        do {
+            id_bit = bus.read_bit(bus.ctx);
+            cmp_id_bit = bus.read_bit(bus.ctx);
+
+            if ((id_bit == 1) && (cmp_id_bit == 1)) {
+                break;
+            } else {
+                if (id_bit != cmp_id_bit) {
+                    search_direction = id_bit;
+                } else {
+                    if (id_bit_number < s.LastDiscrepancy)
+                        search_direction = ((s.ROM_NO[rom_byte_number] & rom_byte_mask) > 0);
+                    else
+                        search_direction = (id_bit_number == s.LastDiscrepancy);
+                    if (search_direction == 0) {
+                        last_zero = id_bit_number;
+                        if (last_zero < 9)
+                            s.LastFamilyDiscrepancy = last_zero;
+                    }
+                }
+
+                if (search_direction == 1)
+                    s.ROM_NO[rom_byte_number] |= rom_byte_mask;
+                else
+                    s.ROM_NO[rom_byte_number] &= ~rom_byte_mask;
+
+                bus.write_bit(bus.ctx, search_direction);
+
+                id_bit_number++;
+                rom_byte_mask <<= 1;
+                if (rom_byte_mask == 0) {
+                    rom_byte_number++;
+                    rom_byte_mask = 1;
+                }
+            }
+        } while (rom_byte_number < 8);
+
+        if (!(id_bit_number < 65)) {
+            s.LastDiscrepancy = last_zero;
+            if (s.LastDiscrepancy == 0)
+                s.LastDeviceFlag = true;
+            search_result = true;
+        }
+    }
+
+    if (!search_result || !s.ROM_NO[0]) {
+        s.LastDiscrepancy = 0;
+        s.LastDeviceFlag = false;
+        s.LastFamilyDiscrepancy = 0;
+        search_result = false;
+    } else {
+        for (int i = 0; i < 8; i++) newAddr[i] = s.ROM_NO[i];
+    }
+    return search_result;
+}
+
+static uint64_t next_random(uint64_t &s)
+{
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+// The same devices on two wires, one for each implementation
+struct Pair {
+    SimWire refWire, newWire;
+    std::vector<SimDevice *> devs;
+    RefState ref;
+    OneWireSearchState state;
+    uint32_t calls, mismatches;
+
+    Pair(const std::vector<uint64_t> &roms, uint64_t alarmSeed) : calls(0), mismatches(0)
+    {
+        for (size_t i = 0; i < roms.size(); i++) {
+            bool alarm = alarmSeed && next_random(alarmSeed) % 3 == 0;
+            devs.push_back(new SimDevice(roms[i]));
+            devs.back()->alarm = alarm;
+            refWire.attach(devs.back());
+            devs.push_back(new SimDevice(roms[i]));
+            devs.back()->alarm = alarm;
+            newWire.attach(devs.back());
+        }
+        ref_reset(ref);
+        onewire_search_reset(state);
+    }
+    ~Pair()
+    {
+        for (size_t i = 0; i < devs.size(); i++) delete devs[i];
+    }
+
+    // The old search left the last ROM in ROM_NO at the end of an
+    // enumeration, the new one clears it; neither looks at it then.
+    bool same_state(bool rom = true) const
+    {
+        return (!rom || memcmp(ref.ROM_NO, state.rom, 8) == 0) &&
+               ref.LastDiscrepancy == state.last_discrepancy &&
+               ref.LastFamilyDiscrepancy == state.last_family_discrepancy &&
+               ref.LastDeviceFlag == state.last_device;
+    }
+
+    // one search call on both; returns what both returned
+    bool search(uint8_t rom[8], bool search_mode = true)
+    {
+        uint8_t refRom[8] = {}, newRom[8] = {};
+        uint32_t refSlots = refWire.stats.slots, newSlots = newWire.stats.slots;
+        bool r = ref_search(refWire.bus(), ref, refRom, search_mode);
+        bool n = onewire_search(newWire.bus(), state, newRom, search_mode);
+        calls++;
+        uint32_t refTaken = refWire.stats.slots - refSlots;
+        uint32_t newTaken = newWire.stats.slots - newSlots;
+        const uint32_t empty = 8 + 2;       // the command, then 1/1
+        if (!r && !n && refTaken == empty && newTaken == 2 * empty) newTaken = empty;
+        if (r != n || (r && memcmp(refRom, newRom, 8)) || !same_state(r) || refTaken != newTaken)
+            mismatches++;
+        memcpy(rom, newRom, 8);
+        return r && n;
+    }
+
+    void target(uint8_t family)
+    {
+        ref_target(ref, family);
+        onewire_search_target(state, family);
+        if (!same_state()) mismatches++;
+    }
+
+    void skip_family(void)
+    {
+        ref_skip_family(ref);
+        onewire_search_skip_family(state);
+        if (!same_state()) mismatches++;
+    }
+};
+
+// Random ROMs, with family codes from a few values so families repeat
+static std::vector<uint64_t> random_roms(size_t n, uint64_t &seed, int families)
+{
+    std::vector<uint64_t> roms;
+    std::set<uint64_t> seen;
+    while (roms.size() < n) {
+        uint8_t family = (uint8_t)(1 + next_random(seed) % (families ? families : 255));
+        if (families) family = (uint8_t)(family * 0x11);
+        uint64_t r = sim_rom(family, next_random(seed));
+        if (seen.insert(r).second) roms.push_back(r);
+    }
+    return roms;
+}
+
+// Devices that differ only in a few chosen bits: discrepancies at
+// every depth and every combination of them
+static std::vector<uint64_t> tree_roms(const int *bits, int nbits)
+{
+    std::vector<uint64_t> roms;
+    for (int m = 0; m < (1 << nbits); m++) {
+        uint64_t v = 0x0012345678900010ull;
+        for (int b = 0; b < nbits; b++)
+            if (m & (1 << b)) v ^= 1ull << bits[b];
+        roms.push_back(sim_rom((uint8_t)v, v >> 8));
+    }
+    return roms;
+}
+
+static uint32_t enumerate(Pair &p, bool search_mode)
+{
+    uint8_t rom[8];
+    uint32_t found = 0;
+    while (found < 300 && p.search(rom, search_mode)) found++;
+    return found;
+}
+
+static void check_bus(const std::vector<uint64_t> &roms, uint64_t seed)
+{
+    // plain, then a second enumeration from the state the first left
+    {
+        Pair p(roms, 0);
+        CHECK_EQ(enumerate(p, true), roms.size());
+        CHECK_EQ(enumerate(p, true), roms.size());
+        CHECK_EQ(p.mismatches, 0);
+    }
+
+    // alarm search, a third of the devices alarming
+    {
+        Pair p(roms, seed);
+        enumerate(p, false);
+        CHECK_EQ(p.mismatches, 0);
+    }
+
+    // target_search() of every family code present and of one that is not
+    std::set<uint8_t> families;
+    for (size_t i = 0; i < roms.size(); i++) families.insert((uint8_t)roms[i]);
+    families.insert(0xFE);
+    for (std::set<uint8_t>::iterator f = families.begin(); f != families.end(); ++f) {
+        Pair p(roms, 0);
+        uint8_t rom[8];
+        p.target(*f);
+        while (p.calls < 300 && p.search(rom) && rom[0] == *f) { }
+        CHECK_EQ(p.mismatches, 0);
+    }
+
+    // skip_family() after the first device of every second family
+    {
+        Pair p(roms, 0);
+        uint8_t rom[8];
+        int family = -1, seen = 0;
+        while (p.calls < 300 && p.search(rom)) {
+            if (rom[0] != family) {
+                family = rom[0];
+                if (seen++ % 2) p.skip_family();
+            }
+        }
+        CHECK_EQ(p.mismatches, 0);
+    }
+}
+
+int main()
+{
+    host_virtual_clock(true);
+    uint64_t seed = 12345;
+
+    for (int run = 0; run < 40; run++)
+        check_bus(random_roms(1 + next_random(seed) % 40, seed, run % 2 ? 4 : 0), seed);
+
+    static const int spread[] = { 0, 9, 20, 31, 42, 55 };
+    static const int family[] = { 0, 1, 3, 6, 7 };
+    static const int serial[] = { 8, 9, 10, 11, 12, 13 };
+    check_bus(tree_roms(spread, 6), seed);
+    check_bus(tree_roms(family, 5), seed);
+    check_bus(tree_roms(serial, 6), seed);
+    // bit 4 would make the base ROM's family 0x10 a 0x00
+    for (int d = 0; d < 56; d++) {
+        if (d == 4) continue;
+        int bits[1] = { d };
+        check_bus(tree_roms(bits, 1), seed);
+    }
+
+    return test_result("test_search_diff");
+}
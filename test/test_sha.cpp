@@ -0,0 +1,157 @@
+// OneWireSha against the simulated DS28E15 and DS28E25: SHA-256 known
+// answers, page MACs over every page of both families, a wrong secret,
+// pages outside the device, and Authenticated Write Memory with the
+// status byte read only once the device has checked the MAC and the
+// programming given its full strong pullup time.  The MAC known answers
+// were computed apart from this library (Python hashlib) from the
+// message layout the driver documents, so a change to that layout in
+// the driver and the simulation alike still fails.
+
+#include "OneWireESP_sha.h"
+#include "sim.h"
+#include "test.h"
+
+#include <string.h>
+
+static bool hex_is(const uint8_t d[32], const char *hex)
+{
+    char s[65];
+    for (int i = 0; i < 32; i++) snprintf(&s[2 * i], 3, "%02x", d[i]);
+    return !strcmp(s, hex);
+}
+
+static bool digest_is(const char *msg, const char *hex)
+{
+    uint8_t d[32];
+    onewire_sha256((const uint8_t *)msg, (uint16_t)strlen(msg), d);
+    return hex_is(d, hex);
+}
+
+//
+// DS28E15 17 56 34 12 00 00 00 70, secret 00 01 .. 1F, manufacturer ID
+// 01 02, challenge FF FE .. E0, page 1 as the simulation fills it.
+//
+//   page MAC:  SHA-256(secret, page, challenge, ROM code, 01, 01 02)
+//   anonymous: the same with FF x 8 for the ROM code
+//   write MAC: SHA-256(secret, ROM code, 02, 01, 01 02, 1B 22 29 30, 11 22 33 44)
+//              for segment 2 of page 1
+//
+static void known_answers(void)
+{
+    uint8_t secret[32], challenge[32], rom[8];
+    for (int i = 0; i < 32; i++) {
+        secret[i] = (uint8_t)i;
+        challenge[i] = (uint8_t)(0xFF - i);
+    }
+
+    SimWire wire;
+    SimAuthenticator dev(sim_rom(DS28E15_FAMILY, 0x123456), secret);
+    wire.attach(&dev);
+    sim_rom_bytes(dev.rom, rom);
+    CHECK_EQ(rom[7], 0x70);
+    dev.manid[0] = 0x01;
+    dev.manid[1] = 0x02;
+
+    OneWireSha sha(wire.bus(), secret);
+    sha.set_manid(0x01, 0x02);
+
+    CHECK_EQ(sha.authenticate(rom, 1, challenge), OW_OK);
+    CHECK(hex_is(dev.last_mac, "065e188708521b99b5cb0101c7b84c2e0a2b3536b56b31bf5d662741cd42f747"));
+    CHECK_EQ(sha.authenticate(rom, 1, challenge, &dev.memory[32], true), OW_OK);
+    CHECK(hex_is(dev.last_mac, "39c871b6107f0323dd9c74b33cbd940210db2feceb021955dae1defa9775efdb"));
+
+    uint8_t old[4] = { 0x1B, 0x22, 0x29, 0x30 }, now[4] = { 0x11, 0x22, 0x33, 0x44 };
+    CHECK(!memcmp(&dev.memory[32 + 2 * 4], old, 4));
+    CHECK_EQ(sha.write_segment(rom, 1, 2, old, now), OW_OK);
+    CHECK(hex_is(dev.last_mac, "1fbf2b23bd8dbb2556643c71ba0e398fbf61cfa171a6874165c1e59fe8939c03"));
+    CHECK_EQ(dev.writes, 1);
+}
+
+static void family(uint8_t code, uint8_t pages)
+{
+    uint8_t secret[32], other[32], challenge[32], rom[8], data[32];
+    for (int i = 0; i < 32; i++) {
+        secret[i] = (uint8_t)(i * 13 + 1);
+        other[i] = secret[i] ^ (i == 5);
+        challenge[i] = (uint8_t)(0xC3 ^ i);
+    }
+
+    SimWire wire;
+    SimAuthenticator dev(sim_rom(code, 0x123456), secret);
+    wire.attach(&dev);
+    sim_rom_bytes(dev.rom, rom);
+    CHECK_EQ(dev.pages, pages);
+
+    OneWireSha sha(wire.bus(), secret);
+
+    // every page, read first or given, with and without the ROM code
+    for (uint8_t p = 0; p < pages; p++) {
+        CHECK_EQ(sha.read_page(rom, p, data), OW_OK);
+        CHECK(!memcmp(data, &dev.memory[p * 32], 32));
+        CHECK_EQ(sha.authenticate(rom, p, challenge), OW_OK);
+        CHECK_EQ(sha.authenticate(rom, p, challenge, data, true), OW_OK);
+    }
+    CHECK_EQ(dev.macs, 2 * pages);
+
+    // outside the device: refused without touching the bus
+    uint32_t resets = wire.stats.resets;
+    CHECK_EQ(sha.read_page(rom, pages, data), OW_BAD_ADDRESS);
+    CHECK_EQ(sha.authenticate(rom, pages, challenge), OW_BAD_ADDRESS);
+    uint8_t seg[4] = { 1, 2, 3, 4 };
+    CHECK_EQ(sha.write_segment(rom, pages, 0, seg, seg), OW_BAD_ADDRESS);
+    CHECK_EQ(sha.write_segment(rom, 0, 8, seg, seg), OW_BAD_ADDRESS);
+    CHECK_EQ(wire.stats.resets, resets);
+
+    // another secret
+    OneWireSha wrong(wire.bus(), other);
+    CHECK_EQ(wrong.authenticate(rom, 0, challenge), OW_MAC_ERROR);
+    CHECK_EQ(wrong.get_stats().failed, 1);
+
+    // authenticated writes to the last page
+    uint8_t last = pages - 1, old[4], now[4] = { 0xDE, 0xAD, 0xBE, 0xEF };
+    memcpy(old, &dev.memory[last * 32 + 3 * 4], 4);
+    CHECK_EQ(sha.write_segment(rom, last, 3, old, now), OW_OK);
+    CHECK_EQ(dev.writes, 1);
+    CHECK(!memcmp(&dev.memory[last * 32 + 3 * 4], now, 4));
+    CHECK(wire.last_pullup_us >= ONEWIRE_SHA_TPRD_US);
+    CHECK_EQ(sha.authenticate(rom, last, challenge), OW_OK);
+
+    // the device checks the MAC over what is there now, not 'old'
+    uint8_t again[4] = { 0, 1, 2, 3 };
+    CHECK_EQ(sha.write_segment(rom, last, 3, old, again), OW_MAC_ERROR);
+    CHECK_EQ(dev.refused, 1);
+    CHECK(!memcmp(&dev.memory[last * 32 + 3 * 4], now, 4));
+    CHECK_EQ(wrong.write_segment(rom, last, 3, now, again), OW_MAC_ERROR);
+    CHECK_EQ(dev.refused, 2);
+    CHECK_EQ(dev.writes, 1);
+
+    // no result was ever read before the device had it
+    CHECK_EQ(dev.early, 0);
+    CHECK_EQ(dev.brownouts, 0);
+    printf("  family %02X: %u pages, %u MACs, %u write\n", code, pages, dev.macs, dev.writes);
+}
+
+int main()
+{
+    host_virtual_clock(true);
+
+    CHECK(digest_is("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+    CHECK(digest_is("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+    CHECK(digest_is("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+                    "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+
+    known_answers();
+    family(DS28E15_FAMILY, 2);
+    family(DS28E25_FAMILY, 16);
+
+    // a device of another family has no pages here
+    SimWire wire;
+    SimThermometer t(sim_rom(0x28, 1));
+    wire.attach(&t);
+    uint8_t secret[32] = { 0 }, rom[8], data[32];
+    sim_rom_bytes(t.rom, rom);
+    OneWireSha sha(wire.bus(), secret);
+    CHECK_EQ(sha.read_page(rom, 0, data), OW_BAD_ADDRESS);
+
+    return test_result("test_sha");
+}
@@ -0,0 +1,73 @@
+// OneWireShards under load: more jobs in flight than the result rings
+// hold, so the engines keep stalling on a full ring and being woken by
+// collect().  Every job must come back, once, with its own data (the
+// power-on scratchpad of its bus's DS18B20); a lost
+// wakeup shows up as a collect() that times out.
+
+#include "OneWireESP_shard.h"
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+#include <string.h>
+
+#define BUSES   6
+#define ROUNDS  300
+
+int main()
+{
+    SimWire wires[BUSES];
+    SimThermometer *sensors[BUSES];
+    OneWireShards shards;
+    uint8_t roms[BUSES][8];
+    static uint8_t data[BUSES][ONEWIRE_SHARD_JOBS][9];
+
+    for (int i = 0; i < BUSES; i++) {
+        sensors[i] = new SimThermometer(sim_rom(0x28, i + 1));
+        wires[i].attach(sensors[i]);
+        wires[i].time_divider = 1000;        // real clock, slots 1000 times short
+        sim_rom_bytes(sensors[i]->rom, roms[i]);
+        CHECK_EQ(shards.add_bus(wires[i].bus()), i);
+    }
+    CHECK(shards.start());
+
+    uint32_t done = 0, bad = 0, timeouts = 0;
+    uint32_t seen[BUSES][ONEWIRE_SHARD_JOBS] = {};
+    for (int round = 0; round < ROUNDS; round++) {
+        // fill every bus's job ring: BUSES * JOBS is more than the results hold
+        for (int b = 0; b < BUSES; b++) {
+            for (int j = 0; j < ONEWIRE_SHARD_JOBS; j++) {
+                memset(data[b][j], 0, 9);
+                CHECK(shards.submit(b, onewire_prog_read_scratch, roms[b], 0, data[b][j],
+                                    (uint32_t)(b << 8 | j)));
+            }
+        }
+        for (int n = 0; n < BUSES * ONEWIRE_SHARD_JOBS; n++) {
+            OneWireShardResult r;
+            if (!shards.collect(r, 1000)) {
+                timeouts++;
+                break;
+            }
+            int b = r.tag >> 8, j = r.tag & 0xFF;
+            if (r.status != OW_OK || r.bus != b || memcmp(data[b][j], sensors[b]->scratch, 9))
+                bad++;
+            seen[b][j]++;
+            done++;
+        }
+        if (timeouts) break;
+    }
+    shards.stop();
+
+    CHECK_EQ(timeouts, 0);
+    CHECK_EQ(bad, 0);
+    CHECK_EQ(done, ROUNDS * BUSES * ONEWIRE_SHARD_JOBS);
+    for (int b = 0; b < BUSES; b++)
+        for (int j = 0; j < ONEWIRE_SHARD_JOBS; j++) CHECK_EQ(seen[b][j], ROUNDS);
+    uint32_t stalls = 0;
+    for (int c = 0; c < portNUM_PROCESSORS; c++) stalls += shards.stats(c).stalls;
+    CHECK(stalls > 0);
+    printf("  %u jobs, %u stalls on a full result ring\n", done, stalls);
+
+    for (int i = 0; i < BUSES; i++) delete sensors[i];
+    return test_result("test_shard");
+}
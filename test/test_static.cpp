@@ -0,0 +1,183 @@
+// No allocation once set up: malloc() and friends are replaced for this
+// program and count the calls made while the trap is armed.  Everything
+// is constructed, started and run once first (the simulated devices
+// size their buffers then), and the trap is armed for the steady state:
+// programs, retries, searches, the cache, the scheduler, the hotplug
+// monitor, the shard engines and telemetry frames, over many rounds.
+// operator new goes through malloc() in libstdc++, so it is caught too.
+
+#include "OneWireESP.h"
+#include "OneWireESP_program.h"
+#include "OneWireESP_retry.h"
+#include "OneWireESP_cache.h"
+#include "OneWireESP_scheduler.h"
+#include "OneWireESP_hotplug.h"
+#include "OneWireESP_shard.h"
+#include "OneWireESP_telemetry.h"
+#include "sim.h"
+#include "test.h"
+
+#include <atomic>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t align, size_t size);
+void __libc_free(void *p);
+}
+
+static std::atomic<bool> armed;
+static std::atomic<uint32_t> allocations;
+
+static inline void trap(void)
+{
+    if (armed) allocations++;
+}
+
+extern "C" void *malloc(size_t size)
+{
+    trap();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+    trap();
+    return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *p, size_t size)
+{
+    trap();
+    return __libc_realloc(p, size);
+}
+
+extern "C" void *memalign(size_t align, size_t size)
+{
+    trap();
+    return __libc_memalign(align, size);
+}
+
+extern "C" int posix_memalign(void **p, size_t align, size_t size)
+{
+    trap();
+    *p = __libc_memalign(align, size);
+    return *p ? 0 : ENOMEM;
+}
+
+extern "C" void *aligned_alloc(size_t align, size_t size)
+{
+    trap();
+    return __libc_memalign(align, size);
+}
+
+extern "C" void free(void *p)
+{
+    trap();
+    __libc_free(p);
+}
+
+#define ROUNDS 50
+
+static uint32_t samples;
+
+static void on_sample(uint8_t, const uint8_t *, const uint8_t *, uint8_t status, void *)
+{
+    if (status == OW_OK) samples++;
+}
+
+int main()
+{
+    host_virtual_clock(true);
+
+    SimWire wire;
+    SimThermometer t1(sim_rom(0x28, 1)), t2(sim_rom(0x28, 2));
+    SimDevice other(sim_rom(0x10, 3));
+    wire.attach(&t1);
+    wire.attach(&t2);
+    wire.attach(&other);
+    uint8_t rom1[8], rom2[8];
+    sim_rom_bytes(t1.rom, rom1);
+    sim_rom_bytes(t2.rom, rom2);
+
+    host_gpio_attach(OW1_PIN, &wire);
+    OneWire ow(OW1_PIN);
+    OneWireRetry retry(wire.bus());
+    OneWireCache cache(wire.bus());
+    OneWireScheduler sched(on_sample, 0);
+    int8_t sb = sched.add_bus(wire.bus());
+    CHECK(sched.add_device(sb, rom1, 1000));
+    OneWireHotplug hp(wire.bus(), GPIO_NUM_4);
+    CHECK(hp.begin());
+
+    SimWire shardWire;
+    SimThermometer t3(sim_rom(0x28, 4));
+    shardWire.attach(&t3);
+    uint8_t rom3[8];
+    sim_rom_bytes(t3.rom, rom3);
+    OneWireShards shards;
+    CHECK_EQ(shards.add_bus(shardWire.bus()), 0);
+    CHECK(shards.start());
+
+    OneWireReading readings[16];
+    uint8_t frame[256];
+    OneWireReading back[16];
+
+    uint32_t bad = 0;
+    for (int round = 0; round <= ROUNDS; round++) {
+        // round 0 warms up, the others run with the trap armed
+        if (round == 1) {
+            allocations = 0;
+            armed = true;
+        }
+        uint8_t rom[8], s[9];
+
+        if (onewire_run(wire.bus(), onewire_prog_read_scratch, rom1, 0, s) != OW_OK) bad++;
+        if (onewire_run(ow.bus1(), onewire_prog_read_scratch, rom2, 0, s) != OW_OK) bad++;
+        if (retry.run(onewire_prog_read_scratch, rom1, 0, s) != OW_OK) bad++;
+
+        ow.reset_search1();
+        int found = 0;
+        while (ow.search1(rom)) found++;
+        if (found != 3) bad++;
+
+        cache.invalidate(rom2);
+        if (cache.read(rom2, 1000, s) != OW_OK) bad++;
+        if (cache.read(rom2, 1000, s) != OW_OK) bad++;
+
+        uint32_t ms = sched.poll();
+        host_advance_us((int64_t)(ms ? ms : 1) * 1000);
+
+        if (hp.discover() != 0) bad++;
+
+        if (!shards.submit(0, onewire_prog_read_scratch, rom3, 0, s, round)) bad++;
+        // timed waits do not wait on the virtual clock: poll instead
+        OneWireShardResult r;
+        while (!shards.collect(r, 0)) { }
+        if (r.status != OW_OK || r.tag != (uint32_t)round) bad++;
+
+        for (int i = 0; i < 16; i++) {
+            readings[i].device = (uint16_t)i;
+            readings[i].time_ms = (uint32_t)(round * 1000 + i);
+            readings[i].value = s[0] | s[1] << 8;
+            readings[i].status = 0;
+        }
+        uint16_t len = onewire_frame_encode(readings, 16, frame, sizeof(frame));
+        if (!len || onewire_frame_decode(frame, len, back, 16) != 16) bad++;
+    }
+    armed = false;
+
+    CHECK_EQ(allocations, 0);
+    CHECK_EQ(bad, 0);
+    CHECK(samples > 0);
+    printf("  %d rounds, %u allocations\n", ROUNDS, (uint32_t)allocations);
+
+    shards.stop();
+    hp.end();
+    host_gpio_attach(OW1_PIN, 0);
+    return test_result("test_static");
+}
@@ -0,0 +1,226 @@
+// OneWireSwitch on the simulated DS2408 and DS2413: channel access reads
+// hand out the samples in order across blocks and around the ring, the
+// DS2408 CRC16 (the first one over the command too) and the DS2413
+// complement reject a disturbed read and close the stream, output
+// writes are confirmed with 0xAA and report the pins, a missing
+// confirmation is OW_VERIFY_ERROR, sample_rate() is what the read slots
+// allow, and a ring buffer read_samples() cannot index into is refused
+// before the bus is touched.
+
+#include "OneWireESP_switch.h"
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+// slots of begin_stream(): Match ROM and the command
+#define STREAM_SLOTS    (9 * 8 + 8)
+// a DS2408 block: 32 samples and the CRC16
+#define BLOCK_SLOTS     (34 * 8)
+
+// What a DS2413 sample reports for the outside levels 'o' and latch 'l'
+static uint8_t ds2413(uint8_t o, uint8_t l)
+{
+    uint8_t pins = o & l;
+    return (uint8_t)((pins & 1) | (l & 1) << 1 | (pins & 2) << 1 | (l & 2) << 2);
+}
+
+static void ring_args(void)
+{
+    SimWire wire;
+    SimSwitch d(sim_rom(0x29, 0x0102030405ull));
+    uint8_t rom[8], ring[4];
+    sim_rom_bytes(d.rom, rom);
+    wire.attach(&d);
+
+    OneWireSwitch sw(wire.bus(), rom);
+    uint16_t head = 0;
+    CHECK_EQ(sw.read_samples(ring, 0, &head, 1), OW_BAD_ADDRESS);
+    head = 4;
+    CHECK_EQ(sw.read_samples(ring, 4, &head, 1), OW_BAD_ADDRESS);
+    CHECK_EQ(head, 4);
+    head = 0xFFFF;
+    CHECK_EQ(sw.read_samples(ring, 4, &head, 1), OW_BAD_ADDRESS);
+    CHECK_EQ(wire.stats.resets, 0);
+}
+
+static void ds2408_stream(void)
+{
+    SimWire wire;
+    SimSwitch d(sim_rom(0x29, 0x11));
+    uint8_t rom[8], ring[80];
+    sim_rom_bytes(d.rom, rom);
+    wire.attach(&d);
+    // a period that does not divide the block, so misplaced samples show
+    for (int i = 0; i < 37; i++) d.levels.push_back((uint8_t)(i * 37 + 11));
+
+    OneWireSwitch sw(wire.bus(), rom);
+    CHECK_EQ(sw.sample_rate(), 0);
+
+    // three blocks under one select, wrapping around the ring
+    uint16_t head = 45;
+    CHECK_EQ(sw.read_samples(ring, 80, &head, 70), OW_OK);
+    CHECK_EQ(head, 35);
+    CHECK_EQ(wire.stats.resets, 1);
+    CHECK_EQ(d.samples, 96);
+    uint32_t bad = 0;
+    for (uint32_t n = 0; n < 70; n++)
+        if (ring[(45 + n) % 80] != d.levels[n % 37]) bad++;
+    CHECK_EQ(bad, 0);
+
+    // the rest of the third block is already read
+    uint32_t slots = wire.stats.slots;
+    CHECK_EQ(sw.read_samples(ring, 80, &head, 20), OW_OK);
+    CHECK_EQ(wire.stats.slots, slots);
+    CHECK_EQ(ring[54], d.levels[89 % 37]);
+
+    // a read inverted in the next block: the CRC16 fails, the samples
+    // before that block stay, the stream is closed
+    wire.flip_slot(5 * 8 + 2);
+    CHECK_EQ(sw.read_samples(ring, 80, &head, 10), OW_CRC_ERROR);
+    CHECK_EQ(head, 61);
+    CHECK_EQ(sw.get_stats().errors, 1);
+    CHECK_EQ(sw.get_stats().samples, 96);
+    CHECK_EQ(wire.stats.resets, 2);
+
+    // and the next read opens a new one, its first CRC16 over the command
+    uint32_t from = d.samples;
+    head = 0;
+    CHECK_EQ(sw.read_samples(ring, 80, &head, 40), OW_OK);
+    CHECK_EQ(wire.stats.resets, 3);
+    CHECK_EQ(ring[0], d.levels[from % 37]);
+    CHECK_EQ(ring[39], d.levels[(from + 39) % 37]);
+    CHECK_EQ(sw.get_stats().errors, 1);
+}
+
+static void ds2413_stream(void)
+{
+    SimWire wire;
+    SimSwitch d(sim_rom(0x3A, 0x12));
+    uint8_t rom[8], ring[64];
+    sim_rom_bytes(d.rom, rom);
+    wire.attach(&d);
+    static const uint8_t outside[] = { 3, 2, 1, 0, 3 };
+    d.levels.assign(outside, outside + 5);
+    d.latch = 0x02;                         // PIOA pulled low by its latch
+
+    OneWireSwitch sw(wire.bus(), rom);
+    uint16_t head = 0;
+    CHECK_EQ(sw.read_samples(ring, 64, &head, 40), OW_OK);
+    CHECK_EQ(head, 40);
+    CHECK_EQ(d.samples, 40);                // no reading ahead past the count
+    uint32_t bad = 0;
+    for (uint32_t n = 0; n < 40; n++)
+        if (ring[n] != ds2413(outside[n % 5], 0x02)) bad++;
+    CHECK_EQ(bad, 0);
+
+    // a complement bit inverted in the third sample: none of the block
+    // is handed out
+    wire.flip_slot(2 * 8 + 6);
+    CHECK_EQ(sw.read_samples(ring, 64, &head, 5), OW_CRC_ERROR);
+    CHECK_EQ(head, 40);
+    CHECK_EQ(sw.get_stats().errors, 1);
+    CHECK_EQ(wire.stats.resets, 2);
+
+    // so is a state bit: its complement no longer matches
+    wire.flip_slot(STREAM_SLOTS + 1);
+    CHECK_EQ(sw.read_samples(ring, 64, &head, 5), OW_CRC_ERROR);
+    CHECK_EQ(sw.get_stats().errors, 2);
+    CHECK_EQ(sw.read_samples(ring, 64, &head, 5), OW_OK);
+    CHECK_EQ(head, 45);
+}
+
+static void outputs(void)
+{
+    SimWire wire;
+    SimSwitch d8(sim_rom(0x29, 0x13)), d3(sim_rom(0x3A, 0x14));
+    uint8_t r8[8], r3[8], states[2];
+    sim_rom_bytes(d8.rom, r8);
+    sim_rom_bytes(d3.rom, r3);
+    wire.attach(&d8);
+    wire.attach(&d3);
+    d8.levels.push_back(0x7F);              // PIO7 held low from outside
+
+    // both values confirmed under one select, with the pins after each
+    OneWireSwitch sw8(wire.bus(), r8);
+    static const uint8_t values[] = { 0x0F, 0xF0 };
+    CHECK_EQ(sw8.write_outputs(values, 2, states), OW_OK);
+    CHECK_EQ(d8.writes, 2);
+    CHECK_EQ(d8.latch, 0xF0);
+    CHECK_EQ(states[0], 0x0F);
+    CHECK_EQ(states[1], 0x70);
+    CHECK_EQ(sw8.get_stats().writes, 2);
+    CHECK_EQ(wire.stats.resets, 2);
+
+    // DS2413: the two latch bits, the state with its complement
+    OneWireSwitch sw3(wire.bus(), r3);
+    static const uint8_t ab[] = { 0x01, 0x02 };
+    CHECK_EQ(sw3.write_outputs(ab, 2, states), OW_OK);
+    CHECK_EQ(d3.latch, 0x02);
+    CHECK_EQ(states[0], ds2413(3, 1) | (~ds2413(3, 1) & 0x0F) << 4);
+    CHECK_EQ(states[1], ds2413(3, 2) | (~ds2413(3, 2) & 0x0F) << 4);
+
+    // the confirmation of the second value read wrong: OW_VERIFY_ERROR,
+    // the first counted, the bus reset
+    uint32_t resets = wire.stats.resets;
+    wire.flip_slot(STREAM_SLOTS + 2 * 16 + 16 + 4);
+    CHECK_EQ(sw8.write_outputs(values, 2, states), OW_VERIFY_ERROR);
+    CHECK_EQ(sw8.get_stats().writes, 3);
+    CHECK_EQ(wire.stats.resets, resets + 2);
+
+    // a value the device does not take (its complement wrong) is not
+    // confirmed either
+    static const uint8_t wrong[] = { OW_RESET, OW_MATCH, OW_WRITE, 3, 0x5A, 0x12, 0x12,
+                                     OW_READ, 1, OW_END };
+    uint8_t conf;
+    CHECK_EQ(onewire_run(wire.bus(), wrong, r8, 0, &conf), OW_OK);
+    CHECK_EQ(conf, 0xFF);
+    CHECK_EQ(d8.latch, 0xF0);
+
+    // a device that is not there
+    uint8_t gone[8];
+    sim_rom_bytes(sim_rom(0x29, 0x99), gone);
+    wire.detach(&d8);
+    wire.detach(&d3);
+    OneWireSwitch none(wire.bus(), gone);
+    CHECK_EQ(none.write_outputs(values, 1), OW_NO_PRESENCE);
+    CHECK_EQ(none.get_stats().writes, 0);
+}
+
+static void rate(void)
+{
+    SimWire wire;
+    SimSwitch d8(sim_rom(0x29, 0x15)), d3(sim_rom(0x3A, 0x16));
+    uint8_t r8[8], r3[8], ring[64];
+    sim_rom_bytes(d8.rom, r8);
+    sim_rom_bytes(d3.rom, r3);
+    wire.attach(&d8);
+    wire.attach(&d3);
+    OneWireSwitch sw8(wire.bus(), r8), sw3(wire.bus(), r3);
+
+    // 8 read slots a sample, and on the DS2408 2 CRC bytes every 32
+    const uint32_t slot_rate = 1000000 / (8 * SIM_READ_US);
+    uint16_t head = 0;
+    for (int i = 0; i < 10; i++) CHECK_EQ(sw8.read_samples(ring, 64, &head, 64), OW_OK);
+    for (int i = 0; i < 10; i++) CHECK_EQ(sw3.read_samples(ring, 64, &head, 64), OW_OK);
+    uint32_t r8rate = sw8.sample_rate(), r3rate = sw3.sample_rate();
+    CHECK(r8rate <= slot_rate * 32 / 34);
+    CHECK(r8rate > slot_rate * 32 / 34 * 9 / 10);
+    CHECK(r3rate <= slot_rate);
+    CHECK(r3rate > slot_rate * 9 / 10);
+    CHECK(r3rate > r8rate);
+    printf("  samples/sec: DS2408 %u, DS2413 %u (%u at 8 slots a sample)\n", r8rate, r3rate,
+           slot_rate);
+}
+
+int main()
+{
+    host_virtual_clock(true);
+
+    ring_args();
+    ds2408_stream();
+    ds2413_stream();
+    outputs();
+    rate();
+
+    return test_result("test_switch");
+}
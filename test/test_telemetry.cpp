@@ -0,0 +1,110 @@
+// Telemetry frames: random batches come back exactly as they went in,
+// across time wraps, extreme values and error statuses; a frame that
+// just fits is written and one byte less is refused; every corrupted,
+// truncated or oversized frame is rejected.
+
+#include "OneWireESP_telemetry.h"
+#include "test.h"
+
+#include <limits.h>
+#include <string.h>
+
+#define MAX_READINGS 200
+
+static uint32_t next_random(uint32_t &s)
+{
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+}
+
+static void random_batch(OneWireReading *r, uint16_t count, uint32_t &seed)
+{
+    uint32_t time = next_random(seed);
+    int32_t value = (int32_t)next_random(seed);
+    for (uint16_t i = 0; i < count; i++) {
+        r[i].device = (uint16_t)next_random(seed);
+        // mostly close together, now and then anywhere
+        if (next_random(seed) % 8) {
+            time += next_random(seed) % 2000;
+            value += (int32_t)(next_random(seed) % 64) - 32;
+        } else {
+            time = next_random(seed);
+            value = (int32_t)next_random(seed);
+        }
+        if (i == 1) value = INT_MIN;
+        if (i == 2) value = INT_MAX;
+        r[i].time_ms = time;
+        r[i].value = value;
+        r[i].status = next_random(seed) % 10 ? 0 : (uint8_t)(1 + next_random(seed) % 255);
+    }
+}
+
+static bool same(const OneWireReading *a, const OneWireReading *b, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (a[i].device != b[i].device || a[i].time_ms != b[i].time_ms ||
+            a[i].value != b[i].value || a[i].status != b[i].status)
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    static OneWireReading in[MAX_READINGS], out[MAX_READINGS];
+    static uint8_t buf[MAX_READINGS * 24];
+    uint32_t seed = 1;
+
+    // round trip
+    for (int run = 0; run < 500; run++) {
+        uint16_t count = (uint16_t)(next_random(seed) % (MAX_READINGS + 1));
+        random_batch(in, count, seed);
+        uint16_t len = onewire_frame_encode(in, count, buf, sizeof(buf));
+        CHECK(len >= 5);
+        CHECK_EQ(onewire_frame_decode(buf, len, out, MAX_READINGS), count);
+        CHECK(same(in, out, count));
+
+        // the exact size fits, one byte less does not
+        static uint8_t exact[sizeof(buf)];
+        CHECK_EQ(onewire_frame_encode(in, count, exact, len), len);
+        CHECK(memcmp(exact, buf, len) == 0);
+        CHECK_EQ(onewire_frame_encode(in, count, exact, len - 1), 0);
+
+        // too many readings for the caller
+        if (count) CHECK_EQ(onewire_frame_decode(buf, len, out, count - 1), -1);
+    }
+
+    // time wraps between two readings, and a batch of one
+    in[0].device = 3;
+    in[0].time_ms = 0xFFFFFF00u;
+    in[0].value = 0x0191;
+    in[0].status = 0;
+    in[1] = in[0];
+    in[1].time_ms = 0x00000100u;
+    for (uint16_t count = 1; count <= 2; count++) {
+        uint16_t len = onewire_frame_encode(in, count, buf, sizeof(buf));
+        CHECK_EQ(onewire_frame_decode(buf, len, out, 2), count);
+        CHECK(same(in, out, count));
+    }
+
+    // any single corrupted byte, and any truncation, is rejected
+    random_batch(in, 32, seed);
+    uint16_t len = onewire_frame_encode(in, 32, buf, sizeof(buf));
+    for (uint16_t i = 0; i < len; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            buf[i] ^= (uint8_t)(1 << bit);
+            CHECK_EQ(onewire_frame_decode(buf, len, out, MAX_READINGS), -1);
+            buf[i] ^= (uint8_t)(1 << bit);
+        }
+        CHECK_EQ(onewire_frame_decode(buf, i, out, MAX_READINGS), -1);
+    }
+    CHECK_EQ(onewire_frame_decode(buf, len, out, MAX_READINGS), 32);
+
+    // an empty batch is a valid frame
+    len = onewire_frame_encode(in, 0, buf, sizeof(buf));
+    CHECK_EQ(onewire_frame_decode(buf, len, out, MAX_READINGS), 0);
+
+    return test_result("test_telemetry");
+}
@@ -0,0 +1,177 @@
+// OneWireTopology on a simulated tree of DS2409 couplers: discover() maps
+// every device to its branch, also with branches left on from before,
+// each Smart-On sends the 0xFF reset stimulus and reads the presence
+// byte and the confirmation, run() switches only the couplers that
+// differ, moving between the two branches of one coupler takes a single
+// Smart-On, and a confirmation that does not come back is an error.
+//
+//   trunk:      t0, c1
+//   c1 main:    a, c2          c1 aux:  b
+//   c2 main:    d              c2 aux:  e
+
+#include "OneWireESP_topology.h"
+#include "sim.h"
+#include "test.h"
+
+#include <string.h>
+
+// slots of a coupler command: Match ROM, the command, the confirmation
+#define SIMPLE_SLOTS    ((9 + 1 + 1) * 8)
+
+struct Tree {
+    SimWire wire;
+    SimThermometer t0, a, b, d, e;
+    SimCoupler c1, c2;
+
+    Tree()
+        : t0(sim_rom(0x28, 0x10)), a(sim_rom(0x28, 0x11)), b(sim_rom(0x28, 0x12)),
+          d(sim_rom(0x28, 0x13)), e(sim_rom(0x28, 0x14)), c1(sim_rom(0x1F, 0x01)),
+          c2(sim_rom(0x1F, 0x02))
+    {
+        SimDevice *all[] = { &t0, &c1, &a, &c2, &b, &d, &e };
+        for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) wire.attach(all[i]);
+        c1.add(&a, 0);
+        c1.add(&c2, 0);
+        c1.add(&b, 1);
+        c2.add(&d, 0);
+        c2.add(&e, 1);
+    }
+
+    uint32_t commands(void) const
+    {
+        return c1.smart_ons + c1.lines_off + c2.smart_ons + c2.lines_off;
+    }
+};
+
+static uint8_t read_temp(OneWireTopology &topo, const SimDevice &dev)
+{
+    uint8_t rom[8], s[9];
+    sim_rom_bytes(dev.rom, rom);
+    return topo.run(rom, onewire_prog_read_scratch, 0, s);
+}
+
+static int branch(const OneWireTopology &topo, const SimDevice &dev)
+{
+    uint8_t rom[8];
+    sim_rom_bytes(dev.rom, rom);
+    return topo.branch_of(rom);
+}
+
+static void discover(bool stale)
+{
+    Tree t;
+    if (stale) {
+        // left on by an earlier run: c2 aux would put e on c1 main
+        t.c1.line = 0;
+        t.c2.line = 1;
+    }
+    OneWireTopology topo(t.wire.bus());
+    CHECK_EQ(topo.discover(), OW_OK);
+    CHECK_EQ(topo.device_count(), 7);
+
+    // branches in discovery order: c1 main 1, c2 main 2, c2 aux 3, c1 aux 4
+    CHECK_EQ(branch(topo, t.t0), 0);
+    CHECK_EQ(branch(topo, t.c1), 0);
+    CHECK_EQ(branch(topo, t.a), 1);
+    CHECK_EQ(branch(topo, t.c2), 1);
+    CHECK_EQ(branch(topo, t.d), 2);
+    CHECK_EQ(branch(topo, t.e), 3);
+    CHECK_EQ(branch(topo, t.b), 4);
+
+    // every Smart-On had its reset stimulus and was confirmed, and all
+    // is off again
+    CHECK_EQ(t.c1.bad_stimulus + t.c2.bad_stimulus, 0);
+    CHECK_EQ(topo.get_stats().errors, 0);
+    CHECK_EQ(topo.get_stats().switches, t.commands());
+    CHECK_EQ(t.c1.line, -1);
+    CHECK_EQ(t.c2.line, -1);
+}
+
+static void switching(void)
+{
+    Tree t;
+    OneWireTopology topo(t.wire.bus());
+    CHECK_EQ(topo.discover(), OW_OK);
+    topo.clear_stats();
+    uint32_t before = t.commands();
+
+    // down two couplers: two Smart-Ons, nothing switched off
+    CHECK_EQ(read_temp(topo, t.d), OW_OK);
+    CHECK_EQ(t.commands() - before, 2);
+    CHECK_EQ(t.c1.line, 0);
+    CHECK_EQ(t.c2.line, 0);
+
+    // the other branch of the same coupler: one Smart-On, no All Lines Off
+    uint32_t off = t.c2.lines_off;
+    CHECK_EQ(read_temp(topo, t.e), OW_OK);
+    CHECK_EQ(t.commands() - before, 3);
+    CHECK_EQ(t.c2.lines_off, off);
+    CHECK_EQ(t.c2.line, 1);
+    CHECK(!t.d.connected());
+
+    // on the way there, and on the trunk: no switching
+    CHECK_EQ(read_temp(topo, t.a), OW_OK);
+    CHECK_EQ(read_temp(topo, t.t0), OW_OK);
+    CHECK_EQ(t.commands() - before, 3);
+    CHECK_EQ(topo.get_stats().avoided, 2);
+
+    // c1 aux: c2 goes off, c1 switches across without All Lines Off
+    off = t.c1.lines_off;
+    CHECK_EQ(read_temp(topo, t.b), OW_OK);
+    CHECK_EQ(t.c2.line, -1);
+    CHECK_EQ(t.c1.line, 1);
+    CHECK_EQ(t.c1.lines_off, off);
+    CHECK_EQ(t.commands() - before, 5);
+    CHECK_EQ(topo.get_stats().switches, 5);
+
+    // order(): reachable first, then by branch
+    uint8_t rd[8], re[8], rt[8], rb[8];
+    sim_rom_bytes(t.d.rom, rd);
+    sim_rom_bytes(t.e.rom, re);
+    sim_rom_bytes(t.t0.rom, rt);
+    sim_rom_bytes(t.b.rom, rb);
+    const uint8_t *list[4] = { re, rd, rt, rb };
+    topo.order(list, 4);
+    CHECK(list[0] == rt && list[1] == rb && list[2] == rd && list[3] == re);
+
+    CHECK_EQ(topo.all_off(), OW_OK);
+    CHECK_EQ(t.c1.line, -1);
+    CHECK_EQ(t.c1.bad_stimulus + t.c2.bad_stimulus, 0);
+    CHECK_EQ(topo.get_stats().errors, 0);
+}
+
+static void unconfirmed(void)
+{
+    Tree t;
+    OneWireTopology topo(t.wire.bus());
+    CHECK_EQ(topo.discover(), OW_OK);
+    topo.clear_stats();
+
+    // a confirmation read wrong: Smart-On is Match ROM, the command, the
+    // stimulus, the presence byte, then the confirmation
+    t.wire.flip_slot((9 + 1 + 1 + 1) * 8 + 2);
+    CHECK_EQ(read_temp(topo, t.a), OW_SWITCH_ERROR);
+    CHECK_EQ(topo.get_stats().errors, 1);
+
+    // an All Lines Off read wrong
+    CHECK_EQ(read_temp(topo, t.a), OW_OK);
+    t.wire.flip_slot(SIMPLE_SLOTS - 1);
+    CHECK_EQ(topo.all_off(), OW_SWITCH_ERROR);
+    CHECK_EQ(topo.get_stats().errors, 2);
+
+    uint8_t rom[8], s[9];
+    sim_rom_bytes(sim_rom(0x28, 0x99), rom);
+    CHECK_EQ(topo.run(rom, onewire_prog_read_scratch, 0, s), OW_UNKNOWN_DEVICE);
+}
+
+int main()
+{
+    host_virtual_clock(true);
+
+    discover(false);
+    discover(true);
+    switching();
+    unconfirmed();
+
+    return test_result("test_topology");
+}
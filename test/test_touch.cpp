@@ -0,0 +1,153 @@
+// OneWireTouch on the simulated bus: the presence pulse of a button put
+// on the probe gets its ID to the callback within one Read ROM (about
+// 6ms, with no task wake-up time on the virtual clock), a bad read is
+// taken again, a held button is not delivered twice and a retouch after
+// the debounce time is, and without the interrupt the probe period
+// finds the button instead.
+
+#include "OneWireESP_touch.h"
+#include "sim.h"
+#include "test.h"
+
+#include <string.h>
+
+#define TOUCH_PIN   GPIO_NUM_4
+
+// A Read ROM: reset, the command and the ROM code
+#define READ_ROM_US (SIM_RESET_US + 8 * SIM_WRITE0_US + 64 * SIM_READ_US)
+
+// The probe pin, pulled low by hand as the button's presence pulse would
+class PulseLine : public HostLine
+{
+  public:
+    PulseLine() : low(false) { }
+    void master(int state) { (void)state; }
+    int level(void) { return !low; }
+
+    void pulse(uint32_t us)
+    {
+        low = true;
+        host_gpio_edge(TOUCH_PIN);
+        host_advance_us(us);
+        low = false;
+        host_gpio_edge(TOUCH_PIN);
+    }
+
+  private:
+    bool low;
+};
+
+struct Delivered {
+    uint32_t calls;
+    uint64_t rom;
+    int64_t at;
+};
+
+static void on_touch(const uint8_t rom[8], void *arg)
+{
+    Delivered *d = (Delivered *)arg;
+    d->calls++;
+    d->rom = sim_rom_value(rom);
+    d->at = host_time_us();
+}
+
+static void interrupt(void)
+{
+    PulseLine line;
+    host_gpio_attach(TOUCH_PIN, &line);
+    SimWire wire;
+    SimDevice button(sim_rom(0x01, 0x7755));
+    Delivered got = { 0, 0, 0 };
+
+    OneWireTouch touch(wire.bus(), TOUCH_PIN, on_touch, &got, 500);
+    CHECK(touch.begin());
+
+    // nothing on the probe: the wait times out with no bus traffic
+    CHECK(!touch.poll(100));
+    CHECK_EQ(wire.stats.resets, 0);
+
+    // a touch: one Read ROM after the end of the pulse
+    wire.attach(&button);
+    line.pulse(120);
+    int64_t pulsed = host_time_us();
+    CHECK(touch.poll(1000));
+    CHECK_EQ(got.calls, 1);
+    CHECK_EQ(got.rom, button.rom);
+    CHECK(got.at - pulsed <= READ_ROM_US);
+    CHECK(touch.get_stats().max_latency_us <= READ_ROM_US);
+    CHECK_EQ(wire.stats.resets, 1);
+    CHECK(touch.touched());
+    CHECK_EQ(sim_rom_value(touch.id()), button.rom);
+
+    // held: checked with a reset every debounce time, and a pulse from
+    // contact bounce is not a new touch
+    CHECK(!touch.poll(2000));
+    CHECK_EQ(touch.get_stats().probes, 1);
+    line.pulse(120);
+    CHECK(!touch.poll(2000));
+    CHECK_EQ(touch.get_stats().repeats, 1);
+    CHECK_EQ(got.calls, 1);
+
+    // taken off: the next check notices, and a retouch after the
+    // debounce time is delivered again, a bad read costing one more
+    wire.detach(&button);
+    CHECK(!touch.poll(2000));
+    CHECK(!touch.touched());
+    host_advance_us(600000);
+    wire.attach(&button);
+    wire.flip_slot(8 + 20);
+    line.pulse(120);
+    pulsed = host_time_us();
+    CHECK(touch.poll(1000));
+    CHECK_EQ(got.calls, 2);
+    CHECK_EQ(touch.get_stats().bad_reads, 1);
+    CHECK(got.at - pulsed <= 2 * READ_ROM_US);
+
+    // a pulse too short for presence wakes nothing
+    touch.clear_stats();
+    wire.detach(&button);
+    CHECK(!touch.poll(2000));
+    line.pulse(20);
+    uint32_t resets = wire.stats.resets;
+    CHECK(!touch.poll(100));
+    CHECK_EQ(touch.get_stats().pulses, 0);
+    CHECK_EQ(wire.stats.resets, resets);
+
+    touch.end();
+    host_gpio_attach(TOUCH_PIN, 0);
+}
+
+static void probing(void)
+{
+    SimWire wire;
+    SimDevice button(sim_rom(0x01, 0x7756));
+    Delivered got = { 0, 0, 0 };
+
+    // no begin(): a reset every 50ms finds the button
+    OneWireTouch touch(wire.bus(), TOUCH_PIN, on_touch, &got, 500, 50);
+    CHECK(!touch.poll(1000));
+    CHECK_EQ(touch.get_stats().probes, 1);
+    CHECK_EQ(touch.get_stats().bus_us, SIM_RESET_US);
+
+    wire.attach(&button);
+    int64_t put = host_time_us();
+    CHECK(touch.poll(1000));
+    CHECK_EQ(got.calls, 1);
+    CHECK_EQ(got.rom, button.rom);
+    CHECK(got.at - put <= 50000 + SIM_RESET_US + READ_ROM_US);
+
+    // a wait shorter than the period does not probe
+    uint32_t probes = touch.get_stats().probes;
+    CHECK(!touch.poll(10));
+    CHECK_EQ(touch.get_stats().probes, probes);
+}
+
+int main()
+{
+    host_virtual_clock(true);
+
+    interrupt();
+    probing();
+
+    return test_result("test_touch");
+}
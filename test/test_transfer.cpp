@@ -0,0 +1,221 @@
+// onewire_transfer() on the simulated bus: segments over 64KiB are
+// passed to the bus in 64KiB-1 pieces that land at the right offsets,
+// only the last piece of a powered write leaves the pullup on, mixed
+// write and read segments from and into separate buffers make up a
+// scratchpad write and read back of a SimEEPROM, and a bad segment or a
+// missing presence pulse stops the list.
+
+#include "OneWireESP.h"
+#include "OneWireESP_program.h"
+#include "sim.h"
+#include "test.h"
+
+#include <string.h>
+#include <vector>
+
+#define LONG_LEN    70000u
+
+// Streams a pattern with no period near 64KiB after 0xF0, and keeps
+// whatever is written after 0x0F
+class SimStream : public SimDevice
+{
+  public:
+    explicit SimStream(uint64_t rom) : SimDevice(rom), cmd(0), n(0) { }
+
+    std::vector<uint8_t> written;
+
+    static uint8_t pattern(uint32_t i) { return (uint8_t)(i * 7 ^ i >> 8 ^ i >> 16); }
+
+  protected:
+    void select(void)
+    {
+        cmd = 0;
+        n = 0;
+    }
+    void received(uint8_t v)
+    {
+        if (!cmd) {
+            cmd = v;
+            if (cmd != 0x0F) listening = false;
+            return;
+        }
+        written.push_back(v);
+    }
+    bool fetch(uint8_t &v)
+    {
+        if (listening || cmd != 0xF0) return false;
+        v = pattern(n++);
+        return true;
+    }
+
+  private:
+    uint8_t cmd;
+    uint32_t n;
+};
+
+// The sim's bus table with the size and power of every call kept
+struct Recorder {
+    OneWireBus inner;
+    std::vector<uint32_t> reads, writes;
+    std::vector<bool> power;
+
+    static uint8_t reset(void *ctx)
+    {
+        Recorder *r = (Recorder *)ctx;
+        return r->inner.reset(r->inner.ctx);
+    }
+    static void write_bytes(void *ctx, const uint8_t *buf, uint16_t count, bool p)
+    {
+        Recorder *r = (Recorder *)ctx;
+        r->writes.push_back(count);
+        r->power.push_back(p);
+        r->inner.write_bytes(r->inner.ctx, buf, count, p);
+    }
+    static void read_bytes(void *ctx, uint8_t *buf, uint16_t count)
+    {
+        Recorder *r = (Recorder *)ctx;
+        r->reads.push_back(count);
+        r->inner.read_bytes(r->inner.ctx, buf, count);
+    }
+    static void write_bit(void *ctx, uint8_t v)
+    {
+        Recorder *r = (Recorder *)ctx;
+        r->inner.write_bit(r->inner.ctx, v);
+    }
+    static uint8_t read_bit(void *ctx)
+    {
+        Recorder *r = (Recorder *)ctx;
+        return r->inner.read_bit(r->inner.ctx);
+    }
+    static void depower(void *ctx)
+    {
+        Recorder *r = (Recorder *)ctx;
+        r->inner.depower(r->inner.ctx);
+    }
+
+    OneWireBus bus(void)
+    {
+        OneWireBus b = { this, reset, write_bytes, read_bytes, write_bit, read_bit, depower, 0, 0 };
+        return b;
+    }
+};
+
+static void long_segments(void)
+{
+    SimWire wire;
+    SimStream dev(sim_rom(0x3A, 0x51));
+    uint8_t rom[8];
+    wire.attach(&dev);
+    sim_rom_bytes(dev.rom, rom);
+    Recorder rec;
+    rec.inner = wire.bus();
+
+    // a read longer than 64KiB, straight into its buffer
+    static const uint8_t read_cmd = 0xF0;
+    std::vector<uint8_t> in(LONG_LEN + 1, 0xEE);
+    OneWireSegment rd[] = {
+        { OW_SEG_RESET, 0, 0, 0, 0 },
+        { OW_SEG_MATCH, 0, 8, rom, 0 },
+        { OW_SEG_WRITE, 0, 1, &read_cmd, 0 },
+        { OW_SEG_READ, 0, LONG_LEN, 0, &in[0] },
+    };
+    CHECK_EQ(onewire_transfer(rec.bus(), rd, 4), OW_OK);
+    CHECK_EQ(rec.reads.size(), 2);
+    CHECK_EQ(rec.reads[0], 0xFFFF);
+    CHECK_EQ(rec.reads[1], LONG_LEN - 0xFFFF);
+    uint32_t bad = 0;
+    for (uint32_t i = 0; i < LONG_LEN; i++)
+        if (in[i] != SimStream::pattern(i)) bad++;
+    CHECK_EQ(bad, 0);
+    CHECK_EQ(in[LONG_LEN], 0xEE);
+
+    // a powered write longer than 64KiB: the pullup only after the end
+    static const uint8_t write_cmd = 0x0F;
+    std::vector<uint8_t> out(LONG_LEN);
+    for (uint32_t i = 0; i < LONG_LEN; i++) out[i] = SimStream::pattern(i + 3);
+    OneWireSegment wr[] = {
+        { OW_SEG_RESET, 0, 0, 0, 0 },
+        { OW_SEG_SKIP, 0, 0, 0, 0 },
+        { OW_SEG_WRITE, 0, 1, &write_cmd, 0 },
+        { OW_SEG_WRITE, 1, LONG_LEN, &out[0], 0 },
+    };
+    rec.writes.clear();
+    rec.power.clear();
+    CHECK_EQ(onewire_transfer(rec.bus(), wr, 4), OW_OK);
+    CHECK_EQ(rec.writes.size(), 4);         // Skip ROM, the command, two pieces
+    CHECK_EQ(rec.writes[2], 0xFFFF);
+    CHECK_EQ(rec.writes[3], LONG_LEN - 0xFFFF);
+    CHECK(!rec.power[2]);
+    CHECK(rec.power[3]);
+    CHECK(wire.pullup());
+    CHECK(dev.written == out);
+    rec.inner.depower(rec.inner.ctx);
+}
+
+static void mixed(void)
+{
+    SimWire wire;
+    SimEEPROM dev(sim_rom(0x2D, 0x52));
+    uint8_t rom[8];
+    wire.attach(&dev);
+    sim_rom_bytes(dev.rom, rom);
+
+    // Write Scratchpad: command and address from one place, the data from
+    // another, the CRC16 into a third
+    struct {
+        uint8_t cmd[3];
+        uint8_t data[8];
+        uint8_t crc[2];
+    } w = { { 0x0F, 0x18, 0x00 }, { 1, 2, 3, 5, 8, 13, 21, 34 }, { 0, 0 } };
+    OneWireSegment wr[] = {
+        { OW_SEG_RESET, 0, 0, 0, 0 },
+        { OW_SEG_MATCH, 0, 8, rom, 0 },
+        { OW_SEG_WRITE, 0, 3, w.cmd, 0 },
+        { OW_SEG_WRITE, 0, 8, w.data, 0 },
+        { OW_SEG_READ, 0, 2, 0, w.crc },
+    };
+    CHECK_EQ(onewire_transfer(wire.bus(), wr, 5), OW_OK);
+    uint16_t crc = OneWire::crc16(w.cmd, 3);
+    CHECK_EQ(OneWire::crc16(w.crc, 2, OneWire::crc16(w.data, 8, crc)), 0xB001);
+
+    // Read Scratchpad into separate fields
+    static const uint8_t read_cmd = 0xAA;
+    uint8_t ta[3], data[8], rcrc[2];
+    OneWireSegment rd[] = {
+        { OW_SEG_RESET, 0, 0, 0, 0 },
+        { OW_SEG_MATCH, 0, 8, rom, 0 },
+        { OW_SEG_WRITE, 0, 1, &read_cmd, 0 },
+        { OW_SEG_READ, 0, 3, 0, ta },
+        { OW_SEG_READ, 0, 8, 0, data },
+        { OW_SEG_READ, 0, 2, 0, rcrc },
+    };
+    CHECK_EQ(onewire_transfer(wire.bus(), rd, 6), OW_OK);
+    CHECK_EQ(ta[0], 0x18);
+    CHECK_EQ(ta[1], 0x00);
+    CHECK_EQ(ta[2], 0x07);
+    CHECK(!memcmp(data, w.data, 8));
+    crc = OneWire::crc16(ta, 3, OneWire::crc16(&read_cmd, 1));
+    CHECK_EQ(OneWire::crc16(rcrc, 2, OneWire::crc16(data, 8, crc)), 0xB001);
+
+    // a list stops at the first failure
+    uint32_t slots = wire.stats.slots;
+    wire.drop_presence(0);
+    CHECK_EQ(onewire_transfer(wire.bus(), rd, 6), OW_NO_PRESENCE);
+    CHECK_EQ(wire.stats.slots, slots);
+    OneWireSegment nomatch[] = { { OW_SEG_RESET, 0, 0, 0, 0 }, { OW_SEG_MATCH, 0, 8, 0, 0 } };
+    CHECK_EQ(onewire_transfer(wire.bus(), nomatch, 2), OW_BAD_PROGRAM);
+    OneWireSegment unknown[] = { { 9, 0, 0, 0, 0 }, { OW_SEG_RESET, 0, 0, 0, 0 } };
+    uint32_t resets = wire.stats.resets;
+    CHECK_EQ(onewire_transfer(wire.bus(), unknown, 2), OW_BAD_PROGRAM);
+    CHECK_EQ(wire.stats.resets, resets);
+}
+
+int main()
+{
+    host_virtual_clock(true);
+
+    long_segments();
+    mixed();
+
+    return test_result("test_transfer");
+}
@@ -436,17 +436,25 @@ void directWriteHigh(IO_REG_TYPE mask)
 #define IO_REG_MASK_ATTR
 
 //Important bit for ESP translation
-#define DIRECT_READ1                        gpio_get_level(OW1_PIN)
-#define DIRECT_WRITE_LOW1                   gpio_set_level(OW1_PIN, 0)
-#define DIRECT_WRITE_HIGH1                  gpio_set_level(OW1_PIN, 1)
-#define DIRECT_MODE_INPUT1                  gpio_set_direction(OW1_PIN,GPIO_MODE_INPUT)
-#define DIRECT_MODE_OUTPUT1                 gpio_set_direction(OW1_PIN,GPIO_MODE_OUTPUT)
-
-#define DIRECT_READ2                        gpio_get_level(OW2_PIN)
-#define DIRECT_WRITE_LOW2                   gpio_set_level(OW2_PIN, 0)
-#define DIRECT_WRITE_HIGH2                  gpio_set_level(OW2_PIN, 1)
-#define DIRECT_MODE_INPUT2                  gpio_set_direction(OW2_PIN,GPIO_MODE_INPUT)
-#define DIRECT_MODE_OUTPUT2                 gpio_set_direction(OW2_PIN,GPIO_MODE_OUTPUT)
+// gpio_get_level()/gpio_set_level()/gpio_set_direction() live in flash, so
+// a cache miss inside a time slot would stretch it.  The gpio_ll calls are
+// inline register accesses and keep the slot code entirely in IRAM.  The
+// pin stays an input throughout (begin() sets that up), so "output mode"
+// is just the output enable, as in OneWireAsync.
+#include "hal/gpio_ll.h"
+#include "soc/gpio_struct.h"
+
+#define DIRECT_READ1                        gpio_ll_get_level(&GPIO, OW1_PIN)
+#define DIRECT_WRITE_LOW1                   gpio_ll_set_level(&GPIO, OW1_PIN, 0)
+#define DIRECT_WRITE_HIGH1                  gpio_ll_set_level(&GPIO, OW1_PIN, 1)
+#define DIRECT_MODE_INPUT1                  gpio_ll_output_disable(&GPIO, OW1_PIN)
+#define DIRECT_MODE_OUTPUT1                 gpio_ll_output_enable(&GPIO, OW1_PIN)
+
+#define DIRECT_READ2                        gpio_ll_get_level(&GPIO, OW2_PIN)
+#define DIRECT_WRITE_LOW2                   gpio_ll_set_level(&GPIO, OW2_PIN, 0)
+#define DIRECT_WRITE_HIGH2                  gpio_ll_set_level(&GPIO, OW2_PIN, 1)
+#define DIRECT_MODE_INPUT2                  gpio_ll_output_disable(&GPIO, OW2_PIN)
+#define DIRECT_MODE_OUTPUT2                 gpio_ll_output_enable(&GPIO, OW2_PIN)
 //#warning "OneWire. Fallback mode. Using API calls for pinMode,digitalRead and digitalWrite. Operation of this library is not guaranteed on this architecture."
 
 #endif
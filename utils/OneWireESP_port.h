@@ -0,0 +1,58 @@
+#ifndef OneWireESP_Port_h
+#define OneWireESP_Port_h
+
+// This header should ONLY be included by the OneWireESP .cpp files.  It
+// gives the transaction engine and the device drivers a clock and a
+// sleep that work both under ESP-IDF and on a Linux host.
+
+#include <stdint.h>
+
+#if defined(ESP_PLATFORM)
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static inline int64_t ow_micros(void)
+{
+    return esp_timer_get_time();
+}
+
+// Sleep at least 'ms' milliseconds.  vTaskDelay(n) ends on the n-th tick
+// interrupt from now, and the first of those can be almost immediate, so
+// the tick count is rounded up and one more tick added.
+static inline void ow_delay_ms(uint32_t ms)
+{
+    if (!ms) return;
+    vTaskDelay((TickType_t)(((uint64_t)ms * configTICK_RATE_HZ + 999) / 1000 + 1));
+}
+
+#else
+#include <time.h>
+
+static inline int64_t ow_micros(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline void ow_delay_ms(uint32_t ms)
+{
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&ts, 0);
+}
+
+#endif
+
+// Sleep until ow_micros() reaches 'deadline'
+static inline void ow_delay_until(int64_t deadline)
+{
+    int64_t left;
+
+    while ((left = deadline - ow_micros()) > 0)
+        ow_delay_ms((uint32_t)((left + 999) / 1000));
+}
+
+#endif
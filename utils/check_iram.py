@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Check that the OneWireESP time slot code links into IRAM.
+
+A flash cache miss in the middle of a time slot stretches it by however
+long the refill takes, which is enough to turn a written 1 into a 0.  The
+slot code is marked IRAM_ATTR, but a missing attribute or a linker
+fragment that moves a section would only show up as rare bit errors, so
+run this on the linker map after every build:
+
+    python utils/check_iram.py build/<project>.map
+
+PlatformIO builds run it after every link by themselves, through
+utils/pio_check_iram.py (the extraScript in library.json).
+
+It exits non-zero and names the functions if any of them landed outside
+an IRAM output section, or if none of them were found in the map.
+"""
+
+import re
+import sys
+
+# (class, method) pairs that run inside a time slot or between the slots
+# of one byte or one search triplet; class None for a free function.  The
+# search passes themselves (OneWire::search1/2, onewire_search) are left
+# out: they only run between triplets, see OneWire::search1().
+SLOT_CODE = [('OneWire', m + n) for n in '12' for m in (
+    'reset', 'write_bit', 'read_bit', 'write', 'write_bytes', 'read',
+    'read_bytes', 'select', 'skip', 'depower', 'triplet')]
+SLOT_CODE += [
+    (None, 'onewire_triplet'),
+    ('OneWireAsync', 'step'),
+    ('OneWireAsync', 'on_alarm'),
+    ('OneWirePresence', 'on_edge'),
+]
+
+
+def mangled(cls, method):
+    # a free function is matched on its name, whatever its parameters
+    if cls is None:
+        return '_Z%d%s' % (len(method), method)
+    return '_ZN%d%s%d%sE' % (len(cls), cls, len(method), method)
+
+
+def label(cls, method):
+    return method if cls is None else '%s::%s' % (cls, method)
+
+
+def scan(lines):
+    """Map every slot code symbol found to the output sections it is in."""
+    names = dict((mangled(c, m), label(c, m)) for c, m in SLOT_CODE)
+    pattern = re.compile(r'(%s)' % '|'.join(re.escape(n) for n in names))
+    found = {}
+    section = None
+    in_map = False
+    for line in lines:
+        # the discarded sections listed before the map do not count
+        if not in_map:
+            in_map = line.startswith('Linker script and memory map')
+            continue
+        if line.startswith('Cross Reference Table'):
+            break
+        if line[:1] == '.':
+            section = line.split()[0]
+            continue
+        m = pattern.search(line)
+        if m and section:
+            found.setdefault(names[m.group(1)], set()).add(section)
+    return found
+
+
+def check(path):
+    """Check one linker map: 0 if all is in IRAM, 1 if not, 2 if none found."""
+    with open(path) as f:
+        found = scan(f)
+    if not found:
+        sys.stderr.write('%s: no OneWireESP slot code in the map\n' % path)
+        return 2
+
+    bad = sorted(name for name, sections in found.items()
+                 if any(not s.startswith('.iram') for s in sections))
+    for name in bad:
+        sys.stderr.write('%s is in %s, not IRAM\n'
+                         % (name, ', '.join(sorted(found[name]))))
+    if bad:
+        return 1
+    print('%d OneWireESP slot functions in IRAM' % len(found))
+    return 0
+
+
+def main(argv):
+    if len(argv) != 2:
+        sys.stderr.write('usage: %s <linker map>\n' % argv[0])
+        return 2
+    return check(argv[1])
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
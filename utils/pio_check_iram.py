@@ -0,0 +1,36 @@
+"""PlatformIO extra script: check the slot code is in IRAM after each link.
+
+library.json names this as the library's extraScript.  It makes the
+firmware link write a map file next to the .elf and runs check_iram.py on
+it as a post action, so a build whose slot code landed in flash fails
+instead of producing rare bit errors on the bus.
+"""
+
+import inspect
+import os
+import sys
+
+from SCons.Script import DefaultEnvironment
+
+Import("env")  # noqa: F821 (provided by SCons)
+
+HERE = os.path.dirname(os.path.abspath(inspect.getfile(inspect.currentframe())))
+sys.path.insert(0, HERE)
+import check_iram  # noqa: E402
+
+# The library's own env only builds the library; the link is in the
+# project's env
+project = DefaultEnvironment()
+MAP = os.path.join("$BUILD_DIR", "${PROGNAME}.map")
+
+project.Append(LINKFLAGS=["-Wl,-Map," + MAP])
+
+
+def check(target, source, env):
+    # a non-zero result fails the build
+    return check_iram.check(env.subst(MAP))
+
+
+project.AddPostAction(
+    os.path.join("$BUILD_DIR", "${PROGNAME}.elf"),
+    project.VerboseAction(check, "Checking OneWireESP slot code is in IRAM"))